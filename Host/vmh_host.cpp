@@ -0,0 +1,774 @@
+//
+//  vmh_host.cpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#include "vmh_host.hpp"
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#define MODULE_HOST "HOST"
+
+// Pids are recycled below this bound, like PID_MAX
+#define VMH_HOST_PID_MAX 99999
+
+struct vnode {
+	char path[MAXPATHLEN];
+	uint32_t vid;
+	int32_t iocount;
+};
+
+struct kauth_cred {
+	uid_t uid;
+};
+
+struct proc {
+	pid_t pid;
+	pid_t ppid;
+	int pidversion;
+	char name[2 * MAXCOMLEN + 1];
+	vnode_t executable;
+	char identity[256];
+	bool signedIdentity;
+	kauth_cred cred;
+};
+
+struct _IOLock {
+	pthread_mutex_t mutex;
+};
+
+struct kauth_listener {
+	kauth_scope_callback_t callback;
+	void *idata;
+};
+
+LiluAPI lilu;
+bool ADDPR(debugEnabled) = false;
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *destination, const char *source, size_t size) {
+	size_t length = strlen(source);
+	if (size) {
+		size_t copied = length < size - 1 ? length : size - 1;
+		memcpy(destination, source, copied);
+		destination[copied] = '\0';
+	}
+	return length;
+}
+#endif
+
+/**
+ * Logging
+ */
+
+static bool hostLogEnabled = getenv("VMH_HOST_LOG") != nullptr;
+
+static void hostLogv(const char *module, const char *format, va_list arguments) {
+	fprintf(stderr, "VMHide %6s: ", module);
+	vfprintf(stderr, format, arguments);
+	fputc('\n', stderr);
+}
+
+void vmhHostLog(bool debug, const char *module, const char *format, ...) {
+	if (debug && !hostLogEnabled) {
+		return;
+	}
+	va_list arguments;
+	va_start(arguments, format);
+	hostLogv(module, format, arguments);
+	va_end(arguments);
+}
+
+void vmhHostPanic(const char *module, const char *format, ...) {
+	va_list arguments;
+	va_start(arguments, format);
+	fprintf(stderr, "panic: ");
+	hostLogv(module, format, arguments);
+	va_end(arguments);
+	abort();
+}
+
+/**
+ * Time and CPUs
+ */
+
+uint64_t mach_absolute_time() {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+}
+
+void clock_timebase_info(mach_timebase_info_t info) {
+	info->numer = 1;
+	info->denom = 1;
+}
+
+void absolutetime_to_nanoseconds(uint64_t abstime, uint64_t *result) {
+	*result = abstime;
+}
+
+void nanoseconds_to_absolutetime(uint64_t nanoseconds, uint64_t *result) {
+	*result = nanoseconds;
+}
+
+int cpu_number() {
+	int cpu = sched_getcpu();
+	return cpu < 0 ? 0 : cpu;
+}
+
+/**
+ * Processes
+ */
+
+static pthread_mutex_t procLock = PTHREAD_MUTEX_INITIALIZER;
+static proc_t procTable[VMH_HOST_PID_MAX + 1];
+static pid_t lastPid = 0;
+static int lastPidVersion = 0;
+static std::map<std::string, vnode_t> vnodes;
+static proc kernelProc = {0, 0, 0, "kernel_task", NULLVP, "", false, {0}};
+static thread_local proc_t currentProc = &kernelProc;
+
+// Executables are shared by path, like the vnode of a binary shared by its processes. Called with procLock held.
+static vnode_t hostVnode(const char *path) {
+	if (!path) {
+		return NULLVP;
+	}
+	vnode_t &vnode = vnodes[path];
+	if (!vnode) {
+		vnode = new struct vnode();
+		strlcpy(vnode->path, path, sizeof(vnode->path));
+		vnode->vid = static_cast<uint32_t>(vnodes.size());
+	}
+	return vnode;
+}
+
+// Replaces the image of a process. Called with procLock held.
+static void hostSetImage(proc_t proc, const char *name, const char *path, const char *identity) {
+	strlcpy(proc->name, name, sizeof(proc->name));
+	proc->executable = hostVnode(path);
+	proc->signedIdentity = identity != nullptr;
+	strlcpy(proc->identity, identity ? identity : "", sizeof(proc->identity));
+	__atomic_store_n(&proc->pidversion, ++lastPidVersion, __ATOMIC_RELAXED);
+}
+
+// Registers a new child of ppid under pid, or under the next free pid when pid is 0
+static proc_t hostSpawn(pid_t pid, pid_t ppid, const char *name, const char *path, const char *identity, uid_t uid) {
+	if (pid < 0 || pid > VMH_HOST_PID_MAX) {
+		return nullptr;
+	}
+	pthread_mutex_lock(&procLock);
+	if (!pid) {
+		pid = lastPid;
+		do {
+			pid = pid == VMH_HOST_PID_MAX ? 1 : pid + 1;
+		} while (procTable[pid] && pid != lastPid);
+		if (procTable[pid]) {
+			pthread_mutex_unlock(&procLock);
+			vmhHostPanic(MODULE_HOST, "Every pid up to %d is in use.", VMH_HOST_PID_MAX);
+		}
+		lastPid = pid;
+	} else if (procTable[pid]) {
+		pthread_mutex_unlock(&procLock);
+		return nullptr;
+	}
+	proc_t proc = new struct proc();
+	proc->cred.uid = uid;
+	proc->pid = pid;
+	proc->ppid = ppid;
+	hostSetImage(proc, name, path, identity);
+	__atomic_store_n(&procTable[pid], proc, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&procLock);
+	return proc;
+}
+
+// Spawned processes are children of launchd
+proc_t vmhHostSpawn(const char *name, const char *path, const char *identity, uid_t uid) {
+	return hostSpawn(0, 1, name, path, identity, uid);
+}
+
+proc_t vmhHostSpawnPid(pid_t pid, const char *name, const char *path, const char *identity, uid_t uid) {
+	return pid ? hostSpawn(pid, 1, name, path, identity, uid) : nullptr;
+}
+
+proc_t vmhHostFork(proc_t parent) {
+	return hostSpawn(0, parent->pid, parent->name, parent->executable ? parent->executable->path : nullptr,
+					 parent->signedIdentity ? parent->identity : nullptr, parent->cred.uid);
+}
+
+// Listeners of the file operation scope, registered once and never freed
+static std::vector<kauth_listener *> fileopListeners;
+
+void vmhHostExec(proc_t proc, const char *name, const char *path, const char *identity) {
+	pthread_mutex_lock(&procLock);
+	hostSetImage(proc, name, path, identity);
+	vnode_t executable = proc->executable;
+	std::vector<kauth_listener *> listeners = fileopListeners;
+	pthread_mutex_unlock(&procLock);
+
+	// Exec authorizes the file operation on the thread of the process itself
+	proc_t previous = currentProc;
+	currentProc = proc;
+	for (kauth_listener *listener : listeners) {
+		listener->callback(&proc->cred, listener->idata, KAUTH_FILEOP_EXEC,
+						   reinterpret_cast<uintptr_t>(executable), reinterpret_cast<uintptr_t>(path), 0, 0);
+	}
+	currentProc = previous;
+}
+
+void vmhHostExit(proc_t proc) {
+	pthread_mutex_lock(&procLock);
+	__atomic_store_n(&procTable[proc->pid], nullptr, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&procLock);
+	delete proc;
+}
+
+void vmhHostSetCurrentProc(proc_t proc) {
+	currentProc = proc ? proc : &kernelProc;
+}
+
+proc_t current_proc() {
+	return currentProc;
+}
+
+pid_t proc_pid(proc_t proc) {
+	return proc->pid;
+}
+
+int proc_ppid(proc_t proc) {
+	return proc->ppid;
+}
+
+// Processes are not reference counted, see vmhHostExit
+proc_t proc_find(int pid) {
+	if (pid < 0 || pid > VMH_HOST_PID_MAX) {
+		return nullptr;
+	}
+	pthread_mutex_lock(&procLock);
+	proc_t proc = pid == 0 ? &kernelProc : procTable[pid];
+	pthread_mutex_unlock(&procLock);
+	return proc;
+}
+
+int proc_rele(proc_t proc) {
+	return 0;
+}
+
+int proc_pidversion(proc_t proc) {
+	return __atomic_load_n(&proc->pidversion, __ATOMIC_RELAXED);
+}
+
+// Like the kernel, an unknown pid leaves the buffer untouched. Names are copied under the
+// process lock, as another thread may be calling exec.
+void proc_name(int pid, char *buffer, int size) {
+	if (pid < 0 || pid > VMH_HOST_PID_MAX || size <= 0) {
+		return;
+	}
+	pthread_mutex_lock(&procLock);
+	proc_t proc = pid == 0 ? &kernelProc : procTable[pid];
+	if (proc) {
+		strlcpy(buffer, proc->name, static_cast<size_t>(size));
+	}
+	pthread_mutex_unlock(&procLock);
+}
+
+void proc_selfname(char *buffer, int size) {
+	if (size > 0) {
+		pthread_mutex_lock(&procLock);
+		strlcpy(buffer, currentProc->name, static_cast<size_t>(size));
+		pthread_mutex_unlock(&procLock);
+	}
+}
+
+// Stand-ins for the private kernel functions VMHide solves at runtime, which take the process lock as well
+static vnode_t hostProcExecutableVnode(proc_t proc) {
+	pthread_mutex_lock(&procLock);
+	vnode_t vnode = proc->executable;
+	if (vnode) {
+		__atomic_fetch_add(&vnode->iocount, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&procLock);
+	return vnode;
+}
+
+static const char *hostCsIdentityGet(proc_t proc) {
+	return proc->signedIdentity ? proc->identity : nullptr;
+}
+
+int vnode_put(vnode_t vnode) {
+	if (__atomic_sub_fetch(&vnode->iocount, 1, __ATOMIC_RELAXED) < 0) {
+		vmhHostPanic(MODULE_HOST, "vnode_put on '%s' without an iocount.", vnode->path);
+	}
+	return 0;
+}
+
+uint32_t vnode_vid(vnode_t vnode) {
+	return vnode->vid;
+}
+
+int vn_getpath(vnode_t vnode, char *path, int *length) {
+	size_t needed = strlen(vnode->path) + 1;
+	if (*length <= 0 || needed > static_cast<size_t>(*length)) {
+		return ENOSPC;
+	}
+	memcpy(path, vnode->path, needed);
+	*length = static_cast<int>(needed);
+	return 0;
+}
+
+kauth_cred_t kauth_cred_get() {
+	return &currentProc->cred;
+}
+
+int kauth_cred_issuser(kauth_cred_t credential) {
+	return credential->uid == 0;
+}
+
+kauth_listener_t kauth_listen_scope(const char *identifier, kauth_scope_callback_t callback, void *idata) {
+	if (strcmp(identifier, KAUTH_SCOPE_FILEOP) != 0) {
+		return nullptr;
+	}
+	kauth_listener *listener = new kauth_listener {callback, idata};
+	pthread_mutex_lock(&procLock);
+	fileopListeners.push_back(listener);
+	pthread_mutex_unlock(&procLock);
+	return listener;
+}
+
+// Listeners are never freed, exec may still hold a copy of the list
+void kauth_unlisten_scope(kauth_listener_t listener) {
+	pthread_mutex_lock(&procLock);
+	for (size_t i = 0; i < fileopListeners.size(); i++) {
+		if (fileopListeners[i] == listener) {
+			fileopListeners.erase(fileopListeners.begin() + static_cast<long>(i));
+			break;
+		}
+	}
+	pthread_mutex_unlock(&procLock);
+}
+
+/**
+ * IOKit
+ */
+
+void *IOMalloc(size_t size) {
+	return malloc(size);
+}
+
+void *IOMallocZero(size_t size) {
+	return calloc(1, size);
+}
+
+void IOFree(void *address, size_t size __unused) {
+	free(address);
+}
+
+void *IOMallocAligned(size_t size, size_t alignment) {
+	void *address = nullptr;
+	if (alignment < sizeof(void *)) {
+		alignment = sizeof(void *);
+	}
+	return posix_memalign(&address, alignment, size) == 0 ? address : nullptr;
+}
+
+void IOFreeAligned(void *address, size_t size __unused) {
+	free(address);
+}
+
+IOLock *IOLockAlloc() {
+	IOLock *lock = new IOLock;
+	pthread_mutex_init(&lock->mutex, nullptr);
+	return lock;
+}
+
+void IOLockFree(IOLock *lock) {
+	pthread_mutex_destroy(&lock->mutex);
+	delete lock;
+}
+
+void IOLockLock(IOLock *lock) {
+	pthread_mutex_lock(&lock->mutex);
+}
+
+void IOLockUnlock(IOLock *lock) {
+	pthread_mutex_unlock(&lock->mutex);
+}
+
+void IOSleep(unsigned milliseconds) {
+	usleep(milliseconds * 1000);
+}
+
+/**
+ * Platform
+ */
+
+static std::string bootArgs = getenv("VMH_HOST_BOOT_ARGS") ? getenv("VMH_HOST_BOOT_ARGS") : "";
+
+void vmhHostSetBootArgs(const char *replacement) {
+	bootArgs = replacement ? replacement : "";
+}
+
+// Same rules as the kernel: a bare argument is a boolean, numbers fill integers and anything else is copied as a string
+bool PE_parse_boot_argn(const char *name, void *value, int size) {
+	size_t nameLength = strlen(name);
+	size_t position = 0;
+	while (position < bootArgs.size()) {
+		size_t end = bootArgs.find(' ', position);
+		if (end == std::string::npos) {
+			end = bootArgs.size();
+		}
+		std::string argument = bootArgs.substr(position, end - position);
+		position = end + 1;
+		if (argument.compare(0, nameLength, name) != 0 || (argument.size() > nameLength && argument[nameLength] != '=')) {
+			continue;
+		}
+		if (argument.size() == nameLength) {
+			if (size >= static_cast<int>(sizeof(int))) {
+				*static_cast<int *>(value) = 1;
+			}
+			return true;
+		}
+		const char *text = argument.c_str() + nameLength + 1;
+		char *numberEnd = nullptr;
+		unsigned long long number = strtoull(text, &numberEnd, 0);
+		if (*text != '\0' && *numberEnd == '\0' && (size == 4 || size == 8)) {
+			if (size == 4) {
+				*static_cast<uint32_t *>(value) = static_cast<uint32_t>(number);
+			} else {
+				*static_cast<uint64_t *>(value) = number;
+			}
+		} else if (size > 0) {
+			strlcpy(static_cast<char *>(value), text, static_cast<size_t>(size));
+		}
+		return true;
+	}
+	return false;
+}
+
+static std::map<std::string, std::vector<uint8_t>> nvram;
+
+void vmhHostSetNvram(const char *key, const void *data, size_t size) {
+	if (data) {
+		nvram[key].assign(static_cast<const uint8_t *>(data), static_cast<const uint8_t *>(data) + size);
+	} else {
+		nvram.erase(key);
+	}
+}
+
+bool NVStorage::init() {
+	return true;
+}
+
+void NVStorage::deinit() {
+}
+
+uint8_t *NVStorage::read(const char *key, uint32_t &size, uint8_t opts, const uint8_t *enckey) {
+	auto found = nvram.find(key);
+	if (found == nvram.end()) {
+		return nullptr;
+	}
+	uint8_t *copy = Buffer::create<uint8_t>(found->second.size() ? found->second.size() : 1);
+	if (copy) {
+		memcpy(copy, found->second.data(), found->second.size());
+		size = static_cast<uint32_t>(found->second.size());
+	}
+	return copy;
+}
+
+i386_cpu_info_t *cpuid_info() {
+	static i386_cpu_info_t info;
+	uint32_t data[4] {0};
+	asm volatile("cpuid" : "=a"(data[0]), "=b"(data[1]), "=c"(data[2]), "=d"(data[3]) : "a"(0));
+	memcpy(&info.cpuid_vendor[0], &data[1], 4);
+	memcpy(&info.cpuid_vendor[4], &data[3], 4);
+	memcpy(&info.cpuid_vendor[8], &data[2], 4);
+	info.cpuid_vendor[12] = '\0';
+	return &info;
+}
+
+/**
+ * sysctl
+ */
+
+struct sysctl_oid_list sysctl__children;
+static pthread_rwlock_t sysctlLock = PTHREAD_RWLOCK_INITIALIZER;
+
+// Copies out like sysctl_old_user, a size query only advances oldidx
+static int hostSysctlOut(struct sysctl_req *req, const void *data, size_t length) {
+	size_t copied = 0;
+	if (req->oldptr) {
+		size_t room = req->oldidx < req->oldlen ? req->oldlen - req->oldidx : 0;
+		copied = length < room ? length : room;
+		if (copied) {
+			memcpy(reinterpret_cast<char *>(req->oldptr) + req->oldidx, data, copied);
+		}
+	}
+	req->oldidx += length;
+	return req->oldptr && copied != length ? ENOMEM : 0;
+}
+
+// Copies in like sysctl_new_user
+static int hostSysctlIn(struct sysctl_req *req, void *data, size_t length) {
+	if (!req->newptr) {
+		return 0;
+	}
+	if (req->newlen - req->newidx < length) {
+		return EINVAL;
+	}
+	memcpy(data, reinterpret_cast<const char *>(req->newptr) + req->newidx, length);
+	req->newidx += length;
+	return 0;
+}
+
+void vmhHostSysctlRequest(sysctl_req &req, void *old, size_t oldlen, const void *replacement, size_t newlen) {
+	bzero(&req, sizeof(req));
+	req.p = currentProc;
+	req.oldptr = reinterpret_cast<user_addr_t>(old);
+	req.oldlen = old ? oldlen : 0;
+	req.oldfunc = hostSysctlOut;
+	req.newptr = reinterpret_cast<user_addr_t>(replacement);
+	req.newlen = replacement ? newlen : 0;
+	req.newfunc = hostSysctlIn;
+}
+
+// Numbers automatic OIDs from OID_AUTO_START and keeps every list sorted by number, like the kernel
+void sysctl_register_oid(struct sysctl_oid *oidp) {
+	sysctl_oid_list *parent = oidp->oid_parent;
+	pthread_rwlock_wrlock(&sysctlLock);
+	sysctl_oid *oid = nullptr;
+	SLIST_FOREACH(oid, parent, oid_link) {
+		if (oid == oidp || strcmp(oid->oid_name, oidp->oid_name) == 0) {
+			pthread_rwlock_unlock(&sysctlLock);
+			vmhHostLog(false, MODULE_HOST, "sysctl_register_oid: '%s' is already registered.", oidp->oid_name);
+			return;
+		}
+	}
+	if (oidp->oid_number == OID_AUTO) {
+		int number = OID_AUTO_START;
+		SLIST_FOREACH(oid, parent, oid_link) {
+			if (oid->oid_number >= number) {
+				number = oid->oid_number + 1;
+			}
+		}
+		oidp->oid_number = number;
+	}
+	sysctl_oid *previous = nullptr;
+	SLIST_FOREACH(oid, parent, oid_link) {
+		if (oidp->oid_number < oid->oid_number) {
+			break;
+		}
+		previous = oid;
+	}
+	if (previous) {
+		SLIST_INSERT_AFTER(previous, oidp, oid_link);
+	} else {
+		SLIST_INSERT_HEAD(parent, oidp, oid_link);
+	}
+	pthread_rwlock_unlock(&sysctlLock);
+}
+
+void sysctl_unregister_oid(struct sysctl_oid *oidp) {
+	pthread_rwlock_wrlock(&sysctlLock);
+	SLIST_REMOVE(oidp->oid_parent, oidp, sysctl_oid, oid_link);
+	pthread_rwlock_unlock(&sysctlLock);
+}
+
+int sysctl_handle_int SYSCTL_HANDLER_ARGS {
+	int value = arg1 ? *static_cast<int *>(arg1) : arg2;
+	int error = SYSCTL_OUT(req, &value, sizeof(value));
+	if (error || !req->newptr) {
+		return error;
+	}
+	if (!arg1) {
+		return EPERM;
+	}
+	return SYSCTL_IN(req, arg1, sizeof(int));
+}
+
+int sysctl_handle_string SYSCTL_HANDLER_ARGS {
+	char *string = static_cast<char *>(arg1);
+	int error = SYSCTL_OUT(req, string, strlen(string) + 1);
+	if (error || !req->newptr) {
+		return error;
+	}
+	size_t length = req->newlen - req->newidx;
+	if (length >= static_cast<size_t>(arg2)) {
+		return EINVAL;
+	}
+	error = SYSCTL_IN(req, string, length);
+	string[length] = '\0';
+	return error;
+}
+
+int sysctlbyname(const char *name, void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
+	pthread_rwlock_rdlock(&sysctlLock);
+	sysctl_oid_list *list = &sysctl__children;
+	sysctl_oid *found = nullptr;
+	const char *component = name;
+	int error = 0;
+	while (!error) {
+		size_t length = strcspn(component, ".");
+		sysctl_oid *oid = nullptr;
+		SLIST_FOREACH(oid, list, oid_link) {
+			if (strncmp(oid->oid_name, component, length) == 0 && oid->oid_name[length] == '\0') {
+				break;
+			}
+		}
+		if (!oid) {
+			error = ENOENT;
+		} else if (component[length] == '\0') {
+			found = oid;
+			break;
+		} else if ((oid->oid_kind & CTLTYPE) != CTLTYPE_NODE || oid->oid_handler) {
+			error = ENOTDIR;
+		} else {
+			list = static_cast<sysctl_oid_list *>(oid->oid_arg1);
+			component += length + 1;
+		}
+	}
+
+	if (!error && !found->oid_handler) {
+		error = EISDIR;
+	}
+	if (!error && newp && !(found->oid_kind & CTLFLAG_WR)) {
+		error = EPERM;
+	}
+	if (!error && newp && !(found->oid_kind & CTLFLAG_ANYBODY) && !kauth_cred_issuser(kauth_cred_get())) {
+		error = EPERM;
+	}
+	if (!error) {
+		sysctl_req req;
+		vmhHostSysctlRequest(req, oldp, oldlenp ? *oldlenp : 0, newp, newlen);
+		error = found->oid_handler(found, found->oid_arg1, found->oid_arg2, &req);
+		if (oldlenp && (!error || error == ENOMEM)) {
+			*oldlenp = req.oldidx;
+		}
+	}
+	pthread_rwlock_unlock(&sysctlLock);
+	if (error) {
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
+
+// Stock OIDs VMHide hooks or reads, with values of an Intel guest
+static int hostHvVmmPresent = 1;
+static int hostHvSupport = 0;
+static int hostHvDisable = 0;
+static char hostCpuFeatures[] = "FPU VME DE PSE TSC MSR PAE MCE CX8 APIC SEP MTRR PGE MCA CMOV PAT PSE36 CLFSH MMX FXSR SSE SSE2 SS HTT SSE3 PCLMULQDQ VMM SSSE3 FMA CX16 SSE4.1 SSE4.2 x2APIC MOVBE POPCNT AES XSAVE OSXSAVE AVX1.0 RDRAND F16C";
+static uint64_t hostTscFrequency = 0;
+
+SYSCTL_NODE(, OID_AUTO, kern, CTLFLAG_RW | CTLFLAG_LOCKED, nullptr, "High kernel, proc, limits &c");
+SYSCTL_NODE(, OID_AUTO, machdep, CTLFLAG_RW | CTLFLAG_LOCKED, nullptr, "Machine dependent");
+SYSCTL_NODE(_machdep, OID_AUTO, cpu, CTLFLAG_RW | CTLFLAG_LOCKED, nullptr, "CPU info");
+SYSCTL_NODE(_machdep, OID_AUTO, tsc, CTLFLAG_RW | CTLFLAG_LOCKED, nullptr, "Timestamp counter parameters");
+SYSCTL_INT(_kern, OID_AUTO, hv_vmm_present, CTLFLAG_RD | CTLFLAG_ANYBODY | CTLFLAG_KERN | CTLFLAG_LOCKED, &hostHvVmmPresent, 0, "");
+SYSCTL_INT(_kern, OID_AUTO, hv_support, CTLFLAG_RD | CTLFLAG_ANYBODY | CTLFLAG_KERN | CTLFLAG_LOCKED, &hostHvSupport, 0, "");
+SYSCTL_INT(_kern, OID_AUTO, hv_disable, CTLFLAG_RW | CTLFLAG_ANYBODY | CTLFLAG_LOCKED, &hostHvDisable, 0, "");
+SYSCTL_STRING(_machdep_cpu, OID_AUTO, features, CTLFLAG_RD | CTLFLAG_KERN | CTLFLAG_LOCKED, hostCpuFeatures, sizeof(hostCpuFeatures), "CPU features");
+
+// machdep.tsc.frequency
+static int hostSysctlTscFrequency SYSCTL_HANDLER_ARGS {
+	return SYSCTL_OUT(req, arg1, sizeof(uint64_t));
+}
+
+SYSCTL_PROC(_machdep_tsc, OID_AUTO, frequency, CTLTYPE_QUAD | CTLFLAG_RD | CTLFLAG_LOCKED, &hostTscFrequency, 0, hostSysctlTscFrequency, "Q", "");
+
+// The TSC is calibrated against the monotonic clock once, like the kernel does against the PIT
+static uint64_t hostCalibrateTsc() {
+	uint64_t startTime = mach_absolute_time();
+	uint64_t startTicks = __builtin_ia32_rdtsc();
+	usleep(10000);
+	uint64_t ticks = __builtin_ia32_rdtsc() - startTicks;
+	uint64_t elapsed = mach_absolute_time() - startTime;
+	return elapsed ? static_cast<uint64_t>(static_cast<double>(ticks) * 1e9 / static_cast<double>(elapsed)) : 0;
+}
+
+/**
+ * Lilu
+ */
+
+static KernelVersion hostKernelVersion = KernelVersion::Tahoe;
+static size_t writeWindows = 0;
+static size_t symbolLookups = 0;
+static bool kernelWriting = false;
+static std::map<std::string, mach_vm_address_t> symbols;
+static std::vector<std::pair<LiluAPI::t_patcherLoaded, void *>> patcherCallbacks;
+
+KernelVersion getKernelVersion() {
+	return hostKernelVersion;
+}
+
+int getKernelMinorVersion() {
+	return 0;
+}
+
+void vmhHostDefineSymbol(const char *symbol, mach_vm_address_t address) {
+	symbols[symbol] = address;
+}
+
+mach_vm_address_t KernelPatcher::solveSymbol(size_t id __unused, const char *symbol) {
+	symbolLookups++;
+	auto found = symbols.find(symbol);
+	if (found == symbols.end() || !found->second) {
+		error = Error::NoSymbolFound;
+		return 0;
+	}
+	return found->second;
+}
+
+kern_return_t MachInfo::setKernelWriting(bool enable, IOSimpleLock *lock __unused) {
+	if (enable == kernelWriting) {
+		return KERN_FAILURE;
+	}
+	kernelWriting = enable;
+	if (enable) {
+		writeWindows++;
+	}
+	return KERN_SUCCESS;
+}
+
+size_t vmhHostWriteWindows() {
+	return writeWindows;
+}
+
+size_t vmhHostSymbolLookups() {
+	return symbolLookups;
+}
+
+LiluAPI::Error LiluAPI::onPatcherLoadForce(t_patcherLoaded callback, void *user) {
+	patcherCallbacks.emplace_back(callback, user);
+	return Error::NoError;
+}
+
+void vmhHostLoadPatcher(KernelPatcher &patcher) {
+	for (auto &callback : patcherCallbacks) {
+		callback.first(callback.second, patcher);
+	}
+}
+
+// Brings up the stock tree and symbols before any harness code runs
+static struct HostBoot {
+	HostBoot() {
+		hostTscFrequency = hostCalibrateTsc();
+		sysctl_oid *stock[] = {
+			&sysctl__kern, &sysctl__machdep, &sysctl__machdep_cpu, &sysctl__machdep_tsc,
+			&sysctl__kern_hv_vmm_present, &sysctl__kern_hv_support, &sysctl__kern_hv_disable,
+			&sysctl__machdep_cpu_features, &sysctl__machdep_tsc_frequency,
+		};
+		for (size_t i = 0; i < arrsize(stock); i++) {
+			sysctl_register_oid(stock[i]);
+		}
+		vmhHostDefineSymbol("_sysctl__children", reinterpret_cast<mach_vm_address_t>(&sysctl__children));
+		vmhHostDefineSymbol("_proc_getexecutablevnode", reinterpret_cast<mach_vm_address_t>(hostProcExecutableVnode));
+		vmhHostDefineSymbol("_cs_identity_get", reinterpret_cast<mach_vm_address_t>(hostCsIdentityGet));
+	}
+} hostBoot;
@@ -0,0 +1,410 @@
+//
+//  vmh_host.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Userspace stand-ins for the kernel and Lilu interfaces VMHide uses, so the module sources
+//  build unmodified as a Linux library, see CMakeLists.txt. kern_start.hpp includes this header
+//  in place of the kernel and Lilu headers whenever VMH_HOST is defined.
+//
+//  Only what VMHide calls is provided. Where the handlers depend on it, the kernel's behaviour
+//  is kept: SYSCTL_OUT and SYSCTL_IN copy and truncate like sysctl_old_user and sysctl_new_user,
+//  OIDs are registered and numbered like sysctl_register_oid does, and every process has a pid,
+//  a generation, a name and optionally an executable and a signing identifier. Harnesses drive
+//  the mock with the vmhHost functions at the bottom of this file.
+//
+
+#ifndef vmh_host_hpp
+#define vmh_host_hpp
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/queue.h>
+#include <sys/types.h>
+
+// System headers are all in, nothing below may clash with them anymore
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+
+#define MAXCOMLEN 16
+#ifndef MAXPATHLEN
+#define MAXPATHLEN 1024
+#endif
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *destination, const char *source, size_t size);
+#endif
+
+// Mach types
+typedef unsigned long long mach_vm_address_t;
+typedef uint64_t user_addr_t;
+typedef int kern_return_t;
+#define KERN_SUCCESS 0
+#define KERN_FAILURE 5
+
+struct mach_timebase_info_data_t {
+	uint32_t numer;
+	uint32_t denom;
+};
+typedef mach_timebase_info_data_t *mach_timebase_info_t;
+
+// Host time is kept in nanoseconds, the timebase is 1/1
+#define NSEC_PER_SEC 1000000000ULL
+uint64_t mach_absolute_time();
+void clock_timebase_info(mach_timebase_info_t info);
+void absolutetime_to_nanoseconds(uint64_t abstime, uint64_t *result);
+void nanoseconds_to_absolutetime(uint64_t nanoseconds, uint64_t *result);
+int cpu_number();
+
+// Processes, vnodes and credentials
+struct vnode;
+typedef struct vnode *vnode_t;
+#define NULLVP ((vnode_t)0)
+
+struct kauth_cred;
+typedef struct kauth_cred *kauth_cred_t;
+
+struct proc;
+typedef struct proc *proc_t;
+
+proc_t current_proc();
+pid_t proc_pid(proc_t proc);
+int proc_ppid(proc_t proc);
+int proc_pidversion(proc_t proc);
+proc_t proc_find(int pid);
+int proc_rele(proc_t proc);
+void proc_name(int pid, char *buffer, int size);
+void proc_selfname(char *buffer, int size);
+
+int vnode_put(vnode_t vnode);
+uint32_t vnode_vid(vnode_t vnode);
+int vn_getpath(vnode_t vnode, char *path, int *length);
+
+kauth_cred_t kauth_cred_get();
+int kauth_cred_issuser(kauth_cred_t credential);
+
+// kauth, only the file operation scope is ever authorized by the mock
+typedef struct kauth_listener *kauth_listener_t;
+typedef int kauth_action_t;
+typedef int (*kauth_scope_callback_t)(kauth_cred_t credential, void *idata, kauth_action_t action,
+									  uintptr_t arg0, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3);
+#define KAUTH_SCOPE_FILEOP "com.apple.kauth.fileop"
+#define KAUTH_FILEOP_EXEC 6
+#define KAUTH_RESULT_ALLOW 1
+#define KAUTH_RESULT_DENY 2
+#define KAUTH_RESULT_DEFER 3
+kauth_listener_t kauth_listen_scope(const char *identifier, kauth_scope_callback_t callback, void *idata);
+void kauth_unlisten_scope(kauth_listener_t listener);
+
+// IOKit
+typedef struct _IOLock IOLock;
+typedef struct _IOSimpleLock IOSimpleLock;
+void *IOMalloc(size_t size);
+void *IOMallocZero(size_t size);
+void IOFree(void *address, size_t size);
+void *IOMallocAligned(size_t size, size_t alignment);
+void IOFreeAligned(void *address, size_t size);
+IOLock *IOLockAlloc();
+void IOLockFree(IOLock *lock);
+void IOLockLock(IOLock *lock);
+void IOLockUnlock(IOLock *lock);
+void IOSleep(unsigned milliseconds);
+
+// Platform expert, boot-args are taken from vmhHostSetBootArgs or VMH_HOST_BOOT_ARGS
+bool PE_parse_boot_argn(const char *name, void *value, int size);
+
+struct i386_cpu_info_t {
+	char cpuid_vendor[16];
+};
+i386_cpu_info_t *cpuid_info();
+
+// sysctl, laid out like the kernel's so that VMHSysctl walks the mock tree unchanged
+struct sysctl_req {
+	struct proc *p;
+	int lock;
+	user_addr_t oldptr;
+	size_t oldlen;
+	size_t oldidx;
+	int (*oldfunc)(struct sysctl_req *req, const void *data, size_t length);
+	user_addr_t newptr;
+	size_t newlen;
+	size_t newidx;
+	int (*newfunc)(struct sysctl_req *req, void *data, size_t length);
+};
+
+struct sysctl_oid;
+SLIST_HEAD(sysctl_oid_list, sysctl_oid);
+
+#define SYSCTL_HANDLER_ARGS (struct sysctl_oid *oidp __unused, void *arg1 __unused, int arg2 __unused, struct sysctl_req *req)
+typedef int (*sysctl_handler_t)(struct sysctl_oid *oidp, void *arg1, int arg2, struct sysctl_req *req);
+
+struct sysctl_oid {
+	struct sysctl_oid_list *oid_parent;
+	SLIST_ENTRY(sysctl_oid) oid_link;
+	int oid_number;
+	int oid_kind;
+	void *oid_arg1;
+	int oid_arg2;
+	const char *oid_name;
+	sysctl_handler_t oid_handler;
+	const char *oid_fmt;
+	const char *oid_descr;
+	int oid_version;
+	int oid_refcnt;
+};
+
+#define SYSCTL_OUT(r, p, l) (r->oldfunc)(r, p, l)
+#define SYSCTL_IN(r, p, l) (r->newfunc)(r, p, l)
+
+#define CTLTYPE 0xf
+#define CTLTYPE_NODE 1
+#define CTLTYPE_INT 2
+#define CTLTYPE_STRING 3
+#define CTLTYPE_QUAD 4
+#define CTLTYPE_OPAQUE 5
+#define CTLFLAG_RD 0x80000000
+#define CTLFLAG_WR 0x40000000
+#define CTLFLAG_RW (CTLFLAG_RD | CTLFLAG_WR)
+#define CTLFLAG_ANYBODY 0x10000000
+#define CTLFLAG_KERN 0x01000000
+#define CTLFLAG_LOCKED 0x00800000
+#define CTLFLAG_OID2 0x00400000
+#define OID_AUTO (-1)
+#define OID_AUTO_START 100
+#define SYSCTL_OID_VERSION 1
+
+#define SYSCTL_DECL(name) extern struct sysctl_oid_list sysctl_##name##_children
+#define SYSCTL_OID(parent, nbr, name, kind, a1, a2, handler, fmt, descr) \
+	struct sysctl_oid sysctl_##parent##_##name = { \
+		&sysctl_##parent##_children, { nullptr }, nbr, (int)(kind | CTLFLAG_OID2), a1, (int)(a2), #name, handler, fmt, descr, SYSCTL_OID_VERSION, 0 \
+	}
+#define SYSCTL_NODE(parent, nbr, name, access, handler, descr) \
+	struct sysctl_oid_list sysctl_##parent##_##name##_children; \
+	SYSCTL_OID(parent, nbr, name, CTLTYPE_NODE | access, (void *)&sysctl_##parent##_##name##_children, 0, handler, "N", descr)
+#define SYSCTL_PROC(parent, nbr, name, access, ptr, arg, handler, fmt, descr) \
+	SYSCTL_OID(parent, nbr, name, access, ptr, arg, handler, fmt, descr)
+#define SYSCTL_INT(parent, nbr, name, access, ptr, val, descr) \
+	SYSCTL_OID(parent, nbr, name, CTLTYPE_INT | access, ptr, val, sysctl_handle_int, "I", descr)
+#define SYSCTL_STRING(parent, nbr, name, access, arg, len, descr) \
+	SYSCTL_OID(parent, nbr, name, CTLTYPE_STRING | access, arg, len, sysctl_handle_string, "A", descr)
+
+extern struct sysctl_oid_list sysctl__children;
+SYSCTL_DECL(_kern);
+SYSCTL_DECL(_machdep);
+
+void sysctl_register_oid(struct sysctl_oid *oidp);
+void sysctl_unregister_oid(struct sysctl_oid *oidp);
+int sysctl_handle_int SYSCTL_HANDLER_ARGS;
+int sysctl_handle_string SYSCTL_HANDLER_ARGS;
+
+// Resolves name through the mock tree and calls its handler as the current process, returns -1 and sets errno on failure
+int sysctlbyname(const char *name, void *oldp, size_t *oldlenp, void *newp, size_t newlen);
+
+// Lilu
+#define xStringify2(a) #a
+#define xStringify(a) xStringify2(a)
+#define arrsize(array) (sizeof(array) / sizeof(array[0]))
+#define ADDPR(a) vmh_host_##a
+
+enum KernelVersion : int {
+	Monterey = 21,
+	Ventura = 22,
+	Sonoma = 23,
+	Sequoia = 24,
+	Tahoe = 25,
+};
+KernelVersion getKernelVersion();
+int getKernelMinorVersion();
+
+constexpr size_t parseModuleVersion(const char *version) {
+	return static_cast<size_t>(version[0] - '0') * 100 + static_cast<size_t>(version[2] - '0') * 10 + static_cast<size_t>(version[4] - '0');
+}
+
+class KernelPatcher {
+public:
+	enum class Error {
+		NoError,
+		NoKinfoFound,
+		NoSymbolFound,
+		KernInitFailure,
+		MemoryIssue,
+		MemoryProtection,
+	};
+
+	static constexpr size_t KernelID {0};
+
+	// Looks the symbol up in the table kept by vmhHostDefineSymbol
+	mach_vm_address_t solveSymbol(size_t id, const char *symbol);
+
+	Error getError() { return error; }
+	void clearError() { error = Error::NoError; }
+
+	IOSimpleLock *kernelWriteLock {nullptr};
+
+private:
+	Error error {Error::NoError};
+};
+
+class MachInfo {
+public:
+	// Counts write windows, and fails when one is opened while another still is
+	static kern_return_t setKernelWriting(bool enable, IOSimpleLock *lock);
+};
+
+class LiluAPI {
+public:
+	enum RunningMode : uint32_t {
+		AllowNormal = 1,
+		AllowInstallerRecovery = 2,
+		AllowSafeMode = 4,
+	};
+
+	enum class Error {
+		NoError,
+		LockError,
+		MemoryError,
+	};
+
+	typedef void (*t_patcherLoaded)(void *user, KernelPatcher &patcher);
+
+	// Callbacks run once vmhHostLoadPatcher is called
+	Error onPatcherLoadForce(t_patcherLoaded callback, void *user = nullptr);
+};
+extern LiluAPI lilu;
+
+struct PluginConfiguration {
+	const char *product;
+	size_t version;
+	uint32_t runmode;
+	const char **disableArg;
+	size_t disableArgNum;
+	const char **debugArg;
+	size_t debugArgNum;
+	const char **betaArg;
+	size_t betaArgNum;
+	KernelVersion minKernel;
+	KernelVersion maxKernel;
+	void (*pluginStart)();
+};
+extern PluginConfiguration ADDPR(config);
+extern bool ADDPR(debugEnabled);
+
+namespace Buffer {
+	template <typename T>
+	T *create(size_t size) {
+		return static_cast<T *>(malloc(sizeof(T) * size));
+	}
+
+	template <typename T>
+	void deleter(T *buffer) {
+		free(buffer);
+	}
+}
+
+#define NVRAM_PREFIX(x, y) x ":" y
+#define LILU_VENDOR_GUID "E09B9297-7928-4440-9AAB-D1F8536FBF0A"
+
+// Variables are set with vmhHostSetNvram, every option is ignored and data is always returned raw
+class NVStorage {
+public:
+	enum Options {
+		OptAuthenticate = 1,
+		OptEncrypted = 2,
+		OptCompressed = 4,
+		OptChecksum = 8,
+		OptSensitive = 16,
+		OptRaw = 32,
+	};
+
+	bool init();
+	void deinit();
+
+	// Returns a Buffer::create copy of the variable, or null if it is not set
+	uint8_t *read(const char *key, uint32_t &size, uint8_t opts = OptAuthenticate, const uint8_t *enckey = nullptr);
+};
+
+// Logging, DBGLOG only prints with VMH_HOST_LOG set in the environment
+void vmhHostLog(bool debug, const char *module, const char *format, ...);
+[[noreturn]] void vmhHostPanic(const char *module, const char *format, ...);
+#define SYSLOG(module, format, ...) vmhHostLog(false, module, format, ##__VA_ARGS__)
+#define DBGLOG(module, format, ...) vmhHostLog(true, module, format, ##__VA_ARGS__)
+#define panic(module, format, ...) vmhHostPanic(module, format, ##__VA_ARGS__)
+#define PANIC_COND(condition, module, format, ...) do { if (condition) vmhHostPanic(module, format, ##__VA_ARGS__); } while (0)
+
+/**
+ * Harness side of the mock. None of these exist in the kernel.
+ */
+
+/**
+ * @brief Creates a process with a fresh pid and generation, path and identity may be null.
+ */
+proc_t vmhHostSpawn(const char *name, const char *path = nullptr, const char *identity = nullptr, uid_t uid = 0);
+
+/**
+ * @brief Creates a process with the given pid, for replaying recorded callers. Returns null if the pid is in use.
+ */
+proc_t vmhHostSpawnPid(pid_t pid, const char *name, const char *path = nullptr, const char *identity = nullptr, uid_t uid = 0);
+
+/**
+ * @brief Creates a child of parent with a fresh pid and generation, running the same image, like fork.
+ */
+proc_t vmhHostFork(proc_t parent);
+
+/**
+ * @brief Replaces the image of a process, giving it a new generation, and notifies the kauth file operation listeners.
+ */
+void vmhHostExec(proc_t proc, const char *name, const char *path = nullptr, const char *identity = nullptr);
+
+/**
+ * @brief Retires a process, its pid may be handed out again. No thread may still run as it, or hold it from proc_find.
+ */
+void vmhHostExit(proc_t proc);
+
+/**
+ * @brief Makes the calling thread run as proc, threads start out as kernel_task.
+ */
+void vmhHostSetCurrentProc(proc_t proc);
+
+/**
+ * @brief Fills in a request the way sysctl does for a userspace caller, old and new may be null.
+ */
+void vmhHostSysctlRequest(sysctl_req &req, void *old, size_t oldlen, const void *replacement, size_t newlen);
+
+/**
+ * @brief Adds or replaces a symbol solved by KernelPatcher::solveSymbol, 0 makes it unresolvable.
+ */
+void vmhHostDefineSymbol(const char *symbol, mach_vm_address_t address);
+
+/**
+ * @brief Runs every onPatcherLoadForce callback with patcher.
+ */
+void vmhHostLoadPatcher(KernelPatcher &patcher);
+
+/**
+ * @brief Replaces the boot-args seen by PE_parse_boot_argn.
+ */
+void vmhHostSetBootArgs(const char *bootArgs);
+
+/**
+ * @brief Sets the NVRAM variable key, GUID prefixed like NVStorage expects it. Null data removes it.
+ */
+void vmhHostSetNvram(const char *key, const void *data, size_t size);
+
+/**
+ * @brief Number of kernel write windows opened so far.
+ */
+size_t vmhHostWriteWindows();
+
+/**
+ * @brief Number of KernelPatcher::solveSymbol calls so far, each one a scan of the symbol table in Lilu.
+ */
+size_t vmhHostSymbolLookups();
+
+#endif /* vmh_host_hpp */
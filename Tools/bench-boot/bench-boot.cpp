@@ -0,0 +1,264 @@
+//
+//  bench-boot.cpp
+//  bench-boot
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Runs the whole init chain of the unmodified module sources, built against the userspace
+//  mocks of Host/: the Lilu plugin start, VMH::init, then the patcher load with the mocked
+//  KernelPatcher, VMH::solveSysCtlChildrenAddr, VMM::init and the reroute. Every run boots a
+//  fresh forked process and reports the kern.vmh.boot phase durations, -c prints them as CSV
+//  so that startup cost can be tracked per commit. Linux only, built by the CMakeLists.txt at
+//  the root of the repository.
+//
+//  -f boots with a filter compiled by Tools/vmh-filterc in the mocked NVRAM, and checks that
+//  kern.vmh.filter then lists its rules rather than VMM::filteredProcs.
+//
+//  VMH::init keeps its CPUID guard, the machine must look like a guest VMHide supports.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "../../VMHide/kern_vmm.hpp"
+#include "../vmh-filterc/vmh_filterc.hpp"
+
+// Synthetic OIDs added around the stock ones, about the size of a macOS sysctl tree
+static const size_t FILLER_NODES = 40;
+static const size_t FILLER_LEAVES = 50;
+static const size_t FILLER_KERN = 300;
+
+// kern.vmh.boot entries, in VMHBootPhase order, then the wall clock of both halves of the chain and the symbol lookups
+static const char *const phaseNames[] = {
+    "init", "patcher_wait", "patcher_load", "sysctl_children", "sysctl_index",
+    "vmm_init", "symbols", "filter", "reroute", "write_window",
+};
+static_assert(arrsize(phaseNames) == VMHBootPhaseCount, "phaseNames must name every VMHBootPhase");
+static const size_t SAMPLES = VMHBootPhaseCount + 3;
+
+static void usage(const char *tool) {
+    fprintf(stderr,
+            "usage: %s [-n runs] [-c] [-f blob]\n"
+            "  -n runs  boots to run, each in a fresh process, 21 by default\n"
+            "  -c       print the median of every phase as CSV\n"
+            "  -f blob  boot with a compiled filter in NVRAM, and expect kern.vmh.filter to list it\n",
+            tool);
+}
+
+/**
+ * Sysctl tree
+ */
+
+static std::deque<sysctl_oid> fillerOids;
+static std::deque<sysctl_oid_list> fillerLists;
+static std::deque<std::string> fillerNames;
+static int fillerValue = 0;
+
+static sysctl_oid *addFiller(sysctl_oid_list *parent, const std::string &name, bool node) {
+    fillerNames.push_back(name);
+    fillerOids.push_back(sysctl_oid {});
+    sysctl_oid *oid = &fillerOids.back();
+    oid->oid_parent = parent;
+    oid->oid_number = OID_AUTO;
+    oid->oid_name = fillerNames.back().c_str();
+    oid->oid_version = SYSCTL_OID_VERSION;
+    if (node) {
+        fillerLists.push_back(sysctl_oid_list {});
+        oid->oid_kind = CTLTYPE_NODE | CTLFLAG_RD;
+        oid->oid_arg1 = &fillerLists.back();
+    } else {
+        oid->oid_kind = CTLTYPE_INT | CTLFLAG_RD;
+        oid->oid_arg1 = &fillerValue;
+        oid->oid_handler = sysctl_handle_int;
+    }
+    sysctl_register_oid(oid);
+    return oid;
+}
+
+static void populateTree() {
+    for (size_t n = 0; n < FILLER_NODES; n++) {
+        sysctl_oid *node = addFiller(&sysctl__children, "filler" + std::to_string(n), true);
+        for (size_t l = 0; l < FILLER_LEAVES; l++) {
+            addFiller(static_cast<sysctl_oid_list *>(node->oid_arg1), "leaf" + std::to_string(l), false);
+        }
+    }
+    for (size_t l = 0; l < FILLER_KERN; l++) {
+        addFiller(&sysctl__kern_children, "filler" + std::to_string(l), false);
+    }
+}
+
+/**
+ * Boot
+ */
+
+// kern.vmh.filter once the compiled filter of -f is loaded, empty without -f
+static std::string expectedFilter;
+
+// Stores the blob where VMHLiveFilter::init looks for it, and lists its rules like kern.vmh.filter does
+static bool loadCompiledFilter(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "bench-boot: cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    std::vector<uint8_t> blob;
+    uint8_t buffer[4096];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        blob.insert(blob.end(), buffer, buffer + got);
+    }
+    fclose(file);
+
+    VMHFilterBlob view;
+    const char *rejected = view.open(blob.data(), blob.size());
+    if (rejected || view.ruleCount() == 0) {
+        fprintf(stderr, "bench-boot: %s is not a usable compiled filter: %s\n", path, rejected ? rejected : "no rules");
+        return false;
+    }
+    for (uint32_t i = 0; i < view.ruleCount(); i++) {
+        const vmh_filter_rule_t &rule = view.rule(i);
+        expectedFilter += (i ? "," : "") + std::string(rule.flags & VMH_FILTER_RULE_TREE ? vmhFilterTreePrefix : "") +
+                          vmhFilterPrefixes[rule.kind] + view.name(rule);
+    }
+    vmhHostSetNvram(NVRAM_PREFIX(LILU_VENDOR_GUID, VMH_FILTER_NVRAM_NAME), blob.data(), blob.size());
+    return true;
+}
+
+// Boots the module in this process and fills samples with nanoseconds, false if the chain failed
+static bool bootOnce(uint64_t (&samples)[SAMPLES]) {
+    populateTree();
+
+    // Lilu calls the plugin start routine once the kext is loaded, and the patcher callbacks much later
+    auto start = std::chrono::steady_clock::now();
+    ADDPR(config).pluginStart();
+    auto started = std::chrono::steady_clock::now();
+    KernelPatcher patcher;
+    vmhHostLoadPatcher(patcher);
+    auto loaded = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < VMHBootPhaseCount; i++) {
+        std::string name = std::string("kern.vmh.boot.") + phaseNames[i];
+        size_t length = sizeof(samples[i]);
+        if (sysctlbyname(name.c_str(), &samples[i], &length, nullptr, 0) != 0) {
+            fprintf(stderr, "bench-boot: cannot read %s: %s\n", name.c_str(), strerror(errno));
+            return false;
+        }
+    }
+    samples[VMHBootPhaseCount] = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(started - start).count());
+    samples[VMHBootPhaseCount + 1] = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(loaded - started).count());
+    samples[VMHBootPhaseCount + 2] = vmhHostSymbolLookups();
+
+    // The kernel is not filtered, a rerouted handler answers it 0 where the stock one says 1
+    int present = -1;
+    size_t length = sizeof(present);
+    if (sysctlbyname("kern.hv_vmm_present", &present, &length, nullptr, 0) != 0 || present != 0) {
+        fprintf(stderr, "bench-boot: kern.hv_vmm_present was not rerouted\n");
+        return false;
+    }
+    if (!expectedFilter.empty()) {
+        char filter[VMH_LIVE_FILTER_POOL * 2];
+        length = sizeof(filter);
+        if (sysctlbyname("kern.vmh.filter", filter, &length, nullptr, 0) != 0 || expectedFilter != filter) {
+            fprintf(stderr, "bench-boot: kern.vmh.filter does not list the compiled filter\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+// Runs bootOnce in a forked child, the module can only boot once per process
+static bool bootForked(uint64_t (&samples)[SAMPLES]) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (child == 0) {
+        close(fds[0]);
+        uint64_t result[SAMPLES] {};
+        bool booted = bootOnce(result);
+        bool written = booted && write(fds[1], result, sizeof(result)) == static_cast<ssize_t>(sizeof(result));
+        _exit(written ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    close(fds[1]);
+    ssize_t got = read(fds[0], samples, sizeof(samples));
+    close(fds[0]);
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fprintf(stderr, "bench-boot: the boot %s\n", WIFSIGNALED(status) ? "panicked" : "failed");
+        return false;
+    }
+    return got == static_cast<ssize_t>(sizeof(samples));
+}
+
+int main(int argc, char *argv[]) {
+    size_t runs = 21;
+    bool csv = false;
+    const char *compiled = nullptr;
+    int option;
+    while ((option = getopt(argc, argv, "n:cf:h")) != -1) {
+        switch (option) {
+            case 'n': runs = strtoull(optarg, nullptr, 0); break;
+            case 'c': csv = true; break;
+            case 'f': compiled = optarg; break;
+            default: usage(argv[0]); return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (runs == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (compiled && !loadCompiledFilter(compiled)) {
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::vector<uint64_t>> samples(SAMPLES);
+    for (size_t run = 0; run < runs; run++) {
+        uint64_t result[SAMPLES];
+        if (!bootForked(result)) {
+            return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < SAMPLES; i++) {
+            samples[i].push_back(result[i]);
+        }
+    }
+
+    if (csv) {
+        printf("phase,median_ns,min_ns,max_ns\n");
+    } else {
+        printf("Boot phases over %zu boots, %zu synthetic OIDs:\n", runs, FILLER_NODES * (FILLER_LEAVES + 1) + FILLER_KERN);
+    }
+    for (size_t i = 0; i < SAMPLES - 1; i++) {
+        std::vector<uint64_t> &sorted = samples[i];
+        std::sort(sorted.begin(), sorted.end());
+        const char *name = i < VMHBootPhaseCount ? phaseNames[i] : i == VMHBootPhaseCount ? "wall_plugin_start" : "wall_patcher_load";
+        uint64_t median = sorted[sorted.size() / 2];
+        if (csv) {
+            printf("%s,%llu,%llu,%llu\n", name, static_cast<unsigned long long>(median),
+                   static_cast<unsigned long long>(sorted.front()), static_cast<unsigned long long>(sorted.back()));
+        } else {
+            printf("  %-20s %10.1f us median, %10.1f min, %10.1f max\n", name, median / 1e3, sorted.front() / 1e3, sorted.back() / 1e3);
+        }
+    }
+    if (csv) {
+        printf("symbol_lookups,%llu,,\n", static_cast<unsigned long long>(samples[SAMPLES - 1].front()));
+    } else {
+        printf("  %-20s %10llu\n", "symbol_lookups", static_cast<unsigned long long>(samples[SAMPLES - 1].front()));
+    }
+    return EXIT_SUCCESS;
+}
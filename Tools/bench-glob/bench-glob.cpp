@@ -0,0 +1,216 @@
+//
+//  bench-glob.cpp
+//  bench-glob
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Compares the original exact-match loop over VMM::filteredProcs, and the same loop extended
+//  with a glob match per rule, against the single-pass DFA from kern_glob.hpp. Every DFA verdict
+//  is checked against fnmatch(3) first, and rule lists at the position limit must be rejected
+//  cleanly. --quick runs fewer lookups for ctest.
+//  Builds anywhere with a C++14 compiler, for example on Linux:
+//  c++ -O2 -std=c++14 -o bench-glob Tools/bench-glob/bench-glob.cpp
+//
+
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../VMHide/kern_glob.hpp"
+
+// Mirrors VMH::DetectedProcess without pulling in the kernel headers
+struct DetectedProcess {
+    const char *name;
+    pid_t pid;
+};
+
+// Same limits as the kext, see kern_livefilter.hpp
+typedef VMHGlobMatcher<1024, 32768> Matcher;
+
+// Number of lookups timed per engine and rule count, --quick lowers it for ctest
+static size_t lookups = 2000000;
+
+// The original VMH_sysctl_vmm_present matching loop, exact names only
+static bool exactLoop(const std::vector<DetectedProcess> &procs, const char *name) {
+    for (size_t i = 0; i < procs.size(); ++i) {
+        if (strcmp(name, procs[i].name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Straightforward backtracking glob match, what a per-rule loop would have to do
+static bool globMatch(const char *pattern, const char *name) {
+    const char *star = nullptr;
+    const char *resume = nullptr;
+    while (*name) {
+        if (*pattern == '?' || (*pattern && *pattern != '*' && *pattern == *name)) {
+            pattern++;
+            name++;
+        } else if (*pattern == '*') {
+            star = pattern++;
+            resume = name;
+        } else if (star) {
+            pattern = star + 1;
+            name = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+static bool ruleLoop(const std::vector<DetectedProcess> &procs, const char *name) {
+    for (size_t i = 0; i < procs.size(); ++i) {
+        if (globMatch(procs[i].name, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Lookup>
+static double timeLookups(const std::vector<std::string> &queries, size_t &hits, Lookup lookup) {
+    hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        hits += lookup(queries[i % queries.size()].c_str());
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / lookups;
+}
+
+static bool runBench(size_t ruleCount) {
+    // Mostly prefix rules, the shape of truncated bundle-style names, with a few substring rules
+    std::vector<std::string> rules;
+    for (size_t i = 0; i < ruleCount; i++) {
+        char buffer[32];
+        if (i % 8 == 7) {
+            snprintf(buffer, sizeof(buffer), "*update%zu*", i);
+        } else {
+            snprintf(buffer, sizeof(buffer), "com.apple.s%zu*", i * 2654435761u % 10007u);
+        }
+        rules.push_back(buffer);
+    }
+    std::vector<DetectedProcess> procs;
+    for (auto &rule : rules) {
+        procs.push_back({rule.c_str(), -1});
+    }
+
+    // What the exact list had to hold instead, one truncated name per rule
+    std::vector<std::string> names;
+    std::vector<DetectedProcess> exactProcs;
+    for (auto &rule : rules) {
+        std::string name;
+        for (char c : rule) {
+            if (c != '*') {
+                name += c;
+            }
+        }
+        names.push_back(name);
+    }
+    for (auto &name : names) {
+        exactProcs.push_back({name.c_str(), -1});
+    }
+
+    // Process names as proc_name returns them, at most MAXCOMLEN (16) characters, half of them matching
+    std::vector<std::string> queries;
+    for (size_t i = 0; i < 1024; i++) {
+        char buffer[17];
+        if (i % 2) {
+            const std::string &rule = rules[i % ruleCount];
+            snprintf(buffer, sizeof(buffer), "%.*sd%zu", static_cast<int>(rule.find('*') == 0 ? 0 : rule.size() - 1), rule.c_str(), i);
+            if (rule[0] == '*') {
+                snprintf(buffer, sizeof(buffer), "x%s", rule.substr(1, rule.size() - 2).c_str());
+            }
+        } else {
+            snprintf(buffer, sizeof(buffer), "daemon%zu", i * 40503u % 100003u);
+        }
+        queries.push_back(buffer);
+    }
+
+    std::unique_ptr<Matcher> matcher(new Matcher());
+    std::unique_ptr<Matcher::Scratch> scratch(new Matcher::Scratch());
+    auto buildStart = std::chrono::steady_clock::now();
+    if (!matcher->build(procs.data(), procs.size(), *scratch)) {
+        printf("%5zu rules: too complex for the DFA limits\n", ruleCount);
+        return true;
+    }
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+    for (auto &query : queries) {
+        bool expected = false;
+        for (auto &rule : rules) {
+            expected |= fnmatch(rule.c_str(), query.c_str(), 0) == 0;
+        }
+        if (matcher->matches(query.c_str()) != expected || ruleLoop(procs, query.c_str()) != expected) {
+            printf("Verdict mismatch for '%s' with %zu rules\n", query.c_str(), ruleCount);
+            return false;
+        }
+    }
+
+    size_t exactHits, ruleHits, dfaHits;
+    double exactNs = timeLookups(queries, exactHits, [&](const char *name) { return exactLoop(exactProcs, name); });
+    double ruleNs = timeLookups(queries, ruleHits, [&](const char *name) { return ruleLoop(procs, name); });
+    double dfaNs = timeLookups(queries, dfaHits, [&](const char *name) { return matcher->matches(name); });
+    printf("%5zu rules: exact loop %8.2f ns/lookup (%zu hits), glob loop %8.2f ns/lookup, DFA %6.2f ns/lookup (%zu hits)"
+           " - %zu states x %zu classes, build %.3f ms\n",
+           ruleCount, exactNs, exactHits, ruleNs, dfaNs, dfaHits, matcher->states(), matcher->classes(), buildMs);
+    return ruleHits == dfaHits;
+}
+
+// Rule lists right at and just past VMH_GLOB_MAX_POSITIONS, one position is kept for the sink
+static bool checkCapacity() {
+    struct Case {
+        const char *rule;
+        size_t count;
+        bool fits;
+        const char *query;
+    };
+    // "*" takes a single accepting position, "a?" two characters and one accepting position
+    const Case cases[] = {
+        {"*", VMH_GLOB_MAX_POSITIONS - 1, true, "anything"},
+        {"*", VMH_GLOB_MAX_POSITIONS, false, nullptr},
+        {"*", VMH_GLOB_MAX_POSITIONS * 2, false, nullptr},
+        {"a?", (VMH_GLOB_MAX_POSITIONS - 1) / 3, true, "ab"},
+        {"a?", (VMH_GLOB_MAX_POSITIONS - 1) / 3 + 1, false, nullptr},
+    };
+    std::unique_ptr<Matcher> matcher(new Matcher());
+    std::unique_ptr<Matcher::Scratch> scratch(new Matcher::Scratch());
+    for (const Case &test : cases) {
+        std::vector<DetectedProcess> procs(test.count, DetectedProcess {test.rule, -1});
+        bool built = matcher->build(procs.data(), procs.size(), *scratch);
+        if (built != test.fits || (built && !matcher->matches(test.query)) || (!built && !matcher->isEmpty())) {
+            printf("%zu '%s' rules: %s, expected them to be %s\n", test.count, test.rule, built ? "built" : "rejected",
+                   test.fits ? "built" : "rejected");
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, const char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--quick") == 0) {
+        lookups = 20000;
+    }
+    if (!checkCapacity()) {
+        return 1;
+    }
+    printf("bench-glob: %zu lookups per engine, 50%% hit ratio\n", lookups);
+    for (size_t ruleCount : {4, 16, 32, 64}) {
+        if (!runBench(ruleCount)) {
+            return 1;
+        }
+    }
+    return 0;
+}
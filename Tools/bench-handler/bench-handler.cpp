@@ -0,0 +1,468 @@
+//
+//  bench-handler.cpp
+//  bench-handler
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Times VMH_sysctl_vmm_present, processCurrentProcessUnique and the reroute path of the
+//  unmodified module sources, built against the userspace mocks of Host/. Linux only, built
+//  by the CMakeLists.txt at the root of the repository:
+//  cmake -S . -B build && cmake --build build && build/bench-handler
+//  Every run checks the verdicts it times, --quick runs fewer iterations for ctest.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "../../VMHide/kern_vmm.hpp"
+
+// Defined by kern_start.cpp, registered by VMH::init
+extern struct sysctl_oid sysctl__kern_vmh;
+
+// Defined by kern_vmm.cpp, installs the handlers specialized for VMH::vmhStateEnum
+bool reRouteHvVmm(KernelPatcher &patcher);
+
+// Handler calls and reroutes timed per repetition, and repetitions per scenario
+static size_t calls = 500000;
+static size_t reroutes = 2000;
+static const size_t REPETITIONS = 5;
+
+// Distinct processes cycled through by the cache miss scenarios, 8 for every verdict cache slot
+static const size_t MISS_PROCESSES = 8 * VMM_VERDICT_CACHE_SLOTS;
+
+// Synthetic OIDs added around the stock ones, about the size of a macOS sysctl tree
+static const size_t FILLER_NODES = 40;
+static const size_t FILLER_LEAVES = 50;
+
+static bool failed = false;
+
+// Median of the per-repetition timings, in nanoseconds per operation
+template <typename Body>
+static double timeMedian(size_t operations, Body body) {
+    std::vector<double> samples;
+    for (size_t r = 0; r < REPETITIONS; r++) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / operations);
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[REPETITIONS / 2];
+}
+
+/**
+ * Sysctl tree
+ */
+
+static std::deque<sysctl_oid> fillerOids;
+static std::deque<sysctl_oid_list> fillerLists;
+static std::deque<std::string> fillerNames;
+static int fillerValue = 0;
+
+static sysctl_oid *addFiller(sysctl_oid_list *parent, const std::string &name, bool node) {
+    fillerNames.push_back(name);
+    fillerOids.push_back(sysctl_oid {});
+    sysctl_oid *oid = &fillerOids.back();
+    oid->oid_parent = parent;
+    oid->oid_number = OID_AUTO;
+    oid->oid_name = fillerNames.back().c_str();
+    oid->oid_version = SYSCTL_OID_VERSION;
+    if (node) {
+        fillerLists.push_back(sysctl_oid_list {});
+        oid->oid_kind = CTLTYPE_NODE | CTLFLAG_RD;
+        oid->oid_arg1 = &fillerLists.back();
+    } else {
+        oid->oid_kind = CTLTYPE_INT | CTLFLAG_RD;
+        oid->oid_arg1 = &fillerValue;
+        oid->oid_handler = sysctl_handle_int;
+    }
+    sysctl_register_oid(oid);
+    return oid;
+}
+
+static size_t populateTree() {
+    size_t count = 0;
+    for (size_t n = 0; n < FILLER_NODES; n++) {
+        sysctl_oid *node = addFiller(&sysctl__children, "filler" + std::to_string(n), true);
+        for (size_t l = 0; l < FILLER_LEAVES; l++) {
+            addFiller(static_cast<sysctl_oid_list *>(node->oid_arg1), "leaf" + std::to_string(l), false);
+        }
+        count += FILLER_LEAVES + 1;
+    }
+    // kern is one of the longest lists of the real tree, the hooked OIDs end up in its middle
+    for (size_t l = 0; l < 300; l++) {
+        addFiller(&sysctl__kern_children, "filler" + std::to_string(l), false);
+        count++;
+    }
+    return count;
+}
+
+// Everything VMH::init does past its CPUID guard, which would refuse most build machines
+static void bootModule() {
+    sysctl_register_oid(&sysctl__kern_vmh);
+    VMHStats::init();
+    VMHLog::init();
+    VMHTrace::init();
+    lilu.onPatcherLoadForce(&VMH::solveSysCtlChildrenAddr);
+    KernelPatcher patcher;
+    vmhHostLoadPatcher(patcher);
+}
+
+/**
+ * Handler
+ */
+
+// Calls the kern.hv_vmm_present handler as the current process, the way sysctl dispatches it
+struct HandlerCall {
+    sysctl_oid *oid;
+    sysctl_req req;
+    int value;
+
+    HandlerCall() : oid(VMHSysctl::find("kern.hv_vmm_present")), value(-1) {
+        vmhHostSysctlRequest(req, &value, sizeof(value), nullptr, 0);
+    }
+
+    int operator()() {
+        req.oldidx = 0;
+        value = -1;
+        int error = oid->oid_handler(oid, oid->oid_arg1, oid->oid_arg2, &req);
+        return error ? -1 : value;
+    }
+};
+
+static std::vector<proc_t> spawnMany(size_t count, const char *prefix, const char *path, const char *identity) {
+    std::vector<proc_t> procs;
+    for (size_t i = 0; i < count; i++) {
+        procs.push_back(vmhHostSpawn((prefix + std::to_string(i)).c_str(), path, identity));
+    }
+    return procs;
+}
+
+// Times the handler for callers cycling through procs, every caller must get expected
+static void benchHandler(const char *scenario, const std::vector<proc_t> &procs, int expected) {
+    HandlerCall call;
+    size_t mismatches = 0;
+    uint64_t hitsBefore = VMHStats::read(VMHStatCacheHits);
+    uint64_t callsBefore = VMHStats::read(VMHStatCalls);
+    double ns = timeMedian(calls, [&]() {
+        for (size_t i = 0; i < calls; i++) {
+            vmhHostSetCurrentProc(procs[i % procs.size()]);
+            mismatches += call() != expected;
+        }
+    });
+    vmhHostSetCurrentProc(nullptr);
+    double hitRate = 100.0 * static_cast<double>(VMHStats::read(VMHStatCacheHits) - hitsBefore) /
+        static_cast<double>(VMHStats::read(VMHStatCalls) - callsBefore);
+    printf("  %-34s %8.1f ns/call, %5.1f%% cache hits%s\n", scenario, ns, hitRate, mismatches ? " (MISMATCH)" : "");
+    failed |= mismatches != 0;
+}
+
+static bool writeFilter(const char *filter) {
+    if (sysctlbyname("kern.vmh.filter", nullptr, nullptr, const_cast<char *>(filter), strlen(filter)) != 0) {
+        printf("  failed to write kern.vmh.filter: %s\n", strerror(errno));
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+static void benchHandlers() {
+    printf("VMH_sysctl_vmm_present, %zu calls per repetition, median of %zu:\n", calls, REPETITIONS);
+    std::vector<proc_t> unfiltered {vmhHostSpawn("Safari", "/Applications/Safari.app/Contents/MacOS/Safari", "com.apple.Safari")};
+    std::vector<proc_t> filtered {vmhHostSpawn("softwareupdated", "/System/Library/PrivateFrameworks/SoftwareUpdateCore.framework/Support/softwareupdated", "com.apple.softwareupdated")};
+    benchHandler("cached, unfiltered", unfiltered, 0);
+    benchHandler("cached, filtered", filtered, 1);
+
+    std::vector<proc_t> misses = spawnMany(MISS_PROCESSES, "daemon", nullptr, nullptr);
+    std::vector<proc_t> globMisses = spawnMany(MISS_PROCESSES, "com.apple.Mobile", nullptr, nullptr);
+    benchHandler("uncached, no rule match", misses, 0);
+    benchHandler("uncached, glob rule match", globMisses, 1);
+
+    // Executables are shared, like the few binaries behind most processes of a real system
+    std::vector<proc_t> pathMisses;
+    for (size_t i = 0; i < MISS_PROCESSES; i++) {
+        std::string path = "/usr/libexec/tool" + std::to_string(i % 64);
+        pathMisses.push_back(vmhHostSpawn(("tool" + std::to_string(i)).c_str(), path.c_str(), "com.apple.tool"));
+    }
+    if (writeFilter("softwareupdated,com.apple.Mobile*,path:/System/Library/PrivateFrameworks/*,bundle:com.apple.MobileSoftwareUpdate*")) {
+        benchHandler("uncached, path and bundle rules", pathMisses, 0);
+    }
+    if (writeFilter("softwareupdated,com.apple.Mobile*,path:/usr/libexec/tool1*")) {
+        std::vector<proc_t> pathMatches;
+        for (size_t i = 0; i < pathMisses.size(); i++) {
+            if (i % 64 >= 10 && i % 64 < 20) {
+                pathMatches.push_back(pathMisses[i]);
+            }
+        }
+        benchHandler("uncached, path rule match", pathMatches, 1);
+    }
+
+    // With debug logging, every call is also counted against its process name for the binary log
+    ADDPR(debugEnabled) = true;
+    benchHandler("cached, unfiltered, binary log", unfiltered, 0);
+    benchHandler("uncached, binary log", misses, 0);
+    ADDPR(debugEnabled) = false;
+}
+
+// Helpers exec'd by a tree rule process, their forks and what those forks exec inherit its verdict
+static void benchTrees() {
+    const char *filter = "softwareupdated,com.apple.Mobile*,path:/usr/libexec/tool1*";
+    const size_t families = VMM_TREE_CACHE_SLOTS / 8;
+    if (!writeFilter((std::string("tree:osinstallersetup,") + filter).c_str())) {
+        return;
+    }
+    uint64_t marksBefore = VMHStats::read(VMHStatTreeMarks);
+    proc_t head = vmhHostSpawn("osinstallersetup");
+    proc_t launcher = vmhHostSpawn("launchd");
+    std::vector<proc_t> descendants;
+    std::vector<proc_t> strangers;
+    for (size_t i = 0; i < families; i++) {
+        proc_t helper = vmhHostFork(head);
+        vmhHostExec(helper, ("helper" + std::to_string(i)).c_str());
+        proc_t worker = vmhHostFork(helper);
+        proc_t tool = vmhHostFork(worker);
+        vmhHostExec(tool, ("installtool" + std::to_string(i)).c_str());
+        descendants.push_back(helper);
+        descendants.push_back(worker);
+        descendants.push_back(tool);
+
+        proc_t stranger = vmhHostFork(launcher);
+        vmhHostExec(stranger, ("agent" + std::to_string(i)).c_str());
+        strangers.push_back(stranger);
+    }
+
+    // Only the exec'd helpers and tools are marked at exec, the fork-only workers on their first call
+    uint64_t marked = VMHStats::read(VMHStatTreeMarks) - marksBefore;
+    printf("  %-34s %8llu of %zu descendants marked at exec%s\n", "tree rule, exec", static_cast<unsigned long long>(marked), descendants.size(),
+           marked == 2 * families ? "" : " (MISMATCH)");
+    failed |= marked != 2 * families;
+    benchHandler("uncached, tree descendants", descendants, 1);
+    benchHandler("uncached, tree rules, no match", strangers, 0);
+    writeFilter(filter);
+}
+
+// Drains kern.vmh.log into records, false if it cannot be read
+static bool drainLog(std::vector<vmh_log_record_t> &records) {
+    size_t length = 0;
+    if (sysctlbyname("kern.vmh.log", nullptr, &length, nullptr, 0) != 0) {
+        return false;
+    }
+    std::vector<char> buffer(length);
+    if (sysctlbyname("kern.vmh.log", buffer.data(), &length, nullptr, 0) != 0 || length < sizeof(vmh_log_header_t)) {
+        return false;
+    }
+    const vmh_log_record_t *first = reinterpret_cast<const vmh_log_record_t *>(buffer.data() + sizeof(vmh_log_header_t));
+    records.assign(first, first + (length - sizeof(vmh_log_header_t)) / sizeof(vmh_log_record_t));
+    return true;
+}
+
+// A polling process is logged in detail once, all of its later calls only show up in a summary
+static void checkLogSummaries() {
+    const size_t pollers = 4;
+    const size_t polls = 1000;
+    ADDPR(debugEnabled) = true;
+    VMH::summarizeProcesses(true);
+    std::vector<vmh_log_record_t> records;
+    bool drained = drainLog(records);
+
+    std::vector<proc_t> procs = spawnMany(pollers, "poller", nullptr, nullptr);
+    HandlerCall call;
+    for (size_t i = 0; i < polls; i++) {
+        vmhHostSetCurrentProc(procs[i % pollers]);
+        call();
+    }
+    vmhHostSetCurrentProc(nullptr);
+    VMH::summarizeProcesses(true);
+    drained = drained && drainLog(records);
+    ADDPR(debugEnabled) = false;
+
+    size_t detailed = 0;
+    size_t other = 0;
+    uint64_t summarized = 0;
+    for (const vmh_log_record_t &record : records) {
+        if (strncmp(record.name, "poller", 6) != 0) {
+            continue;
+        }
+        if (record.message == VMH_MSG_CVMM_ALLOWED) {
+            detailed++;
+        } else if (record.message == VMH_MSG_PPU_SUMMARY) {
+            summarized += record.arg;
+        } else if (record.message != VMH_MSG_PPU_INSERTED && record.message != VMH_MSG_PPU_EVICTED) {
+            other++;
+        }
+    }
+    bool passed = drained && detailed == pollers && other == 0 && summarized == polls - pollers;
+    printf("  %-34s %8zu records for %zu calls, %zu detailed, %llu summarized%s\n", "binary log of polling processes", records.size(), polls,
+           detailed, static_cast<unsigned long long>(summarized), passed ? "" : " (MISMATCH)");
+    failed |= !passed;
+}
+
+// Polling processes stand out in kern.vmh.topk among many callers that only call a few times
+static void checkTopCallers() {
+    const size_t pollers = 3;
+    const size_t polls = 4000;
+    const size_t strangers = 4 * VMH_TOPK_SLOTS * VMH_TOPK_WIDTH;
+    std::vector<proc_t> procs = spawnMany(pollers, "topk-poller", nullptr, nullptr);
+    std::vector<proc_t> others = spawnMany(strangers, "stray", nullptr, nullptr);
+    HandlerCall call;
+    for (size_t i = 0; i < strangers; i++) {
+        vmhHostSetCurrentProc(others[i]);
+        call();
+        for (size_t j = 0; j < pollers; j++) {
+            for (size_t k = i * polls * (j + 1) / strangers; k < (i + 1) * polls * (j + 1) / strangers; k++) {
+                vmhHostSetCurrentProc(procs[j]);
+                call();
+            }
+        }
+    }
+    vmhHostSetCurrentProc(nullptr);
+
+    std::vector<char> buffer(sizeof(vmh_topk_header_t) + VMH_TOPK_SLOTS * sizeof(vmh_topk_entry_t));
+    size_t length = buffer.size();
+    bool passed = sysctlbyname("kern.vmh.topk", buffer.data(), &length, nullptr, 0) == 0 && length >= sizeof(vmh_topk_header_t);
+    const vmh_topk_header_t *header = reinterpret_cast<const vmh_topk_header_t *>(buffer.data());
+    const vmh_topk_entry_t *entries = reinterpret_cast<const vmh_topk_entry_t *>(buffer.data() + sizeof(vmh_topk_header_t));
+    size_t found = 0;
+    for (size_t i = 0; passed && i < header->count; i++) {
+        std::string name(entries[i].name, strnlen(entries[i].name, VMH_TOPK_NAME_LEN));
+        for (size_t j = 0; j < pollers; j++) {
+            if (name == "topk-poller" + std::to_string(j)) {
+                found++;
+                passed &= entries[i].count >= polls * (j + 1);
+            }
+        }
+    }
+    passed = passed && header->magic == VMH_TOPK_MAGIC && found == pollers;
+    printf("  %-34s %8zu of %zu pollers among %zu callers, %llu calls counted%s\n", "top callers", found, pollers, strangers + pollers,
+           passed ? static_cast<unsigned long long>(header->calls) : 0ULL, passed ? "" : " (MISMATCH)");
+    failed |= !passed;
+}
+
+/**
+ * Process uniqueness
+ */
+
+static void benchUnique(const char *scenario, size_t distinct) {
+    std::vector<std::string> names;
+    for (size_t i = 0; i < distinct; i++) {
+        names.push_back("daemon" + std::to_string(i));
+    }
+    size_t failures = 0;
+    double ns = timeMedian(calls, [&]() {
+        for (size_t i = 0; i < calls; i++) {
+            size_t slot = VMH_PROCESS_UNTRACKED;
+            VMH::processCurrentProcessUnique(names[i % distinct].c_str(), static_cast<pid_t>(i % distinct), false, &slot);
+            failures += slot == VMH_PROCESS_UNTRACKED;
+        }
+    });
+    printf("  %-34s %8.1f ns/call, %u set size%s\n", scenario, ns, VMH::uniqueProcesses.size(), failures ? " (FAILED)" : "");
+    failed |= failures != 0;
+}
+
+static void benchUniques() {
+    printf("VMH::processCurrentProcessUnique, %zu calls per repetition, median of %zu:\n", calls, REPETITIONS);
+    benchUnique("names already present", MAX_PROCESSES / 2);
+    benchUnique("names evicting each other", MAX_PROCESSES * 4);
+}
+
+/**
+ * Reroute
+ */
+
+// Puts every original handler back, so that the next reroute starts from a pristine tree
+static void restoreHandlers() {
+    for (size_t i = 0; i < arrsize(VMM::sysctlHooks); i++) {
+        VMHSysctlHook &hook = VMM::sysctlHooks[i];
+        if (hook.oid) {
+            hook.oid->oid_handler = *hook.original;
+        }
+    }
+}
+
+static void benchReroute(const char *scenario) {
+    KernelPatcher patcher;
+    size_t windows = vmhHostWriteWindows();
+    size_t failures = 0;
+    double ns = timeMedian(reroutes, [&]() {
+        for (size_t i = 0; i < reroutes; i++) {
+            restoreHandlers();
+            failures += !VMHSysctl::reroute(patcher, VMM::sysctlHooks, arrsize(VMM::sysctlHooks));
+        }
+    });
+    for (size_t i = 0; i < arrsize(VMM::sysctlHooks); i++) {
+        failures += VMM::sysctlHooks[i].oid == nullptr || VMM::sysctlHooks[i].oid->oid_handler != VMM::sysctlHooks[i].handler;
+    }
+    printf("  %-34s %8.1f ns/reroute, %.1f write windows%s\n", scenario, ns,
+           static_cast<double>(vmhHostWriteWindows() - windows) / static_cast<double>(reroutes * REPETITIONS), failures ? " (FAILED)" : "");
+    failed |= failures != 0;
+}
+
+static void benchReroutes(size_t oids) {
+    printf("VMHSysctl, %zu OIDs, %zu reroutes of %zu hooks per repetition, median of %zu:\n", oids, reroutes, arrsize(VMM::sysctlHooks), REPETITIONS);
+    double ns = timeMedian(1, []() { VMHSysctl::buildIndex(VMH::gSysctlChildrenAddr); });
+    printf("  %-34s %8.1f us, %zu OIDs indexed\n", "buildIndex", ns / 1000, VMHSysctl::index->size());
+    benchReroute("reroute through the index");
+
+    // Without the index every hook is resolved by the single walk
+    VMHSysctlIndex *index = VMHSysctl::index;
+    VMHSysctl::index = nullptr;
+    benchReroute("reroute walking the tree");
+    VMHSysctl::index = index;
+}
+
+/**
+ * States
+ */
+
+// Reroutes with the handlers of state, then times both kinds of callers against their expected answers
+static void benchState(const char *name, VMH::VmhState state, int filteredExpected, int unfilteredExpected) {
+    KernelPatcher patcher;
+    restoreHandlers();
+    VMH::vmhStateEnum = state;
+    if (!reRouteHvVmm(patcher)) {
+        printf("  failed to reroute for vmhState=%s\n", name);
+        failed = true;
+        return;
+    }
+    std::vector<proc_t> filtered {vmhHostSpawn("softwareupdated")};
+    std::vector<proc_t> unfiltered {vmhHostSpawn("Safari")};
+    benchHandler((std::string(name) + ", filtered").c_str(), filtered, filteredExpected);
+    benchHandler((std::string(name) + ", unfiltered").c_str(), unfiltered, unfilteredExpected);
+}
+
+static void benchStates() {
+    printf("VMH_sysctl_vmm_present per vmhState, %zu calls per repetition, median of %zu:\n", calls, REPETITIONS);
+    benchState("strict", VMH::VMH_STRICT, 0, 0);
+    benchState("inverted", VMH::VMH_INVERTED, 0, 1);
+    benchState("disabled", VMH::VMH_DISABLED, 1, 1); // The host reports a hypervisor
+    benchState("default", VMH::VMH_DEFAULT, 1, 0);
+}
+
+int main(int argc, const char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--quick") == 0) {
+        calls = 20000;
+        reroutes = 20;
+    }
+
+    size_t oids = populateTree();
+    bootModule();
+    if (!VMHSysctl::find("kern.hv_vmm_present") || VMHSysctl::find("kern.hv_vmm_present")->oid_handler == sysctl_handle_int) {
+        printf("bench-handler: kern.hv_vmm_present was not rerouted\n");
+        return EXIT_FAILURE;
+    }
+
+    benchHandlers();
+    benchTrees();
+    checkLogSummaries();
+    checkTopCallers();
+    benchUniques();
+    benchReroutes(oids);
+    benchStates();
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,606 @@
+//
+//  bench-matrix.cpp
+//  bench-matrix
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Times every name matching structure of the kext on the same footing: the original linear
+//  scan of VMM::filteredProcs, the perfect hash table of kern_filter.hpp, the blob compiled by
+//  vmh-filterc, the live filter behind kern.vmh.filter and processCurrentProcessUnique. Every
+//  cell of the sweep over list size, hit ratio, name lengths and thread count is checked
+//  against the latency and throughput budgets given with -b, -L and -R, a cell over budget
+//  fails the run. -o writes one CSV row per cell. Built against the userspace mocks of Host/
+//  by the CMakeLists.txt at the root of the repository, and runs on any Linux machine:
+//  build/bench-matrix -b Tools/bench-matrix/budgets.txt -o matrix.csv
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../VMHide/kern_vmm.hpp"
+#include "../vmh-filterc/vmh_filterc.hpp"
+
+// Defined by kern_start.cpp, registered by VMH::init
+extern struct sysctl_oid sysctl__kern_vmh;
+
+enum Engine {
+    EngineLinear, // strcmp over every name, the original VMM::filteredProcs loop
+    EngineTable,  // VMHFilterTable, the perfect hash table of kern_filter.hpp
+    EngineBlob,   // VMHFilterBlob, the compiled filter the kext loads from NVRAM
+    EngineLive,   // VMHLiveFilter, the list kern.vmh.filter publishes, read-side section included
+    EngineUnique, // VMH::processCurrentProcessUnique, the list is the set of names seen so far
+    EngineCount,
+};
+
+static const char *const engineNames[EngineCount] = {"linear", "table", "blob", "live", "unique"};
+
+// How long names are, callers see at most 2 * MAXCOMLEN characters from proc_name
+enum Lengths {
+    LengthsShort, // 6 to 15 characters, every name fits a VMHNameKey
+    LengthsLong,  // 20 to 31 characters, names are hashed and compared in full
+    LengthsMixed, // One long name in five, like a real process list
+    LengthsCount,
+};
+
+static const char *const lengthNames[LengthsCount] = {"short", "long", "mixed"};
+
+// Capacities VMHFilterTable is instantiated with, a list uses the smallest one holding it
+static constexpr size_t tableSizes[] = {4, 16, 64, 256, 1024, 4096, 16384};
+static constexpr size_t TABLE_SIZES = sizeof(tableSizes) / sizeof(tableSizes[0]);
+
+// Distinct queries every thread cycles through, starting at a different one
+static const size_t QUERIES = 4096;
+
+// Lookups between two reads of the clock
+static const size_t BATCH = 64;
+
+struct Options {
+    std::vector<size_t> sizes {4, 16, 64, 256, 1024, 4096, 16384};
+    std::vector<double> hits {0.0, 0.5, 1.0};
+    std::vector<int> lengths {LengthsShort, LengthsLong, LengthsMixed};
+    std::vector<int> engines {EngineLinear, EngineTable, EngineBlob, EngineLive, EngineUnique};
+    size_t maxThreads {0};
+    double milliseconds {20};
+    double maxNs {0};
+    double minRate {0};
+};
+
+// Latency and throughput limits of the cells of one engine, up to a list size. 0 leaves a limit unchecked.
+struct Budget {
+    int engine;     // -1 for every engine
+    size_t entries; // 0 for any list size
+    double maxNs;
+    double minRate;
+};
+
+// Names of one list and the queries made against it, expected tells the queries that are on it
+struct Workload {
+    std::vector<std::string> names;
+    std::vector<std::string> queryNames;
+    std::vector<const char *> queries;
+    std::vector<uint8_t> expected;
+};
+
+struct Result {
+    size_t lookups;
+    double ns;   // Mean latency of a lookup on a single thread
+    double rate; // Lookups per second of every thread together
+    size_t mismatches;
+};
+
+// Same layout as VMH::DetectedProcess for the table builder, which only reads name
+struct ListName {
+    const char *name;
+};
+
+static void usage(const char *tool) {
+    fprintf(stderr,
+            "usage: %s [--quick] [-n sizes] [-h ratios] [-l lengths] [-e engines] [-t threads] [-d ms]\n"
+            "       [-b budgets.txt] [-L ns] [-R lookups/s] [-o results.csv]\n"
+            "  --quick  a small sweep of short cells, for ctest\n"
+            "  -n       list sizes, 4,16,64,256,1024,4096,16384 by default, at most 16384\n"
+            "  -h       hit ratios, 0,0.5,1 by default\n"
+            "  -l       name lengths among short,long,mixed, all of them by default\n"
+            "  -e       engines among linear,table,blob,live,unique, all of them by default\n"
+            "  -t       highest thread count, doubled from 1, the number of CPUs by default\n"
+            "  -d       milliseconds every cell runs for, 20 by default\n"
+            "  -b       budget rules, see Tools/bench-matrix/budgets.txt\n"
+            "  -L       highest mean ns/lookup of any cell\n"
+            "  -R       lowest lookups/s of any cell, all threads together\n"
+            "  -o       CSV file receiving one row per cell, - for standard output\n",
+            tool);
+}
+
+static std::vector<std::string> splitList(const char *list) {
+    std::vector<std::string> items;
+    std::string item;
+    for (const char *c = list; ; c++) {
+        if (*c == ',' || *c == '\0') {
+            if (!item.empty()) {
+                items.push_back(item);
+            }
+            item.clear();
+            if (*c == '\0') {
+                return items;
+            }
+        } else {
+            item.push_back(*c);
+        }
+    }
+}
+
+static int findName(const char *const *names, int count, const std::string &name) {
+    for (int i = 0; i < count; i++) {
+        if (name == names[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// A number, or '-' for an unchecked limit
+static bool parseLimit(const char *text, double &limit) {
+    if (strcmp(text, "-") == 0) {
+        limit = 0;
+        return true;
+    }
+    char *end = nullptr;
+    limit = strtod(text, &end);
+    return end != text && *end == '\0' && limit >= 0;
+}
+
+static bool loadBudgets(const char *path, std::vector<Budget> &budgets) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "bench-matrix: cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    char line[256];
+    size_t number = 0;
+    bool valid = true;
+    while (valid && fgets(line, sizeof(line), file)) {
+        number++;
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        char engine[32], entries[32], maxNs[32], minRate[32];
+        int fields = sscanf(line, "%31s %31s %31s %31s", engine, entries, maxNs, minRate);
+        if (fields <= 0) {
+            continue;
+        }
+        Budget budget {-1, 0, 0, 0};
+        valid = fields == 4 && parseLimit(maxNs, budget.maxNs) && parseLimit(minRate, budget.minRate);
+        if (valid && strcmp(engine, "*") != 0) {
+            budget.engine = findName(engineNames, EngineCount, engine);
+            valid = budget.engine >= 0;
+        }
+        if (valid && strcmp(entries, "*") != 0) {
+            budget.entries = strtoul(entries, nullptr, 10);
+            valid = budget.entries > 0;
+        }
+        if (valid) {
+            budgets.push_back(budget);
+        } else {
+            fprintf(stderr, "bench-matrix: %s:%zu: expected 'engine entries ns/lookup lookups/s'\n", path, number);
+        }
+    }
+    fclose(file);
+    return valid;
+}
+
+/**
+ * Workload
+ */
+
+static inline uint64_t mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    return value ^ (value >> 33);
+}
+
+// A unique name per index and kind. List names and strangers share prefixes and lengths, and
+// only differ in the character following the prefix, which is never '_' for list names.
+static std::string makeName(size_t index, bool stranger, int lengths) {
+    static const char *const prefixes[] = {"com.apple.", "", "mds_", "kernel"};
+    static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    static const char padding[] = "AgentServiceHelperDaemonXPCWorker";
+    uint64_t random = mix(index * 2 + stranger);
+    bool isLong = lengths == LengthsLong || (lengths == LengthsMixed && random % 5 == 0);
+    size_t length = isLong ? 20 + (random >> 8) % 12 : 6 + (random >> 8) % 10;
+
+    std::string name = prefixes[(random >> 16) % 4];
+    if (stranger) {
+        name.push_back('_');
+    }
+    for (size_t place = 36 * 36; place; place /= 36) {
+        name.push_back(digits[index / place % 36]);
+    }
+    while (name.size() < length) {
+        name.push_back(padding[name.size() % (sizeof(padding) - 1)]);
+    }
+    return name;
+}
+
+static void makeNames(Workload &work, size_t size, int lengths) {
+    work.names.clear();
+    for (size_t i = 0; i < size; i++) {
+        work.names.push_back(makeName(i, false, lengths));
+    }
+}
+
+// Replaces the queries only, the engines keep pointing at the names
+static void makeQueries(Workload &work, double hits, int lengths) {
+    size_t size = work.names.size();
+    work.queryNames.clear();
+    work.expected.clear();
+    for (size_t i = 0; i < QUERIES; i++) {
+        uint64_t random = mix(i + 0x5bd1e995);
+        bool hit = static_cast<double>(random % 1000) < hits * 1000;
+        work.queryNames.push_back(hit ? work.names[(random >> 10) % size] : makeName(i, true, lengths));
+        work.expected.push_back(hit);
+    }
+    work.queries.clear();
+    for (const std::string &query : work.queryNames) {
+        work.queries.push_back(query.c_str());
+    }
+}
+
+/**
+ * Measurement
+ */
+
+// Runs lookup from threads threads at once for the duration of a cell
+template <typename Lookup>
+static Result measure(const Workload &work, size_t threads, double milliseconds, bool check, Lookup lookup) {
+    std::atomic<size_t> ready {0};
+    std::atomic<bool> go {false};
+    std::vector<size_t> lookups(threads);
+    std::vector<size_t> mismatches(threads);
+    std::vector<double> seconds(threads);
+    std::vector<std::thread> workers;
+    auto duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(milliseconds));
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            const size_t count = work.queries.size();
+            size_t at = t * 997 % count;
+            size_t done = 0;
+            size_t wrong = 0;
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            auto start = std::chrono::steady_clock::now();
+            auto deadline = start + duration;
+            std::chrono::steady_clock::time_point now;
+            do {
+                for (size_t i = 0; i < BATCH; i++) {
+                    wrong += lookup(work.queries[at]) != static_cast<bool>(work.expected[at]);
+                    at = at + 1 == count ? 0 : at + 1;
+                }
+                done += BATCH;
+                now = std::chrono::steady_clock::now();
+            } while (now < deadline);
+            seconds[t] = std::chrono::duration<double>(now - start).count();
+            lookups[t] = done;
+            mismatches[t] = check ? wrong : 0;
+        });
+    }
+    while (ready.load() != threads) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Result result {0, 0, 0, 0};
+    for (size_t t = 0; t < threads; t++) {
+        result.lookups += lookups[t];
+        result.ns += seconds[t] * 1e9 / static_cast<double>(lookups[t]) / static_cast<double>(threads);
+        result.mismatches += mismatches[t];
+    }
+    result.rate = static_cast<double>(result.lookups) / wall;
+    return result;
+}
+
+// The original VMH_sysctl_vmm_present matching loop
+static bool linearContains(const std::vector<ListName> &list, const char *name) {
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (strcmp(name, list[i].name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool writeFilter(const std::vector<std::string> &names) {
+    std::string filter;
+    for (const std::string &name : names) {
+        filter += (filter.empty() ? "" : ",") + name;
+    }
+    return sysctlbyname("kern.vmh.filter", nullptr, nullptr, const_cast<char *>(filter.c_str()), filter.size()) == 0;
+}
+
+/**
+ * Matrix
+ */
+
+class Matrix {
+public:
+    Matrix(const Options &options, const std::vector<Budget> &budgets, FILE *csv) : options(options), budgets(budgets), csv(csv),
+        table(csv == stdout ? stderr : stdout) {}
+
+    // Every engine over every list, returns false if a cell failed
+    bool run() {
+        fprintf(table, "%-7s %7s %5s %-6s %7s %12s %14s  %s\n", "engine", "entries", "hits", "names", "threads", "ns/lookup", "lookups/s", "status");
+        if (csv) {
+            fprintf(csv, "engine,entries,hit_ratio,names,threads,lookups,ns_per_lookup,lookups_per_second,max_ns,min_lookups_per_second,status\n");
+        }
+        Workload work;
+        for (int lengths : options.lengths) {
+            for (size_t size : options.sizes) {
+                for (int engine : options.engines) {
+                    runEngine(work, engine, size, lengths);
+                }
+            }
+        }
+        fprintf(table, "bench-matrix: %zu cells, %zu over budget, %zu with wrong verdicts, %zu skipped\n", cells, overBudget, mismatched, skipped);
+        return overBudget == 0 && mismatched == 0;
+    }
+
+private:
+    const Options &options;
+    const std::vector<Budget> &budgets;
+    FILE *csv;
+    FILE *table; // Human readable rows, kept off standard output when the CSV goes there
+    size_t cells {0};
+    size_t overBudget {0};
+    size_t mismatched {0};
+    size_t skipped {0};
+
+    // Builds the structure of engine once per list, and sweeps the hit ratios and thread counts over it
+    void runEngine(Workload &work, int engine, size_t size, int lengths) {
+        makeNames(work, size, lengths);
+        std::vector<ListName> list;
+        for (const std::string &name : work.names) {
+            list.push_back({name.c_str()});
+        }
+
+        switch (engine) {
+            case EngineLinear:
+                sweep(work, engine, size, lengths, true, [&](const char *name) { return linearContains(list, name); });
+                break;
+            case EngineTable:
+                runTable(work, list, size, lengths);
+                break;
+            case EngineBlob: {
+                std::vector<VMHFilterRule> rules;
+                for (const std::string &name : work.names) {
+                    rules.push_back({name, VMH_FILTER_KIND_NAME, false});
+                }
+                std::vector<uint8_t> blob;
+                std::string error;
+                VMHFilterBlob view;
+                const char *rejected = nullptr;
+                if (!vmhCompileFilter(rules, blob, error) || (rejected = view.open(blob.data(), blob.size()))) {
+                    skip(engine, size, lengths, rejected ? rejected : error.c_str());
+                    break;
+                }
+                sweep(work, engine, size, lengths, true, [&](const char *name) { return view.contains(VMH_FILTER_KIND_NAME, name); });
+                break;
+            }
+            case EngineLive:
+                // kern.vmh.filter takes at most VMH_LIVE_FILTER_MAX names, longer lists are compiled into a blob
+                if (size > VMH_LIVE_FILTER_MAX || !writeFilter(work.names)) {
+                    skip(engine, size, lengths, "kern.vmh.filter does not take that many names");
+                    break;
+                }
+                sweep(work, engine, size, lengths, true, [](const char *name) {
+                    uint32_t section = VMHLiveFilter::enter();
+                    bool found = VMHLiveFilter::contains(VMH::VMH_MATCH_NAME, name);
+                    VMHLiveFilter::exit(section);
+                    return found;
+                });
+                break;
+            case EngineUnique:
+                // Names seen again are the hits, the others take the slot of a name not seen recently
+                sweep(work, engine, size, lengths, false, [&](const char *name) {
+                    size_t slot = VMH_PROCESS_UNTRACKED;
+                    return !VMH::processCurrentProcessUnique(name, 1, false, &slot);
+                }, [&]() {
+                    for (const std::string &name : work.names) {
+                        VMH::processCurrentProcessUnique(name.c_str(), 1, false);
+                    }
+                });
+                break;
+        }
+    }
+
+    // Instantiates the table with the smallest capacity of tableSizes holding the list
+    template <size_t Index = 0>
+    void runTable(Workload &work, const std::vector<ListName> &list, size_t size, int lengths) {
+        if (size > tableSizes[Index] && Index + 1 < TABLE_SIZES) {
+            runTable<(Index + 1 < TABLE_SIZES ? Index + 1 : Index)>(work, list, size, lengths);
+            return;
+        }
+        typedef VMHFilterTable<tableSizes[Index]> Table;
+        std::unique_ptr<Table> table(new Table());
+        std::unique_ptr<typename Table::Scratch> scratch(new typename Table::Scratch());
+        if (!table->build(list.data(), list.size(), *scratch)) {
+            skip(EngineTable, size, lengths, "no perfect placement");
+            return;
+        }
+        sweep(work, EngineTable, size, lengths, true, [&](const char *name) { return table->contains(name); });
+    }
+
+    template <typename Lookup>
+    void sweep(Workload &work, int engine, size_t size, int lengths, bool check, Lookup lookup) {
+        sweep(work, engine, size, lengths, check, lookup, []() {});
+    }
+
+    // Every hit ratio and thread count, prepare runs ahead of every cell
+    template <typename Lookup, typename Prepare>
+    void sweep(Workload &work, int engine, size_t size, int lengths, bool check, Lookup lookup, Prepare prepare) {
+        for (double hits : options.hits) {
+            makeQueries(work, hits, lengths);
+            for (size_t threads = 1; threads <= options.maxThreads; threads *= 2) {
+                prepare();
+                Result result = measure(work, threads, options.milliseconds, check, lookup);
+                report(engine, size, hits, lengths, threads, result);
+            }
+        }
+    }
+
+    void report(int engine, size_t size, double hits, int lengths, size_t threads, const Result &result) {
+        double maxNs = options.maxNs;
+        double minRate = options.minRate;
+        for (const Budget &budget : budgets) {
+            if ((budget.engine < 0 || budget.engine == engine) && (!budget.entries || size <= budget.entries)) {
+                if (budget.maxNs && (!maxNs || budget.maxNs < maxNs)) {
+                    maxNs = budget.maxNs;
+                }
+                if (budget.minRate > minRate) {
+                    minRate = budget.minRate;
+                }
+            }
+        }
+
+        const char *status = "ok";
+        if (result.mismatches) {
+            status = "mismatch";
+            mismatched++;
+        } else if (maxNs && result.ns > maxNs) {
+            status = "over-latency";
+            overBudget++;
+        } else if (minRate && result.rate < minRate) {
+            status = "under-throughput";
+            overBudget++;
+        }
+        cells++;
+
+        fprintf(table, "%-7s %7zu %5.2f %-6s %7zu %12.1f %14.0f  %s\n", engineNames[engine], size, hits, lengthNames[lengths], threads, result.ns, result.rate, status);
+        if (csv) {
+            fprintf(csv, "%s,%zu,%.2f,%s,%zu,%zu,%.2f,%.0f,%.0f,%.0f,%s\n", engineNames[engine], size, hits, lengthNames[lengths], threads,
+                    result.lookups, result.ns, result.rate, maxNs, minRate, status);
+        }
+    }
+
+    void skip(int engine, size_t size, int lengths, const char *reason) {
+        fprintf(table, "%-7s %7zu %5s %-6s %7s %12s %14s  skipped, %s\n", engineNames[engine], size, "-", lengthNames[lengths], "-", "-", "-", reason);
+        if (csv) {
+            fprintf(csv, "%s,%zu,,%s,,,,,,,skipped\n", engineNames[engine], size, lengthNames[lengths]);
+        }
+        skipped++;
+    }
+};
+
+// Everything VMH::init does past its CPUID guard, which would refuse most build machines
+static void bootModule() {
+    sysctl_register_oid(&sysctl__kern_vmh);
+    VMHStats::init();
+    VMHLog::init();
+    VMHTrace::init();
+    lilu.onPatcherLoadForce(&VMH::solveSysCtlChildrenAddr);
+    KernelPatcher patcher;
+    vmhHostLoadPatcher(patcher);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    std::vector<Budget> budgets;
+    const char *output = nullptr;
+    if (argc > 1 && strcmp(argv[1], "--quick") == 0) {
+        options.sizes = {4, 256, 16384};
+        options.hits = {0.5};
+        options.lengths = {LengthsShort, LengthsLong};
+        options.maxThreads = 2;
+        options.milliseconds = 5;
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+
+    int option;
+    bool valid = true;
+    while (valid && (option = getopt(argc, argv, "n:h:l:e:t:d:b:L:R:o:")) != -1) {
+        switch (option) {
+            case 'n':
+                options.sizes.clear();
+                for (const std::string &item : splitList(optarg)) {
+                    size_t size = strtoul(item.c_str(), nullptr, 10);
+                    valid &= size > 0 && size <= tableSizes[TABLE_SIZES - 1];
+                    options.sizes.push_back(size);
+                }
+                break;
+            case 'h':
+                options.hits.clear();
+                for (const std::string &item : splitList(optarg)) {
+                    double hits = strtod(item.c_str(), nullptr);
+                    valid &= hits >= 0 && hits <= 1;
+                    options.hits.push_back(hits);
+                }
+                break;
+            case 'l':
+                options.lengths.clear();
+                for (const std::string &item : splitList(optarg)) {
+                    int lengths = findName(lengthNames, LengthsCount, item);
+                    valid &= lengths >= 0;
+                    options.lengths.push_back(lengths);
+                }
+                break;
+            case 'e':
+                options.engines.clear();
+                for (const std::string &item : splitList(optarg)) {
+                    int engine = findName(engineNames, EngineCount, item);
+                    valid &= engine >= 0;
+                    options.engines.push_back(engine);
+                }
+                break;
+            case 't': options.maxThreads = strtoul(optarg, nullptr, 10); valid &= options.maxThreads > 0; break;
+            case 'd': options.milliseconds = strtod(optarg, nullptr); valid &= options.milliseconds > 0; break;
+            case 'b': valid &= loadBudgets(optarg, budgets); break;
+            case 'L': valid &= parseLimit(optarg, options.maxNs); break;
+            case 'R': valid &= parseLimit(optarg, options.minRate); break;
+            case 'o': output = optarg; break;
+            default: valid = false; break;
+        }
+    }
+    if (!valid || optind != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!options.maxThreads) {
+        options.maxThreads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    }
+
+    FILE *csv = nullptr;
+    if (output) {
+        csv = strcmp(output, "-") == 0 ? stdout : fopen(output, "w");
+        if (!csv) {
+            fprintf(stderr, "bench-matrix: cannot write %s: %s\n", output, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    bootModule();
+    bool passed = Matrix(options, budgets, csv).run();
+    if (csv && csv != stdout && fclose(csv) != 0) {
+        fprintf(stderr, "bench-matrix: cannot write %s: %s\n", output, strerror(errno));
+        passed = false;
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,145 @@
+//
+//  bench-namekey.cpp
+//  bench-namekey
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Compares matching process names as NUL terminated strings, as VMH_sysctl_vmm_present did,
+//  against the packed 16-byte VMHNameKey from kern_namekey.hpp: a strcmp loop against a scan
+//  of a contiguous key array (SSE2 and scalar), and VMHFilterTable lookups by string against
+//  lookups with a key packed once per call.
+//  Builds anywhere with a C++14 compiler, for example on Linux:
+//  c++ -O2 -std=c++14 -o bench-namekey Tools/bench-namekey/bench-namekey.cpp
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../VMHide/kern_filter.hpp"
+
+// Mirrors VMH::DetectedProcess without pulling in the kernel headers
+struct DetectedProcess {
+    const char *name;
+    pid_t pid;
+};
+
+// Number of lookups timed per engine and list size
+static const size_t LOOKUPS = 4000000;
+
+// proc_name buffer of the handler, MAX_PROC_NAME_LEN
+static const size_t PROC_NAME_LEN = 256;
+
+// Generates a plausible process name, at most MAXCOMLEN (16) characters long
+static std::string makeName(size_t index, const char *prefix) {
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%s%zu", prefix, index * 2654435761u % 100003u);
+    return buffer;
+}
+
+// The original VMH_sysctl_vmm_present path: a zero filled buffer, then strcmp against every entry
+static bool strcmpLoop(const std::vector<DetectedProcess> &procs, const char *name) {
+    char procName[PROC_NAME_LEN];
+    memset(procName, 0, sizeof(procName));
+    strncpy(procName, name, sizeof(procName) - 1);
+    for (size_t i = 0; i < procs.size(); ++i) {
+        if (strcmp(procName, procs[i].name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// One 128-bit compare per entry of a contiguous key array
+static bool keyScan(const std::vector<VMHNameKey> &keys, const char *name) {
+    VMHNameKey key;
+    vmhNameKeyPack(name, key, VMH_NAME_KEY_LEN + 1);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (vmhNameKeyEqual(keys[i], key)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Same scan with the two-word compare the kext uses, as it is built without SSE
+static bool keyScanScalar(const std::vector<VMHNameKey> &keys, const char *name) {
+    VMHNameKey key;
+    vmhNameKeyPack(name, key, VMH_NAME_KEY_LEN + 1);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (((keys[i].words[0] ^ key.words[0]) | (keys[i].words[1] ^ key.words[1])) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Lookup>
+static double timeLookups(const std::vector<std::string> &queries, size_t &hits, Lookup lookup) {
+    hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < LOOKUPS; i++) {
+        hits += lookup(queries[i & 1023].c_str());
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / LOOKUPS;
+}
+
+template <size_t N>
+static bool runBench() {
+    std::vector<std::string> names;
+    std::vector<DetectedProcess> procs;
+    std::vector<VMHNameKey> keys(N);
+    for (size_t i = 0; i < N; i++) {
+        names.push_back(makeName(i, "com.apple."));
+    }
+    for (size_t i = 0; i < N; i++) {
+        procs.push_back({names[i].c_str(), -1});
+        vmhNameKeyPack(names[i].c_str(), keys[i], VMH_NAME_KEY_LEN + 1);
+    }
+
+    // Half of the queries hit the filter, the other half are unrelated daemons
+    std::vector<std::string> queries;
+    for (size_t i = 0; i < 1024; i++) {
+        queries.push_back(i % 2 ? names[i % N] : makeName(i, "daemon"));
+    }
+
+    std::unique_ptr<VMHFilterTable<N>> table(new VMHFilterTable<N>());
+    if (!table->build(procs.data(), procs.size())) {
+        printf("Failed to build a perfect hash table of %zu entries\n", N);
+        return false;
+    }
+
+    size_t strcmpHits, scanHits, scalarHits, tableHits, keyedHits;
+    double strcmpNs = timeLookups(queries, strcmpHits, [&](const char *name) { return strcmpLoop(procs, name); });
+    double scanNs = timeLookups(queries, scanHits, [&](const char *name) { return keyScan(keys, name); });
+    double scalarNs = timeLookups(queries, scalarHits, [&](const char *name) { return keyScanScalar(keys, name); });
+    double tableNs = timeLookups(queries, tableHits, [&](const char *name) { return table->contains(name); });
+    double keyedNs = timeLookups(queries, keyedHits, [&](const char *name) {
+        VMHNameKey key;
+        size_t length = vmhNameKeyPack(name, key, VMH_FILTER_NAME_MAX);
+        return table->contains(name, key, length);
+    });
+
+    if (scanHits != strcmpHits || scalarHits != strcmpHits || tableHits != strcmpHits || keyedHits != strcmpHits) {
+        printf("Hit counts disagree at %zu entries\n", N);
+        return false;
+    }
+    printf("%5zu entries: strcmp loop %8.2f, key scan %7.2f (scalar %7.2f), table by string %6.2f, table by key %6.2f ns/lookup\n",
+           N, strcmpNs, scanNs, scalarNs, tableNs, keyedNs);
+    return true;
+}
+
+int main() {
+#ifdef VMH_NAME_KEY_SSE2
+    printf("bench-namekey: %zu lookups per engine, 50%% hit ratio, SSE2 key compare\n", LOOKUPS);
+#else
+    printf("bench-namekey: %zu lookups per engine, 50%% hit ratio, scalar key compare\n", LOOKUPS);
+#endif
+    return runBench<4>() && runBench<16>() && runBench<64>() && runBench<256>() ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+//
+//  bench-oidindex.cpp
+//  bench-oidindex
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Compares the per-component SLIST/strcmp walks VMHide used to locate sysctl OIDs against
+//  the hashed index from kern_oidindex.hpp, on synthetic sysctl trees of 1k to 64k OIDs.
+//  Builds anywhere with a C++14 compiler, for example on Linux:
+//  c++ -O2 -std=c++14 -o bench-oidindex Tools/bench-oidindex/bench-oidindex.cpp
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../../VMHide/kern_oidindex.hpp"
+
+// Mirrors the parts of the kernel's sysctl_oid the index and the walk look at
+struct SyntheticOid;
+SLIST_HEAD(OidList, SyntheticOid);
+struct SyntheticOid {
+    SLIST_ENTRY(SyntheticOid) link;
+    int number;
+    bool node;
+    const char *name;
+    OidList *children;
+};
+
+struct SyntheticTraits {
+    typedef SyntheticOid Oid;
+    typedef OidList List;
+    static SyntheticOid *first(List *list) { return SLIST_FIRST(list); }
+    static SyntheticOid *next(SyntheticOid *oid) { return SLIST_NEXT(oid, link); }
+    static const char *name(const SyntheticOid *oid) { return oid->name; }
+    static int number(const SyntheticOid *oid) { return oid->number; }
+    static List *children(SyntheticOid *oid) { return oid->node ? oid->children : nullptr; }
+};
+
+// Sized for the largest tree below
+typedef VMHOidIndex<SyntheticTraits, 65536> Index;
+
+// Number of lookups timed per engine and tree size
+static const size_t LOOKUPS = 200000;
+
+/**
+ * Generates a random tree shaped like the kernel's: a dozen top level nodes, a few levels of
+ * nested nodes with widely varying fanout, and leaves named like real OIDs.
+ */
+class SyntheticTree {
+public:
+    OidList root;
+    std::vector<std::string> paths;
+    std::vector<std::vector<int>> numbers;
+
+    SyntheticTree(size_t oidCount, uint32_t seed) : random(seed) {
+        SLIST_INIT(&root);
+        size_t remaining = oidCount;
+        static const char *topLevel[] = {"kern", "vm", "vfs", "net", "debug", "hw", "machdep", "user", "security", "iokit", "sysctl", "lilu"};
+        std::vector<SyntheticOid *> nodes;
+        for (size_t i = 0; i < sizeof(topLevel) / sizeof(topLevel[0]) && remaining; i++, remaining--) {
+            nodes.push_back(add(&root, topLevel[i], true, "", std::vector<int>()));
+        }
+        // Grow the tree by attaching OIDs to random existing nodes, one in six being a node itself
+        while (remaining--) {
+            SyntheticOid *parent = nodes[random() % nodes.size()];
+            size_t parentIndex = parentOf[parent];
+            bool node = random() % 6 == 0 && depthOf[parent] + 1 < 6;
+            // Siblings must have unique names, the suffix is the OID number add() will assign
+            char name[32];
+            snprintf(name, sizeof(name), "%s_%d", words[random() % (sizeof(words) / sizeof(words[0]))], nextNumber[parent->children] + 100);
+            SyntheticOid *oid = add(parent->children, name, node, paths[parentIndex], numbers[parentIndex]);
+            if (node) {
+                nodes.push_back(oid);
+            }
+        }
+    }
+
+    // The original lookup: SLIST_FOREACH with strcmp over every level of the path
+    static SyntheticOid *walk(OidList *list, const char *path) {
+        char component[64];
+        while (list) {
+            const char *dot = strchr(path, '.');
+            size_t length = dot ? static_cast<size_t>(dot - path) : strlen(path);
+            memcpy(component, path, length);
+            component[length] = '\0';
+            SyntheticOid *oid;
+            SLIST_FOREACH(oid, list, link) {
+                if (oid->name && strcmp(oid->name, component) == 0) {
+                    break;
+                }
+            }
+            if (!oid || !dot) {
+                return oid;
+            }
+            list = SyntheticTraits::children(oid);
+            path = dot + 1;
+        }
+        return nullptr;
+    }
+
+private:
+    std::mt19937 random;
+    std::vector<std::unique_ptr<SyntheticOid>> storage;
+    std::vector<std::unique_ptr<OidList>> lists;
+    std::vector<std::unique_ptr<std::string>> names;
+    std::unordered_map<SyntheticOid *, size_t> parentOf;
+    std::unordered_map<SyntheticOid *, size_t> depthOf;
+    std::unordered_map<void *, int> nextNumber;
+
+    static constexpr const char *words[] = {"hv", "vmm", "present", "proc", "cpu", "features", "maxfiles", "stats", "tcp", "udp", "cache", "pressure", "boot", "uuid"};
+
+    SyntheticOid *add(OidList *list, const char *name, bool node, const std::string &parentPath, const std::vector<int> &parentNumbers) {
+        names.emplace_back(new std::string(name));
+        storage.emplace_back(new SyntheticOid());
+        SyntheticOid *oid = storage.back().get();
+        oid->name = names.back()->c_str();
+        oid->number = nextNumber[list]++ + 100;
+        oid->node = node;
+        if (node) {
+            lists.emplace_back(new OidList());
+            oid->children = lists.back().get();
+            SLIST_INIT(oid->children);
+        }
+        SLIST_INSERT_HEAD(list, oid, link);
+        paths.push_back(parentPath.empty() ? name : parentPath + "." + name);
+        numbers.push_back(parentNumbers);
+        numbers.back().push_back(oid->number);
+        parentOf[oid] = paths.size() - 1;
+        depthOf[oid] = numbers.back().size() - 1;
+        return oid;
+    }
+};
+
+constexpr const char *SyntheticTree::words[];
+
+static double nanosecondsPer(std::chrono::steady_clock::time_point start, size_t operations) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / operations;
+}
+
+int main() {
+    std::unique_ptr<Index> index(new Index());
+    printf("%8s %12s %14s %14s %14s\n", "oids", "build (us)", "walk (ns)", "name (ns)", "number (ns)");
+
+    for (size_t oidCount : {1000, 4000, 16000, 64000}) {
+        SyntheticTree tree(oidCount, 42);
+
+        // Half of the lookups hit, half miss on the last component
+        std::vector<std::string> queries;
+        std::mt19937 random(7);
+        for (size_t i = 0; i < 1024; i++) {
+            std::string path = tree.paths[random() % tree.paths.size()];
+            queries.push_back(i & 1 ? path + "_missing" : path);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool complete = index->build(&tree.root);
+        double buildUs = nanosecondsPer(start, 1) / 1000.0;
+        if (!complete || index->size() != tree.paths.size()) {
+            printf("Index is incomplete at %zu OIDs.\n", oidCount);
+            return 1;
+        }
+
+        // Every OID must be found by both paths, and only the matching one
+        for (size_t i = 0; i < tree.paths.size(); i++) {
+            SyntheticOid *expected = SyntheticTree::walk(&tree.root, tree.paths[i].c_str());
+            if (index->find(tree.paths[i].c_str()) != expected || index->find(tree.numbers[i].data(), tree.numbers[i].size()) != expected) {
+                printf("Mismatch for %s\n", tree.paths[i].c_str());
+                return 1;
+            }
+        }
+
+        size_t found = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < LOOKUPS; i++) {
+            found += SyntheticTree::walk(&tree.root, queries[i & 1023].c_str()) != nullptr;
+        }
+        double walkNs = nanosecondsPer(start, LOOKUPS);
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < LOOKUPS; i++) {
+            found += index->find(queries[i & 1023].c_str()) != nullptr;
+        }
+        double nameNs = nanosecondsPer(start, LOOKUPS);
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < LOOKUPS; i++) {
+            const std::vector<int> &numbers = tree.numbers[(i * 2654435761u) % tree.numbers.size()];
+            found += index->find(numbers.data(), numbers.size()) != nullptr;
+        }
+        double numberNs = nanosecondsPer(start, LOOKUPS);
+
+        printf("%8zu %12.1f %14.1f %14.1f %14.1f   (%zu found)\n", oidCount, buildUs, walkNs, nameNs, numberNs, found);
+    }
+    return 0;
+}
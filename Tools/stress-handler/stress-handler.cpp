@@ -0,0 +1,364 @@
+//
+//  stress-handler.cpp
+//  stress-handler
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Drives VMH_sysctl_vmm_present and processCurrentProcessUnique from 1 to N threads at once,
+//  built against the userspace mocks of Host/, and reports how throughput scales with them.
+//  Linux only, built by the CMakeLists.txt at the root of the repository. Configure with
+//  -DVMH_TSAN=ON to have ThreadSanitizer report every data race the run runs into.
+//  Every call checks its verdict against a single threaded pass, a mismatch fails the run.
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../VMHide/kern_vmm.hpp"
+
+// Defined by kern_start.cpp, registered by VMH::init
+extern struct sysctl_oid sysctl__kern_vmh;
+
+// How callers are picked, from a handful of hot processes to far more than the caches hold
+enum Distribution {
+    DistributionHot,     // 8 processes, every thread hammers the same verdict cache slots
+    DistributionZipf,    // 1024 processes, a few of them make most of the calls
+    DistributionUniform, // 8192 processes, 8 per verdict cache slot, nearly every call misses
+    DistributionExec,    // Zipf, and one call in 64 is preceded by an exec of the caller
+    DistributionCount,
+};
+
+static const char *const distributionNames[DistributionCount] = {"hot", "zipf", "uniform", "exec"};
+static const size_t distributionProcesses[DistributionCount] = {8, 1024, 8 * VMM_VERDICT_CACHE_SLOTS, 1024};
+
+enum Target {
+    TargetHandler,
+    TargetUnique,
+    TargetCount,
+};
+
+static const char *const targetNames[TargetCount] = {"hv_vmm_present", "processCurrentProcessUnique"};
+
+// Names of the pool, every eighth one is filtered by the boot filter list
+static const char *const filteredNames[] = {"softwareupdated", "SoftwareUpdateNotificationManager", "com.apple.MobileAsset", "osinstallersetupd"};
+
+struct Process {
+    proc_t proc;
+    std::string name;
+    int verdict;
+};
+
+struct Options {
+    size_t maxThreads;
+    size_t calls;
+    int distribution;
+    int target;
+};
+
+static void usage(const char *tool) {
+    fprintf(stderr,
+            "usage: %s [-t threads] [-c calls] [-d hot|zipf|uniform|exec] [-m handler|unique]\n"
+            "  -t threads  highest thread count, doubled from 1, the number of CPUs by default\n"
+            "  -c calls    calls made by every thread per step, 200000 by default\n"
+            "  -d          caller distribution, every one of them by default\n"
+            "  -m          function to stress, both of them by default\n",
+            tool);
+}
+
+// Everything VMH::init does past its CPUID guard, which would refuse most build machines
+static void bootModule() {
+    sysctl_register_oid(&sysctl__kern_vmh);
+    VMHStats::init();
+    VMHLog::init();
+    VMHTrace::init();
+    lilu.onPatcherLoadForce(&VMH::solveSysCtlChildrenAddr);
+    KernelPatcher patcher;
+    vmhHostLoadPatcher(patcher);
+}
+
+// Calls the kern.hv_vmm_present handler as the current process, the way sysctl dispatches it
+static int callHandler(sysctl_oid *oid) {
+    int value = -1;
+    sysctl_req req;
+    vmhHostSysctlRequest(req, &value, sizeof(value), nullptr, 0);
+    int error = oid->oid_handler(oid, oid->oid_arg1, oid->oid_arg2, &req);
+    return error ? -1 : value;
+}
+
+/**
+ * Hardware counters
+ */
+
+// Counters of the whole process, inherited by every thread started after they are opened
+class Counters {
+public:
+    Counters() {
+        static const uint64_t configs[Events] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+        for (size_t i = 0; i < Events; i++) {
+            perf_event_attr attr {};
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fds[i] < 0) {
+                error = errno;
+            }
+        }
+    }
+
+    ~Counters() {
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    bool available() const { return error == 0; }
+    const char *reason() const { return strerror(error); }
+
+    void start() {
+        for (int fd : fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    // Cycles, instructions and cache misses since start, including every thread that exited since
+    void stop(uint64_t (&values)[3]) {
+        for (size_t i = 0; i < Events; i++) {
+            values[i] = 0;
+            if (fds[i] >= 0) {
+                ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+                if (read(fds[i], &values[i], sizeof(values[i])) != sizeof(values[i])) {
+                    values[i] = 0;
+                }
+            }
+        }
+    }
+
+private:
+    static const size_t Events = 3;
+    int fds[Events] {-1, -1, -1};
+    int error {0};
+};
+
+/**
+ * Workload
+ */
+
+static std::vector<Process> makePool(sysctl_oid *oid, size_t count) {
+    std::vector<Process> pool;
+    for (size_t i = 0; i < count; i++) {
+        std::string name = i % 8 == 0 ? filteredNames[(i / 8) % arrsize(filteredNames)] : "stress" + std::to_string(i);
+        pool.push_back({vmhHostSpawn(name.c_str()), name, 0});
+    }
+    // The single threaded verdicts every concurrent call has to agree with
+    for (Process &process : pool) {
+        vmhHostSetCurrentProc(process.proc);
+        process.verdict = callHandler(oid);
+    }
+    vmhHostSetCurrentProc(nullptr);
+    return pool;
+}
+
+static void releasePool(std::vector<Process> &pool) {
+    for (Process &process : pool) {
+        vmhHostExit(process.proc);
+    }
+    pool.clear();
+}
+
+// xorshift64, seeded per thread
+static inline uint64_t nextRandom(uint64_t &state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static inline size_t pick(uint64_t &state, int distribution, size_t size) {
+    uint64_t random = nextRandom(state);
+    if (distribution == DistributionUniform || distribution == DistributionHot) {
+        return random % size;
+    }
+    // Cubing a uniform variable piles most of the mass onto the first processes
+    double uniform = static_cast<double>(random >> 11) / static_cast<double>(1ULL << 53);
+    return static_cast<size_t>(uniform * uniform * uniform * static_cast<double>(size));
+}
+
+struct Step {
+    double wall;
+    double perThread;
+    size_t failures;
+    size_t contended;
+};
+
+static Step runStep(sysctl_oid *oid, std::vector<Process> &pool, size_t threads, const Options &options) {
+    std::atomic<size_t> ready {0};
+    std::atomic<bool> go {false};
+    std::atomic<size_t> failures {0};
+    std::atomic<size_t> contended {0};
+    std::vector<std::thread> workers;
+    std::vector<double> seconds(threads);
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            uint64_t state = 0x9e3779b97f4a7c15ULL * (t + 1);
+            size_t localFailures = 0;
+            size_t localContended = 0;
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < options.calls; i++) {
+                Process &process = pool[pick(state, options.distribution, pool.size())];
+                if (options.target == TargetUnique) {
+                    size_t slot = VMH_PROCESS_UNTRACKED;
+                    VMH::processCurrentProcessUnique(process.name.c_str(), proc_pid(process.proc), false, &slot);
+                    localContended += slot == VMH_PROCESS_UNTRACKED;
+                    continue;
+                }
+                // Re-executing the same image drops the cached verdict without changing it
+                if (options.distribution == DistributionExec && nextRandom(state) % 64 == 0) {
+                    vmhHostExec(process.proc, process.name.c_str());
+                }
+                vmhHostSetCurrentProc(process.proc);
+                localFailures += callHandler(oid) != process.verdict;
+            }
+            seconds[t] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            vmhHostSetCurrentProc(nullptr);
+            failures.fetch_add(localFailures);
+            contended.fetch_add(localContended);
+        });
+    }
+    while (ready.load() != threads) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double sum = 0;
+    for (double s : seconds) {
+        sum += s;
+    }
+    return {wall, sum / static_cast<double>(threads), failures.load(), contended.load()};
+}
+
+static size_t runMatrix(sysctl_oid *oid, const Options &options) {
+    size_t failures = 0;
+    for (int target = 0; target < TargetCount; target++) {
+        if (options.target >= 0 && options.target != target) {
+            continue;
+        }
+        for (int distribution = 0; distribution < DistributionCount; distribution++) {
+            if (options.distribution >= 0 && options.distribution != distribution) {
+                continue;
+            }
+            // Exec only changes what the handler sees
+            if (target == TargetUnique && distribution == DistributionExec) {
+                continue;
+            }
+            Options step = options;
+            step.target = target;
+            step.distribution = distribution;
+            std::vector<Process> pool = makePool(oid, distributionProcesses[distribution]);
+            printf("%s, %s callers (%zu processes), %zu calls per thread:\n", targetNames[target], distributionNames[distribution], pool.size(), options.calls);
+            printf("  %7s %12s %8s %12s %12s %12s %12s\n", "threads", "calls/s", "scaling", "ns/call", "cycles/call", "insns/call", "misses/call");
+
+            double single = 0;
+            for (size_t threads = 1; threads <= options.maxThreads; threads = threads * 2 > options.maxThreads && threads != options.maxThreads ? options.maxThreads : threads * 2) {
+                Counters counters;
+                counters.start();
+                Step result = runStep(oid, pool, threads, step);
+                uint64_t values[3];
+                counters.stop(values);
+
+                double total = static_cast<double>(threads * options.calls);
+                double throughput = total / result.wall;
+                single = threads == 1 ? throughput : single;
+                printf("  %7zu %12.0f %7.2fx %12.1f", threads, throughput, throughput / single, result.perThread * 1e9 / static_cast<double>(options.calls));
+                if (counters.available()) {
+                    printf(" %12.1f %12.1f %12.2f", values[0] / total, values[1] / total, values[2] / total);
+                } else {
+                    printf(" %12s %12s %12s", "-", "-", "-");
+                }
+                if (result.failures) {
+                    printf("  %zu wrong verdicts", result.failures);
+                }
+                if (result.contended) {
+                    printf("  %zu contended inserts", result.contended);
+                }
+                printf("\n");
+                failures += result.failures;
+            }
+            releasePool(pool);
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char *argv[]) {
+    Options options {std::thread::hardware_concurrency(), 200000, -1, -1};
+    int option;
+    while ((option = getopt(argc, argv, "t:c:d:m:h")) != -1) {
+        switch (option) {
+            case 't': options.maxThreads = strtoull(optarg, nullptr, 0); break;
+            case 'c': options.calls = strtoull(optarg, nullptr, 0); break;
+            case 'd':
+                for (int i = 0; i < DistributionCount; i++) {
+                    options.distribution = strcmp(optarg, distributionNames[i]) == 0 ? i : options.distribution;
+                }
+                if (options.distribution < 0) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'm':
+                options.target = strcmp(optarg, "handler") == 0 ? TargetHandler : strcmp(optarg, "unique") == 0 ? TargetUnique : -2;
+                if (options.target == -2) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default: usage(argv[0]); return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (options.maxThreads == 0 || options.calls == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bootModule();
+    sysctl_oid *oid = VMHSysctl::find("kern.hv_vmm_present");
+    Counters probe;
+    printf("stress-handler: up to %zu threads on %u CPUs, hardware counters %s%s\n", options.maxThreads, std::thread::hardware_concurrency(),
+           probe.available() ? "available" : "unavailable: ", probe.available() ? "" : probe.reason());
+
+    size_t failures = runMatrix(oid, options);
+    if (failures) {
+        printf("stress-handler: %zu calls returned a different verdict than the single threaded pass\n", failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,55 @@
+//
+//  test-vmm-host.cpp
+//  test-vmm
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  The host backend of test-vmm: the unmodified module sources, built against the userspace
+//  mocks of Host/ by the CMakeLists.txt at the root of the repository. Empty in the Xcode
+//  build, where test-vmm reads the real kern.hv_vmm_present.
+//
+
+#ifdef VMH_HOST
+
+#include "../../VMHide/kern_vmm.hpp"
+#include "test-vmm.h"
+
+// Defined by kern_start.cpp, registered by VMH::init
+extern struct sysctl_oid sysctl__kern_vmh;
+
+// Mocked process every thread of this worker runs as
+static proc_t workerProc = nullptr;
+
+// Everything VMH::init does past its CPUID guard, the forked workers inherit the booted module
+static int hostStart(const char *const *, size_t) {
+    sysctl_register_oid(&sysctl__kern_vmh);
+    VMHStats::init();
+    VMHLog::init();
+    VMHTrace::init();
+    lilu.onPatcherLoadForce(&VMH::solveSysCtlChildrenAddr);
+    KernelPatcher patcher;
+    vmhHostLoadPatcher(patcher);
+    return 0;
+}
+
+static int hostBecome(const char *name, char *const []) {
+    workerProc = vmhHostSpawn(name);
+    return workerProc ? 0 : -1;
+}
+
+static void hostAttach() {
+    vmhHostSetCurrentProc(workerProc);
+}
+
+// Goes through the mocked sysctlbyname, name lookup included, like a userspace caller on macOS
+static int hostRead(int *value) {
+    size_t length = sizeof(*value);
+    return sysctlbyname("kern.hv_vmm_present", value, &length, nullptr, 0);
+}
+
+static void hostStop() {
+}
+
+extern "C" const vmm_backend vmm_host_backend = {"host", hostStart, hostBecome, hostAttach, hostRead, hostStop};
+
+#endif /* VMH_HOST */
@@ -4,23 +4,361 @@
 //
 //  Created by RoyalGraphX on 5/12/25.
 //
+//  Without options, reads kern.hv_vmm_present once and prints it. With any of -p, -t, -n or
+//  -N it becomes a load generator: forks worker processes running under the given process
+//  names, each reading kern.hv_vmm_present from several threads at once, and reports calls
+//  per second, latency percentiles and the value every process name was answered.
+//
+//  Reads go through a backend. On macOS it is the real sysctl, workers named differently
+//  from the tool run from a hard link, or a copy, of it under that name. The CMakeLists.txt
+//  at the root of the repository also builds a host backend on Linux, the unmodified VMHide
+//  handler running in-process against the mocks of Host/, so the same runs compare a
+//  developer machine with a guest.
+//
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/sysctl.h> // Required for sysctlbyname
+#include <stdint.h>
 #include <errno.h>      // Required for errno
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#ifdef __APPLE__
+#include <sys/sysctl.h> // Required for sysctlbyname
+#include <copyfile.h>
+#include <mach-o/dyld.h>
+#endif
+
+#include "test-vmm.h"
+
+#define MAX_WORKERS 256
+#define MAX_THREADS 256
+#define MAX_NAMES 64
+
+// Log-linear latency histogram, 8 buckets per power of two, within 12.5% of every sample
+#define LATENCY_SUB_BITS 3
+#define LATENCY_BUCKETS 512
+
+// What a worker process reports back to the parent once all of its threads are done
+typedef struct {
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t values[2];   // Reads answered 0 and 1
+    uint64_t otherValues; // Reads answered anything else
+    uint64_t maxNs;
+    uint64_t buckets[LATENCY_BUCKETS];
+} worker_result;
+
+/**
+ * sysctl backend
+ */
+
+#ifdef __APPLE__
+static char copyDir[PATH_MAX];
+static const char *const *copyNames;
+static size_t copyNameCount;
+
+// Resolved path of the running executable, whose file name the kernel knows the process by
+static int executablePath(char (*resolved)[PATH_MAX], const char **name) {
+    char self[PATH_MAX];
+    uint32_t size = sizeof(self);
+    if (_NSGetExecutablePath(self, &size) != 0 || !realpath(self, *resolved)) {
+        printf("Cannot locate the test-vmm executable.\n");
+        return -1;
+    }
+    const char *slash = strrchr(*resolved, '/');
+    *name = slash ? slash + 1 : *resolved;
+    return 0;
+}
+
+// Links, or copies, the tool into a temporary directory under every name it has to run as
+static int sysctlStart(const char *const *names, size_t count) {
+    char resolved[PATH_MAX];
+    const char *self;
+    if (executablePath(&resolved, &self) != 0) {
+        return -1;
+    }
+    const char *tmp = getenv("TMPDIR");
+    snprintf(copyDir, sizeof(copyDir), "%s/test-vmm.XXXXXX", tmp && *tmp ? tmp : "/tmp");
+    if (!mkdtemp(copyDir)) {
+        perror(copyDir);
+        return -1;
+    }
+    copyNames = names;
+    copyNameCount = count;
+    for (size_t i = 0; i < count; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", copyDir, names[i]);
+        if (strcmp(names[i], self) == 0 || access(path, X_OK) == 0) {
+            continue;
+        }
+        if (link(resolved, path) != 0 && copyfile(resolved, path, NULL, COPYFILE_ALL) != 0) {
+            perror(path);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// The kernel names a process after the file it executes, so the worker execs its copy
+static int sysctlBecome(const char *name, char *const argv[]) {
+    char resolved[PATH_MAX];
+    const char *self;
+    if (executablePath(&resolved, &self) != 0) {
+        return -1;
+    }
+    if (strcmp(name, self) == 0) {
+        return 0;
+    }
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", copyDir, name);
+    execv(path, argv);
+    perror(path);
+    return -1;
+}
+
+static void sysctlAttach(void) {
+}
+
+static int sysctlRead(int *value) {
+    size_t len = sizeof(*value);
+    return sysctlbyname("kern.hv_vmm_present", value, &len, NULL, 0);
+}
+
+static void sysctlStop(void) {
+    if (!copyDir[0]) {
+        return;
+    }
+    for (size_t i = 0; i < copyNameCount; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", copyDir, copyNames[i]);
+        unlink(path);
+    }
+    rmdir(copyDir);
+}
 
-int main(int argc, const char * argv[]) {
+static const vmm_backend sysctl_backend = {"sysctl", sysctlStart, sysctlBecome, sysctlAttach, sysctlRead, sysctlStop};
+#endif
+
+static const vmm_backend *const backends[] = {
+#ifdef __APPLE__
+    &sysctl_backend,
+#endif
+#ifdef VMH_HOST
+    &vmm_host_backend,
+#endif
+    NULL,
+};
+
+/**
+ * Latency
+ */
+
+static uint64_t nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static size_t latencyBucket(uint64_t ns) {
+    if (ns < (1u << LATENCY_SUB_BITS)) {
+        return (size_t)ns;
+    }
+    unsigned exponent = 63 - (unsigned)__builtin_clzll(ns);
+    size_t bucket = (exponent - LATENCY_SUB_BITS + 1) * (1u << LATENCY_SUB_BITS) +
+                    (size_t)((ns >> (exponent - LATENCY_SUB_BITS)) & ((1u << LATENCY_SUB_BITS) - 1));
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+// Smallest latency that lands in bucket
+static uint64_t bucketFloor(size_t bucket) {
+    if (bucket < (1u << LATENCY_SUB_BITS)) {
+        return bucket;
+    }
+    unsigned exponent = (unsigned)(bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+    uint64_t mantissa = (1u << LATENCY_SUB_BITS) | (bucket & ((1u << LATENCY_SUB_BITS) - 1));
+    return mantissa << (exponent - LATENCY_SUB_BITS);
+}
+
+static uint64_t percentile(const worker_result *result, double quantile) {
+    uint64_t target = (uint64_t)(quantile * (double)result->calls);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += result->buckets[i];
+        if (seen > target) {
+            return bucketFloor(i);
+        }
+    }
+    return result->maxNs;
+}
+
+static void mergeResult(worker_result *into, const worker_result *from) {
+    into->calls += from->calls;
+    into->errors += from->errors;
+    into->values[0] += from->values[0];
+    into->values[1] += from->values[1];
+    into->otherValues += from->otherValues;
+    if (from->maxNs > into->maxNs) {
+        into->maxNs = from->maxNs;
+    }
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+        into->buckets[i] += from->buckets[i];
+    }
+}
+
+/**
+ * Worker processes
+ */
+
+typedef struct {
+    const vmm_backend *backend;
+    uint64_t calls;
+    int goFd;
+    pthread_t thread;
+    worker_result result;
+} worker_thread;
+
+static void *runThread(void *argument) {
+    worker_thread *state = argument;
+    state->backend->attach();
+
+    // Every thread of every worker starts when the parent closes the go pipe
+    char go;
+    while (read(state->goFd, &go, 1) < 0 && errno == EINTR) {
+    }
+
+    worker_result *result = &state->result;
+    for (uint64_t i = 0; i < state->calls; i++) {
+        int value = -1;
+        uint64_t start = nowNs();
+        int error = state->backend->read(&value);
+        uint64_t elapsed = nowNs() - start;
+        result->calls++;
+        if (error) {
+            result->errors++;
+            continue;
+        }
+        if (value == 0 || value == 1) {
+            result->values[value]++;
+        } else {
+            result->otherValues++;
+        }
+        result->buckets[latencyBucket(elapsed)]++;
+        if (elapsed > result->maxNs) {
+            result->maxNs = elapsed;
+        }
+    }
+    return NULL;
+}
+
+static int writeAll(int fd, const void *data, size_t size) {
+    const char *bytes = data;
+    while (size) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return -1;
+        }
+        bytes += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+static int readAll(int fd, void *data, size_t size) {
+    char *bytes = data;
+    while (size) {
+        ssize_t got = read(fd, bytes, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return -1;
+        }
+        bytes += got;
+        size -= (size_t)got;
+    }
+    return 0;
+}
+
+// Body of a worker process, the backend already made it known under its name
+static int runWorker(const vmm_backend *backend, size_t threads, uint64_t calls, int resultFd, int readyFd, int goFd) {
+    static worker_thread states[MAX_THREADS];
+    size_t started = 0;
+    for (; started < threads; started++) {
+        memset(&states[started], 0, sizeof(states[started]));
+        states[started].backend = backend;
+        states[started].calls = calls;
+        states[started].goFd = goFd;
+        if (pthread_create(&states[started].thread, NULL, runThread, &states[started]) != 0) {
+            break;
+        }
+    }
+    char ready = started == threads;
+    writeAll(readyFd, &ready, 1);
+    close(readyFd);
+
+    static worker_result total;
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(states[i].thread, NULL);
+        mergeResult(&total, &states[i].result);
+    }
+    if (!ready || writeAll(resultFd, &total, sizeof(total)) != 0) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Load generator
+ */
+
+static void usage(const char *tool) {
+    fprintf(stderr,
+            "usage: %s [-b backend] [-p processes] [-t threads] [-n calls] [-N name[,name...]]\n"
+            "  -b backend    sysctl (macOS) or host (Linux), the first one built in by default\n"
+            "  -p processes  worker processes, 1 by default\n"
+            "  -t threads    threads per worker process, 1 by default\n"
+            "  -n calls      reads per thread, 100000 by default\n"
+            "  -N names      comma separated process names, handed out to the workers in turn,\n"
+            "                the name of the tool by default\n"
+            "  Without -p, -t, -n or -N, reads kern.hv_vmm_present once.\n",
+            tool);
+}
+
+// Splits the comma separated list in place, returns the number of names or 0 if one is unusable
+static size_t splitNames(char *list, const char **names) {
+    size_t count = 0;
+    for (char *name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        if (count == MAX_NAMES || strchr(name, '/') || strlen(name) > NAME_MAX) {
+            return 0;
+        }
+        names[count++] = name;
+    }
+    return count;
+}
+
+// The original test-vmm, a single read
+static int readOnce(const vmm_backend *backend, char *const argv[]) {
+    const char *vmm_sysctl_name = "kern.hv_vmm_present";
+    const char *self = argv[0];
+    const char *slash = strrchr(self, '/');
+    self = slash ? slash + 1 : self;
     int vmm_present = 0;
-    size_t len = sizeof(vmm_present);
-    const char* vmm_sysctl_name = "kern.hv_vmm_present";
 
     printf("Attempting to read sysctl: %s\n", vmm_sysctl_name);
-
-    // Attempt to get the sysctl value
-    // int sysctlbyname(const char *, void *, size_t *, void *, size_t);
-    if (sysctlbyname(vmm_sysctl_name, &vmm_present, &len, NULL, 0) == -1) {
+    if (backend->start(&self, 1) != 0 || backend->become(self, argv) != 0) {
+        return 1;
+    }
+    backend->attach();
+    int failed = backend->read(&vmm_present) == -1;
+    backend->stop();
+    if (failed) {
         perror("Error calling sysctlbyname");
         if (errno == ENOENT) {
             printf("Sysctl '%s' does not exist. This could mean sysctl is unavailable.\n", vmm_sysctl_name);
@@ -28,18 +366,183 @@ int main(int argc, const char * argv[]) {
         return 1; // Indicate an error
     }
 
-    if (len == sizeof(vmm_present)) {
-        printf("Sysctl '%s' value: %d\n", vmm_sysctl_name, vmm_present);
-        if (vmm_present == 1) {
-            printf("Indicates a Virtual Machine Environment is present.\n");
-        } else {
-            printf("Indicates a Virtual Machine Environment is NOT present (or value is 0).\n");
-        }
+    printf("Sysctl '%s' value: %d\n", vmm_sysctl_name, vmm_present);
+    if (vmm_present == 1) {
+        printf("Indicates a Virtual Machine Environment is present.\n");
     } else {
-        printf("Sysctl '%s' returned an unexpected length: %zu\n", vmm_sysctl_name, len);
-        return 1; // Indicate an error
+        printf("Indicates a Virtual Machine Environment is NOT present (or value is 0).\n");
     }
-
     printf("test-vmm finished.\n");
     return 0; // Indicate success
 }
+
+int main(int argc, char * argv[]) {
+    const vmm_backend *backend = backends[0];
+    size_t processes = 1;
+    size_t threads = 1;
+    uint64_t calls = 100000;
+    char *nameList = NULL;
+    const char *workerFds = NULL;
+    int load = 0;
+    int option;
+    while ((option = getopt(argc, argv, "b:p:t:n:N:w:h")) != -1) {
+        switch (option) {
+            case 'b':
+                backend = NULL;
+                for (size_t i = 0; backends[i]; i++) {
+                    if (strcmp(backends[i]->name, optarg) == 0) {
+                        backend = backends[i];
+                    }
+                }
+                if (!backend) {
+                    fprintf(stderr, "test-vmm: backend '%s' is not built in\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'p': processes = strtoull(optarg, NULL, 0); load = 1; break;
+            case 't': threads = strtoull(optarg, NULL, 0); load = 1; break;
+            case 'n': calls = strtoull(optarg, NULL, 0); load = 1; break;
+            case 'N': nameList = optarg; load = 1; break;
+            case 'w': workerFds = optarg; break; // Internal, a worker exec'd under its name
+            default: usage(argv[0]); return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (!backend) {
+        fprintf(stderr, "test-vmm: no backend is built in, build on macOS or with the CMakeLists.txt\n");
+        return EXIT_FAILURE;
+    }
+    if (processes == 0 || processes > MAX_WORKERS || threads == 0 || threads > MAX_THREADS || calls == 0 || optind != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!load && !workerFds) {
+        return readOnce(backend, argv);
+    }
+
+    const char *names[MAX_NAMES];
+    const char *slash = strrchr(argv[0], '/');
+    size_t nameCount = 1;
+    names[0] = slash ? slash + 1 : argv[0];
+    if (nameList && (nameCount = splitNames(nameList, names)) == 0) {
+        fprintf(stderr, "test-vmm: process names must be 1 to %d characters without '/', at most %d of them\n", NAME_MAX, MAX_NAMES);
+        return EXIT_FAILURE;
+    }
+
+    // A worker exec'd by the backend picks up where its fork left off
+    if (workerFds) {
+        int resultFd, readyFd, goFd;
+        if (sscanf(workerFds, "%d:%d:%d", &resultFd, &readyFd, &goFd) != 3 || backend->become(names[0], argv) != 0) {
+            return EXIT_FAILURE;
+        }
+        return runWorker(backend, threads, calls, resultFd, readyFd, goFd);
+    }
+
+    if (backend->start(names, nameCount) != 0) {
+        return EXIT_FAILURE;
+    }
+    int readyPipe[2], goPipe[2];
+    if (pipe(readyPipe) != 0 || pipe(goPipe) != 0) {
+        perror("pipe");
+        return EXIT_FAILURE;
+    }
+
+    // Every worker gets its own result pipe, and a command line naming it, for backends that exec
+    static int resultFds[MAX_WORKERS];
+    static pid_t pids[MAX_WORKERS];
+    size_t forked = 0;
+    fflush(stdout);
+    for (; forked < processes; forked++) {
+        int resultPipe[2];
+        if (pipe(resultPipe) != 0) {
+            perror("pipe");
+            break;
+        }
+        const char *name = names[forked % nameCount];
+        char fds[64], threadArg[32], callArg[32];
+        snprintf(fds, sizeof(fds), "%d:%d:%d", resultPipe[1], readyPipe[1], goPipe[0]);
+        snprintf(threadArg, sizeof(threadArg), "%zu", threads);
+        snprintf(callArg, sizeof(callArg), "%llu", (unsigned long long)calls);
+        char *workerArgv[] = {argv[0], "-b", (char *)backend->name, "-t", threadArg, "-n", callArg, "-N", (char *)name, "-w", fds, NULL};
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            close(resultPipe[0]);
+            close(resultPipe[1]);
+            break;
+        }
+        if (pid == 0) {
+            close(resultPipe[0]);
+            close(readyPipe[0]);
+            close(goPipe[1]);
+            if (backend->become(name, workerArgv) != 0) {
+                _exit(EXIT_FAILURE);
+            }
+            _exit(runWorker(backend, threads, calls, resultPipe[1], readyPipe[1], goPipe[0]));
+        }
+        close(resultPipe[1]);
+        resultFds[forked] = resultPipe[0];
+        pids[forked] = pid;
+    }
+    close(readyPipe[1]);
+    close(goPipe[0]);
+
+    // Wait for every thread to be created, then release them all at once
+    size_t ready = 0;
+    char byte;
+    while (ready < forked && readAll(readyPipe[0], &byte, 1) == 0 && byte) {
+        ready++;
+    }
+    close(readyPipe[0]);
+    uint64_t start = nowNs();
+    close(goPipe[1]);
+
+    static worker_result total;
+    static worker_result perName[MAX_NAMES];
+    int failed = forked != processes || ready != forked;
+    for (size_t i = 0; i < forked; i++) {
+        static worker_result result;
+        if (readAll(resultFds[i], &result, sizeof(result)) == 0) {
+            mergeResult(&total, &result);
+            mergeResult(&perName[i % nameCount], &result);
+        } else {
+            failed = 1;
+        }
+        close(resultFds[i]);
+    }
+    uint64_t elapsed = nowNs() - start;
+    for (size_t i = 0; i < forked; i++) {
+        int status = 0;
+        waitpid(pids[i], &status, 0);
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS;
+    }
+    backend->stop();
+    if (failed) {
+        fprintf(stderr, "test-vmm: a worker process failed\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("test-vmm: %s backend, %zu processes x %zu threads x %llu reads of kern.hv_vmm_present\n", backend->name,
+           processes, threads, (unsigned long long)calls);
+    printf("  %.0f calls/sec, %llu errors\n", (double)total.calls * 1e9 / (double)(elapsed ? elapsed : 1),
+           (unsigned long long)total.errors);
+    printf("  latency ns: p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu\n", (unsigned long long)percentile(&total, 0.5),
+           (unsigned long long)percentile(&total, 0.9), (unsigned long long)percentile(&total, 0.99),
+           (unsigned long long)percentile(&total, 0.999), (unsigned long long)total.maxNs);
+
+    // Every read of a process name should get the same answer, VMHide decides by name
+    int mixed = 0;
+    for (size_t i = 0; i < nameCount && i < forked; i++) {
+        const worker_result *result = &perName[i];
+        int value = result->values[1] ? 1 : 0;
+        if (result->errors || result->otherValues || (result->values[0] && result->values[1])) {
+            mixed = 1;
+            printf("  %-32s %llu reads: %llu answered 0, %llu answered 1, %llu other, %llu errors\n", names[i],
+                   (unsigned long long)result->calls, (unsigned long long)result->values[0], (unsigned long long)result->values[1],
+                   (unsigned long long)result->otherValues, (unsigned long long)result->errors);
+        } else {
+            printf("  %-32s %llu reads, kern.hv_vmm_present %d\n", names[i], (unsigned long long)result->calls, value);
+        }
+    }
+    return total.errors || mixed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,50 @@
+//
+//  test-vmm.h
+//  test-vmm
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Backends test-vmm reads kern.hv_vmm_present through. The sysctl backend is the real
+//  sysctl of a macOS guest, the host backend is the in-process build of the VMHide handler
+//  against the userspace mocks of Host/, see test-vmm-host.cpp.
+//
+
+#ifndef test_vmm_h
+#define test_vmm_h
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *name;
+
+    // Once, in the parent, before any worker process is forked, with every name a worker will
+    // run as. Returns 0 on success.
+    int (*start)(const char *const *names, size_t count);
+
+    // Once per worker process, right after the fork, makes the process known by name. argv is
+    // the worker command line, for backends that have to exec the tool again under that name.
+    int (*become)(const char *name, char *const argv[]);
+
+    // Once per worker thread, before its first read
+    void (*attach)(void);
+
+    // One read of kern.hv_vmm_present, returns 0 and the value, or -1 and sets errno
+    int (*read)(int *value);
+
+    // Once, in the parent, after every worker exited
+    void (*stop)(void);
+} vmm_backend;
+
+#ifdef VMH_HOST
+extern const vmm_backend vmm_host_backend;
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* test_vmm_h */
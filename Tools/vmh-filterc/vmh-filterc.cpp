@@ -0,0 +1,171 @@
+//
+//  vmh-filterc.cpp
+//  vmh-filterc
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Compiles a plain-text filter list into the versioned, checksummed blob VMHide loads at boot
+//  from the vmh-filter NVRAM variable, in place of VMM::filteredProcs. Rules are written like
+//  kern.vmh.filter takes them, one per line or separated by commas, with '#' comments:
+//
+//    softwareupdated
+//    com.apple.Mobile*
+//    path:/usr/libexec/*
+//    bundle:com.apple.MobileSoftwareUpdate*
+//    tree:osinstallersetup
+//
+//  Every compiled blob is opened and checked with the lookup code of the kext before it is
+//  written. -d lists the rules of an existing blob, -p prints the OpenCore config.plist entry
+//  that stores it in NVRAM. Builds anywhere with a C++14 compiler, for example on Linux:
+//  c++ -O2 -std=c++14 -o vmh-filterc Tools/vmh-filterc/vmh-filterc.cpp
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "vmh_filterc.hpp"
+
+// LILU_VENDOR_GUID of Lilu's kern_nvram.hpp, the kext reads VMH_FILTER_NVRAM_NAME below it
+static const char *const LILU_VENDOR_GUID = "E09B9297-7928-4440-9AAB-D1F8536FBF0A";
+
+static void usage(const char *tool) {
+    fprintf(stderr,
+            "usage: %s [-o blob] [-p] rules.txt\n"
+            "       %s -d blob\n"
+            "  -o blob  write the compiled filter to blob, vmh-filter.bin by default\n"
+            "  -p       print the OpenCore config.plist NVRAM entry holding the blob\n"
+            "  -d blob  check blob and list its rules\n"
+            "  rules.txt may be - to read the rules from standard input\n",
+            tool, tool);
+}
+
+static bool readFile(const char *path, std::string &contents) {
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "vmh-filterc: cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    char buffer[4096];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, got);
+    }
+    bool failed = ferror(file) != 0;
+    if (file != stdin) {
+        fclose(file);
+    }
+    if (failed) {
+        fprintf(stderr, "vmh-filterc: cannot read %s\n", path);
+    }
+    return !failed;
+}
+
+static std::string base64(const std::vector<uint8_t> &data) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string encoded;
+    for (size_t i = 0; i < data.size(); i += 3) {
+        uint32_t chunk = static_cast<uint32_t>(data[i]) << 16;
+        if (i + 1 < data.size()) {
+            chunk |= static_cast<uint32_t>(data[i + 1]) << 8;
+        }
+        if (i + 2 < data.size()) {
+            chunk |= data[i + 2];
+        }
+        encoded.push_back(alphabet[(chunk >> 18) & 63]);
+        encoded.push_back(alphabet[(chunk >> 12) & 63]);
+        encoded.push_back(i + 1 < data.size() ? alphabet[(chunk >> 6) & 63] : '=');
+        encoded.push_back(i + 2 < data.size() ? alphabet[chunk & 63] : '=');
+    }
+    return encoded;
+}
+
+// Lists every rule of a blob, after the same checks the kext runs before using it
+static int decode(const char *path) {
+    std::string contents;
+    if (!readFile(path, contents)) {
+        return EXIT_FAILURE;
+    }
+    std::vector<uint8_t> blob(contents.begin(), contents.end());
+    VMHFilterBlob view;
+    const char *error = view.open(blob.data(), blob.size());
+    if (error) {
+        fprintf(stderr, "vmh-filterc: %s is rejected: %s\n", path, error);
+        return EXIT_FAILURE;
+    }
+    printf("# %s: %u rules, %u bytes\n", path, view.ruleCount(), view.size());
+    for (uint32_t i = 0; i < view.ruleCount(); i++) {
+        const vmh_filter_rule_t &rule = view.rule(i);
+        printf("%s%s%s\n", rule.flags & VMH_FILTER_RULE_TREE ? vmhFilterTreePrefix : "", vmhFilterPrefixes[rule.kind], view.name(rule));
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = "vmh-filter.bin";
+    const char *decodePath = nullptr;
+    bool plist = false;
+    int option;
+    while ((option = getopt(argc, argv, "o:pd:h")) != -1) {
+        switch (option) {
+            case 'o': output = optarg; break;
+            case 'p': plist = true; break;
+            case 'd': decodePath = optarg; break;
+            default: usage(argv[0]); return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (decodePath) {
+        return decode(decodePath);
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::string text;
+    std::vector<VMHFilterRule> rules;
+    std::vector<uint8_t> blob;
+    std::string error;
+    if (!readFile(argv[optind], text)) {
+        return EXIT_FAILURE;
+    }
+    if (!vmhParseFilterRules(text, rules, error) || !vmhCompileFilter(rules, blob, error)) {
+        fprintf(stderr, "vmh-filterc: %s: %s\n", argv[optind], error.c_str());
+        return EXIT_FAILURE;
+    }
+
+    // Open the blob like the kext does, and look every exact rule up in it
+    VMHFilterBlob view;
+    const char *rejected = view.open(blob.data(), blob.size());
+    size_t missing = 0;
+    for (size_t i = 0; !rejected && i < rules.size(); i++) {
+        missing += !vmhIsGlob(rules[i].name.c_str()) && !view.contains(rules[i].kind, rules[i].name.c_str());
+    }
+    if (rejected || missing) {
+        fprintf(stderr, "vmh-filterc: the compiled filter does not check out: %s\n", rejected ? rejected : "exact rules are missing");
+        return EXIT_FAILURE;
+    }
+
+    FILE *file = fopen(output, "wb");
+    if (!file || fwrite(blob.data(), 1, blob.size(), file) != blob.size() || fclose(file) != 0) {
+        fprintf(stderr, "vmh-filterc: cannot write %s: %s\n", output, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    size_t globs = 0;
+    size_t trees = 0;
+    for (const VMHFilterRule &rule : rules) {
+        globs += vmhIsGlob(rule.name.c_str());
+        trees += rule.tree;
+    }
+    fprintf(stderr, "vmh-filterc: %zu rules (%u name, %u path, %u bundle, %zu glob, %zu tree) compiled into %zu bytes, %s\n", rules.size(),
+            view.rules(VMH_FILTER_KIND_NAME), view.rules(VMH_FILTER_KIND_PATH), view.rules(VMH_FILTER_KIND_BUNDLE), globs, trees, blob.size(), output);
+
+    if (plist) {
+        printf("<key>%s</key>\n<dict>\n\t<key>%s</key>\n\t<data>%s</data>\n</dict>\n", LILU_VENDOR_GUID, VMH_FILTER_NVRAM_NAME, base64(blob).c_str());
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,299 @@
+//
+//  vmh_filterc.hpp
+//  vmh-filterc
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Parser and compiler behind vmh-filterc, shared with the benchmarks so that they time blobs
+//  built exactly like the ones the kext loads. Userspace only.
+//
+
+#ifndef vmh_filterc_hpp
+#define vmh_filterc_hpp
+
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../VMHide/kern_filterblob.hpp"
+#include "../../VMHide/kern_glob.hpp"
+
+// Prefixes of every kind in a rule list, the same as kern.vmh.filter accepts
+static const char *const vmhFilterPrefixes[VMH_FILTER_KINDS] = {"", "path:", "bundle:"};
+
+// Prefix of tree rules, ahead of the kind prefix
+static const char vmhFilterTreePrefix[] = "tree:";
+
+// Times the table of a kind may double in size when its names do not place
+static const size_t VMH_FILTERC_GROWTHS = 4;
+
+struct VMHFilterRule {
+    std::string name;
+    uint8_t kind;
+    bool tree;
+};
+
+// Same layout as VMH::DetectedProcess for VMHGlobMatcher::build, which only reads name
+struct VMHFilterGlob {
+    const char *name;
+};
+
+static inline std::string vmhFilterTrim(const std::string &text) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return std::string();
+    }
+    return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
+
+/**
+ * @brief Parses a rule list. Rules are separated by commas or newlines, surrounding blanks are
+ * ignored and '#' starts a comment up to the end of its line. A "path:" or "bundle:" prefix
+ * matches the executable path or bundle identifier instead of the process name, and a "tree:"
+ * prefix ahead of it extends the rule to descendants, like in kern.vmh.filter. Duplicates are
+ * dropped, a rule given both with and without "tree:" is kept as a tree rule.
+ * @return false with a message in error if a rule is invalid.
+ */
+static inline bool vmhParseFilterRules(const std::string &text, std::vector<VMHFilterRule> &rules, std::string &error) {
+    size_t line = 0;
+    for (size_t lineStart = 0; lineStart <= text.size();) {
+        size_t lineEnd = std::min(text.find('\n', lineStart), text.size());
+        std::string content = text.substr(lineStart, lineEnd - lineStart);
+        content = content.substr(0, content.find('#'));
+        lineStart = lineEnd + 1;
+        line++;
+
+        for (size_t ruleStart = 0; ruleStart <= content.size();) {
+            size_t ruleEnd = std::min(content.find(',', ruleStart), content.size());
+            std::string rule = vmhFilterTrim(content.substr(ruleStart, ruleEnd - ruleStart));
+            ruleStart = ruleEnd + 1;
+            if (rule.empty()) {
+                continue;
+            }
+            bool tree = rule.compare(0, strlen(vmhFilterTreePrefix), vmhFilterTreePrefix) == 0;
+            if (tree) {
+                rule = rule.substr(strlen(vmhFilterTreePrefix));
+            }
+            uint8_t kind = VMH_FILTER_KIND_NAME;
+            for (uint8_t k = VMH_FILTER_KIND_NAME + 1; k < VMH_FILTER_KINDS; k++) {
+                size_t prefixLength = strlen(vmhFilterPrefixes[k]);
+                if (rule.compare(0, prefixLength, vmhFilterPrefixes[k]) == 0) {
+                    rule = rule.substr(prefixLength);
+                    kind = k;
+                    break;
+                }
+            }
+            if (rule.empty() || rule.size() > VMH_FILTER_RULE_MAX) {
+                error = "line " + std::to_string(line) + ": rules must be 1 to " + std::to_string(VMH_FILTER_RULE_MAX) + " bytes long";
+                return false;
+            }
+            bool duplicate = false;
+            for (VMHFilterRule &existing : rules) {
+                if (existing.kind == kind && existing.name == rule) {
+                    existing.tree |= tree;
+                    duplicate = true;
+                }
+            }
+            if (!duplicate) {
+                rules.push_back({rule, kind, tree});
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Hash-and-displace placement of names into buckets seeds and 2 * buckets slots, the
+ * construction of VMHFilterTable::build with a table sized at runtime.
+ * @param slotOf Receives, for every slot, the index of its name or -1.
+ */
+static inline bool vmhPlaceFilterTable(const std::vector<const char *> &names, uint32_t buckets, std::vector<uint32_t> &seeds, std::vector<int32_t> &slotOf) {
+    seeds.assign(buckets, 0);
+    slotOf.assign(buckets * 2, -1);
+    std::vector<uint64_t> hashes(names.size());
+    std::vector<std::vector<uint32_t>> members(buckets);
+    for (size_t i = 0; i < names.size(); i++) {
+        VMHNameKey key;
+        size_t length = vmhNameKeyPack(names[i], key, VMH_FILTER_NAME_MAX);
+        hashes[i] = vmhNameHash(names[i], key, length);
+        members[hashes[i] & (buckets - 1)].push_back(static_cast<uint32_t>(i));
+    }
+
+    // Place the most crowded buckets first, they are the hardest to satisfy
+    std::vector<uint32_t> order(buckets);
+    for (uint32_t b = 0; b < buckets; b++) {
+        order[b] = b;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return members[a].size() > members[b].size(); });
+    std::vector<size_t> targets;
+    for (uint32_t bucket : order) {
+        const std::vector<uint32_t> &keys = members[bucket];
+        if (keys.empty()) {
+            break;
+        }
+        if (keys.size() > VMH_FILTER_MAX_BUCKET) {
+            return false;
+        }
+        bool placed = false;
+        for (uint32_t seed = 0; seed < VMH_FILTER_MAX_SEED && !placed; seed++) {
+            targets.clear();
+            bool fits = true;
+            for (size_t k = 0; k < keys.size() && fits; k++) {
+                size_t target = vmhNameMix(hashes[keys[k]], seed) & (buckets * 2 - 1);
+                fits = slotOf[target] < 0 && std::find(targets.begin(), targets.end(), target) == targets.end();
+                targets.push_back(target);
+            }
+            if (fits) {
+                for (size_t k = 0; k < keys.size(); k++) {
+                    slotOf[targets[k]] = static_cast<int32_t>(keys[k]);
+                }
+                seeds[bucket] = seed;
+                placed = true;
+            }
+        }
+        if (!placed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline uint32_t vmhFilterAlign(size_t offset, size_t alignment) {
+    return static_cast<uint32_t>((offset + alignment - 1) & ~(alignment - 1));
+}
+
+/**
+ * @brief Compiles rules into a blob the kext can search in place, see vmh_filter_header_t.
+ * @return false with a message in error if the rules do not fit a blob.
+ */
+static inline bool vmhCompileFilter(const std::vector<VMHFilterRule> &rules, std::vector<uint8_t> &blob, std::string &error) {
+    vmh_filter_header_t header {};
+    header.magic = VMH_FILTER_MAGIC;
+    header.version = VMH_FILTER_VERSION;
+    header.headerSize = sizeof(vmh_filter_header_t);
+    header.ruleCount = static_cast<uint32_t>(rules.size());
+
+    // The pool starts with an empty name, so that it is never empty itself
+    std::string pool(1, '\0');
+    std::vector<uint32_t> nameOffsets;
+    size_t globs = 0;
+    size_t trees = 0;
+    for (const VMHFilterRule &rule : rules) {
+        nameOffsets.push_back(static_cast<uint32_t>(pool.size()));
+        pool.append(rule.name);
+        pool.push_back('\0');
+        globs += vmhIsGlob(rule.name.c_str());
+        trees += rule.tree;
+    }
+    if (globs > VMH_FILTER_MAX_GLOBS) {
+        error = std::to_string(globs) + " glob rules, at most " + std::to_string(VMH_FILTER_MAX_GLOBS) + " are supported";
+        return false;
+    }
+    if (trees > VMH_FILTER_MAX_TREES) {
+        error = std::to_string(trees) + " tree rules, at most " + std::to_string(VMH_FILTER_MAX_TREES) + " are supported";
+        return false;
+    }
+
+    // Per kind, exact names are placed into a perfect hash table, and glob rules must compile within the kext's budget
+    std::vector<uint32_t> seeds[VMH_FILTER_KINDS];
+    std::vector<int32_t> slotOf[VMH_FILTER_KINDS];
+    std::vector<size_t> exactRule[VMH_FILTER_KINDS];
+    for (uint8_t kind = 0; kind < VMH_FILTER_KINDS; kind++) {
+        std::vector<const char *> exact;
+        std::vector<VMHFilterGlob> kindGlobs;
+        for (size_t i = 0; i < rules.size(); i++) {
+            if (rules[i].kind != kind) {
+                continue;
+            }
+            header.tables[kind].rules++;
+            if (vmhIsGlob(rules[i].name.c_str())) {
+                kindGlobs.push_back({rules[i].name.c_str()});
+            } else {
+                exact.push_back(rules[i].name.c_str());
+                exactRule[kind].push_back(i);
+            }
+        }
+        typedef VMHGlobMatcher<VMH_FILTER_GLOB_STATES, VMH_FILTER_GLOB_TRANSITIONS> Matcher;
+        std::unique_ptr<Matcher> matcher(new Matcher());
+        std::unique_ptr<Matcher::Scratch> scratch(new Matcher::Scratch());
+        if (!matcher->build(kindGlobs.data(), kindGlobs.size(), *scratch)) {
+            error = std::string("the ") + (kind == VMH_FILTER_KIND_NAME ? "name" : vmhFilterPrefixes[kind]) + " glob rules compile to too large a DFA";
+            return false;
+        }
+        if (exact.empty()) {
+            continue;
+        }
+        uint32_t buckets = static_cast<uint32_t>(vmhPow2(exact.size()));
+        size_t growths = 0;
+        while (!vmhPlaceFilterTable(exact, buckets, seeds[kind], slotOf[kind])) {
+            if (++growths > VMH_FILTERC_GROWTHS) {
+                error = std::string("no perfect hash table found for the ") + (kind == VMH_FILTER_KIND_NAME ? "name" : vmhFilterPrefixes[kind]) + " rules";
+                return false;
+            }
+            buckets *= 2;
+        }
+        header.tables[kind].buckets = buckets;
+        header.tables[kind].exact = static_cast<uint32_t>(exact.size());
+    }
+
+    // Layout: header, every seed array, every slot array, the rules and the pool
+    size_t offset = sizeof(vmh_filter_header_t);
+    for (uint8_t kind = 0; kind < VMH_FILTER_KINDS; kind++) {
+        header.tables[kind].seeds = header.tables[kind].buckets ? static_cast<uint32_t>(offset) : 0;
+        offset += header.tables[kind].buckets * sizeof(uint32_t);
+    }
+    offset = vmhFilterAlign(offset, 16);
+    for (uint8_t kind = 0; kind < VMH_FILTER_KINDS; kind++) {
+        header.tables[kind].slots = header.tables[kind].buckets ? static_cast<uint32_t>(offset) : 0;
+        offset += header.tables[kind].buckets * 2 * sizeof(vmh_filter_slot_t);
+    }
+    header.rules = static_cast<uint32_t>(offset);
+    offset += rules.size() * sizeof(vmh_filter_rule_t);
+    header.pool = static_cast<uint32_t>(offset);
+    header.poolSize = static_cast<uint32_t>(pool.size());
+    offset = vmhFilterAlign(offset + pool.size(), 8);
+    if (offset > VMH_FILTER_BLOB_MAX) {
+        error = "the compiled filter needs " + std::to_string(offset) + " bytes, at most " + std::to_string(VMH_FILTER_BLOB_MAX) + " are supported";
+        return false;
+    }
+    header.size = static_cast<uint32_t>(offset);
+
+    blob.assign(offset, 0);
+    for (uint8_t kind = 0; kind < VMH_FILTER_KINDS; kind++) {
+        const vmh_filter_table_t &table = header.tables[kind];
+        if (!table.buckets) {
+            continue;
+        }
+        memcpy(&blob[table.seeds], seeds[kind].data(), table.buckets * sizeof(uint32_t));
+        vmh_filter_slot_t *slots = reinterpret_cast<vmh_filter_slot_t *>(&blob[table.slots]);
+        for (size_t s = 0; s < slotOf[kind].size(); s++) {
+            if (slotOf[kind][s] < 0) {
+                continue;
+            }
+            size_t rule = exactRule[kind][static_cast<size_t>(slotOf[kind][s])];
+            VMHNameKey key;
+            slots[s].length = static_cast<uint32_t>(vmhNameKeyPack(rules[rule].name.c_str(), key, VMH_FILTER_NAME_MAX));
+            slots[s].key[0] = key.words[0];
+            slots[s].key[1] = key.words[1];
+            slots[s].name = nameOffsets[rule];
+        }
+    }
+    vmh_filter_rule_t *entries = reinterpret_cast<vmh_filter_rule_t *>(&blob[header.rules]);
+    for (size_t i = 0; i < rules.size(); i++) {
+        entries[i].name = nameOffsets[i];
+        entries[i].length = static_cast<uint16_t>(rules[i].name.size());
+        entries[i].kind = rules[i].kind;
+        entries[i].flags = (vmhIsGlob(rules[i].name.c_str()) ? VMH_FILTER_RULE_GLOB : 0) | (rules[i].tree ? VMH_FILTER_RULE_TREE : 0);
+    }
+    memcpy(&blob[header.pool], pool.data(), pool.size());
+    memcpy(blob.data(), &header, sizeof(header));
+
+    const size_t covered = offsetof(vmh_filter_header_t, checksum) + sizeof(header.checksum);
+    header.checksum = vmh_filter_checksum(blob.data() + covered, static_cast<uint32_t>(blob.size() - covered));
+    memcpy(blob.data(), &header, sizeof(header));
+    return true;
+}
+
+#endif /* vmh_filterc_hpp */
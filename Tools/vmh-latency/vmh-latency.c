@@ -0,0 +1,170 @@
+//
+//  vmh-latency.c
+//  vmh-latency
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Renders the kern.vmh.latency histograms as p50/p99/p99.9 per handler phase.
+//  On macOS the blob is read live from the kext, elsewhere it can be read from a file
+//  saved with -w, for example on Linux:
+//  cc -O2 -o vmh-latency Tools/vmh-latency/vmh-latency.c && ./vmh-latency -f latency.bin
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <sys/sysctl.h> // Required for sysctlbyname
+#endif
+
+#include "../../VMHide/vmh_abi.h"
+
+static const char *phaseNames[VMH_LATENCY_PHASES] = {"lookup", "match", "out", "total"};
+
+typedef struct {
+    vmh_latency_header_t header;
+    uint64_t counts[VMH_LATENCY_PHASES][VMH_LATENCY_BUCKETS];
+} latency_blob_t;
+
+// Reads the blob from the running kext
+static int readSysctl(latency_blob_t *blob) {
+#ifdef __APPLE__
+    size_t len = sizeof(*blob);
+    if (sysctlbyname("kern.vmh.latency", blob, &len, NULL, 0) == -1) {
+        perror("Error calling sysctlbyname");
+        if (errno == ENOENT) {
+            printf("Sysctl 'kern.vmh.latency' does not exist. Is VMHide loaded?\n");
+        }
+        return 1;
+    }
+    if (len != sizeof(*blob)) {
+        printf("Sysctl 'kern.vmh.latency' returned an unexpected length: %zu\n", len);
+        return 1;
+    }
+    return 0;
+#else
+    (void)blob;
+    printf("Reading kern.vmh.latency requires macOS, use -f to read a saved blob.\n");
+    return 1;
+#endif
+}
+
+// Reads a blob saved with -w
+static int readFile(const char *path, latency_blob_t *blob) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+    size_t len = fread(blob, 1, sizeof(*blob), file);
+    fclose(file);
+    if (len != sizeof(*blob)) {
+        printf("'%s' is %zu bytes, expected %zu.\n", path, len, sizeof(*blob));
+        return 1;
+    }
+    return 0;
+}
+
+static int writeFile(const char *path, const latency_blob_t *blob) {
+    FILE *file = fopen(path, "wb");
+    if (!file || fwrite(blob, sizeof(*blob), 1, file) != 1) {
+        perror(path);
+        if (file) {
+            fclose(file);
+        }
+        return 1;
+    }
+    fclose(file);
+    return 0;
+}
+
+// Highest duration in ticks of the bucket holding the given quantile, HDR style
+static uint64_t percentile(const uint64_t *counts, uint64_t total, double quantile, int *saturated) {
+    uint64_t target = (uint64_t)(quantile * (double)total);
+    if (target >= total) {
+        target = total - 1;
+    }
+    uint64_t seen = 0;
+    for (uint32_t bucket = 0; bucket < VMH_LATENCY_BUCKETS; bucket++) {
+        seen += counts[bucket];
+        if (seen > target) {
+            if (bucket == VMH_LATENCY_BUCKETS - 1) {
+                *saturated = 1;
+                return vmh_latency_bucket_low(bucket);
+            }
+            return vmh_latency_bucket_low(bucket + 1) - 1;
+        }
+    }
+    return 0;
+}
+
+// Formats ticks as nanoseconds when the TSC frequency is known
+static void printDuration(uint64_t ticks, uint64_t frequency, int saturated) {
+    if (frequency) {
+        printf(" %s%10.1f ns", saturated ? ">" : " ", (double)ticks * 1e9 / (double)frequency);
+    } else {
+        printf(" %s%10llu tk", saturated ? ">" : " ", (unsigned long long)ticks);
+    }
+}
+
+int main(int argc, char * const argv[]) {
+    const char *input = NULL;
+    const char *output = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "f:w:")) != -1) {
+        switch (option) {
+            case 'f': input = optarg; break;
+            case 'w': output = optarg; break;
+            default:
+                printf("Usage: %s [-f saved.bin] [-w save.bin]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    latency_blob_t *blob = calloc(1, sizeof(*blob));
+    if (!blob || (input ? readFile(input, blob) : readSysctl(blob))) {
+        free(blob);
+        return 1;
+    }
+
+    const vmh_latency_header_t *header = &blob->header;
+    if (header->magic != VMH_LATENCY_MAGIC || header->version != VMH_ABI_VERSION ||
+        header->phases != VMH_LATENCY_PHASES || header->buckets != VMH_LATENCY_BUCKETS ||
+        header->subBits != VMH_LATENCY_SUB_BITS) {
+        printf("Unsupported latency blob (magic 0x%08x, version %u), rebuild vmh-latency against this VMHide.\n",
+               header->magic, header->version);
+        free(blob);
+        return 1;
+    }
+
+    if (output && writeFile(output, blob)) {
+        free(blob);
+        return 1;
+    }
+
+    printf("%-8s %12s %14s %14s %14s\n", "phase", "samples", "p50", "p99", "p99.9");
+    for (uint32_t phase = 0; phase < VMH_LATENCY_PHASES; phase++) {
+        const uint64_t *counts = blob->counts[phase];
+        uint64_t total = 0;
+        for (uint32_t bucket = 0; bucket < VMH_LATENCY_BUCKETS; bucket++) {
+            total += counts[bucket];
+        }
+        printf("%-8s %12llu", phaseNames[phase], (unsigned long long)total);
+        if (total) {
+            static const double quantiles[] = {0.50, 0.99, 0.999};
+            for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+                int saturated = 0;
+                uint64_t ticks = percentile(counts, total, quantiles[i], &saturated);
+                printDuration(ticks, header->tscFrequency, saturated);
+            }
+        }
+        printf("\n");
+    }
+
+    // The original handler only performs the SYSCTL_OUT phase, everything else is added by VMHide
+    printf("\nThe original handler only performs 'out', 'total' minus 'out' is the latency VMHide adds.\n");
+    free(blob);
+    return 0;
+}
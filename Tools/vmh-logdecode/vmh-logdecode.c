@@ -0,0 +1,211 @@
+//
+//  vmh-logdecode.c
+//  vmh-logdecode
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Decodes the binary log records VMHide keeps instead of formatting DBGLOG messages in the
+//  hv_vmm_present handler. On macOS the records are drained live from kern.vmh.log (root only),
+//  anywhere else they can be decoded from a file saved with -w, for example on Linux:
+//  cc -O2 -o vmh-logdecode Tools/vmh-logdecode/vmh-logdecode.c && ./vmh-logdecode -f vmh.log
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <sys/sysctl.h> // Required for sysctlbyname
+#endif
+
+#include "../../VMHide/vmh_abi.h"
+
+// Message table, generated from the same list the kext records with
+typedef struct {
+    const char *module;
+    const char *format;
+} message_t;
+
+#define VMH_LOG_MESSAGE_ENTRY(id, module, format) {module, format},
+static const message_t messages[VMH_MSG_COUNT] = {
+    VMH_LOG_MESSAGES(VMH_LOG_MESSAGE_ENTRY)
+};
+#undef VMH_LOG_MESSAGE_ENTRY
+
+// Expands the {field} placeholders of a message format with the fields of a record
+static void render(const vmh_log_record_t *record, char *out, size_t size) {
+    const char *format = record->message < VMH_MSG_COUNT ? messages[record->message].format : "Unknown message {arg}.";
+    size_t used = 0;
+    out[0] = '\0';
+    while (*format && used + 1 < size) {
+        int written = 0;
+        if (strncmp(format, "{name}", 6) == 0) {
+            written = snprintf(out + used, size - used, "%.*s", VMH_LOG_NAME_LEN, record->name);
+            format += 6;
+        } else if (strncmp(format, "{pid}", 5) == 0) {
+            written = snprintf(out + used, size - used, "%d", record->pid);
+            format += 5;
+        } else if (strncmp(format, "{verdict}", 9) == 0) {
+            written = snprintf(out + used, size - used, "%u", record->verdict);
+            format += 9;
+        } else if (strncmp(format, "{arg}", 5) == 0) {
+            written = snprintf(out + used, size - used, "%llu", (unsigned long long)record->arg);
+            format += 5;
+        } else if (strncmp(format, "{hex}", 5) == 0) {
+            written = snprintf(out + used, size - used, "0x%llx", (unsigned long long)record->arg);
+            format += 5;
+        } else {
+            out[used] = *format++;
+            out[used + 1] = '\0';
+            written = 1;
+        }
+        if (written < 0) {
+            break;
+        }
+        used += (size_t)written < size - used ? (size_t)written : size - used - 1;
+    }
+}
+
+static int compareTimestamps(const void *a, const void *b) {
+    uint64_t left = ((const vmh_log_record_t *)a)->timestamp;
+    uint64_t right = ((const vmh_log_record_t *)b)->timestamp;
+    return left < right ? -1 : left > right;
+}
+
+// Prints one drained batch, records of different CPUs are merged by timestamp
+static int decode(const vmh_log_header_t *header, vmh_log_record_t *records, size_t count) {
+    if (header->magic != VMH_LOG_MAGIC || header->version != VMH_ABI_VERSION || header->recordSize != sizeof(vmh_log_record_t)) {
+        printf("Unsupported log blob (magic 0x%08x, version %u), rebuild vmh-logdecode against this VMHide.\n",
+               header->magic, header->version);
+        return 1;
+    }
+    if (header->lost) {
+        printf("--- %llu records lost, drain more often ---\n", (unsigned long long)header->lost);
+    }
+
+    qsort(records, count, sizeof(*records), compareTimestamps);
+    uint32_t numer = header->timebaseNumer ? header->timebaseNumer : 1;
+    uint32_t denom = header->timebaseDenom ? header->timebaseDenom : 1;
+    char line[512];
+    for (size_t i = 0; i < count; i++) {
+        const vmh_log_record_t *record = &records[i];
+        double seconds = (double)record->timestamp * numer / denom / 1e9;
+        const char *module = record->message < VMH_MSG_COUNT ? messages[record->message].module : "???";
+        render(record, line, sizeof(line));
+        printf("[%14.6f] CPU%-3u %s: %s\n", seconds, record->cpu, module, line);
+    }
+    return 0;
+}
+
+// Decodes a file of one or more blobs, as appended by -w. Every blob is preceded by its length.
+static int decodeFile(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+
+    int result = 0;
+    uint64_t length;
+    while (!result && fread(&length, sizeof(length), 1, file) == 1) {
+        if (length < sizeof(vmh_log_header_t) || length > (1ULL << 30)) {
+            printf("'%s' is not a saved VMHide log.\n", path);
+            result = 1;
+            break;
+        }
+        unsigned char *blob = malloc(length);
+        if (!blob || fread(blob, 1, length, file) != length) {
+            printf("'%s' is truncated.\n", path);
+            free(blob);
+            result = 1;
+            break;
+        }
+        vmh_log_header_t header;
+        memcpy(&header, blob, sizeof(header));
+        size_t count = (length - sizeof(header)) / sizeof(vmh_log_record_t);
+        result = decode(&header, (vmh_log_record_t *)(blob + sizeof(header)), count);
+        free(blob);
+    }
+    fclose(file);
+    return result;
+}
+
+#ifdef __APPLE__
+// Drains kern.vmh.log once, optionally appending the raw blob to save
+static int drainSysctl(FILE *save) {
+    size_t len = 0;
+    if (sysctlbyname("kern.vmh.log", NULL, &len, NULL, 0) == -1) {
+        perror("Error calling sysctlbyname");
+        if (errno == ENOENT) {
+            printf("Sysctl 'kern.vmh.log' does not exist. Is VMHide loaded?\n");
+        } else if (errno == EPERM) {
+            printf("Draining 'kern.vmh.log' requires root.\n");
+        }
+        return 1;
+    }
+    unsigned char *blob = malloc(len);
+    if (!blob || sysctlbyname("kern.vmh.log", blob, &len, NULL, 0) == -1 || len < sizeof(vmh_log_header_t)) {
+        perror("Error calling sysctlbyname");
+        free(blob);
+        return 1;
+    }
+    if (save) {
+        uint64_t length = len;
+        fwrite(&length, sizeof(length), 1, save);
+        fwrite(blob, 1, len, save);
+        fflush(save);
+    }
+    vmh_log_header_t header;
+    memcpy(&header, blob, sizeof(header));
+    size_t count = (len - sizeof(header)) / sizeof(vmh_log_record_t);
+    int result = decode(&header, (vmh_log_record_t *)(blob + sizeof(header)), count);
+    free(blob);
+    return result;
+}
+#endif
+
+int main(int argc, char * const argv[]) {
+    const char *input = NULL;
+    const char *output = NULL;
+    int follow = 0;
+    int option;
+    while ((option = getopt(argc, argv, "f:w:F")) != -1) {
+        switch (option) {
+            case 'f': input = optarg; break;
+            case 'w': output = optarg; break;
+            case 'F': follow = 1; break;
+            default:
+                printf("Usage: %s [-f saved.log] [-w save.log] [-F]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (input) {
+        return decodeFile(input);
+    }
+
+#ifdef __APPLE__
+    FILE *save = NULL;
+    if (output && !(save = fopen(output, "ab"))) {
+        perror(output);
+        return 1;
+    }
+    int result;
+    do {
+        result = drainSysctl(save);
+        if (follow) {
+            usleep(250000);
+        }
+    } while (follow && !result);
+    if (save) {
+        fclose(save);
+    }
+    return result;
+#else
+    (void)output;
+    (void)follow;
+    printf("Draining kern.vmh.log requires macOS, use -f to decode a saved log.\n");
+    return 1;
+#endif
+}
@@ -0,0 +1,368 @@
+//
+//  vmh-replay.cpp
+//  vmh-replay
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Replays hv_vmm_present call traces through the unmodified handler, built against the
+//  userspace mocks of Host/, and reports throughput and per-call latency. Linux only, built by
+//  the CMakeLists.txt at the root of the repository.
+//
+//  Traces are recorded by VMHide itself. On the macOS guest, as root:
+//  sysctl kern.vmh.trace_enabled=1
+//  while sleep 0.5; do sysctl -b kern.vmh.trace; done >> hosts.trace
+//  then, anywhere: vmh-replay hosts.trace
+//
+//  Every call is replayed as the process that made it, with its pid, name and exec history,
+//  so the verdict and executable caches see the same stream they saw on the guest. Recorded
+//  processes have no executable or code signature, path: and bundle: rules never match them.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../VMHide/kern_vmm.hpp"
+
+// Defined by kern_start.cpp, registered by VMH::init
+extern struct sysctl_oid sysctl__kern_vmh;
+
+struct Trace {
+    std::vector<vmh_trace_record_t> records;
+    uint32_t timebaseNumer {1};
+    uint32_t timebaseDenom {1};
+    uint64_t tscFrequency {0};
+    uint64_t lost {0};
+};
+
+// One replayed call, the process it runs as and whether that process called exec right before
+struct Call {
+    proc_t proc;
+    bool exec;
+    bool first;
+    const vmh_trace_record_t *record;
+};
+
+static void usage(const char *tool) {
+    fprintf(stderr,
+            "usage: %s [-p] [-n repeat] [-F filter] trace...\n"
+            "       %s -s calls -o trace\n"
+            "  -p         replay at the original pacing rather than at full speed\n"
+            "  -n repeat  replay the trace this many times, 1 by default\n"
+            "  -F filter  replace kern.vmh.filter before replaying, to compare filter lists\n"
+            "  -s calls   record a synthetic workload of this many calls into -o instead\n",
+            tool, tool);
+}
+
+// Everything VMH::init does past its CPUID guard, which would refuse most build machines
+static void bootModule() {
+    sysctl_register_oid(&sysctl__kern_vmh);
+    VMHStats::init();
+    VMHLog::init();
+    VMHTrace::init();
+    lilu.onPatcherLoadForce(&VMH::solveSysCtlChildrenAddr);
+    KernelPatcher patcher;
+    vmhHostLoadPatcher(patcher);
+}
+
+// Calls the kern.hv_vmm_present handler as the current process, the way sysctl dispatches it
+static int callHandler(sysctl_oid *oid) {
+    int value = -1;
+    sysctl_req req;
+    vmhHostSysctlRequest(req, &value, sizeof(value), nullptr, 0);
+    int error = oid->oid_handler(oid, oid->oid_arg1, oid->oid_arg2, &req);
+    return error ? -1 : value;
+}
+
+/**
+ * Trace files
+ */
+
+// Appends every kern.vmh.trace read found in path to trace
+static bool loadTrace(const char *path, Trace &trace) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "vmh-replay: cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    bool first = trace.records.empty();
+    vmh_trace_header_t header;
+    size_t reads = 0;
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        if (header.magic != VMH_TRACE_MAGIC || header.version != VMH_ABI_VERSION || header.recordSize != sizeof(vmh_trace_record_t)) {
+            fprintf(stderr, "vmh-replay: %s: read %zu is not a version %d trace\n", path, reads, VMH_ABI_VERSION);
+            fclose(file);
+            return false;
+        }
+        size_t offset = trace.records.size();
+        trace.records.resize(offset + header.count);
+        if (fread(&trace.records[offset], sizeof(vmh_trace_record_t), header.count, file) != header.count) {
+            fprintf(stderr, "vmh-replay: %s: read %zu is truncated\n", path, reads);
+            fclose(file);
+            return false;
+        }
+        if (first) {
+            trace.timebaseNumer = header.timebaseNumer ? header.timebaseNumer : 1;
+            trace.timebaseDenom = header.timebaseDenom ? header.timebaseDenom : 1;
+            trace.tscFrequency = header.tscFrequency;
+            first = false;
+        }
+        trace.lost += header.lost;
+        reads++;
+    }
+    fclose(file);
+    return true;
+}
+
+// Drains kern.vmh.trace into file
+static bool drainTrace(FILE *file, std::vector<char> &buffer, size_t &records) {
+    size_t length = buffer.size();
+    if (sysctlbyname("kern.vmh.trace", buffer.data(), &length, nullptr, 0) != 0) {
+        fprintf(stderr, "vmh-replay: cannot read kern.vmh.trace: %s\n", strerror(errno));
+        return false;
+    }
+    const vmh_trace_header_t *header = reinterpret_cast<const vmh_trace_header_t *>(buffer.data());
+    if (header->lost) {
+        fprintf(stderr, "vmh-replay: %llu records were lost\n", static_cast<unsigned long long>(header->lost));
+        return false;
+    }
+    records += header->count;
+    return fwrite(buffer.data(), 1, length, file) == length;
+}
+
+/**
+ * Recording
+ */
+
+// Daemons of a typical guest, the filtered ones among them are asked as often as the others
+static const char *const workloadNames[] = {
+    "launchd", "logd", "mds", "mds_stores", "mdworker_shared", "softwareupdated", "trustd", "cfprefsd",
+    "com.apple.MobileSoftwareUpdate.UpdateBrainService", "distnoted", "sysctl", "osinstallersetupd",
+    "SoftwareUpdateNotificationManager", "WindowServer", "Finder", "Dock", "Safari", "bird", "cloudd",
+    "nsurlsessiond", "akd", "apsd", "com.apple.MobileAsset", "system_profiler", "ioreg",
+};
+
+// Records a synthetic workload: popular processes ask far more often than the rest, some call exec and new ones start
+static int recordWorkload(size_t calls, const char *output) {
+    FILE *file = fopen(output, "wb");
+    if (!file) {
+        fprintf(stderr, "vmh-replay: cannot create %s: %s\n", output, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    bootModule();
+    int enable = 1;
+    if (sysctlbyname("kern.vmh.trace_enabled", nullptr, nullptr, &enable, sizeof(enable)) != 0) {
+        fprintf(stderr, "vmh-replay: cannot enable kern.vmh.trace: %s\n", strerror(errno));
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+    sysctl_oid *oid = VMHSysctl::find("kern.hv_vmm_present");
+
+    std::vector<proc_t> procs;
+    for (size_t i = 0; i < 256; i++) {
+        procs.push_back(vmhHostSpawn(workloadNames[i % arrsize(workloadNames)]));
+    }
+    std::vector<char> buffer(sizeof(vmh_trace_header_t) + VMH_TRACE_SLOTS * sizeof(vmh_trace_record_t));
+    size_t recorded = 0;
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    bool ok = true;
+    for (size_t i = 0; i < calls && ok; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        double uniform = static_cast<double>(state >> 11) / static_cast<double>(1ULL << 53);
+        size_t index = static_cast<size_t>(uniform * uniform * uniform * static_cast<double>(procs.size()));
+        if (state % 512 == 0) {
+            vmhHostExec(procs[index], workloadNames[(state >> 16) % arrsize(workloadNames)]);
+        } else if (state % 512 == 1) {
+            vmhHostExit(procs[index]);
+            procs[index] = vmhHostSpawn(workloadNames[(state >> 16) % arrsize(workloadNames)]);
+        }
+        vmhHostSetCurrentProc(procs[index]);
+        callHandler(oid);
+        if (i % (VMH_TRACE_SLOTS / 2) == VMH_TRACE_SLOTS / 2 - 1) {
+            vmhHostSetCurrentProc(nullptr);
+            ok = drainTrace(file, buffer, recorded);
+        }
+    }
+    vmhHostSetCurrentProc(nullptr);
+    ok = ok && drainTrace(file, buffer, recorded);
+    fclose(file);
+    if (!ok || recorded != calls) {
+        fprintf(stderr, "vmh-replay: recorded %zu of %zu calls\n", recorded, calls);
+        return EXIT_FAILURE;
+    }
+    printf("vmh-replay: recorded %zu calls of %zu processes into %s\n", recorded, procs.size(), output);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Replay
+ */
+
+// Turns the records into calls, recreating every recorded process along with its exec history
+static std::vector<Call> prepareCalls(const Trace &trace, size_t &processes) {
+    std::map<pid_t, std::pair<proc_t, uint32_t>> live;
+    std::vector<Call> calls;
+    processes = 0;
+    for (const vmh_trace_record_t &record : trace.records) {
+        char name[VMH_TRACE_NAME_LEN + 1];
+        memcpy(name, record.name, VMH_TRACE_NAME_LEN);
+        name[VMH_TRACE_NAME_LEN] = '\0';
+
+        // The kernel calls as itself, and keeps its pid
+        if (record.pid == 0) {
+            calls.push_back({nullptr, false, false, &record});
+            continue;
+        }
+        auto found = live.find(record.pid);
+        bool exec = false;
+        bool first = false;
+        if (found == live.end()) {
+            proc_t proc = vmhHostSpawnPid(record.pid, name);
+            if (!proc) {
+                continue;
+            }
+            found = live.emplace(record.pid, std::make_pair(proc, record.generation)).first;
+            processes++;
+            first = true;
+        } else if (found->second.second != record.generation) {
+            // A new generation under the same pid is an exec, or a pid recycled by a new process
+            found->second.second = record.generation;
+            exec = true;
+        }
+        calls.push_back({found->second.first, exec, first, &record});
+    }
+    return calls;
+}
+
+static double percentile(const std::vector<double> &sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+static int replay(const Trace &trace, bool paced, size_t repeat, bool expectVerdicts) {
+    size_t processes = 0;
+    std::vector<Call> calls = prepareCalls(trace, processes);
+    if (calls.empty()) {
+        fprintf(stderr, "vmh-replay: the trace holds no calls\n");
+        return EXIT_FAILURE;
+    }
+    sysctl_oid *oid = VMHSysctl::find("kern.hv_vmm_present");
+    uint64_t firstTimestamp = calls.front().record->timestamp;
+    uint64_t lastTimestamp = calls.back().record->timestamp;
+
+    std::vector<double> latencies;
+    latencies.reserve(calls.size() * repeat);
+    size_t disagreements = 0;
+    uint64_t hitsBefore = VMHStats::read(VMHStatCacheHits);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < repeat; round++) {
+        auto roundStart = std::chrono::steady_clock::now();
+        for (const Call &call : calls) {
+            if (paced) {
+                // mach_absolute_time ticks to nanoseconds, through the timebase of the recording machine
+                uint64_t offset = (call.record->timestamp - firstTimestamp) * trace.timebaseNumer / trace.timebaseDenom;
+                std::this_thread::sleep_until(roundStart + std::chrono::nanoseconds(offset));
+            }
+            // Later rounds start every process over from the image it was first seen with
+            if (call.exec || (round && call.first)) {
+                char name[VMH_TRACE_NAME_LEN + 1];
+                memcpy(name, call.record->name, VMH_TRACE_NAME_LEN);
+                name[VMH_TRACE_NAME_LEN] = '\0';
+                vmhHostExec(call.proc, name);
+            }
+            vmhHostSetCurrentProc(call.proc);
+            auto before = std::chrono::steady_clock::now();
+            int verdict = callHandler(oid);
+            auto after = std::chrono::steady_clock::now();
+            latencies.push_back(std::chrono::duration<double, std::nano>(after - before).count());
+            disagreements += verdict != call.record->verdict;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    vmhHostSetCurrentProc(nullptr);
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double hits = static_cast<double>(VMHStats::read(VMHStatCacheHits) - hitsBefore);
+    std::sort(latencies.begin(), latencies.end());
+    printf("vmh-replay: %zu calls of %zu processes, %.3f s recorded, %llu records lost while recording\n",
+           calls.size(), processes, static_cast<double>((lastTimestamp - firstTimestamp) * trace.timebaseNumer / trace.timebaseDenom) / 1e9,
+           static_cast<unsigned long long>(trace.lost));
+    printf("  replayed %zu times %s: %.3f s, %.0f calls/s, %.1f%% cache hits\n", repeat, paced ? "at the original pacing" : "at full speed",
+           seconds, static_cast<double>(latencies.size()) / seconds, 100.0 * hits / static_cast<double>(latencies.size()));
+    printf("  latency ns: p50 %.0f, p90 %.0f, p99 %.0f, p99.9 %.0f, max %.0f\n", percentile(latencies, 0.5), percentile(latencies, 0.9),
+           percentile(latencies, 0.99), percentile(latencies, 0.999), latencies.back());
+
+    // The handler timed itself on the guest as well
+    if (trace.tscFrequency) {
+        std::vector<double> recorded;
+        for (const vmh_trace_record_t &record : trace.records) {
+            recorded.push_back(static_cast<double>(record.ticks) * 1e9 / static_cast<double>(trace.tscFrequency));
+        }
+        std::sort(recorded.begin(), recorded.end());
+        printf("  recorded ns: p50 %.0f, p90 %.0f, p99 %.0f, p99.9 %.0f, max %.0f\n", percentile(recorded, 0.5), percentile(recorded, 0.9),
+               percentile(recorded, 0.99), percentile(recorded, 0.999), recorded.back());
+    }
+    printf("  %zu verdicts differ from the recorded ones\n", disagreements);
+    return expectVerdicts && disagreements ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    bool paced = false;
+    size_t repeat = 1;
+    size_t synthetic = 0;
+    const char *filter = nullptr;
+    const char *output = nullptr;
+    int option;
+    while ((option = getopt(argc, argv, "pn:F:s:o:h")) != -1) {
+        switch (option) {
+            case 'p': paced = true; break;
+            case 'n': repeat = strtoull(optarg, nullptr, 0); break;
+            case 'F': filter = optarg; break;
+            case 's': synthetic = strtoull(optarg, nullptr, 0); break;
+            case 'o': output = optarg; break;
+            default: usage(argv[0]); return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (synthetic) {
+        if (!output) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        return recordWorkload(synthetic, output);
+    }
+    if (optind == argc || repeat == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Trace trace;
+    for (int i = optind; i < argc; i++) {
+        if (!loadTrace(argv[i], trace)) {
+            return EXIT_FAILURE;
+        }
+    }
+    // Reads of different CPUs never overlap, but files may be given in any order
+    std::stable_sort(trace.records.begin(), trace.records.end(), [](const vmh_trace_record_t &a, const vmh_trace_record_t &b) {
+        return a.timestamp < b.timestamp;
+    });
+
+    bootModule();
+    if (filter && sysctlbyname("kern.vmh.filter", nullptr, nullptr, const_cast<char *>(filter), strlen(filter)) != 0) {
+        fprintf(stderr, "vmh-replay: cannot write kern.vmh.filter: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // With the filter list of the recording, every verdict must come out the same
+    return replay(trace, paced, repeat, filter == nullptr);
+}
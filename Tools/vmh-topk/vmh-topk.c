@@ -0,0 +1,124 @@
+//
+//  vmh-topk.c
+//  vmh-topk
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Lists the processes querying kern.hv_vmm_present the most, from kern.vmh.topk, with their
+//  estimated call count and the value they were answered. On macOS the blob is read live from
+//  the kext as root, elsewhere it can be read from a file saved with -w, for example on Linux:
+//  cc -O2 -o vmh-topk Tools/vmh-topk/vmh-topk.c -lm && ./vmh-topk -f topk.bin
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <sys/sysctl.h> // Required for sysctlbyname
+#endif
+
+#include "../../VMHide/vmh_abi.h"
+
+typedef struct {
+    vmh_topk_header_t header;
+    vmh_topk_entry_t entries[VMH_TOPK_SLOTS];
+} topk_blob_t;
+
+// Reads the blob from the running kext, returns its length or 0
+static size_t readSysctl(topk_blob_t *blob) {
+#ifdef __APPLE__
+    size_t len = sizeof(*blob);
+    if (sysctlbyname("kern.vmh.topk", blob, &len, NULL, 0) == -1) {
+        perror("Error calling sysctlbyname");
+        if (errno == ENOENT) {
+            printf("Sysctl 'kern.vmh.topk' does not exist. Is VMHide loaded?\n");
+        } else if (errno == EPERM) {
+            printf("Reading 'kern.vmh.topk' requires root, run with sudo.\n");
+        }
+        return 0;
+    }
+    return len;
+#else
+    (void)blob;
+    printf("Reading kern.vmh.topk requires macOS, use -f to read a saved blob.\n");
+    return 0;
+#endif
+}
+
+// Reads a blob saved with -w
+static size_t readFile(const char *path, topk_blob_t *blob) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return 0;
+    }
+    size_t len = fread(blob, 1, sizeof(*blob), file);
+    fclose(file);
+    return len;
+}
+
+static int writeFile(const char *path, const topk_blob_t *blob, size_t len) {
+    FILE *file = fopen(path, "wb");
+    if (!file || fwrite(blob, len, 1, file) != 1) {
+        perror(path);
+        if (file) {
+            fclose(file);
+        }
+        return 1;
+    }
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char * const argv[]) {
+    const char *input = NULL;
+    const char *output = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "f:w:")) != -1) {
+        switch (option) {
+            case 'f': input = optarg; break;
+            case 'w': output = optarg; break;
+            default:
+                printf("Usage: %s [-f saved.bin] [-w save.bin]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    topk_blob_t blob;
+    memset(&blob, 0, sizeof(blob));
+    size_t len = input ? readFile(input, &blob) : readSysctl(&blob);
+    if (len < sizeof(blob.header)) {
+        if (len) {
+            printf("The top callers blob is %zu bytes, expected at least %zu.\n", len, sizeof(blob.header));
+        }
+        return 1;
+    }
+
+    const vmh_topk_header_t *header = &blob.header;
+    if (header->magic != VMH_TOPK_MAGIC || header->version != VMH_ABI_VERSION || header->entrySize != sizeof(vmh_topk_entry_t) ||
+        header->count > VMH_TOPK_SLOTS || len != sizeof(*header) + header->count * sizeof(vmh_topk_entry_t)) {
+        printf("Unsupported top callers blob (magic 0x%08x, version %u), rebuild vmh-topk against this VMHide.\n",
+               header->magic, header->version);
+        return 1;
+    }
+
+    if (output && writeFile(output, &blob, len)) {
+        return 1;
+    }
+
+    printf("%4s  %-16s %14s %8s %8s\n", "rank", "process", "calls", "share", "answer");
+    for (uint32_t i = 0; i < header->count; i++) {
+        const vmh_topk_entry_t *entry = &blob.entries[i];
+        double share = header->calls ? 100.0 * (double)entry->count / (double)header->calls : 0.0;
+        printf("%4u  %-16.*s %14llu %7.2f%% %8u\n", i + 1, VMH_TOPK_NAME_LEN, entry->name, (unsigned long long)entry->count, share, entry->verdict);
+    }
+
+    // Count-min guarantee, every estimate is at most e / width of all calls above the true count
+    double bound = M_E * (double)header->calls / (double)(header->width ? header->width : 1);
+    printf("\n%llu calls counted. Each count may exceed the true one by up to %.0f calls, with %.1f%% confidence.\n",
+           (unsigned long long)header->calls, bound, 100.0 * (1.0 - exp(-(double)header->depth)));
+    return 0;
+}
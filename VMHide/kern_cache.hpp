@@ -0,0 +1,230 @@
+//
+//  kern_cache.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_cache_hpp
+#define kern_cache_hpp
+
+// Like kern_filter.hpp, this header stays free of kernel includes so the tools can share it.
+#include <stddef.h>
+#include <stdint.h>
+
+// Bits of caller data a VMHVerdictCache entry carries along with the verdict
+#define VMH_VERDICT_NOTE_BITS 9
+
+/**
+ * @brief Fixed-size, lock-free cache of filter verdicts keyed by pid and process generation.
+ *
+ * Every slot is a single 64-bit word, so readers and writers only ever need one relaxed
+ * atomic load or store and can never observe a torn entry. The word packs a valid bit,
+ * the verdict, a VMH_VERDICT_NOTE_BITS note, 22 bits of the process generation
+ * (proc_pidversion, which changes on every fork and exec) and 31 bits of the pid. A recycled
+ * pid therefore never hits the entry of the process that previously owned it, unless it was
+ * recycled exactly a multiple of 4M generations later. Colliding pids simply overwrite each other.
+ *
+ * @tparam Slots Number of entries, must be a power of two.
+ */
+template <size_t Slots>
+class VMHVerdictCache {
+	static_assert(Slots && !(Slots & (Slots - 1)), "VMHVerdictCache size must be a power of two");
+
+public:
+	/**
+	 * @brief Looks up the cached verdict of a process.
+	 * @param note Receives the note attached by annotate, 0 if none. May be null.
+	 * @return true on a hit, in which case verdict is filled in.
+	 */
+	bool lookup(int32_t pid, uint32_t generation, bool &verdict, uint32_t *note = nullptr) const {
+		uint64_t entry = __atomic_load_n(&entries[index(pid)], __ATOMIC_RELAXED);
+		if ((entry & ~(VerdictBit | NoteMask)) != key(pid, generation)) {
+			return false;
+		}
+		verdict = (entry & VerdictBit) != 0;
+		if (note) {
+			*note = static_cast<uint32_t>((entry & NoteMask) >> NoteShift);
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Records the verdict of a process, replacing whatever occupied its slot.
+	 */
+	void store(int32_t pid, uint32_t generation, bool verdict) {
+		__atomic_store_n(&entries[index(pid)], key(pid, generation) | (verdict ? VerdictBit : 0), __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * @brief Attaches a note to the cached verdict of a process, if it is still cached.
+	 * The verdict is never stored again, so a concurrent clear() always wins.
+	 */
+	void annotate(int32_t pid, uint32_t generation, uint32_t note) {
+		uint64_t *slot = &entries[index(pid)];
+		uint64_t entry = __atomic_load_n(slot, __ATOMIC_RELAXED);
+		if ((entry & ~(VerdictBit | NoteMask)) == key(pid, generation)) {
+			uint64_t annotated = (entry & ~NoteMask) | ((static_cast<uint64_t>(note) << NoteShift) & NoteMask);
+			__atomic_compare_exchange_n(slot, &entry, annotated, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		}
+	}
+
+	/**
+	 * @brief Drops the entry of a pid, regardless of its generation.
+	 */
+	void invalidate(int32_t pid) {
+		uint64_t *slot = &entries[index(pid)];
+		uint64_t entry = __atomic_load_n(slot, __ATOMIC_RELAXED);
+		if ((entry & PidMask) == (static_cast<uint64_t>(pid) & PidMask)) {
+			// Only clear the slot if nobody replaced it in the meantime
+			__atomic_compare_exchange_n(slot, &entry, 0, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		}
+	}
+
+	/**
+	 * @brief Drops every entry, used whenever the filter itself changes.
+	 */
+	void clear() {
+		for (size_t i = 0; i < Slots; i++) {
+			__atomic_store_n(&entries[i], 0, __ATOMIC_RELAXED);
+		}
+	}
+
+private:
+	static constexpr uint64_t ValidBit = 1ULL << 63;
+	static constexpr uint64_t VerdictBit = 1ULL << 62;
+	static constexpr uint64_t PidMask = 0x7fffffffULL;
+	static constexpr unsigned GenerationBits = 62 - VMH_VERDICT_NOTE_BITS - 31;
+	static constexpr unsigned NoteShift = 31 + GenerationBits;
+	static constexpr uint64_t NoteMask = ((1ULL << VMH_VERDICT_NOTE_BITS) - 1) << NoteShift;
+
+	uint64_t entries[Slots] {};
+
+	static size_t index(int32_t pid) {
+		return (static_cast<uint32_t>(pid) * 2654435761U) & (Slots - 1);
+	}
+
+	static uint64_t key(int32_t pid, uint32_t generation) {
+		return ValidBit | ((static_cast<uint64_t>(generation) & ((1ULL << GenerationBits) - 1)) << 31) | (static_cast<uint64_t>(pid) & PidMask);
+	}
+};
+
+/**
+ * @brief Fixed-size, lock-free cache of 32-bit name hashes keyed by pid.
+ *
+ * Same single-word layout as VMHVerdictCache, the word packs a valid bit, 31 bits of the pid
+ * and the hash. There is no room for the process generation, so an entry is only as current
+ * as its last store: callers store the hash whenever they store a verdict of the process in a
+ * VMHVerdictCache with as many slots, and trust it only while that verdict hits.
+ *
+ * @tparam Slots Number of entries, must be a power of two.
+ */
+template <size_t Slots>
+class VMHNameHashCache {
+	static_assert(Slots && !(Slots & (Slots - 1)), "VMHNameHashCache size must be a power of two");
+
+public:
+	/**
+	 * @brief Looks up the name hash of a pid.
+	 * @return true on a hit, in which case hash is filled in.
+	 */
+	bool lookup(int32_t pid, uint32_t &hash) const {
+		uint64_t entry = __atomic_load_n(&entries[index(pid)], __ATOMIC_RELAXED);
+		if ((entry & (ValidBit | PidMask)) != key(pid)) {
+			return false;
+		}
+		hash = static_cast<uint32_t>(entry >> HashShift);
+		return true;
+	}
+
+	/**
+	 * @brief Records the name hash of a pid, replacing whatever occupied its slot.
+	 */
+	void store(int32_t pid, uint32_t hash) {
+		__atomic_store_n(&entries[index(pid)], key(pid) | (static_cast<uint64_t>(hash) << HashShift), __ATOMIC_RELAXED);
+	}
+
+private:
+	static constexpr uint64_t ValidBit = 1ULL << 31;
+	static constexpr uint64_t PidMask = 0x7fffffffULL;
+	static constexpr unsigned HashShift = 32;
+
+	uint64_t entries[Slots] {};
+
+	// Same slot as the pid has in a VMHVerdictCache of as many slots
+	static size_t index(int32_t pid) {
+		return (static_cast<uint32_t>(pid) * 2654435761U) & (Slots - 1);
+	}
+
+	static uint64_t key(int32_t pid) {
+		return ValidBit | (static_cast<uint64_t>(pid) & PidMask);
+	}
+};
+
+/**
+ * @brief Fixed-size, lock-free cache of filter verdicts keyed by executable vnode.
+ *
+ * Same single-word layout as VMHVerdictCache, keyed by the vnode address and its vid
+ * (vnode_vid, which changes whenever the vnode is recycled for another file). The slot is
+ * taken from the low address bits and the next 30 bits are kept in the entry, which together
+ * cover the whole 512 GB x86_64 kernel address space, so a verdict is never served for a
+ * different executable.
+ *
+ * @tparam Slots Number of entries, must be a power of two.
+ */
+template <size_t Slots>
+class VMHVnodeVerdictCache {
+	static_assert(Slots && !(Slots & (Slots - 1)), "VMHVnodeVerdictCache size must be a power of two");
+	static_assert(Slots >= 64, "VMHVnodeVerdictCache needs at least 64 slots to tell every kernel address apart");
+
+public:
+	/**
+	 * @brief Looks up the cached verdict of an executable.
+	 * @return true on a hit, in which case verdict is filled in.
+	 */
+	bool lookup(const void *vnode, uint32_t vid, bool &verdict) const {
+		uint64_t entry = __atomic_load_n(&entries[index(vnode)], __ATOMIC_RELAXED);
+		if ((entry & ~VerdictBit) != key(vnode, vid)) {
+			return false;
+		}
+		verdict = (entry & VerdictBit) != 0;
+		return true;
+	}
+
+	/**
+	 * @brief Records the verdict of an executable, replacing whatever occupied its slot.
+	 */
+	void store(const void *vnode, uint32_t vid, bool verdict) {
+		__atomic_store_n(&entries[index(vnode)], key(vnode, vid) | (verdict ? VerdictBit : 0), __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * @brief Drops every entry, used whenever the filter itself changes.
+	 */
+	void clear() {
+		for (size_t i = 0; i < Slots; i++) {
+			__atomic_store_n(&entries[i], 0, __ATOMIC_RELAXED);
+		}
+	}
+
+private:
+	static constexpr uint64_t ValidBit = 1ULL << 63;
+	static constexpr uint64_t VerdictBit = 1ULL << 62;
+
+	// vnodes are at least 8 byte aligned, the lowest bits carry no information
+	static constexpr unsigned AlignBits = 3;
+	static constexpr unsigned SlotBits = __builtin_ctzll(Slots);
+
+	uint64_t entries[Slots] {};
+
+	static size_t index(const void *vnode) {
+		return (reinterpret_cast<uintptr_t>(vnode) >> AlignBits) & (Slots - 1);
+	}
+
+	static uint64_t key(const void *vnode, uint32_t vid) {
+		uint64_t tag = (reinterpret_cast<uintptr_t>(vnode) >> (AlignBits + SlotBits)) & 0x3fffffffULL;
+		return ValidBit | (tag << 32) | vid;
+	}
+};
+
+#endif /* kern_cache_hpp */
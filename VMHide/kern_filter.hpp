@@ -0,0 +1,362 @@
+//
+//  kern_filter.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_filter_hpp
+#define kern_filter_hpp
+
+// This header is intentionally free of kernel and Lilu includes, so that the exact
+// same lookup code can be compiled into the userspace tools and benchmarks.
+#include <stddef.h>
+#include <stdint.h>
+#include "kern_namekey.hpp"
+
+// Upper bound on compared bytes of a filter name, mirrors MAX_PROC_NAME_LEN
+#define VMH_FILTER_NAME_MAX 256
+
+// Upper bound on seeds tried per bucket, and keys that may share a single bucket
+#define VMH_FILTER_MAX_SEED 0x100000
+#define VMH_FILTER_MAX_BUCKET 16
+
+/**
+ * @brief 64-bit FNV-1a hash of a NUL terminated name, bounded by VMH_FILTER_NAME_MAX.
+ */
+constexpr uint64_t vmhNameHash(const char *name) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < VMH_FILTER_NAME_MAX && name[i] != '\0'; i++) {
+		hash ^= static_cast<uint8_t>(name[i]);
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/**
+ * @brief Derives a slot hash from a name hash and a per-bucket seed (splitmix64 finalizer).
+ */
+constexpr uint64_t vmhNameMix(uint64_t hash, uint32_t seed) {
+	uint64_t x = hash ^ (static_cast<uint64_t>(seed) * 0x9e3779b97f4a7c15ULL);
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+/**
+ * @brief Hash of a name from its key, valid for names of up to VMH_NAME_KEY_LEN bytes.
+ */
+constexpr uint64_t vmhNameKeyHash(const VMHNameKey &key) {
+	return vmhNameMix(key.words[0] ^ vmhNameMix(key.words[1], 0), 0);
+}
+
+/**
+ * @brief Hash of a name given its key and length, longer names are hashed in full.
+ */
+constexpr uint64_t vmhNameHash(const char *name, const VMHNameKey &key, size_t length) {
+	return length <= VMH_NAME_KEY_LEN ? vmhNameKeyHash(key) : vmhNameHash(name);
+}
+
+/**
+ * @brief Bounded equality of two NUL terminated names.
+ */
+constexpr bool vmhNameEqual(const char *a, const char *b) {
+	for (size_t i = 0; i < VMH_FILTER_NAME_MAX; i++) {
+		if (a[i] != b[i]) {
+			return false;
+		}
+		if (a[i] == '\0') {
+			return true;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Smallest power of two greater or equal to n (and at least 1).
+ */
+constexpr size_t vmhPow2(size_t n) {
+	size_t p = 1;
+	while (p < n) {
+		p <<= 1;
+	}
+	return p;
+}
+
+/**
+ * @brief Slot of a perfect hash table, the packed key of its name next to its length.
+ */
+struct VMHFilterSlot {
+	VMHNameKey key;
+	const char *name {nullptr};
+	size_t length {0};
+};
+
+/**
+ * @brief Perfect hash table in caller provided storage, sized at runtime.
+ *
+ * Built with hash-and-displace: every name hashes into one of buckets buckets, and each
+ * bucket stores the seed that scatters its names into free slots without collisions.
+ * Slots hold the packed VMHNameKey of their name next to its length, so a lookup is one
+ * key hash, one seed load and a single 128-bit compare for names of up to MAXCOMLEN bytes,
+ * no matter how many names are in the table. Only longer names compare their remaining bytes.
+ * VMHFilterTable runs the same construction on storage of its own.
+ */
+class VMHFilterTableView {
+public:
+	constexpr VMHFilterTableView() {}
+
+	/**
+	 * @param seeds Storage for buckets seeds.
+	 * @param slots Storage for 2 * buckets slots.
+	 * @param buckets Power of two, see vmhFilterBuckets.
+	 */
+	constexpr VMHFilterTableView(uint32_t *seeds, VMHFilterSlot *slots, size_t buckets) : seeds(seeds), slots(slots), buckets(buckets) {}
+
+	/**
+	 * @brief Populates the table from any entry type exposing a `const char *name` member.
+	 * Null and duplicate names are skipped. The table only references the names, they must outlive it.
+	 * @param hashes, order Working memory for entryCount entries.
+	 * @param offsets Working memory for buckets + 1 entries.
+	 * @return true if a perfect placement was found for every name.
+	 */
+	template <typename Entry>
+	constexpr bool build(const Entry *entries, size_t entryCount, uint64_t *hashes, uint32_t *order, uint32_t *offsets) {
+		clear();
+
+		// Hash every name once, and group the entries by bucket with a counting sort
+		for (size_t b = 0; b <= buckets; b++) {
+			offsets[b] = 0;
+		}
+		for (size_t i = 0; i < entryCount; i++) {
+			if (entries[i].name) {
+				VMHNameKey key;
+				size_t length = vmhNameKeyPack(entries[i].name, key, VMH_FILTER_NAME_MAX);
+				hashes[i] = vmhNameHash(entries[i].name, key, length);
+				offsets[(hashes[i] & (buckets - 1)) + 1]++;
+			}
+		}
+		uint32_t largest = 0;
+		for (size_t b = 0; b < buckets; b++) {
+			if (offsets[b + 1] > largest) {
+				largest = offsets[b + 1];
+			}
+			offsets[b + 1] += offsets[b];
+		}
+		for (size_t i = 0; i < entryCount; i++) {
+			if (entries[i].name) {
+				// seeds[] counts the entries already sorted into each bucket until it is placed
+				size_t b = hashes[i] & (buckets - 1);
+				order[offsets[b] + seeds[b]++] = static_cast<uint32_t>(i);
+			}
+		}
+
+		// Place the most crowded buckets first, they are the hardest to satisfy
+		for (uint32_t size = largest; size > 0; size--) {
+			for (size_t b = 0; b < buckets; b++) {
+				if (offsets[b + 1] - offsets[b] == size && !place(entries, hashes, &order[offsets[b]], size, b)) {
+					clear();
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Checks whether name is part of the table.
+	 */
+	bool contains(const char *name) const {
+		VMHNameKey key;
+		size_t length = vmhNameKeyPack(name, key, VMH_FILTER_NAME_MAX);
+		return find(seeds, slots, buckets, name, key, length);
+	}
+
+	/**
+	 * @brief Same as contains(name), for callers that already packed the name.
+	 */
+	bool contains(const char *name, const VMHNameKey &key, size_t length) const {
+		return find(seeds, slots, buckets, name, key, length);
+	}
+
+	/**
+	 * @brief Lookup of contains, on the storage of a table with the given number of buckets.
+	 */
+	static bool find(const uint32_t *seeds, const VMHFilterSlot *slots, size_t buckets, const char *name, const VMHNameKey &key, size_t length) {
+		if (!buckets) {
+			return false;
+		}
+		uint64_t hash = vmhNameHash(name, key, length);
+		const VMHFilterSlot &slot = slots[vmhNameMix(hash, seeds[hash & (buckets - 1)]) & (buckets * 2 - 1)];
+		return slot.name && slot.length == length && vmhNameKeyEqual(slot.key, key) &&
+			   (length <= VMH_NAME_KEY_LEN || vmhNameEqual(slot.name + VMH_NAME_KEY_LEN, name + VMH_NAME_KEY_LEN));
+	}
+
+	constexpr size_t size() const { return count; }
+
+private:
+	uint32_t *seeds {nullptr};
+	VMHFilterSlot *slots {nullptr};
+	size_t buckets {0};
+	size_t count {0};
+
+	constexpr void clear() {
+		for (size_t b = 0; b < buckets; b++) {
+			seeds[b] = 0;
+		}
+		for (size_t s = 0; s < buckets * 2; s++) {
+			slots[s] = VMHFilterSlot();
+		}
+		count = 0;
+	}
+
+	template <typename Entry>
+	constexpr bool place(const Entry *entries, const uint64_t *hashes, const uint32_t *members, size_t memberCount, size_t bucket) {
+		const char *keys[VMH_FILTER_MAX_BUCKET] {};
+		uint64_t keyHashes[VMH_FILTER_MAX_BUCKET] {};
+		size_t targets[VMH_FILTER_MAX_BUCKET] {};
+		size_t keyCount = 0;
+
+		// Collect the unique names of this bucket
+		for (size_t m = 0; m < memberCount; m++) {
+			const char *name = entries[members[m]].name;
+			bool duplicate = false;
+			for (size_t k = 0; k < keyCount; k++) {
+				if (vmhNameEqual(keys[k], name)) {
+					duplicate = true;
+					break;
+				}
+			}
+			if (duplicate) {
+				continue;
+			}
+			if (keyCount == VMH_FILTER_MAX_BUCKET) {
+				return false;
+			}
+			keys[keyCount] = name;
+			keyHashes[keyCount] = hashes[members[m]];
+			keyCount++;
+		}
+
+		// Find the first seed that lands every name of the bucket in a free, distinct slot
+		for (uint32_t seed = 0; seed < VMH_FILTER_MAX_SEED; seed++) {
+			bool fits = true;
+			for (size_t k = 0; k < keyCount && fits; k++) {
+				targets[k] = vmhNameMix(keyHashes[k], seed) & (buckets * 2 - 1);
+				if (slots[targets[k]].name) {
+					fits = false;
+				}
+				for (size_t j = 0; j < k && fits; j++) {
+					if (targets[j] == targets[k]) {
+						fits = false;
+					}
+				}
+			}
+			if (fits) {
+				for (size_t k = 0; k < keyCount; k++) {
+					VMHFilterSlot &slot = slots[targets[k]];
+					slot.name = keys[k];
+					slot.length = vmhNameKeyPack(keys[k], slot.key, VMH_FILTER_NAME_MAX);
+				}
+				count += keyCount;
+				seeds[bucket] = seed;
+				return true;
+			}
+		}
+
+		return false;
+	}
+};
+
+/**
+ * @brief Buckets of a table holding count names, 0 for an empty table.
+ */
+constexpr size_t vmhFilterBuckets(size_t count) {
+	return count ? vmhPow2(count) : 0;
+}
+
+/**
+ * @brief Perfect hash table over a fixed list of process names, see VMHFilterTableView for the construction.
+ * build() is constexpr so the kext generates the table at compile time, while the tools can
+ * still build large tables at runtime.
+ *
+ * @tparam N Maximum number of names the table holds.
+ */
+template <size_t N>
+class VMHFilterTable {
+public:
+	static constexpr size_t Buckets = vmhPow2(N);
+	static constexpr size_t Slots = Buckets * 2;
+
+	/**
+	 * @brief Working memory of build(), kept apart so runtime builders can allocate it off the stack.
+	 */
+	struct Scratch {
+		uint64_t hashes[N] {};
+		uint32_t order[N] {};
+		uint32_t offsets[Buckets + 1] {};
+	};
+
+	constexpr VMHFilterTable() {}
+
+	/**
+	 * @brief Populates the table from any entry type exposing a `const char *name` member.
+	 * Null and duplicate names are skipped. The table only references the names, they must outlive it.
+	 * @return true if a perfect placement was found for every name.
+	 */
+	template <typename Entry>
+	constexpr bool build(const Entry *entries, size_t entryCount) {
+		Scratch scratch;
+		return build(entries, entryCount, scratch);
+	}
+
+	/**
+	 * @brief Same as build(entries, entryCount), with caller provided working memory.
+	 */
+	template <typename Entry>
+	constexpr bool build(const Entry *entries, size_t entryCount, Scratch &scratch) {
+		// A list too long for the table still leaves it empty
+		bool fits = entryCount <= N;
+		VMHFilterTableView view(seeds, slots, Buckets);
+		valid = view.build(entries, fits ? entryCount : 0, scratch.hashes, scratch.order, scratch.offsets) && fits;
+		count = valid ? view.size() : 0;
+		return valid;
+	}
+
+	/**
+	 * @brief Checks whether name is part of the table.
+	 */
+	bool contains(const char *name) const {
+		VMHNameKey key;
+		size_t length = vmhNameKeyPack(name, key, VMH_FILTER_NAME_MAX);
+		return contains(name, key, length);
+	}
+
+	/**
+	 * @brief Same as contains(name), for callers that already packed the name.
+	 */
+	bool contains(const char *name, const VMHNameKey &key, size_t length) const {
+		return VMHFilterTableView::find(seeds, slots, Buckets, name, key, length);
+	}
+
+	constexpr bool isValid() const { return valid; }
+	constexpr size_t size() const { return count; }
+
+private:
+	uint32_t seeds[Buckets] {};
+	VMHFilterSlot slots[Slots] {};
+	size_t count {0};
+	bool valid {false};
+};
+
+/**
+ * @brief Generates a perfect hash table from a fixed array of entries, usable in constant expressions.
+ */
+template <typename Entry, size_t N>
+constexpr VMHFilterTable<N> vmhMakeFilterTable(const Entry (&entries)[N]) {
+	VMHFilterTable<N> table;
+	table.build(entries, N);
+	return table;
+}
+
+#endif /* kern_filter_hpp */
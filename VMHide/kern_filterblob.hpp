@@ -0,0 +1,183 @@
+//
+//  kern_filterblob.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_filterblob_hpp
+#define kern_filterblob_hpp
+
+// Like kern_filter.hpp, this header stays free of kernel includes so the tools can share it.
+#include <stddef.h>
+#include <stdint.h>
+#include "kern_filter.hpp"
+#include "vmh_abi.h"
+
+/**
+ * @brief Read-only view of a filter blob compiled by Tools/vmh-filterc, see vmh_filter_header_t.
+ *
+ * open() checks the blob once, its checksum and every offset against the bounds of the blob.
+ * From then on lookups run on the blob as it is, with nothing parsed or allocated: the exact
+ * rules of every kind sit in a perfect hash table built like VMHFilterTable, so a lookup is
+ * one key hash, one seed load and a single slot compare. Glob rules are only listed, their
+ * owner compiles them. The kext and every tool use this exact code.
+ */
+class VMHFilterBlob {
+public:
+	/**
+	 * @brief Validates size bytes at data as a compiled filter. data must stay valid, and unchanged,
+	 * as long as the view is used.
+	 * @return nullptr on success, otherwise why the blob was rejected.
+	 */
+	const char *open(const void *data, size_t size) {
+		base = nullptr;
+		header = nullptr;
+		if (!data || size < sizeof(vmh_filter_header_t) || size > VMH_FILTER_BLOB_MAX) {
+			return "blob size out of range";
+		}
+		if (reinterpret_cast<uintptr_t>(data) % 8) {
+			return "blob is not 8 byte aligned";
+		}
+		const uint8_t *bytes = static_cast<const uint8_t *>(data);
+		const vmh_filter_header_t *candidate = static_cast<const vmh_filter_header_t *>(data);
+		if (candidate->magic != VMH_FILTER_MAGIC || candidate->version != VMH_FILTER_VERSION ||
+			candidate->headerSize != sizeof(vmh_filter_header_t) || candidate->size != size) {
+			return "not a compiled filter of this version";
+		}
+		const size_t covered = offsetof(vmh_filter_header_t, checksum) + sizeof(candidate->checksum);
+		if (vmh_filter_checksum(bytes + covered, static_cast<uint32_t>(size - covered)) != candidate->checksum) {
+			return "checksum mismatch";
+		}
+
+		// The pool ends with a NUL byte, so every name in it is terminated
+		if (!fits(candidate->pool, candidate->poolSize, size) || !candidate->poolSize || bytes[candidate->pool + candidate->poolSize - 1] != '\0') {
+			return "name pool out of bounds";
+		}
+		if (!fits(candidate->rules, static_cast<uint64_t>(candidate->ruleCount) * sizeof(vmh_filter_rule_t), size) ||
+			candidate->rules % alignof(vmh_filter_rule_t)) {
+			return "rules out of bounds";
+		}
+		const vmh_filter_rule_t *ruleList = reinterpret_cast<const vmh_filter_rule_t *>(bytes + candidate->rules);
+		uint32_t perKind[VMH_FILTER_KINDS] {};
+		uint32_t globs = 0;
+		uint32_t trees = 0;
+		for (uint32_t i = 0; i < candidate->ruleCount; i++) {
+			const vmh_filter_rule_t &entry = ruleList[i];
+			if (entry.kind >= VMH_FILTER_KINDS || !entry.length || entry.length > VMH_FILTER_RULE_MAX ||
+				!named(entry.name, entry.length, candidate->poolSize)) {
+				return "rule out of bounds";
+			}
+			perKind[entry.kind]++;
+			globs += (entry.flags & VMH_FILTER_RULE_GLOB) != 0;
+			trees += (entry.flags & VMH_FILTER_RULE_TREE) != 0;
+		}
+		if (globs > VMH_FILTER_MAX_GLOBS) {
+			return "too many glob rules";
+		}
+		if (trees > VMH_FILTER_MAX_TREES) {
+			return "too many tree rules";
+		}
+
+		for (uint32_t kind = 0; kind < VMH_FILTER_KINDS; kind++) {
+			const vmh_filter_table_t &table = candidate->tables[kind];
+			if (table.rules != perKind[kind] || table.exact > table.rules) {
+				return "rule counts do not add up";
+			}
+			if (!table.buckets) {
+				if (table.exact) {
+					return "exact rules without a table";
+				}
+				continue;
+			}
+			if ((table.buckets & (table.buckets - 1)) || table.buckets > VMH_FILTER_BLOB_MAX / sizeof(vmh_filter_slot_t) ||
+				!fits(table.seeds, static_cast<uint64_t>(table.buckets) * sizeof(uint32_t), size) || table.seeds % alignof(uint32_t) ||
+				!fits(table.slots, static_cast<uint64_t>(table.buckets) * 2 * sizeof(vmh_filter_slot_t), size) || table.slots % 16) {
+				return "table out of bounds";
+			}
+			const vmh_filter_slot_t *slots = reinterpret_cast<const vmh_filter_slot_t *>(bytes + table.slots);
+			for (uint32_t s = 0; s < table.buckets * 2; s++) {
+				if (slots[s].length && (slots[s].length > VMH_FILTER_RULE_MAX || !named(slots[s].name, slots[s].length, candidate->poolSize))) {
+					return "slot out of bounds";
+				}
+			}
+		}
+
+		base = bytes;
+		header = candidate;
+		return nullptr;
+	}
+
+	/**
+	 * @brief Checks whether name matches an exact rule of the given kind.
+	 */
+	bool contains(uint32_t kind, const char *name) const {
+		VMHNameKey key;
+		size_t length = vmhNameKeyPack(name, key, VMH_FILTER_NAME_MAX);
+		return contains(kind, name, key, length);
+	}
+
+	/**
+	 * @brief Same as contains(kind, name), for callers that already packed the name.
+	 */
+	bool contains(uint32_t kind, const char *name, const VMHNameKey &key, size_t length) const {
+		if (!header || kind >= VMH_FILTER_KINDS) {
+			return false;
+		}
+		const vmh_filter_table_t &table = header->tables[kind];
+		if (!table.buckets) {
+			return false;
+		}
+		uint64_t hash = vmhNameHash(name, key, length);
+		const uint32_t *seeds = reinterpret_cast<const uint32_t *>(base + table.seeds);
+		const vmh_filter_slot_t &slot = reinterpret_cast<const vmh_filter_slot_t *>(base + table.slots)
+			[vmhNameMix(hash, seeds[hash & (table.buckets - 1)]) & (table.buckets * 2 - 1)];
+		return slot.length == length && ((slot.key[0] ^ key.words[0]) | (slot.key[1] ^ key.words[1])) == 0 &&
+			   (length <= VMH_NAME_KEY_LEN || vmhNameEqual(pool() + slot.name + VMH_NAME_KEY_LEN, name + VMH_NAME_KEY_LEN));
+	}
+
+	bool isOpen() const { return header != nullptr; }
+	uint32_t size() const { return header ? header->size : 0; }
+	uint32_t ruleCount() const { return header ? header->ruleCount : 0; }
+
+	/**
+	 * @brief Number of rules, exact and glob, of the given kind.
+	 */
+	uint32_t rules(uint32_t kind) const {
+		return header && kind < VMH_FILTER_KINDS ? header->tables[kind].rules : 0;
+	}
+
+	/**
+	 * @brief Rule at index, in the order of the source list. index must be below ruleCount().
+	 */
+	const vmh_filter_rule_t &rule(uint32_t index) const {
+		return reinterpret_cast<const vmh_filter_rule_t *>(base + header->rules)[index];
+	}
+
+	/**
+	 * @brief NUL terminated name of a rule of this blob.
+	 */
+	const char *name(const vmh_filter_rule_t &entry) const {
+		return pool() + entry.name;
+	}
+
+private:
+	const uint8_t *base {nullptr};
+	const vmh_filter_header_t *header {nullptr};
+
+	const char *pool() const {
+		return reinterpret_cast<const char *>(base + header->pool);
+	}
+
+	// Whether length bytes at offset lie within a blob of size bytes
+	static bool fits(uint64_t offset, uint64_t length, size_t size) {
+		return offset >= sizeof(vmh_filter_header_t) && offset <= size && length <= size - offset;
+	}
+
+	// Whether a name of length bytes at offset, and its NUL byte, lie within the pool
+	static bool named(uint32_t offset, uint32_t length, uint32_t poolSize) {
+		return static_cast<uint64_t>(offset) + length < poolSize;
+	}
+};
+
+#endif /* kern_filterblob_hpp */
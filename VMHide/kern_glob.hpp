@@ -0,0 +1,437 @@
+//
+//  kern_glob.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_glob_hpp
+#define kern_glob_hpp
+
+// Like kern_filter.hpp, this header stays free of kernel includes so the tools can share it.
+#include <stddef.h>
+#include <stdint.h>
+#include "kern_filter.hpp"
+
+// Most pattern characters, summed over every glob of a list, a matcher is compiled from
+#define VMH_GLOB_MAX_POSITIONS 1024
+
+/**
+ * @brief Checks whether a filter name is a glob rule rather than an exact name.
+ */
+constexpr bool vmhIsGlob(const char *name) {
+	for (size_t i = 0; i < VMH_FILTER_NAME_MAX && name[i] != '\0'; i++) {
+		if (name[i] == '*' || name[i] == '?') {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Matches name against a single rule, exact or glob, with the semantics of VMHGlobMatcher.
+ * For the handful of rules not worth a DFA. Backtracks to the last '*' only, so it runs in
+ * O(rule * name) at worst and without recursion.
+ */
+inline bool vmhGlobMatch(const char *rule, const char *name) {
+	const char *star = nullptr;
+	const char *resume = nullptr;
+	while (*name != '\0') {
+		if (*rule == '*') {
+			star = rule++;
+			resume = name;
+		} else if (*rule != '\0' && (*rule == '?' || *rule == *name)) {
+			rule++;
+			name++;
+		} else if (star) {
+			rule = star + 1;
+			name = ++resume;
+		} else {
+			return false;
+		}
+	}
+	while (*rule == '*') {
+		rule++;
+	}
+	return *rule == '\0';
+}
+
+/**
+ * @brief DFA compiled by VMHGlobMatcher, with its transitions in storage sized to it.
+ * VMHGlobMatcher::copyTo fills one in, a default constructed table matches nothing.
+ */
+class VMHGlobTable {
+public:
+	/**
+	 * @brief Checks whether name matches any of the rules.
+	 */
+	bool matches(const char *name) const {
+		if (!next) {
+			return false;
+		}
+		size_t state = 1;
+		for (size_t i = 0; i < VMH_FILTER_NAME_MAX && name[i] != '\0' && state != forever; i++) {
+			state = next[state * classCount + classOf[static_cast<uint8_t>(name[i])]];
+			if (state == 0) {
+				return false;
+			}
+		}
+		return (accepting[state / 8] >> (state % 8)) & 1;
+	}
+
+	bool isEmpty() const { return !next; }
+	size_t states() const { return stateCount; }
+	size_t classes() const { return classCount; }
+
+	/**
+	 * @brief Bytes of storage holding the transitions and accepting states of a DFA of that size.
+	 */
+	static constexpr size_t storageSize(size_t states, size_t classes) {
+		return states * classes * sizeof(uint16_t) + (states + 7) / 8;
+	}
+
+private:
+	template <size_t, size_t> friend class VMHGlobMatcher;
+
+	uint8_t classOf[256] {};
+	const uint16_t *next {nullptr};
+	const uint8_t *accepting {nullptr};
+	size_t classCount {1};
+	size_t stateCount {0};
+	uint16_t forever {0};
+};
+
+/**
+ * @brief Set of glob rules compiled into a single DFA, matched in one pass over a name.
+ *
+ * Rules are anchored at both ends: '*' matches any run of bytes, '?' any single byte, and
+ * everything else itself, so "com.apple.Mobile*" is a prefix rule and "*softwareupdate*" a
+ * substring one. Every rule becomes a chain of NFA positions, a '*' turning the position after
+ * it into a self loop. build() runs the subset construction over the union of the chains,
+ * with bytes that no rule names collapsed into a single class. Every set that completes a rule
+ * ending with '*' collapses into a single accepting sink, so prefix rules stop multiplying the
+ * states of the others once they matched. Matching is then a table walk of one load per byte
+ * no matter how many rules there are, and stops as soon as the verdict is certain. Callers
+ * that keep the DFA around copy it out with copyTo, into storage sized to the states it has.
+ *
+ * @tparam MaxStates Most DFA states, rule sets needing more are rejected.
+ * @tparam MaxTransitions Most DFA states times byte classes.
+ */
+template <size_t MaxStates, size_t MaxTransitions>
+class VMHGlobMatcher {
+	static_assert(MaxStates < 0xffff, "VMHGlobMatcher states must fit 16 bits");
+
+public:
+	static constexpr size_t PositionWords = VMH_GLOB_MAX_POSITIONS / 64;
+	static constexpr size_t HashSlots = vmhPow2(MaxStates) * 2;
+
+	/**
+	 * @brief Working memory of build(), kept apart so runtime builders can allocate it off the stack.
+	 * Sized for VMH_GLOB_MAX_POSITIONS, builders that know their rules allocate scratchSize() instead.
+	 */
+	struct Scratch {
+		uint16_t buckets[HashSlots];
+		int16_t tokens[VMH_GLOB_MAX_POSITIONS];
+		bool loops[VMH_GLOB_MAX_POSITIONS];
+		uint64_t sets[MaxStates * PositionWords]; // MaxStates sets of as many words as the rules need
+	};
+
+	/**
+	 * @brief Positions one glob rule needs, 0 for an exact name. Rules built together need one more, for the sink they share.
+	 */
+	static size_t positionsOf(const char *name) {
+		if (!name || !vmhIsGlob(name)) {
+			return 0;
+		}
+		size_t positions = 1;
+		for (size_t c = 0; c < VMH_FILTER_NAME_MAX && name[c] != '\0'; c++) {
+			positions += name[c] != '*';
+		}
+		return positions;
+	}
+
+	/**
+	 * @brief Positions the glob rules of entries need, the sink included. 0 without glob rules.
+	 */
+	template <typename Entry>
+	static size_t positionsOf(const Entry *entries, size_t entryCount) {
+		size_t positions = 0;
+		for (size_t i = 0; i < entryCount; i++) {
+			positions += positionsOf(entries[i].name);
+		}
+		return positions ? positions + 1 : 0;
+	}
+
+	/**
+	 * @brief Bytes of Scratch that build() uses for rules of that many positions, see positionsOf.
+	 */
+	static constexpr size_t scratchSize(size_t positions) {
+		return offsetof(Scratch, sets) + MaxStates * wordsFor(positions) * sizeof(uint64_t);
+	}
+
+	/**
+	 * @brief Compiles every glob rule of entries, any type exposing a `const char *name` member.
+	 * Exact names are skipped, they belong in a VMHFilterTable.
+	 * @return false if the rules need more positions, states or transitions than available.
+	 */
+	template <typename Entry>
+	bool build(const Entry *entries, size_t entryCount, Scratch &scratch) {
+		return build(entries, entryCount, scratch, sizeof(Scratch));
+	}
+
+	/**
+	 * @brief Same as build(entries, entryCount, scratch), with scratchBytes of working memory at scratch.
+	 * @return false as well if the rules need more than scratchBytes, see scratchSize.
+	 */
+	template <typename Entry>
+	bool build(const Entry *entries, size_t entryCount, Scratch &scratch, size_t scratchBytes) {
+		clear();
+		if (scratchBytes < scratchSize(0)) {
+			return false;
+		}
+
+		// Lay out the NFA: every rule is a chain of positions ending with an accepting one.
+		// The last position is kept free for the sink below, so positions stays below VMH_GLOB_MAX_POSITIONS.
+		size_t positions = 0;
+		for (size_t i = 0; i < entryCount; i++) {
+			const char *name = entries[i].name;
+			if (!name || !vmhIsGlob(name)) {
+				continue;
+			}
+			bool loop = false;
+			for (size_t c = 0; c < VMH_FILTER_NAME_MAX && name[c] != '\0'; c++) {
+				if (name[c] == '*') {
+					loop = true;
+					continue;
+				}
+				if (positions + 1 >= VMH_GLOB_MAX_POSITIONS) {
+					return false;
+				}
+				scratch.tokens[positions] = name[c] == '?' ? Any : static_cast<uint8_t>(name[c]);
+				scratch.loops[positions] = loop;
+				positions++;
+				loop = false;
+			}
+			if (positions + 1 >= VMH_GLOB_MAX_POSITIONS) {
+				return false;
+			}
+			scratch.tokens[positions] = Accept;
+			scratch.loops[positions] = loop;
+			positions++;
+		}
+		if (positions == 0) {
+			return true;
+		}
+		// One more accepting position that loops, the only member of the sink every completed '*' rule leads to
+		size_t sink = positions;
+		scratch.tokens[sink] = Accept;
+		scratch.loops[sink] = true;
+		words = wordsFor(sink + 1);
+		if (scratchSize(sink + 1) > scratchBytes) {
+			return false;
+		}
+
+		// Every byte some rule names literally gets a class of its own, all others share class 0
+		classCount = 1;
+		for (size_t p = 0; p < positions; p++) {
+			int16_t token = scratch.tokens[p];
+			if (token >= 0 && classOf[token] == 0) {
+				if (classCount == 256) {
+					return false;
+				}
+				classOf[token] = static_cast<uint8_t>(classCount++);
+			}
+		}
+		uint8_t representative[256] {};
+		for (size_t b = 1; b < 256; b++) {
+			if (classOf[b]) {
+				representative[classOf[b]] = static_cast<uint8_t>(b);
+			}
+		}
+
+		// State 0 is the dead state, the empty set. State 1 is the start, the first position of every rule.
+		if (MaxStates < 2 || 2 * classCount > MaxTransitions) {
+			clear();
+			return false;
+		}
+		for (size_t h = 0; h < HashSlots; h++) {
+			scratch.buckets[h] = Empty;
+		}
+		uint64_t start[PositionWords] {};
+		for (size_t p = 0; p < positions; p++) {
+			if (p == 0 || scratch.tokens[p - 1] == Accept) {
+				start[p / 64] |= 1ULL << (p % 64);
+			}
+		}
+		uint64_t dead[PositionWords] {};
+		add(scratch, dead, positions, sink);
+		add(scratch, start, positions, sink);
+
+		// Subset construction, states are numbered in discovery order so the worklist is implicit
+		for (size_t state = 0; state < stateCount; state++) {
+			for (size_t cls = 0; cls < classCount; cls++) {
+				uint64_t target[PositionWords] {};
+				// Class 0 bytes only ever advance through '?' and '*'
+				uint8_t byte = representative[cls];
+				for (size_t p = 0; p <= sink; p++) {
+					if (!(scratch.sets[state * words + p / 64] & (1ULL << (p % 64)))) {
+						continue;
+					}
+					int16_t token = scratch.tokens[p];
+					if (scratch.loops[p]) {
+						target[p / 64] |= 1ULL << (p % 64);
+					}
+					if (token == Any || (token >= 0 && token == byte && cls != 0)) {
+						target[(p + 1) / 64] |= 1ULL << ((p + 1) % 64);
+					}
+				}
+				size_t found = add(scratch, target, positions, sink);
+				if (found == Empty || (stateCount * classCount > MaxTransitions)) {
+					clear();
+					return false;
+				}
+				next[state * classCount + cls] = static_cast<uint16_t>(found);
+			}
+
+			for (size_t p = 0; p <= sink; p++) {
+				if (scratch.tokens[p] == Accept && (scratch.sets[state * words + p / 64] & (1ULL << (p % 64)))) {
+					accepting[state / 8] |= static_cast<uint8_t>(1 << (state % 8));
+					if (p == sink) {
+						forever = static_cast<uint16_t>(state);
+					}
+					break;
+				}
+			}
+		}
+
+		rules = true;
+		return true;
+	}
+
+	/**
+	 * @brief Checks whether name matches any of the rules.
+	 */
+	bool matches(const char *name) const {
+		if (!rules) {
+			return false;
+		}
+		size_t state = 1;
+		for (size_t i = 0; i < VMH_FILTER_NAME_MAX && name[i] != '\0' && state != forever; i++) {
+			state = next[state * classCount + classOf[static_cast<uint8_t>(name[i])]];
+			if (state == 0) {
+				return false;
+			}
+		}
+		return (accepting[state / 8] >> (state % 8)) & 1;
+	}
+
+	bool isEmpty() const { return !rules; }
+	size_t states() const { return stateCount; }
+	size_t classes() const { return classCount; }
+
+	/**
+	 * @brief Bytes of storage copyTo needs for the DFA built last.
+	 */
+	size_t tableSize() const {
+		return rules ? VMHGlobTable::storageSize(stateCount, classCount) : 0;
+	}
+
+	/**
+	 * @brief Points table at a copy of the DFA built last, written to tableSize() bytes at storage.
+	 * The table matches nothing without rules, storage is not touched then and may be null.
+	 */
+	void copyTo(VMHGlobTable &table, void *storage) const {
+		table = VMHGlobTable {};
+		if (!rules) {
+			return;
+		}
+		size_t transitions = stateCount * classCount;
+		uint16_t *tableNext = static_cast<uint16_t *>(storage);
+		uint8_t *tableAccepting = reinterpret_cast<uint8_t *>(tableNext + transitions);
+		for (size_t t = 0; t < transitions; t++) {
+			tableNext[t] = next[t];
+		}
+		for (size_t s = 0; s < (stateCount + 7) / 8; s++) {
+			tableAccepting[s] = accepting[s];
+		}
+		for (size_t b = 0; b < 256; b++) {
+			table.classOf[b] = classOf[b];
+		}
+		table.next = tableNext;
+		table.accepting = tableAccepting;
+		table.classCount = classCount;
+		table.stateCount = stateCount;
+		table.forever = forever;
+	}
+
+private:
+	static constexpr int16_t Any = -1;
+	static constexpr int16_t Accept = -2;
+	static constexpr uint16_t Empty = 0xffff;
+
+	uint8_t classOf[256] {};
+	uint8_t accepting[(MaxStates + 7) / 8] {};
+	uint16_t next[MaxTransitions] {};
+	size_t classCount {1};
+	size_t stateCount {0};
+	size_t words {PositionWords};
+	uint16_t forever {0};
+	bool rules {false};
+
+	static constexpr size_t wordsFor(size_t positions) { return (positions + 63) / 64; }
+
+	void clear() {
+		for (size_t b = 0; b < 256; b++) {
+			classOf[b] = 0;
+		}
+		for (size_t s = 0; s < (MaxStates + 7) / 8; s++) {
+			accepting[s] = 0;
+		}
+		classCount = 1;
+		stateCount = 0;
+		forever = 0;
+		rules = false;
+	}
+
+	// Index of the state holding set, adding it if it is new. Returns Empty once MaxStates is exceeded.
+	size_t add(Scratch &scratch, uint64_t *set, size_t positions, size_t sink) {
+		// Any completed rule ending with '*' accepts whatever follows, all such sets are the same state
+		for (size_t p = 0; p < positions; p++) {
+			if (scratch.tokens[p] == Accept && scratch.loops[p] && (set[p / 64] & (1ULL << (p % 64)))) {
+				for (size_t w = 0; w < words; w++) {
+					set[w] = 0;
+				}
+				set[sink / 64] |= 1ULL << (sink % 64);
+				break;
+			}
+		}
+
+		uint64_t hash = 0;
+		for (size_t w = 0; w < words; w++) {
+			hash = vmhNameMix(hash ^ set[w], static_cast<uint32_t>(w));
+		}
+		for (size_t probe = 0; probe < HashSlots; probe++) {
+			uint16_t &bucket = scratch.buckets[(hash + probe) & (HashSlots - 1)];
+			if (bucket == Empty) {
+				if (stateCount == MaxStates) {
+					return Empty;
+				}
+				for (size_t w = 0; w < words; w++) {
+					scratch.sets[stateCount * words + w] = set[w];
+				}
+				bucket = static_cast<uint16_t>(stateCount);
+				return stateCount++;
+			}
+			bool equal = true;
+			for (size_t w = 0; w < words && equal; w++) {
+				equal = scratch.sets[bucket * words + w] == set[w];
+			}
+			if (equal) {
+				return bucket;
+			}
+		}
+		return Empty;
+	}
+};
+
+#endif /* kern_glob_hpp */
@@ -0,0 +1,95 @@
+//
+//  kern_grace.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_grace_hpp
+#define kern_grace_hpp
+
+// Like kern_filter.hpp, this header stays free of kernel includes so the tools can share it.
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Read-side critical sections and grace periods, in the spirit of sleepable RCU.
+ *
+ * Readers never block and never write shared cache lines: entering a section is one relaxed
+ * increment of a per-CPU counter and a full fence, leaving it is one release increment. A writer
+ * publishes a new version of the protected data with a single atomic pointer store, then calls
+ * synchronize(), which returns once every reader that may still reference the previous version
+ * has left its section. The previous version can be freed afterwards.
+ *
+ * Counters come in two parities. synchronize() flips the active parity and waits for the old
+ * one to drain, twice, so a steady stream of new readers cannot delay a writer indefinitely.
+ * One flip is not enough: a reader preempted between loading the parity and incrementing its
+ * counter may count itself into a parity the writer already found idle, and is only waited for
+ * once that parity is flipped away from again. A reader may migrate between enter and exit,
+ * only the sums over every CPU are meaningful. Writers must be serialized by the caller.
+ *
+ * @tparam CPUs Number of counter blocks, CPUs beyond it share blocks.
+ */
+template <size_t CPUs>
+class VMHGracePeriod {
+public:
+	/**
+	 * @brief Enters a read-side section on behalf of the given CPU.
+	 * @return Token to pass to exit().
+	 */
+	uint32_t enter(size_t cpu) {
+		uint32_t parity = __atomic_load_n(&active, __ATOMIC_RELAXED) & 1;
+		__atomic_fetch_add(&counters[cpu % CPUs].locks[parity], 1, __ATOMIC_RELAXED);
+		// Pairs with the fence in synchronize(): either the writer sees this reader, or this reader
+		// sees the version the writer published before it looked
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		return parity;
+	}
+
+	/**
+	 * @brief Leaves a read-side section, cpu may differ from the one passed to enter().
+	 */
+	void exit(size_t cpu, uint32_t token) {
+		__atomic_fetch_add(&counters[cpu % CPUs].unlocks[token], 1, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * @brief Waits until every section entered before the call has been left.
+	 * @param wait Called between checks, sleeps or yields.
+	 */
+	template <typename Wait>
+	void synchronize(Wait wait) {
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		for (size_t flip = 0; flip < 2; flip++) {
+			uint32_t parity = __atomic_fetch_add(&active, 1, __ATOMIC_SEQ_CST) & 1;
+			while (!idle(parity)) {
+				wait();
+			}
+		}
+	}
+
+private:
+	struct alignas(64) Counters {
+		uint64_t locks[2];
+		uint64_t unlocks[2];
+	};
+
+	uint32_t active {0};
+	Counters counters[CPUs] {};
+
+	// Unlocks are summed first, any unlock seen implies its lock is seen as well
+	bool idle(uint32_t parity) const {
+		uint64_t unlocks = 0;
+		for (size_t cpu = 0; cpu < CPUs; cpu++) {
+			unlocks += __atomic_load_n(&counters[cpu].unlocks[parity], __ATOMIC_ACQUIRE);
+		}
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		uint64_t locks = 0;
+		for (size_t cpu = 0; cpu < CPUs; cpu++) {
+			locks += __atomic_load_n(&counters[cpu].locks[parity], __ATOMIC_RELAXED);
+		}
+		return locks == unlocks;
+	}
+};
+
+#endif /* kern_grace_hpp */
@@ -0,0 +1,505 @@
+//
+//  kern_livefilter.cpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#include "kern_livefilter.hpp"
+
+VMHLiveFilter::Snapshot *VMHLiveFilter::current = nullptr;
+VMHGracePeriod<VMH_STATS_MAX_CPUS> VMHLiveFilter::grace;
+IOLock *VMHLiveFilter::writeLock = nullptr;
+VMHLiveFilter::RetiredCallback VMHLiveFilter::retiredCallback = nullptr;
+
+// kern.vmh.filter prefixes of each VMH::MatchKind, process names have none
+static const char *const matchPrefixes[VMH::VMH_MATCH_KINDS] = {"", "path:", "bundle:"};
+
+// kern.vmh.filter prefix of tree rules, ahead of the kind prefix as in "tree:path:/usr/sbin/softwareupdated"
+static const char treePrefix[] = "tree:";
+
+// Blanks around a kern.vmh.filter rule are ignored, like Tools/vmh-filterc does
+static bool isFilterBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Compiled filters index their rules by kind, exactly like VMH::MatchKind
+static_assert(VMH_FILTER_KIND_NAME == static_cast<int>(VMH::VMH_MATCH_NAME) && VMH_FILTER_KIND_PATH == static_cast<int>(VMH::VMH_MATCH_PATH) &&
+			  VMH_FILTER_KIND_BUNDLE == static_cast<int>(VMH::VMH_MATCH_BUNDLE) && VMH_FILTER_KINDS == static_cast<int>(VMH::VMH_MATCH_KINDS),
+			  "Compiled filter kinds must match VMH::MatchKind");
+
+// Snapshots and builders carve their arrays out of one allocation, aligned for VMHNameKey, the strictest of them
+static size_t aligned(size_t size) {
+	return (size + alignof(VMHNameKey) - 1) & ~(alignof(VMHNameKey) - 1);
+}
+
+// Tree rules are also kept apart, matched one by one when a process calls exec
+bool VMHLiveFilter::addTreeRule(Snapshot *snapshot, const VMH::DetectedProcess &rule) {
+	if (snapshot->treeCount == VMH_FILTER_MAX_TREES) {
+		return false;
+	}
+	snapshot->tree[snapshot->treeCount++] = rule;
+	snapshot->treeOfKind[rule.match]++;
+	return true;
+}
+
+// The glob matcher and its scratch are only allocated when some rule needs them
+VMHLiveFilter::Builder *VMHLiveFilter::allocBuilder(size_t count, size_t positions) {
+	if (positions > VMH_GLOB_MAX_POSITIONS) {
+		// No kind may need more, build() rejects it before touching more scratch than that
+		positions = VMH_GLOB_MAX_POSITIONS;
+	}
+	size_t globScratchSize = positions ? GlobMatcher::scratchSize(positions) : 0;
+	size_t size = aligned(sizeof(Builder));
+	size_t globsAt = size;
+	size += positions ? aligned(sizeof(GlobMatcher)) : 0;
+	size_t globScratchAt = size;
+	size += aligned(globScratchSize);
+	size_t ofKindAt = size;
+	size += aligned(count * sizeof(VMH::DetectedProcess));
+	size_t exactAt = size;
+	size += aligned(count * sizeof(VMH::DetectedProcess));
+	size_t hashesAt = size;
+	size += aligned(count * sizeof(uint64_t));
+	size_t orderAt = size;
+	size += aligned(count * sizeof(uint32_t));
+	size_t offsetsAt = size;
+	size += (vmhFilterBuckets(count) + 1) * sizeof(uint32_t);
+
+	uint8_t *memory = static_cast<uint8_t *>(IOMalloc(size));
+	if (!memory) {
+		return nullptr;
+	}
+	// An all zero matcher is an empty matcher
+	bzero(memory, size);
+	Builder *builder = reinterpret_cast<Builder *>(memory);
+	builder->globs = positions ? reinterpret_cast<GlobMatcher *>(memory + globsAt) : nullptr;
+	builder->globScratch = reinterpret_cast<GlobMatcher::Scratch *>(memory + globScratchAt);
+	builder->globScratchSize = globScratchSize;
+	builder->ofKind = reinterpret_cast<VMH::DetectedProcess *>(memory + ofKindAt);
+	builder->exact = reinterpret_cast<VMH::DetectedProcess *>(memory + exactAt);
+	builder->hashes = reinterpret_cast<uint64_t *>(memory + hashesAt);
+	builder->order = reinterpret_cast<uint32_t *>(memory + orderAt);
+	builder->offsets = reinterpret_cast<uint32_t *>(memory + offsetsAt);
+	builder->size = size;
+	return builder;
+}
+
+// The DFA is built in the builder, then copied to storage of exactly its size
+int VMHLiveFilter::compileGlobs(Rules &rules, const VMH::DetectedProcess *entries, size_t count, Builder *builder) {
+	if (!builder->globs) {
+		return 0;
+	}
+	// Only fails when the rules are too large for it, in size or in complexity
+	if (!builder->globs->build(entries, count, *builder->globScratch, builder->globScratchSize)) {
+		return ENOSPC;
+	}
+	size_t size = builder->globs->tableSize();
+	if (size) {
+		rules.globStorage = IOMalloc(size);
+		if (!rules.globStorage) {
+			return ENOMEM;
+		}
+		rules.globSize = size;
+	}
+	builder->globs->copyTo(rules.globs, rules.globStorage);
+	return 0;
+}
+
+// Frees a snapshot no reader can reach, or one that was never published
+void VMHLiveFilter::destroy(Snapshot *snapshot) {
+	for (size_t kind = 0; kind < VMH::VMH_MATCH_KINDS; kind++) {
+		if (snapshot->rules[kind].globStorage) {
+			IOFree(snapshot->rules[kind].globStorage, snapshot->rules[kind].globSize);
+		}
+	}
+	if (snapshot->blobData) {
+		Buffer::deleter(snapshot->blobData);
+	}
+	IOFree(snapshot, snapshot->size);
+}
+
+// Builds a snapshot holding copies of the given names, nothing is published here
+int VMHLiveFilter::build(const VMH::DetectedProcess *procs, size_t count, Snapshot **snapshot) {
+	if (count > VMH_LIVE_FILTER_MAX) {
+		return ENOSPC;
+	}
+
+	// Size the pool and the exact tables of every kind from the list first
+	size_t used = 0;
+	size_t exactCounts[VMH::VMH_MATCH_KINDS] {};
+	for (size_t i = 0; i < count; i++) {
+		size_t length = strnlen(procs[i].name, VMH_FILTER_NAME_MAX);
+		if (length == VMH_FILTER_NAME_MAX || procs[i].match >= VMH::VMH_MATCH_KINDS || used + length + 1 > VMH_LIVE_FILTER_POOL) {
+			return used + length + 1 > VMH_LIVE_FILTER_POOL ? ENOSPC : EINVAL;
+		}
+		used += length + 1;
+		if (!vmhIsGlob(procs[i].name)) {
+			exactCounts[procs[i].match]++;
+		}
+	}
+	size_t size = aligned(sizeof(Snapshot));
+	size_t slotsAt[VMH::VMH_MATCH_KINDS];
+	size_t seedsAt[VMH::VMH_MATCH_KINDS];
+	for (size_t kind = 0; kind < VMH::VMH_MATCH_KINDS; kind++) {
+		size_t buckets = vmhFilterBuckets(exactCounts[kind]);
+		slotsAt[kind] = size;
+		size += aligned(buckets * 2 * sizeof(VMHFilterSlot));
+		seedsAt[kind] = size;
+		size += aligned(buckets * sizeof(uint32_t));
+	}
+	size_t procsAt = size;
+	size += aligned(count * sizeof(VMH::DetectedProcess));
+	size_t poolAt = size;
+	size += used;
+
+	uint8_t *memory = static_cast<uint8_t *>(IOMalloc(size));
+	if (!memory) {
+		return ENOMEM;
+	}
+	// An all zero table is an empty table
+	bzero(memory, size);
+	Snapshot *built = reinterpret_cast<Snapshot *>(memory);
+	built->procs = reinterpret_cast<VMH::DetectedProcess *>(memory + procsAt);
+	built->pool = reinterpret_cast<char *>(memory + poolAt);
+	built->size = size;
+	Builder *builder = allocBuilder(count, GlobMatcher::positionsOf(procs, count));
+	if (!builder) {
+		destroy(built);
+		return ENOMEM;
+	}
+
+	// The table references names, so they are copied into the snapshot first
+	used = 0;
+	int error = 0;
+	for (size_t i = 0; i < count && !error; i++) {
+		size_t length = strnlen(procs[i].name, VMH_FILTER_NAME_MAX);
+		memcpy(&built->pool[used], procs[i].name, length + 1);
+		built->procs[i].name = &built->pool[used];
+		built->procs[i].pid = procs[i].pid;
+		built->procs[i].match = procs[i].match;
+		built->procs[i].tree = procs[i].tree;
+		used += length + 1;
+		if (procs[i].tree && !addTreeRule(built, built->procs[i])) {
+			error = ENOSPC;
+		}
+	}
+	built->count = count;
+
+	// Per kind, exact names go to the hash table and glob rules are compiled into a single DFA
+	for (size_t kind = 0; kind < VMH::VMH_MATCH_KINDS && !error; kind++) {
+		size_t kindCount = 0;
+		size_t exactCount = 0;
+		for (size_t i = 0; i < count; i++) {
+			if (built->procs[i].match != kind) {
+				continue;
+			}
+			builder->ofKind[kindCount++] = built->procs[i];
+			if (!vmhIsGlob(built->procs[i].name)) {
+				builder->exact[exactCount++] = built->procs[i];
+			}
+		}
+
+		Rules &rules = built->rules[kind];
+		rules.count = kindCount;
+		rules.table = VMHFilterTableView(reinterpret_cast<uint32_t *>(memory + seedsAt[kind]),
+										 reinterpret_cast<VMHFilterSlot *>(memory + slotsAt[kind]), vmhFilterBuckets(exactCount));
+		if (!rules.table.build(builder->exact, exactCount, builder->hashes, builder->order, builder->offsets)) {
+			error = ENOSPC;
+		} else {
+			error = compileGlobs(rules, builder->ofKind, kindCount, builder);
+		}
+	}
+	IOFree(builder, builder->size);
+	if (error) {
+		destroy(built);
+		return error;
+	}
+	*snapshot = built;
+	return 0;
+}
+
+// Builds a snapshot around a compiled filter, only its glob rules are compiled here
+int VMHLiveFilter::buildCompiled(uint8_t *data, uint32_t size, Snapshot **snapshot) {
+	// Exact rules are looked up in the blob itself, the snapshot needs no tables of its own
+	void *memory = IOMalloc(sizeof(Snapshot));
+	if (!memory) {
+		return ENOMEM;
+	}
+	bzero(memory, sizeof(Snapshot));
+	Snapshot *built = static_cast<Snapshot *>(memory);
+	built->size = sizeof(Snapshot);
+	const char *rejected = built->blob.open(data, size);
+	if (rejected) {
+		DBGLOG(MODULE_LFLT, "The compiled filter is rejected: %s.", rejected);
+		destroy(built);
+		return EINVAL;
+	}
+
+	// The glob and tree rules name strings of the blob pool
+	const VMHFilterBlob &blob = built->blob;
+	size_t globCount = 0;
+	size_t positions = 0;
+	for (uint32_t i = 0; i < blob.ruleCount(); i++) {
+		const vmh_filter_rule_t &rule = blob.rule(i);
+		if (rule.flags & VMH_FILTER_RULE_TREE) {
+			// open() already capped the tree rules at VMH_FILTER_MAX_TREES
+			addTreeRule(built, {blob.name(rule), -1, static_cast<VMH::MatchKind>(rule.kind), true});
+		}
+		if (rule.flags & VMH_FILTER_RULE_GLOB) {
+			globCount++;
+			positions += GlobMatcher::positionsOf(blob.name(rule));
+		}
+	}
+	Builder *builder = allocBuilder(globCount, positions ? positions + 1 : 0);
+	if (!builder) {
+		destroy(built);
+		return ENOMEM;
+	}
+	int error = 0;
+	for (size_t kind = 0; kind < VMH::VMH_MATCH_KINDS && !error; kind++) {
+		size_t kindGlobs = 0;
+		for (uint32_t i = 0; i < blob.ruleCount(); i++) {
+			const vmh_filter_rule_t &rule = blob.rule(i);
+			if (rule.kind != kind || !(rule.flags & VMH_FILTER_RULE_GLOB)) {
+				continue;
+			}
+			builder->ofKind[kindGlobs].name = blob.name(rule);
+			builder->ofKind[kindGlobs].pid = -1;
+			builder->ofKind[kindGlobs].match = static_cast<VMH::MatchKind>(kind);
+			kindGlobs++;
+		}
+
+		Rules &rules = built->rules[kind];
+		rules.count = blob.rules(static_cast<uint32_t>(kind));
+		error = compileGlobs(rules, builder->ofKind, kindGlobs, builder);
+	}
+	IOFree(builder, builder->size);
+	if (error) {
+		destroy(built);
+		return error;
+	}
+	built->blobData = data;
+	built->blobSize = size;
+	*snapshot = built;
+	return 0;
+}
+
+// Reads the vmh-filter NVRAM variable written from the output of Tools/vmh-filterc
+VMHLiveFilter::Snapshot *VMHLiveFilter::loadCompiled() {
+	NVStorage storage;
+	if (!storage.init()) {
+		DBGLOG(MODULE_LFLT, "NVRAM is not available, no compiled filter can be loaded.");
+		return nullptr;
+	}
+	uint32_t size = 0;
+	uint8_t *data = storage.read(NVRAM_PREFIX(LILU_VENDOR_GUID, VMH_FILTER_NVRAM_NAME), size, NVStorage::OptRaw);
+	storage.deinit();
+	if (!data) {
+		return nullptr;
+	}
+
+	Snapshot *snapshot = nullptr;
+	int error = buildCompiled(data, size, &snapshot);
+	if (error) {
+		Buffer::deleter(data);
+		DBGLOG(MODULE_WARN, "Ignoring the compiled filter in NVRAM with error %d, the built-in list is used instead.", error);
+		return nullptr;
+	}
+	DBGLOG(MODULE_LFLT, "Loaded a compiled filter of %u rules and %u bytes from NVRAM.", snapshot->blob.ruleCount(), size);
+	return snapshot;
+}
+
+// Publishes a snapshot, readers switch over on their next lookup
+void VMHLiveFilter::publish(Snapshot *snapshot) {
+	Snapshot *previous = __atomic_exchange_n(&current, snapshot, __ATOMIC_RELEASE);
+	if (!previous) {
+		return;
+	}
+
+	// Lookups that may have started on the previous snapshot are short, poll rather than block
+	grace.synchronize([]() { IOSleep(1); });
+	if (retiredCallback) {
+		retiredCallback();
+	}
+	destroy(previous);
+}
+
+// kern.vmh.filter handler, reads the list as comma separated names and replaces it on write.
+// Writes are restricted to root by sysctl itself, as the OID is not CTLFLAG_ANYBODY.
+int VMH_sysctl_filter(struct sysctl_oid *oidp __unused, void *arg1 __unused, int arg2 __unused, struct sysctl_req *req) {
+	IOLockLock(VMHLiveFilter::writeLock);
+
+	// Readers of the sysctl hold the write lock, the current snapshot cannot be retired under them
+	const VMHLiveFilter::Snapshot *snapshot = VMHLiveFilter::current;
+	// A compiled filter lists its rules from the blob, in the order of its source list
+	const VMHFilterBlob &blob = snapshot->blob;
+	size_t count = blob.isOpen() ? blob.ruleCount() : snapshot->count;
+	int error = 0;
+	for (size_t i = 0; i < count && !error; i++) {
+		if (i > 0) {
+			error = SYSCTL_OUT(req, ",", 1);
+		}
+		const char *prefix;
+		const char *name;
+		bool tree;
+		if (blob.isOpen()) {
+			const vmh_filter_rule_t &rule = blob.rule(static_cast<uint32_t>(i));
+			prefix = matchPrefixes[rule.kind];
+			name = blob.name(rule);
+			tree = (rule.flags & VMH_FILTER_RULE_TREE) != 0;
+		} else {
+			prefix = matchPrefixes[snapshot->procs[i].match];
+			name = snapshot->procs[i].name;
+			tree = snapshot->procs[i].tree;
+		}
+		if (!error && tree) {
+			error = SYSCTL_OUT(req, treePrefix, strlen(treePrefix));
+		}
+		if (!error && *prefix) {
+			error = SYSCTL_OUT(req, prefix, strlen(prefix));
+		}
+		if (!error) {
+			error = SYSCTL_OUT(req, name, strlen(name));
+		}
+	}
+	if (!error) {
+		error = SYSCTL_OUT(req, "", 1);
+	}
+	if (error || !req->newptr) {
+		IOLockUnlock(VMHLiveFilter::writeLock);
+		return error;
+	}
+
+	// Every name of the batch is replaced at once, a failed write leaves the current list untouched
+	size_t length = req->newlen;
+	if (length >= VMH_LIVE_FILTER_POOL) {
+		IOLockUnlock(VMHLiveFilter::writeLock);
+		return ENOSPC;
+	}
+	char *input = static_cast<char *>(IOMalloc(length + 1));
+	if (!input) {
+		IOLockUnlock(VMHLiveFilter::writeLock);
+		return ENOMEM;
+	}
+	error = SYSCTL_IN(req, input, length);
+	input[length] = '\0';
+
+	// Names are separated by commas or newlines, blanks around them are trimmed and empty
+	// names are ignored. They are counted first, so the parsed list is allocated at its size.
+	count = 0;
+	bool blank = true;
+	for (size_t i = 0; !error && i <= length; i++) {
+		char c = input[i];
+		if (c == ',' || c == '\n' || c == '\0') {
+			count += !blank;
+			blank = true;
+		} else if (!isFilterBlank(c)) {
+			blank = false;
+		}
+	}
+	if (!error && count > VMH_LIVE_FILTER_MAX) {
+		error = ENOSPC;
+	}
+	VMH::DetectedProcess *parsed = nullptr;
+	if (!error && count) {
+		parsed = static_cast<VMH::DetectedProcess *>(IOMalloc(count * sizeof(VMH::DetectedProcess)));
+		error = parsed ? 0 : ENOMEM;
+	}
+
+	// A "path:" or "bundle:" prefix matches the name against the executable path or bundle
+	// identifier instead, and a "tree:" prefix ahead of it extends the rule to every
+	// descendant of a matching process. A rule left empty by its prefixes is rejected,
+	// exactly as vmh-filterc rejects it.
+	size_t parsedCount = 0;
+	char *name = input;
+	for (size_t i = 0; !error && i <= length; i++) {
+		char c = input[i];
+		if (c != ',' && c != '\n' && c != '\0') {
+			continue;
+		}
+		char *end = &input[i];
+		*end = '\0';
+		while (name < end && isFilterBlank(*name)) {
+			name++;
+		}
+		while (end > name && isFilterBlank(end[-1])) {
+			*--end = '\0';
+		}
+		if (name < end) {
+			VMH::DetectedProcess &parsedRule = parsed[parsedCount++];
+			parsedRule.pid = -1;
+			parsedRule.match = VMH::VMH_MATCH_NAME;
+			parsedRule.tree = strncmp(name, treePrefix, strlen(treePrefix)) == 0;
+			if (parsedRule.tree) {
+				name += strlen(treePrefix);
+			}
+			parsedRule.name = name;
+			for (size_t kind = VMH::VMH_MATCH_NAME + 1; kind < VMH::VMH_MATCH_KINDS; kind++) {
+				size_t prefixLength = strlen(matchPrefixes[kind]);
+				if (strncmp(name, matchPrefixes[kind], prefixLength) == 0) {
+					parsedRule.name = name + prefixLength;
+					parsedRule.match = static_cast<VMH::MatchKind>(kind);
+					break;
+				}
+			}
+			if (*parsedRule.name == '\0') {
+				error = EINVAL;
+			}
+		}
+		name = &input[i + 1];
+	}
+
+	VMHLiveFilter::Snapshot *replacement = nullptr;
+	if (!error) {
+		error = VMHLiveFilter::build(parsed, count, &replacement);
+	}
+	if (parsed) {
+		IOFree(parsed, count * sizeof(VMH::DetectedProcess));
+	}
+	IOFree(input, length + 1);
+	if (!error) {
+		VMHLiveFilter::publish(replacement);
+		DBGLOG(MODULE_LFLT, "Replaced the filter list, now holding %lu name, %lu path and %lu bundle rules, %lu of them tree rules.", replacement->rules[VMH::VMH_MATCH_NAME].count,
+			   replacement->rules[VMH::VMH_MATCH_PATH].count, replacement->rules[VMH::VMH_MATCH_BUNDLE].count, replacement->treeCount);
+	} else {
+		DBGLOG(MODULE_LFLT, "Rejected a filter list update with error %d.", error);
+	}
+
+	IOLockUnlock(VMHLiveFilter::writeLock);
+	return error;
+}
+
+// kern.vmh.filter
+SYSCTL_PROC(_kern_vmh, OID_AUTO, filter, CTLTYPE_STRING | CTLFLAG_RW | CTLFLAG_LOCKED, nullptr, 0, VMH_sysctl_filter, "A", "Comma separated names, path: and bundle: rules of the filtered processes");
+
+// Function for the live filter init routine
+bool VMHLiveFilter::init(const VMH::DetectedProcess *procs, size_t count, RetiredCallback retired) {
+	writeLock = IOLockAlloc();
+	Snapshot *snapshot = nullptr;
+	int error = writeLock ? 0 : ENOMEM;
+
+	// A compiled filter stored in NVRAM replaces the built-in list, which stays the fallback
+	if (!error) {
+		snapshot = loadCompiled();
+	}
+	if (!error && !snapshot) {
+		error = build(procs, count, &snapshot);
+	}
+	if (error) {
+		DBGLOG(MODULE_ERROR, "Failed to build the initial filter list with error %d.", error);
+		if (writeLock) {
+			IOLockFree(writeLock);
+			writeLock = nullptr;
+		}
+		return false;
+	}
+
+	retiredCallback = retired;
+	publish(snapshot);
+	sysctl_register_oid(&sysctl__kern_vmh_filter);
+	DBGLOG(MODULE_LFLT, "Published the initial filter list of %lu %s rules, kern.vmh.filter is writable.",
+		   snapshot->rules[VMH::VMH_MATCH_NAME].count + snapshot->rules[VMH::VMH_MATCH_PATH].count + snapshot->rules[VMH::VMH_MATCH_BUNDLE].count,
+		   snapshot->blob.isOpen() ? "compiled" : "built-in");
+	return true;
+}
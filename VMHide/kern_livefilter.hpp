@@ -0,0 +1,205 @@
+//
+//  kern_livefilter.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_livefilter_hpp
+#define kern_livefilter_hpp
+
+// Include Parent Module
+#include "kern_start.hpp"
+#include "kern_filter.hpp"
+#include "kern_filterblob.hpp"
+#include "kern_glob.hpp"
+#include "kern_grace.hpp"
+#include "kern_stats.hpp"
+
+// Logging Defs
+#define MODULE_LFLT "LFLT"
+
+// Most names a filter list may hold, and the bytes available to store them
+#define VMH_LIVE_FILTER_MAX 128
+#define VMH_LIVE_FILTER_POOL 4096
+
+// Most DFA states and transitions the glob rules of a list may compile to, compiled filters get the same budget
+#define VMH_LIVE_FILTER_GLOB_STATES VMH_FILTER_GLOB_STATES
+#define VMH_LIVE_FILTER_GLOB_TRANSITIONS VMH_FILTER_GLOB_TRANSITIONS
+
+/**
+ * @brief Process filter list that can be replaced at runtime through kern.vmh.filter.
+ *
+ * Every rule matches one kind of string, see VMH::MatchKind: the process name, or with a
+ * "path:" or "bundle:" prefix in kern.vmh.filter, the executable path or bundle identifier.
+ * Names containing '*' or '?' are glob rules, such as "com.apple.Mobile*", every other name
+ * must match exactly. Rules prefixed with "tree:" also filter every descendant of a matching
+ * process, see VMM for how descendants are tracked. The list is an immutable snapshot: per kind a perfect hash table of the
+ * exact names and a DFA compiled from the glob rules, and its own copy of every name, each
+ * allocated at the size the list needs. Writers
+ * build a complete new snapshot, publish it with a single pointer store and free the previous
+ * one after a grace period. The boot snapshot may instead come from a filter compiled by
+ * Tools/vmh-filterc and stored in NVRAM, whose exact rules are then searched in the blob itself.
+ * Readers never lock, they only bracket their lookups with enter() and exit():
+ *
+ *   uint32_t section = VMHLiveFilter::enter();
+ *   bool filtered = VMHLiveFilter::contains(VMH::VMH_MATCH_NAME, name);
+ *   VMHLiveFilter::exit(section);
+ */
+class VMHLiveFilter {
+public:
+
+	// Called once a replaced snapshot is no longer used by any reader
+	typedef void (*RetiredCallback)();
+
+	/**
+	 * @brief Publishes the initial list and registers kern.vmh.filter, kern.vmh must already be registered.
+	 * A valid compiled filter in the VMH_FILTER_NVRAM_NAME variable takes the place of procs.
+	 * @param retired Called after every replacement, for instance to drop verdicts derived from the old list.
+	 * @return false if the initial list could not be built.
+	 */
+	static bool init(const VMH::DetectedProcess *procs, size_t count, RetiredCallback retired);
+
+	/**
+	 * @brief Enters a read-side section, the current snapshot stays valid until the matching exit().
+	 */
+	static uint32_t enter() {
+		return grace.enter(static_cast<size_t>(cpu_number()));
+	}
+
+	/**
+	 * @brief Checks whether a string of the given kind matches the current list, only valid between enter() and exit().
+	 */
+	static bool contains(VMH::MatchKind kind, const char *string) {
+		const Snapshot *snapshot = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+		if (!snapshot) {
+			return false;
+		}
+		const Rules &rules = snapshot->rules[kind];
+		bool exact = snapshot->blob.isOpen() ? snapshot->blob.contains(kind, string) : rules.table.contains(string);
+		return exact || rules.globs.matches(string);
+	}
+
+	/**
+	 * @brief Checks whether the current list has rules of the given kind, only valid between enter() and exit().
+	 * Lets callers skip resolving strings nothing would be matched against.
+	 */
+	static bool hasRules(VMH::MatchKind kind) {
+		const Snapshot *snapshot = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+		return snapshot && snapshot->rules[kind].count;
+	}
+
+	/**
+	 * @brief Checks whether a string of the given kind matches a tree rule, only valid between enter() and exit().
+	 * Tree rules are few and only checked when a process calls exec, or first calls without a verdict,
+	 * so they are matched one by one rather than through a table.
+	 */
+	static bool matchesTree(VMH::MatchKind kind, const char *string) {
+		const Snapshot *snapshot = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+		if (!snapshot) {
+			return false;
+		}
+		for (size_t i = 0; i < snapshot->treeCount; i++) {
+			if (snapshot->tree[i].match == kind && vmhGlobMatch(snapshot->tree[i].name, string)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Checks whether the current list has tree rules, of any kind or of the given one. Only valid between enter() and exit().
+	 */
+	static bool hasTreeRules() {
+		const Snapshot *snapshot = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+		return snapshot && snapshot->treeCount;
+	}
+
+	static bool hasTreeRules(VMH::MatchKind kind) {
+		const Snapshot *snapshot = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+		return snapshot && snapshot->treeOfKind[kind];
+	}
+
+	/**
+	 * @brief Leaves a read-side section.
+	 */
+	static void exit(uint32_t section) {
+		grace.exit(static_cast<size_t>(cpu_number()), section);
+	}
+
+private:
+
+	typedef VMHGlobMatcher<VMH_LIVE_FILTER_GLOB_STATES, VMH_LIVE_FILTER_GLOB_TRANSITIONS> GlobMatcher;
+
+	struct Rules {
+		VMHFilterTableView table; // Over storage allocated with the snapshot
+		VMHGlobTable globs;
+		void *globStorage;        // DFA of globs, allocated apart once its size is known
+		size_t globSize;
+		size_t count;
+	};
+
+	// Allocated in size bytes, followed by the table storage, procs and pool it points to
+	struct Snapshot {
+		Rules rules[VMH::VMH_MATCH_KINDS];
+		VMH::DetectedProcess *procs;
+		size_t count;
+		char *pool;
+		size_t size;
+		VMHFilterBlob blob;     // Open when the snapshot was loaded from a compiled filter, procs is empty then
+		uint8_t *blobData;      // Owned by the snapshot, allocated by NVStorage
+		uint32_t blobSize;
+		VMH::DetectedProcess tree[VMH_FILTER_MAX_TREES]; // Tree rules, also part of rules
+		size_t treeCount;
+		size_t treeOfKind[VMH::VMH_MATCH_KINDS];
+	};
+
+	// Working memory of a build, sized to its list and allocated rather than taken from the kernel stack.
+	// Allocated in size bytes, followed by the arrays it points to.
+	struct Builder {
+		GlobMatcher *globs;     // Null when the list has no glob rules
+		GlobMatcher::Scratch *globScratch;
+		size_t globScratchSize;
+		VMH::DetectedProcess *ofKind;
+		VMH::DetectedProcess *exact;
+		uint64_t *hashes;
+		uint32_t *order;
+		uint32_t *offsets;
+		size_t size;
+	};
+
+	static Snapshot *current;
+	static VMHGracePeriod<VMH_STATS_MAX_CPUS> grace;
+	static IOLock *writeLock;
+	static RetiredCallback retiredCallback;
+
+	// Allocates working memory for count entries, of which the glob rules need positions DFA positions
+	static Builder *allocBuilder(size_t count, size_t positions);
+
+	// Compiles the glob rules of entries into rules, with the DFA copied to storage of its size. Returns an errno.
+	static int compileGlobs(Rules &rules, const VMH::DetectedProcess *entries, size_t count, Builder *builder);
+
+	// Frees a snapshot along with the DFAs and compiled filter it owns
+	static void destroy(Snapshot *snapshot);
+
+	// Builds a snapshot holding copies of the given names, returns an errno
+	static int build(const VMH::DetectedProcess *procs, size_t count, Snapshot **snapshot);
+
+	// Builds a snapshot around a compiled filter, which it takes ownership of on success. Returns an errno.
+	static int buildCompiled(uint8_t *data, uint32_t size, Snapshot **snapshot);
+
+	// Reads the compiled filter from NVRAM, null if there is none or it cannot be used
+	static Snapshot *loadCompiled();
+
+	// Adds a rule to the tree rules of a snapshot, false if there are already VMH_FILTER_MAX_TREES
+	static bool addTreeRule(Snapshot *snapshot, const VMH::DetectedProcess &rule);
+
+	// Publishes a snapshot, and frees the previous one once no reader can reach it. Called with writeLock held.
+	static void publish(Snapshot *snapshot);
+
+	// kern.vmh.filter handler, reads the list as comma separated names and replaces it on write
+	friend int VMH_sysctl_filter(struct sysctl_oid *oidp, void *arg1, int arg2, struct sysctl_req *req);
+
+};
+
+#endif /* kern_livefilter_hpp */
@@ -0,0 +1,124 @@
+//
+//  kern_log.cpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#include "kern_log.hpp"
+#include "kern_stats.hpp"
+
+// Rings are allocated once during init, and never freed as VMHide cannot be unloaded
+VMHLog::Ring *VMHLog::rings = nullptr;
+uint32_t VMHLog::ringCount = 0;
+IOLock *VMHLog::drainLock = nullptr;
+uint64_t VMHLog::carriedLost = 0;
+
+// Records copied out at once, keeps the stack usage of the drain small
+#define VMH_LOG_CHUNK 8
+
+// Appends a record to the ring of the current CPU, the message is formatted by whoever drains it
+void VMHLog::record(uint16_t message, const char *name, pid_t pid, int verdict, uint64_t arg) {
+	Ring *published = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+	if (!published) {
+		return;
+	}
+	
+	uint32_t cpu = static_cast<uint32_t>(cpu_number());
+	vmh_log_record_t entry {};
+	entry.timestamp = mach_absolute_time();
+	entry.arg = arg;
+	entry.pid = pid;
+	entry.message = message;
+	entry.cpu = static_cast<uint8_t>(cpu);
+	entry.verdict = static_cast<uint8_t>(verdict);
+	for (size_t i = 0; name && i < VMH_LOG_NAME_LEN && name[i] != '\0'; i++) {
+		entry.name[i] = name[i];
+	}
+	published[cpu % ringCount].push(entry);
+}
+
+// kern.vmh.log handler, a vmh_log_header_t followed by as many drained records as fit the caller's buffer
+int VMH_sysctl_log(struct sysctl_oid *oidp __unused, void *arg1 __unused, int arg2 __unused, struct sysctl_req *req) {
+	// Process names of other users' processes are not for everyone, and draining consumes the records
+	if (!kauth_cred_issuser(kauth_cred_get())) {
+		return EPERM;
+	}
+	if (!VMHLog::rings) {
+		return ENOENT;
+	}
+	
+	// Size query, report the worst case of every ring being full
+	if (!req->oldptr) {
+		return SYSCTL_OUT(req, nullptr, sizeof(vmh_log_header_t) + VMHLog::ringCount * VMH_LOG_SLOTS * sizeof(vmh_log_record_t));
+	}
+	if (req->oldlen < sizeof(vmh_log_header_t)) {
+		return ENOMEM;
+	}
+	size_t room = (req->oldlen - sizeof(vmh_log_header_t)) / sizeof(vmh_log_record_t);
+	
+	IOLockLock(VMHLog::drainLock);
+	
+	mach_timebase_info_data_t timebase {};
+	clock_timebase_info(&timebase);
+	vmh_log_header_t header {};
+	header.magic = VMH_LOG_MAGIC;
+	header.version = VMH_ABI_VERSION;
+	header.recordSize = sizeof(vmh_log_record_t);
+	header.timebaseNumer = timebase.numer;
+	header.timebaseDenom = timebase.denom;
+	header.lost = VMHLog::carriedLost;
+	for (uint32_t cpu = 0; cpu < VMHLog::ringCount; cpu++) {
+		header.lost += VMHLog::rings[cpu].skipOverwritten();
+	}
+	VMHLog::carriedLost = 0;
+	int error = SYSCTL_OUT(req, &header, sizeof(header));
+	
+	// Overwrites noticed while copying are carried over to the next drain
+	vmh_log_record_t chunk[VMH_LOG_CHUNK];
+	for (uint32_t cpu = 0; cpu < VMHLog::ringCount && !error && room; cpu++) {
+		size_t copied;
+		do {
+			copied = VMHLog::rings[cpu].drain(chunk, room < VMH_LOG_CHUNK ? room : VMH_LOG_CHUNK, VMHLog::carriedLost);
+			if (copied) {
+				error = SYSCTL_OUT(req, chunk, copied * sizeof(vmh_log_record_t));
+				room -= copied;
+			}
+		} while (copied && !error && room);
+	}
+	
+	IOLockUnlock(VMHLog::drainLock);
+	return error;
+}
+
+// kern.vmh.log
+SYSCTL_PROC(_kern_vmh, OID_AUTO, log, CTLTYPE_OPAQUE | CTLFLAG_RD | CTLFLAG_LOCKED, nullptr, 0, VMH_sysctl_log, "S,vmh_log_header_t", "Drains the VMHide binary log");
+
+// Function for the binary log init routine
+void VMHLog::init() {
+	// One ring per CPU that may ever come online, CPUs beyond VMH_STATS_MAX_CPUS share rings
+	uint32_t count = VMHStats::possibleCpus();
+	
+	drainLock = IOLockAlloc();
+	void *memory = IOMallocAligned(count * sizeof(Ring), alignof(Ring));
+	if (!drainLock || !memory) {
+		DBGLOG(MODULE_ERROR, "Failed to allocate the binary log, VMHLOG messages will be dropped.");
+		if (drainLock) {
+			IOLockFree(drainLock);
+			drainLock = nullptr;
+		}
+		if (memory) {
+			IOFreeAligned(memory, count * sizeof(Ring));
+		}
+		return;
+	}
+	// An all zero ring is an empty ring
+	bzero(memory, count * sizeof(Ring));
+	ringCount = count;
+	
+	sysctl_register_oid(&sysctl__kern_vmh_log);
+	
+	// Publish the rings last, record() only checks this pointer
+	__atomic_store_n(&rings, static_cast<Ring *>(memory), __ATOMIC_RELEASE);
+	DBGLOG(MODULE_BLOG, "Allocated %u binary log rings of %d records.", count, VMH_LOG_SLOTS);
+}
@@ -0,0 +1,59 @@
+//
+//  kern_log.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_log_hpp
+#define kern_log_hpp
+
+// Include Parent Module
+#include "kern_start.hpp"
+#include "kern_ring.hpp"
+#include "vmh_abi.h"
+
+// Logging Defs
+#define MODULE_BLOG "BLOG"
+
+// Records kept per CPU before the oldest ones are overwritten
+#define VMH_LOG_SLOTS 256
+
+/**
+ * @brief Records a binary log message, see VMH_LOG_MESSAGES in vmh_abi.h.
+ * Like DBGLOG this only does anything while debug logging is enabled, but it never formats:
+ * the record is drained through kern.vmh.log and rendered by Tools/vmh-logdecode.
+ */
+#define VMHLOG(message, name, pid, verdict, arg) \
+	do { if (ADDPR(debugEnabled)) VMHLog::record(message, name, pid, verdict, arg); } while (0)
+
+/**
+ * @brief Deferred-format binary log, one lock-free ring of fixed-size records per CPU.
+ */
+class VMHLog {
+public:
+
+	// Allocates the rings and registers kern.vmh.log, kern.vmh must already be registered
+	static void init();
+
+	/**
+	 * @brief Appends a record to the ring of the current CPU. Safe from any context that may call DBGLOG.
+	 * @param name Process name, only the first VMH_LOG_NAME_LEN bytes are kept. May be null.
+	 */
+	static void record(uint16_t message, const char *name, pid_t pid, int verdict, uint64_t arg);
+
+private:
+
+	typedef VMHRing<vmh_log_record_t, VMH_LOG_SLOTS> Ring;
+
+	static Ring *rings;
+	static uint32_t ringCount;
+	static IOLock *drainLock;
+	static uint64_t carriedLost;
+
+	// kern.vmh.log handler, drains every ring into the caller's buffer
+	friend int VMH_sysctl_log(struct sysctl_oid *oidp, void *arg1, int arg2, struct sysctl_req *req);
+
+};
+
+#endif /* kern_log_hpp */
@@ -0,0 +1,63 @@
+//
+//  kern_namekey.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_namekey_hpp
+#define kern_namekey_hpp
+
+// Like kern_filter.hpp, this header stays free of kernel includes so the tools can share it.
+#include <stddef.h>
+#include <stdint.h>
+
+// The kernel is built without SSE, only the userspace builds of the tools get the vector compare
+#if defined(__SSE2__) && !defined(KERNEL)
+#include <emmintrin.h>
+#define VMH_NAME_KEY_SSE2 1
+#endif
+
+// Bytes of a name held by a key, matches MAXCOMLEN
+#define VMH_NAME_KEY_LEN 16
+
+/**
+ * @brief First VMH_NAME_KEY_LEN bytes of a process name, zero padded, as one aligned 128-bit value.
+ *
+ * Names of up to MAXCOMLEN bytes, which is most of what proc_name returns, are compared in full
+ * by comparing their keys, without touching the strings themselves.
+ */
+struct alignas(16) VMHNameKey {
+	uint64_t words[2] {};
+};
+
+/**
+ * @brief Packs the first VMH_NAME_KEY_LEN bytes of name into key.
+ * @return Length of name, bounded by limit.
+ */
+constexpr size_t vmhNameKeyPack(const char *name, VMHNameKey &key, size_t limit) {
+	key.words[0] = 0;
+	key.words[1] = 0;
+	size_t length = 0;
+	for (; length < limit && name[length] != '\0'; length++) {
+		if (length < VMH_NAME_KEY_LEN) {
+			key.words[length / 8] |= static_cast<uint64_t>(static_cast<uint8_t>(name[length])) << ((length % 8) * 8);
+		}
+	}
+	return length;
+}
+
+/**
+ * @brief Compares two keys, one 128-bit compare where SSE2 is available.
+ */
+static inline bool vmhNameKeyEqual(const VMHNameKey &a, const VMHNameKey &b) {
+#ifdef VMH_NAME_KEY_SSE2
+	__m128i equal = _mm_cmpeq_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(a.words)),
+								   _mm_load_si128(reinterpret_cast<const __m128i *>(b.words)));
+	return _mm_movemask_epi8(equal) == 0xffff;
+#else
+	return ((a.words[0] ^ b.words[0]) | (a.words[1] ^ b.words[1])) == 0;
+#endif
+}
+
+#endif /* kern_namekey_hpp */
@@ -0,0 +1,276 @@
+//
+//  kern_oidindex.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_oidindex_hpp
+#define kern_oidindex_hpp
+
+// Like kern_filter.hpp, this header stays free of kernel includes so the tools can share it.
+#include <stddef.h>
+#include <stdint.h>
+#include "kern_filter.hpp"
+
+// Deepest OID path indexed, the kernel tree is no deeper than 6 levels
+#define VMH_OID_MAX_DEPTH 16
+
+/**
+ * @brief Hashed index over a sysctl tree, by dotted name path and by OID number path.
+ *
+ * Built in a single iterative depth-first traversal. Path hashes are computed incrementally,
+ * every OID extends the hash of its parent, so building costs one hash step per OID. Entries
+ * keep a link to their parent, and every hit is verified against the full path through those
+ * links, so hash collisions can never return the wrong OID. The index holds up to Capacity
+ * OIDs, anything beyond is left out and reported through isComplete().
+ *
+ * The tree layout is supplied by Traits, so the same code indexes the kernel tree and the
+ * synthetic trees of the benchmarks:
+ *   typedef ... Oid; typedef ... List;
+ *   static Oid *first(List *); static Oid *next(Oid *);
+ *   static const char *name(const Oid *); static int number(const Oid *);
+ *   static List *children(Oid *);  // nullptr unless the OID is a node with children
+ *
+ * @tparam Capacity Maximum number of OIDs indexed.
+ */
+template <typename Traits, size_t Capacity>
+class VMHOidIndex {
+public:
+	typedef typename Traits::Oid Oid;
+	typedef typename Traits::List List;
+
+	// Every OID is inserted twice (name and number path), keep the table at most half full
+	static constexpr size_t Slots = vmhPow2(Capacity) * 4;
+	static constexpr uint32_t None = 0xffffffff;
+
+	/**
+	 * @brief Indexes every OID below root, replacing the previous contents.
+	 * @return false if the tree did not fit, the index then holds the OIDs visited first.
+	 */
+	bool build(List *root) {
+		clear();
+
+		// The hashes of the parent path live on the traversal stack, entries only keep the parent link
+		struct Frame {
+			Oid *cursor;
+			uint32_t parent;
+			uint64_t nameHash;
+			uint64_t numberHash;
+		};
+		Frame stack[VMH_OID_MAX_DEPTH];
+		size_t depth = 0;
+		stack[0] = {Traits::first(root), None, NameSeed, NumberSeed};
+
+		while (true) {
+			Oid *oid = stack[depth].cursor;
+			if (!oid) {
+				if (depth == 0) {
+					break;
+				}
+				depth--;
+				continue;
+			}
+			stack[depth].cursor = Traits::next(oid);
+
+			const char *name = Traits::name(oid);
+			if (!name) {
+				continue;
+			}
+			if (count == Capacity) {
+				complete = false;
+				break;
+			}
+
+			const Frame &frame = stack[depth];
+			uint32_t self = static_cast<uint32_t>(count++);
+			entries[self].oid = oid;
+			entries[self].parent = frame.parent;
+			uint64_t nameHash = nameStep(frame.parent == None ? frame.nameHash : nameStep(frame.nameHash, "."), name);
+			uint64_t numberHash = numberStep(frame.numberHash, Traits::number(oid));
+			insert(nameHash, self);
+			insert(numberHash, self);
+
+			List *children = Traits::children(oid);
+			if (children) {
+				if (depth + 1 == VMH_OID_MAX_DEPTH) {
+					complete = false;
+				} else {
+					stack[++depth] = {Traits::first(children), self, nameHash, numberHash};
+				}
+			}
+		}
+		return complete;
+	}
+
+	/**
+	 * @brief Finds an OID by dotted name path, such as "kern.hv_vmm_present".
+	 */
+	Oid *find(const char *path) const {
+		uint64_t hash = nameStep(NameSeed, path);
+		for (size_t probe = 0; probe < Slots; probe++) {
+			const Slot &slot = slots[(hash + probe) & (Slots - 1)];
+			if (slot.entry == None) {
+				return nullptr;
+			}
+			if (slot.tag == tagOf(hash) && matchesName(slot.entry, path)) {
+				return entries[slot.entry].oid;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * @brief Finds an OID by number path, as used by sysctl(3) MIBs.
+	 */
+	Oid *find(const int *numbers, size_t length) const {
+		if (!length || length > VMH_OID_MAX_DEPTH) {
+			return nullptr;
+		}
+		uint64_t hash = NumberSeed;
+		for (size_t i = 0; i < length; i++) {
+			hash = numberStep(hash, numbers[i]);
+		}
+		for (size_t probe = 0; probe < Slots; probe++) {
+			const Slot &slot = slots[(hash + probe) & (Slots - 1)];
+			if (slot.entry == None) {
+				return nullptr;
+			}
+			if (slot.tag == tagOf(hash) && matchesNumbers(slot.entry, numbers, length)) {
+				return entries[slot.entry].oid;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * @brief Writes the dotted path of the OID at position i (in traversal order) into buffer.
+	 * @return Depth of the OID, 0 for top level OIDs.
+	 */
+	size_t pathAt(size_t i, char *buffer, size_t size) const {
+		uint32_t chain[VMH_OID_MAX_DEPTH];
+		size_t depth = 0;
+		for (uint32_t e = static_cast<uint32_t>(i); e != None && depth < VMH_OID_MAX_DEPTH; e = entries[e].parent) {
+			chain[depth++] = e;
+		}
+		size_t used = 0;
+		for (size_t d = depth; d > 0 && size; d--) {
+			const char *name = Traits::name(entries[chain[d - 1]].oid);
+			for (size_t c = 0; name[c] != '\0' && used + 1 < size; c++) {
+				buffer[used++] = name[c];
+			}
+			if (d > 1 && used + 1 < size) {
+				buffer[used++] = '.';
+			}
+		}
+		if (size) {
+			buffer[used] = '\0';
+		}
+		return depth - 1;
+	}
+
+	Oid *oidAt(size_t i) const { return entries[i].oid; }
+	size_t size() const { return count; }
+	bool isComplete() const { return complete; }
+
+private:
+	static constexpr uint64_t NameSeed = 0xcbf29ce484222325ULL;
+	static constexpr uint64_t NumberSeed = 0x84222325cbf29ce4ULL;
+
+	struct Entry {
+		Oid *oid;
+		uint32_t parent;
+	};
+
+	// Slots store the upper hash bits, most mismatches are rejected without touching the entry
+	struct Slot {
+		uint32_t tag;
+		uint32_t entry;
+	};
+
+	Entry entries[Capacity];
+	Slot slots[Slots];
+	size_t count {0};
+	bool complete {true};
+
+	void clear() {
+		for (size_t i = 0; i < Slots; i++) {
+			slots[i].entry = None;
+		}
+		count = 0;
+		complete = true;
+	}
+
+	static uint32_t tagOf(uint64_t hash) {
+		return static_cast<uint32_t>(hash >> 32);
+	}
+
+	// FNV-1a over a string, continuing from hash
+	static uint64_t nameStep(uint64_t hash, const char *string) {
+		for (size_t i = 0; string[i] != '\0'; i++) {
+			hash ^= static_cast<uint8_t>(string[i]);
+			hash *= 0x100000001b3ULL;
+		}
+		return hash;
+	}
+
+	static uint64_t numberStep(uint64_t hash, int number) {
+		return vmhNameMix(hash, static_cast<uint32_t>(number));
+	}
+
+	void insert(uint64_t hash, uint32_t entry) {
+		for (size_t probe = 0; probe < Slots; probe++) {
+			Slot &slot = slots[(hash + probe) & (Slots - 1)];
+			if (slot.entry == None) {
+				slot.tag = tagOf(hash);
+				slot.entry = entry;
+				return;
+			}
+		}
+	}
+
+	// Compares the path of an entry with a dotted path, component by component from the leaf up
+	bool matchesName(uint32_t e, const char *path) const {
+		size_t end = 0;
+		while (path[end] != '\0') {
+			end++;
+		}
+		while (e != None) {
+			const char *name = Traits::name(entries[e].oid);
+			size_t length = 0;
+			while (name[length] != '\0') {
+				length++;
+			}
+			if (length > end) {
+				return false;
+			}
+			size_t start = end - length;
+			for (size_t c = 0; c < length; c++) {
+				if (path[start + c] != name[c]) {
+					return false;
+				}
+			}
+			e = entries[e].parent;
+			if (e == None) {
+				return start == 0;
+			}
+			if (start == 0 || path[start - 1] != '.') {
+				return false;
+			}
+			end = start - 1;
+		}
+		return false;
+	}
+
+	bool matchesNumbers(uint32_t e, const int *numbers, size_t length) const {
+		for (size_t i = length; i > 0; i--) {
+			if (e == None || Traits::number(entries[e].oid) != numbers[i - 1]) {
+				return false;
+			}
+			e = entries[e].parent;
+		}
+		return e == None;
+	}
+};
+
+#endif /* kern_oidindex_hpp */
@@ -0,0 +1,36 @@
+//
+//  kern_patch.cpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#include "kern_patch.hpp"
+#include "kern_stats.hpp"
+
+// Applies every store within one window, nothing else may run while protection is lowered
+void VMHPatchTransaction::commit(KernelPatcher &patcher) {
+	if (!count) {
+		return;
+	}
+	
+	// On macOS Ventura (Darwin 22) and newer (?), we must disable kernel write protection.
+	// Not too sure when this began to be a requirement, but let's do it for Vent+ for now.
+	bool protectedWrites = getKernelVersion() >= KernelVersion::Ventura;
+	DBGLOG(MODULE_PATCH, "Applying %lu stores%s.", count, protectedWrites ? " with kernel write protection disabled" : "");
+	
+	uint64_t windowStart = mach_absolute_time();
+	if (protectedWrites) {
+		PANIC_COND(MachInfo::setKernelWriting(true, patcher.kernelWriteLock) != KERN_SUCCESS, MODULE_SHORT, "Failed to disable kernel write protection.");
+	}
+	for (size_t i = 0; i < count; i++) {
+		__atomic_store_n(stores[i].slot, stores[i].value, __ATOMIC_RELEASE);
+	}
+	if (protectedWrites) {
+		MachInfo::setKernelWriting(false, patcher.kernelWriteLock);
+	}
+	VMHStats::recordBoot(VMHBootWriteWindow, windowStart);
+	VMHStats::count(VMHStatWriteWindows);
+	
+	count = 0;
+}
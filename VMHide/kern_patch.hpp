@@ -0,0 +1,66 @@
+//
+//  kern_patch.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_patch_hpp
+#define kern_patch_hpp
+
+// Include Parent Module
+#include "kern_start.hpp"
+
+// Logging Defs
+#define MODULE_PATCH "PATCH"
+
+// Upper bound on pointer stores queued in a single VMHPatchTransaction
+#define VMH_PATCH_MAX_STORES 32
+
+/**
+ * @brief Batch of pointer stores into write-protected kernel memory.
+ *
+ * Stores are queued with add() and applied by commit() within a single kernel write window,
+ * each as a release store, so a CPU seeing a new pointer also sees everything written before
+ * commit(). The window holds nothing but the stores themselves: every lookup, check and log
+ * happens before it opens. Its duration is recorded into kern.vmh.boot.write_window.
+ */
+class VMHPatchTransaction {
+public:
+	
+	/**
+	 * @brief Queues value to be stored into slot.
+	 * @return false if the transaction is full, nothing is queued then.
+	 */
+	template <typename T>
+	bool add(T *slot, T value) {
+		static_assert(sizeof(T) == sizeof(void *), "VMHPatchTransaction only stores pointer sized values");
+		if (count == VMH_PATCH_MAX_STORES) {
+			return false;
+		}
+		stores[count].slot = reinterpret_cast<void **>(slot);
+		stores[count].value = reinterpret_cast<void *>(value);
+		count++;
+		return true;
+	}
+	
+	/**
+	 * @brief Applies every queued store within one write window, and empties the transaction.
+	 */
+	void commit(KernelPatcher &patcher);
+	
+	size_t size() const { return count; }
+	
+private:
+	
+	struct Store {
+		void **slot;
+		void *value;
+	};
+	
+	Store stores[VMH_PATCH_MAX_STORES] {};
+	size_t count {0};
+	
+};
+
+#endif /* kern_patch_hpp */
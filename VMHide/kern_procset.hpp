@@ -0,0 +1,302 @@
+//
+//  kern_procset.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_procset_hpp
+#define kern_procset_hpp
+
+// Like kern_filter.hpp, this header stays free of kernel includes so the tools can share it.
+#include <stddef.h>
+#include <stdint.h>
+#include "kern_filter.hpp"
+
+// Bytes interned per name, one VMHNameKey. Longer names are tracked by their first 16 bytes,
+// exactly like the kernel truncates p_comm.
+#define VMH_PROCSET_NAME_LEN VMH_NAME_KEY_LEN
+
+// Number of neighbouring slots a name may occupy, starting from its home slot
+#define VMH_PROCSET_WINDOW 8
+
+// Bounded retries when racing other CPUs for the same window
+#define VMH_PROCSET_RETRIES 4
+
+// Most pauses spent waiting for another CPU to publish the name it is inserting
+#define VMH_PROCSET_SETTLE_SPINS 256
+
+/**
+ * @brief Outcome of VMHProcessSet::insert.
+ */
+enum VMHProcessSetResult {
+	VMHProcessSetPresent,   // Name was already tracked
+	VMHProcessSetInserted,  // Name was added to a free slot
+	VMHProcessSetEvicted,   // Name was added in place of a name not seen recently
+	VMHProcessSetContended, // Every candidate slot was being written by another CPU
+};
+
+/**
+ * @brief Concurrent set of process names with CLOCK eviction.
+ *
+ * Names are interned into a compact arena of VMHNameKey, 16 aligned bytes per slot. Every name
+ * lives within VMH_PROCSET_WINDOW slots of its home slot (open addressing), so a membership
+ * check is one hash and at most a window of tag compares. Inserts are lock-free: a slot is
+ * claimed with a compare-and-swap on its state word, the name is written, and the slot is
+ * published with a release store. Each slot carries a CLOCK reference bit, set whenever the
+ * name is seen. When a window is full, the sweep clears reference bits and evicts the first
+ * slot that was not seen since the last pass, so the set never stops tracking new names.
+ * Every slot also counts the repeat sightings of its name, until takeRepeats collects them.
+ * Repeats still pending when a name is evicted are dropped along with it, and counted in
+ * droppedRepeats. A slot another CPU is still writing is never reported as present: an insert
+ * racing it for the same name waits for it to be published, and tries again if it is not.
+ *
+ * @tparam Slots Number of slots, must be a power of two.
+ */
+template <size_t Slots>
+class VMHProcessSet {
+	static_assert(Slots >= VMH_PROCSET_WINDOW && !(Slots & (Slots - 1)), "VMHProcessSet size must be a power of two");
+
+public:
+	/**
+	 * @brief Marks name as seen, adding it to the set if needed. A name already present has a repeat counted.
+	 * @param where Receives the slot holding the name, or Slots when the set is contended. May be null.
+	 */
+	VMHProcessSetResult insert(const char *name, size_t *where = nullptr) {
+		VMHNameKey key;
+		vmhNameKeyPack(name, key, VMH_PROCSET_NAME_LEN);
+		return insert(key, where);
+	}
+
+	/**
+	 * @brief Same as insert(name), for callers that already packed the name.
+	 */
+	VMHProcessSetResult insert(const VMHNameKey &key, size_t *where = nullptr) {
+		uint64_t hash = vmhNameKeyHash(key);
+		uint32_t tag = static_cast<uint32_t>(hash >> 34);
+		size_t home = hash & (Slots - 1);
+		if (where) {
+			*where = Slots;
+		}
+
+		for (size_t attempt = 0; attempt < VMH_PROCSET_RETRIES; attempt++) {
+			size_t vacant = Slots;
+			size_t slot = find(home, tag, key, &vacant);
+			if (slot != Slots) {
+				repeat(slot);
+				if (where) {
+					*where = slot;
+				}
+				return VMHProcessSetPresent;
+			}
+
+			bool evicted = false;
+			slot = vacant;
+			if (slot == Slots) {
+				slot = evict(home, tag);
+				evicted = slot != Slots;
+			} else {
+				uint32_t expected = 0;
+				if (!__atomic_compare_exchange_n(&states[slot], &expected, busy(tag), false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+					continue;
+				}
+			}
+			if (slot == Slots) {
+				continue;
+			}
+
+			// The slot is ours, intern the name. Repeats left on it belong to the name it held before.
+			__atomic_store_n(&names[slot].words[0], key.words[0], __ATOMIC_RELAXED);
+			__atomic_store_n(&names[slot].words[1], key.words[1], __ATOMIC_RELAXED);
+			__atomic_store_n(&referenced[slot], 1, __ATOMIC_RELAXED);
+			uint32_t pending = __atomic_exchange_n(&repeats[slot], 0, __ATOMIC_RELAXED);
+			if (pending) {
+				__atomic_fetch_add(&dropped, pending, __ATOMIC_RELAXED);
+			}
+
+			// Another CPU may be inserting the same name right now. Back off if it already published it,
+			// or if it claimed an earlier slot of the window. Both claims are sequentially consistent,
+			// so at least one of the two racing CPUs is guaranteed to see the other.
+			size_t winner = raced(home, tag, key, slot);
+			if (winner != Slots) {
+				__atomic_store_n(&states[slot], 0, __ATOMIC_RELEASE);
+				if (evicted) {
+					__atomic_fetch_sub(&count, 1, __ATOMIC_RELAXED);
+				}
+				// Only a published copy makes the name present, the other CPU may still back off itself
+				if (!settled(winner, tag, key)) {
+					continue;
+				}
+				repeat(winner);
+				if (where) {
+					*where = winner;
+				}
+				return VMHProcessSetPresent;
+			}
+
+			__atomic_store_n(&states[slot], ready(tag), __ATOMIC_RELEASE);
+			if (!evicted) {
+				__atomic_fetch_add(&count, 1, __ATOMIC_RELAXED);
+			}
+			if (where) {
+				*where = slot;
+			}
+			return evicted ? VMHProcessSetEvicted : VMHProcessSetInserted;
+		}
+
+		return VMHProcessSetContended;
+	}
+
+	/**
+	 * @brief Checks whether name is currently tracked, without marking it as seen.
+	 */
+	bool contains(const char *name) const {
+		VMHNameKey key;
+		vmhNameKeyPack(name, key, VMH_PROCSET_NAME_LEN);
+		uint64_t hash = vmhNameKeyHash(key);
+		uint32_t tag = static_cast<uint32_t>(hash >> 34);
+		size_t home = hash & (Slots - 1);
+		return find(home, tag, key, nullptr) != Slots;
+	}
+
+	/**
+	 * @brief Marks the name of slot as seen again, for callers that remembered where insert put it.
+	 * If the name was evicted in the meantime, the repeat is counted against its replacement.
+	 */
+	void repeat(size_t slot) {
+		__atomic_store_n(&referenced[slot], 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&repeats[slot], 1, __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * @brief Returns the repeats counted for slot since the previous call, and resets them.
+	 */
+	uint32_t takeRepeats(size_t slot) {
+		return __atomic_exchange_n(&repeats[slot], 0, __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * @brief Repeats lost because their name was evicted before takeRepeats collected them.
+	 */
+	uint64_t droppedRepeats() const {
+		return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * @brief Number of names currently tracked.
+	 */
+	uint32_t size() const {
+		return __atomic_load_n(&count, __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * @brief Copies the name of slot into buffer (at least VMH_PROCSET_NAME_LEN + 1 bytes).
+	 * @return false if the slot holds no published name.
+	 */
+	bool nameAt(size_t slot, char *buffer) const {
+		uint32_t state = __atomic_load_n(&states[slot], __ATOMIC_ACQUIRE);
+		if ((state & PhaseMask) != PhaseReady) {
+			return false;
+		}
+		uint64_t words[2] = {__atomic_load_n(&names[slot].words[0], __ATOMIC_RELAXED), __atomic_load_n(&names[slot].words[1], __ATOMIC_RELAXED)};
+		for (size_t i = 0; i < VMH_PROCSET_NAME_LEN; i++) {
+			buffer[i] = static_cast<char>(words[i / 8] >> ((i % 8) * 8));
+		}
+		buffer[VMH_PROCSET_NAME_LEN] = '\0';
+		return __atomic_load_n(&states[slot], __ATOMIC_ACQUIRE) == state;
+	}
+
+	static constexpr size_t capacity() { return Slots; }
+
+private:
+	static constexpr uint32_t PhaseMask = 3;
+	static constexpr uint32_t PhaseBusy = 1;
+	static constexpr uint32_t PhaseReady = 2;
+
+	uint32_t states[Slots] {};
+	VMHNameKey names[Slots] {};
+	uint8_t referenced[Slots] {};
+	uint32_t repeats[Slots] {};
+	uint32_t count {0};
+	uint32_t hand {0};
+	uint64_t dropped {0};
+
+	static uint32_t busy(uint32_t tag) { return (tag << 2) | PhaseBusy; }
+	static uint32_t ready(uint32_t tag) { return (tag << 2) | PhaseReady; }
+
+	// The low bits of a key hash select the home slot, the top 30 bits are the tag kept in the state word.
+	// Keys are read word by word, as a writer may be replacing them, and compared once copied.
+	bool matches(size_t slot, const VMHNameKey &key) const {
+		VMHNameKey interned;
+		interned.words[0] = __atomic_load_n(&names[slot].words[0], __ATOMIC_RELAXED);
+		interned.words[1] = __atomic_load_n(&names[slot].words[1], __ATOMIC_RELAXED);
+		return vmhNameKeyEqual(interned, key);
+	}
+
+	// Scans the window for a published copy of key, optionally reporting the first free slot.
+	// Slots still being written are skipped, raced() sorts out two CPUs inserting the same name.
+	size_t find(size_t home, uint32_t tag, const VMHNameKey &key, size_t *vacant) const {
+		for (size_t i = 0; i < VMH_PROCSET_WINDOW; i++) {
+			size_t slot = (home + i) & (Slots - 1);
+			uint32_t state = __atomic_load_n(&states[slot], __ATOMIC_ACQUIRE);
+			if (state == ready(tag) && matches(slot, key) && __atomic_load_n(&states[slot], __ATOMIC_ACQUIRE) == state) {
+				return slot;
+			}
+			if (state == 0 && vacant && *vacant == Slots) {
+				*vacant = slot;
+			}
+		}
+		return Slots;
+	}
+
+	// CLOCK sweep over the window, starting at a rotating hand. Returns a claimed slot, or Slots
+	size_t evict(size_t home, uint32_t tag) {
+		size_t start = __atomic_fetch_add(&hand, 1, __ATOMIC_RELAXED);
+		for (size_t i = 0; i < VMH_PROCSET_WINDOW * 2; i++) {
+			size_t slot = (home + (start + i) % VMH_PROCSET_WINDOW) & (Slots - 1);
+			uint32_t state = __atomic_load_n(&states[slot], __ATOMIC_ACQUIRE);
+			if ((state & PhaseMask) != PhaseReady) {
+				continue;
+			}
+			if (__atomic_exchange_n(&referenced[slot], 0, __ATOMIC_RELAXED)) {
+				continue; // Second chance
+			}
+			if (__atomic_compare_exchange_n(&states[slot], &state, busy(tag), false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+				return slot;
+			}
+		}
+		return Slots;
+	}
+
+	// Looks for a copy of the same name another CPU published or claimed while we were writing ours.
+	// Returns the slot of that copy, or Slots.
+	size_t raced(size_t home, uint32_t tag, const VMHNameKey &key, size_t mine) {
+		for (size_t i = 0; i < VMH_PROCSET_WINDOW; i++) {
+			size_t slot = (home + i) & (Slots - 1);
+			if (slot == mine) {
+				continue;
+			}
+			uint32_t state = __atomic_load_n(&states[slot], __ATOMIC_SEQ_CST);
+			if (state == ready(tag) && matches(slot, key)) {
+				return slot;
+			}
+			if (state == busy(tag) && ((slot - home) & (Slots - 1)) < ((mine - home) & (Slots - 1))) {
+				return slot;
+			}
+		}
+		return Slots;
+	}
+
+	// Waits a bounded time for the CPU writing slot to finish, then checks that it published key there.
+	// It only ever waits on a claim earlier in the window than its own, so two CPUs never wait on each other.
+	bool settled(size_t slot, uint32_t tag, const VMHNameKey &key) const {
+		uint32_t state = __atomic_load_n(&states[slot], __ATOMIC_ACQUIRE);
+		for (size_t spin = 0; state == busy(tag) && spin < VMH_PROCSET_SETTLE_SPINS; spin++) {
+			__builtin_ia32_pause();
+			state = __atomic_load_n(&states[slot], __ATOMIC_ACQUIRE);
+		}
+		return state == ready(tag) && matches(slot, key) && __atomic_load_n(&states[slot], __ATOMIC_ACQUIRE) == state;
+	}
+};
+
+#endif /* kern_procset_hpp */
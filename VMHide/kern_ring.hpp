@@ -0,0 +1,147 @@
+//
+//  kern_ring.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_ring_hpp
+#define kern_ring_hpp
+
+// Like kern_filter.hpp, this header stays free of kernel includes so the tools can share it.
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Lock-free ring of fixed-size binary records, overwriting the oldest records when full.
+ *
+ * Any number of writers reserve a ticket with a single fetch-add on the head, claim the slot by
+ * marking its sequence busy with their ticket, write their record and publish it by replacing
+ * the mark with the ticket, seqlock style. Two writers whose tickets are Slots apart may meet
+ * in one slot when the older one is preempted: the newer ticket always takes the claim over,
+ * and the older writer drops its record as soon as it sees its mark gone, before every word and
+ * when publishing. The single reader (callers serialize drains themselves) copies a record and
+ * checks that its sequence did not change meanwhile, so records overwritten during the copy,
+ * or dropped, are counted as lost rather than returned torn. Records are copied word by word
+ * with atomics, hence Record must be a trivially copyable type whose size is a multiple of 8 bytes.
+ *
+ * One race remains: an older writer preempted between checking its mark and storing a word
+ * can still store that single word into the record of the newer one, after it was published.
+ * It takes a writer lapped by the whole ring within one store, and only ever tears one word.
+ *
+ * @tparam Record Record type.
+ * @tparam Slots Number of records kept, must be a power of two.
+ */
+template <typename Record, size_t Slots>
+class VMHRing {
+	static_assert(Slots && !(Slots & (Slots - 1)), "VMHRing size must be a power of two");
+	static_assert(sizeof(Record) % sizeof(uint64_t) == 0, "VMHRing records must be a multiple of 8 bytes");
+
+public:
+	/**
+	 * @brief Appends a record, never blocks.
+	 */
+	void push(const Record &record) {
+		uint64_t ticket = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+		Slot &slot = slots[ticket & (Slots - 1)];
+
+		// Readers must never accept the slot while its words are being replaced. Release stores of the
+		// words (plain moves on x86) guarantee a reader seeing any new word also sees the busy mark.
+		uint64_t mark = Busy | ticket;
+		uint64_t sequence = __atomic_load_n(&slot.sequence, __ATOMIC_RELAXED);
+		do {
+			if (newer(sequence, ticket)) {
+				return; // Lapped by a newer ticket, which the reader counts this record as lost to
+			}
+		} while (!__atomic_compare_exchange_n(&slot.sequence, &sequence, mark, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+		const uint64_t *words = reinterpret_cast<const uint64_t *>(&record);
+		for (size_t i = 0; i < Words; i++) {
+			if (__atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) != mark) {
+				return;
+			}
+			__atomic_store_n(&slot.words[i], words[i], __ATOMIC_RELEASE);
+		}
+		__atomic_compare_exchange_n(&slot.sequence, &mark, ticket + 1, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * @brief Copies up to count records, oldest first, and consumes them.
+	 * @param lost Incremented by the number of records overwritten before they could be read.
+	 * @return Number of records copied. Stops early at a record still being written.
+	 */
+	size_t drain(Record *out, size_t count, uint64_t &lost) {
+		lost += skipOverwritten();
+		uint64_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+
+		size_t copied = 0;
+		while (copied < count && tail < end) {
+			Slot &slot = slots[tail & (Slots - 1)];
+			uint64_t before = __atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE);
+			if (!newer(before, tail) && before != tail + 1) {
+				break; // A writer holds this ticket, or has yet to claim it, resume from here on the next drain
+			}
+			if (before & Busy) {
+				// A newer ticket claimed the slot, this record is gone
+				lost++;
+				tail++;
+				continue;
+			}
+			uint64_t *words = reinterpret_cast<uint64_t *>(&out[copied]);
+			for (size_t i = 0; i < Words; i++) {
+				words[i] = __atomic_load_n(&slot.words[i], __ATOMIC_ACQUIRE);
+			}
+			if (before == tail + 1 && __atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) == before) {
+				copied++;
+			} else {
+				lost++; // Overwritten by a newer record, before or while we copied it
+			}
+			tail++;
+		}
+		return copied;
+	}
+
+	/**
+	 * @brief Skips the records that were already overwritten by newer ones.
+	 * @return Number of records skipped.
+	 */
+	uint64_t skipOverwritten() {
+		uint64_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+		if (end - tail <= Slots) {
+			return 0;
+		}
+		uint64_t skipped = end - Slots - tail;
+		tail = end - Slots;
+		return skipped;
+	}
+
+	/**
+	 * @brief Number of records written but not yet drained, including ones that will be lost.
+	 */
+	uint64_t pending() const {
+		return __atomic_load_n(&head, __ATOMIC_RELAXED) - tail;
+	}
+
+	static constexpr size_t capacity() { return Slots; }
+
+private:
+	static constexpr size_t Words = sizeof(Record) / sizeof(uint64_t);
+	static constexpr uint64_t Busy = 1ULL << 63; // Set along with the ticket of the writer holding the slot
+
+	struct Slot {
+		uint64_t sequence;
+		uint64_t words[Words];
+	};
+
+	// Whether sequence was left by a ticket newer than ticket, busy or published
+	static bool newer(uint64_t sequence, uint64_t ticket) {
+		return (sequence & Busy) ? (sequence & ~Busy) > ticket : sequence > ticket + 1;
+	}
+
+	// Writers share the head, keep it away from the reader-owned tail
+	alignas(64) uint64_t head {0};
+	alignas(64) uint64_t tail {0};
+	Slot slots[Slots] {};
+};
+
+#endif /* kern_ring_hpp */
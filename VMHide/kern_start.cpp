@@ -7,6 +7,11 @@
 
 #include "kern_start.hpp"
 #include "kern_vmm.hpp"
+#include "kern_stats.hpp"
+#include "kern_log.hpp"
+#include "kern_trace.hpp"
+#include "kern_sysctl.hpp"
+#include "kern_symbols.hpp"
 
 static VMH vmhInstance;
 VMH *VMH::callbackVMH;
@@ -14,62 +19,141 @@ VMH *VMH::callbackVMH;
 // default to enabled, why else would someone use this?
 VMH::VmhState VMH::vmhStateEnum = VMH::VMH_DEFAULT;
 
+// vmhState boot-arg values, in VmhState order
+static const char *const vmhStateNames[] = {"inverted", "undercover", "internal", "disabled", "enabled", "default", "strict"};
+static_assert(arrsize(vmhStateNames) == VMH::VMH_STRICT + 1, "vmhStateNames must name every VMH::VmhState.");
+
+// Function to parse the vmhState boot-arg, the handler installed for kern.hv_vmm_present depends on it
+void VMH::parseState() {
+	char state[16] {};
+	if (!PE_parse_boot_argn("vmhState", state, sizeof(state))) {
+		return;
+	}
+	for (size_t i = 0; i < arrsize(vmhStateNames); i++) {
+		if (strcmp(state, vmhStateNames[i]) == 0) {
+			vmhStateEnum = static_cast<VmhState>(i);
+			DBGLOG(MODULE_INFO, "vmhState=%s requested.", state);
+			return;
+		}
+	}
+	DBGLOG(MODULE_WARN, "Unknown vmhState=%s, keeping the default state.", state);
+}
+
+// End of VMH::init, the patcher load is timed from there
+static uint64_t initEnd = 0;
+
 // Definition for the global _sysctl__children address
 mach_vm_address_t VMH::gSysctlChildrenAddr = 0;
 
+// Every kernel symbol VMHide needs, resolved in a single batch when the patcher loads
+static mach_vm_address_t sysctlChildrenSymbol = 0;
+static VMHSymbolRequest kernelSymbols[] = {
+	{"_sysctl__children", &sysctlChildrenSymbol, true},
+	{"_proc_getexecutablevnode", reinterpret_cast<mach_vm_address_t *>(&VMM::procExecutableVnode), false},
+	{"_cs_identity_get", reinterpret_cast<mach_vm_address_t *>(&VMM::csIdentityGet), false},
+};
+
 // To only be modified by CarnationsInternal, to display various Internal logs and headers
 const bool VMH::IS_INTERNAL = false; // MUST CHANCE THIS TO FALSE BEFORE CREATING COMMITS
 
+// kern.vmh, registered during init so that modules can hang their own entries below it
+SYSCTL_NODE(_kern, OID_AUTO, vmh, CTLFLAG_RW | CTLFLAG_LOCKED, nullptr, "VMHide");
+
+// Set of process names seen so far, replaces a 64 KB array with roughly 6 KB of slots
+VMHProcessSet<MAX_PROCESSES> VMH::uniqueProcesses;
+
+// Earliest mach_absolute_time of the next summary of repeat calls
+static uint64_t nextProcessSummary = 0;
+
 // Function to process a Proc's Uniqueness in terms of a seen/unseen basis
-bool VMH::processCurrentProcessUnique(const char* procName, pid_t procPid, bool isFiltered) {
+bool VMH::processCurrentProcessUnique(const char* procName, pid_t procPid, bool isFiltered, size_t *slot) {
 
-    // Check if the process name is already in the array
-    for (int i = 0; i < uniqueProcessCount; i++) {
-        if (strncmp(uniqueProcesses[i], procName, MAX_PROC_NAME_LEN) == 0) {
-            DBGLOG(MODULE_PPU, "Process '%s' (PID: %d) already exists in the unique process array.", procName, procPid);
-            return true; // Indicate success because the process already exists
-        }
+    // Insert the process name, this is safe to call from any number of CPUs at once
+    size_t tracked = VMH_PROCESS_UNTRACKED;
+    bool firstSeen = false;
+    switch (uniqueProcesses.insert(procName, &tracked)) {
+        case VMHProcessSetPresent:
+            break; // Already seen, the set counted the repeat for the next summary
+        case VMHProcessSetInserted:
+            VMHLOG(VMH_MSG_PPU_INSERTED, procName, procPid, isFiltered, uniqueProcesses.size());
+            firstSeen = true; // We added a process to the session set.
+            break;
+        case VMHProcessSetEvicted:
+            VMHLOG(VMH_MSG_PPU_EVICTED, procName, procPid, isFiltered, 0);
+            firstSeen = true; // The set is full but keeps tracking the most recent processes
+            break;
+        default:
+            // Every candidate slot is being written by other CPUs; log a warning
+            VMHLOG(VMH_MSG_PPU_CONTENDED, procName, procPid, isFiltered, 0);
+            break; // The next call for this process will try again
     }
-
-    // If array is not full, add the new process name
-    if (uniqueProcessCount < MAX_PROCESSES) {
-        strlcpy(uniqueProcesses[uniqueProcessCount], procName, MAX_PROC_NAME_LEN);
-        uniqueProcessCount++;
-        DBGLOG(MODULE_PPU, "Process '%s' (PID: %d) added to the unique process array.", procName, procPid);
-        return true; // Indicate success because we added a process to the session array.
-    } else {
-        // Array is full; log a warning
-        DBGLOG(MODULE_PPU, "Unique process array is full. Cannot add process '%s' (PID: %d).", procName, procPid);
-        return false; // Indicate failure because the array is full
+    if (slot) {
+        *slot = tracked;
     }
+    return firstSeen;
+
+}
 
+// Function to log the repeat calls of every tracked process, one record per name that called again
+void VMH::summarizeProcesses(bool force) {
+	uint64_t now = mach_absolute_time();
+	uint64_t due = __atomic_load_n(&nextProcessSummary, __ATOMIC_RELAXED);
+	if (!force && now < due) {
+		return;
+	}
+	
+	// Only the CPU moving the deadline summarizes, the others keep counting
+	uint64_t interval = 0;
+	nanoseconds_to_absolutetime(VMH_PROCESS_SUMMARY_INTERVAL * NSEC_PER_SEC, &interval);
+	if (!__atomic_compare_exchange_n(&nextProcessSummary, &due, now + interval, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		return;
+	}
+	char procName[VMH_PROCSET_NAME_LEN + 1];
+	for (size_t slot = 0; slot < uniqueProcesses.capacity(); slot++) {
+		uint32_t repeats = uniqueProcesses.takeRepeats(slot);
+		if (repeats && uniqueProcesses.nameAt(slot, procName)) {
+			VMHLOG(VMH_MSG_PPU_SUMMARY, procName, 0, 0, repeats);
+		}
+	}
 }
 
 // Function to get _sysctl__children memory address
 mach_vm_address_t VMH::sysctlChildrenAddr(KernelPatcher &patcher) {
 	
-    // Resolve the _sysctl__children symbol with the given patcher
-    mach_vm_address_t resolvedAddress = patcher.solveSymbol(KernelPatcher::KernelID, "_sysctl__children");
+    uint64_t phaseStart = mach_absolute_time();
+	
+    // Resolve the _sysctl__children symbol with the given patcher, along with every other symbol of kernelSymbols
+    VMHSymbols::solve(patcher, kernelSymbols, arrsize(kernelSymbols));
+    VMHStats::recordBoot(VMHBootSymbols, phaseStart);
+    mach_vm_address_t resolvedAddress = sysctlChildrenSymbol;
 
     // Check if the address was successfully resolved, else return 0
     if (resolvedAddress) {
         DBGLOG(MODULE_SYSCA, "Resolved _sysctl__children at address: 0x%llx", resolvedAddress);
 
+        // Index the whole tree in a single traversal, the boot reroute looks its hooks up there
+        uint64_t indexStart = mach_absolute_time();
+        VMHSysctl::buildIndex(resolvedAddress);
+        VMHStats::recordBoot(VMHBootSysctlIndex, indexStart);
+        VMHStats::recordBoot(VMHBootSysctlChildren, phaseStart);
+
         // Optional: Iterate and log OIDs for debugging (can be extensive)
         #if DEBUG
-        sysctl_oid_list *sysctlChildrenList = reinterpret_cast<sysctl_oid_list *>(resolvedAddress);
-        DBGLOG(MODULE_SYSCA, "Sysctl children list at address: 0x%llx", reinterpret_cast<mach_vm_address_t>(sysctlChildrenList));
-        sysctl_oid *oid;
-        SLIST_FOREACH(oid, sysctlChildrenList, oid_link) {
-            DBGLOG(MODULE_SYSCA, "OID Name: %s, OID Number: %d", oid->oid_name, oid->oid_number);
+        DBGLOG(MODULE_SYSCA, "Sysctl children list at address: 0x%llx", resolvedAddress);
+        if (VMHSysctl::index) {
+            char path[64];
+            for (size_t i = 0; i < VMHSysctl::index->size(); i++) {
+                if (VMHSysctl::index->pathAt(i, path, sizeof(path)) == 0) {
+                    DBGLOG(MODULE_SYSCA, "OID Name: %s, OID Number: %d", path, VMHSysctl::index->oidAt(i)->oid_number);
+                }
+            }
         }
         #endif
         
         return resolvedAddress;
     } else {
-        KernelPatcher::Error err = patcher.getError();
-        DBGLOG(MODULE_SYSCA, "Failed to resolve _sysctl__children. (Lilu returned: %d)", err);
-        patcher.clearError();
+        DBGLOG(MODULE_SYSCA, "Failed to resolve _sysctl__children.");
+        VMHStats::recordBoot(VMHBootSysctlChildren, phaseStart);
         return 0;
     }
 	
@@ -77,6 +161,10 @@ mach_vm_address_t VMH::sysctlChildrenAddr(KernelPatcher &patcher) {
 
 // Callback function to solve for and store _sysctl__children address
 void VMH::solveSysCtlChildrenAddr(void *user __unused, KernelPatcher &Patcher) {
+    uint64_t phaseStart = mach_absolute_time();
+    if (initEnd) {
+        VMHStats::recordBoot(VMHBootPatcherWait, initEnd);
+    }
     DBGLOG(MODULE_SSYSCTL, "VMH::solveSysCtlChildrenAddr called successfully. Attempting to resolve and store _sysctl__children address.");
 	
     VMH::gSysctlChildrenAddr = VMH::sysctlChildrenAddr(Patcher);
@@ -92,12 +180,16 @@ void VMH::solveSysCtlChildrenAddr(void *user __unused, KernelPatcher &Patcher) {
     DBGLOG(MODULE_INIT, "Initializing VMM module.");
     VMM::init(Patcher);
 	
+    VMHStats::recordBoot(VMHBootPatcherLoad, phaseStart);
     DBGLOG(MODULE_SSYSCTL, "VMH::solveSysCtlChildrenAddr finished.");
 }
 
 // Main VMH Routine function
 void VMH::init() {
 
+    // Timed into kern.vmh.boot.init, registered further below
+    uint64_t phaseStart = mach_absolute_time();
+
     // Guest CPUID Check Header BEGIN
     // DO NOT MODIFY. NO EXPRESSED PERMISSION IS GIVEN BY CARNATIONS BOTANICA TO DO SO. NO EXCEPTIONS.
     char vendor[13];
@@ -184,9 +276,20 @@ void VMH::init() {
     }
     // Internal Header END
 	
+    // Read the requested state before anything depends on it
+    VMH::parseState();
+	
+    // Register kern.vmh, the statistics, the binary log and the call trace below it, these do not depend on the patcher
+    DBGLOG(MODULE_INIT, "Registering kern.vmh sysctl node.");
+    sysctl_register_oid(&sysctl__kern_vmh);
+    VMHStats::init();
+    VMHLog::init();
+    VMHTrace::init();
+	
     // Register the main sysctl children address resolver
     DBGLOG(MODULE_INIT, "Registering VMH::solveSysCtlChildrenAddr with onPatcherLoadForce.");
     lilu.onPatcherLoadForce(&VMH::solveSysCtlChildrenAddr);
+    initEnd = VMHStats::recordBoot(VMHBootInit, phaseStart);
 
 }
 
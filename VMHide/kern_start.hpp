@@ -8,17 +8,32 @@
 #ifndef kern_start_h
 #define kern_start_h
 
-// VMHide Includes
+// VMHide Includes, every kernel and Lilu header the modules use comes in through here.
+// Userspace builds define VMH_HOST and get the mocks of Host/ instead, see CMakeLists.txt.
+#ifdef VMH_HOST
+#include "../Host/vmh_host.hpp"
+#else
 #include <Headers/plugin_start.hpp>
 #include <Headers/kern_patcher.hpp>
 #include <Headers/kern_api.hpp>
 #include <Headers/kern_util.hpp>
 #include <Headers/kern_mach.hpp>
+#include <Headers/kern_nvram.hpp>
 #include <mach/i386/vm_types.h>
 #include <libkern/libkern.h>
 #include <IOKit/IOLib.h>
 #include <sys/sysctl.h>
+#include <sys/kauth.h>
+#include <sys/vnode.h>
+#include <sys/errno.h>
+#include <kern/clock.h>
+#include <kern/cpu_number.h>
 #include <i386/cpuid.h>
+#endif
+#include "kern_procset.hpp"
+
+// kern.vmh, parent node of every sysctl VMHide registers
+SYSCTL_DECL(_kern_vmh);
 
 // Logging Defs
 #define MODULE_INIT "INIT"
@@ -45,15 +60,31 @@ public:
     #define MAX_PROC_NAME_LEN 256
 	
 	/**
-	 * Process Uniqueness of a proc
+	 * Slot reported by processCurrentProcessUnique for names the set could not track
 	 */
-	static char uniqueProcesses[MAX_PROCESSES][MAX_PROC_NAME_LEN];
-	static int uniqueProcessCount;
+	#define VMH_PROCESS_UNTRACKED MAX_PROCESSES
 	
 	/**
-	 * Declaration of Func to proc Uniqueness
+	 * Seconds between two summaries of repeat calls, see summarizeProcesses
 	 */
-	static bool processCurrentProcessUnique(const char* procName, pid_t procPid, bool isFiltered);
+	#define VMH_PROCESS_SUMMARY_INTERVAL 60
+	
+	/**
+	 * Process Uniqueness of a proc, names are interned into a concurrent set with CLOCK eviction
+	 */
+	static VMHProcessSet<MAX_PROCESSES> uniqueProcesses;
+	
+	/**
+	 * Declaration of Func to proc Uniqueness, returns true the first time procName is seen.
+	 * Repeat calls are only counted against the name, slot receives where it is tracked.
+	 */
+	static bool processCurrentProcessUnique(const char* procName, pid_t procPid, bool isFiltered, size_t *slot = nullptr);
+	
+	/**
+	 * Logs the repeat calls counted per name since the last summary, at most once per
+	 * VMH_PROCESS_SUMMARY_INTERVAL unless forced. Cheap to call when no summary is due.
+	 */
+	static void summarizeProcesses(bool force = false);
 
     /**
      * Standard Init and deInit functions
@@ -79,17 +110,34 @@ public:
 	*/
 	static VmhState vmhStateEnum;
 	
+	/**
+	* Sets vmhStateEnum from the vmhState boot-arg, unknown values keep VMH_DEFAULT
+	*/
+	static void parseState();
+	
 	/**
 	* Publicly accessible internal build flag
 	*/
 	static const bool IS_INTERNAL;
 	
 	/**
-	* Struct to hold both process name and potential PID
+	* What a DetectedProcess name is matched against
+	*/
+	enum MatchKind {
+		VMH_MATCH_NAME,   // proc_name, at most MAXCOMLEN characters unless the process set a longer one
+		VMH_MATCH_PATH,   // Full path of the executable
+		VMH_MATCH_BUNDLE, // Code signing identifier, the bundle identifier for apps and Apple daemons
+		VMH_MATCH_KINDS,
+	};
+	
+	/**
+	* Struct to hold both process name and potential PID, along with what the name is matched against
 	*/
 	struct DetectedProcess {
 		const char *name;
     	pid_t pid;
+		MatchKind match {VMH_MATCH_NAME};
+		bool tree {false}; // Every descendant of a matching process is filtered as well
 	};
 	
     /**
@@ -0,0 +1,260 @@
+//
+//  kern_stats.cpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#include "kern_stats.hpp"
+
+// Per-CPU counter blocks, zero initialized
+VMHStats::CPUBlock VMHStats::perCpu[VMH_STATS_MAX_CPUS];
+
+// Latency histograms and caller sketches are allocated once during init, and never freed as VMHide cannot be unloaded
+VMHStats::LatencyBlock *VMHStats::latency = nullptr;
+uint32_t VMHStats::latencyCount = 0;
+uint64_t VMHStats::bootNanoseconds[VMHBootPhaseCount];
+VMHTopK VMHStats::callers;
+uint64_t VMHStats::tscFrequency = 0;
+
+// Buckets summed and copied out at once, keeps the stack usage of the handler small
+#define VMH_LATENCY_CHUNK 16
+
+// Top callers copied out at once, for the same reason
+#define VMH_TOPK_CHUNK 8
+
+// Shared handler of every kern.vmh.stats entry, arg2 selects the counter to aggregate
+static int VMH_sysctl_stats_counter(struct sysctl_oid *oidp __unused, void *arg1 __unused, int arg2, struct sysctl_req *req) {
+	uint64_t value = VMHStats::read(static_cast<VMHStatsCounter>(arg2));
+	return SYSCTL_OUT(req, &value, sizeof(value));
+}
+
+// Shared handler of every kern.vmh.boot entry, arg2 selects the phase
+static int VMH_sysctl_boot_phase(struct sysctl_oid *oidp __unused, void *arg1 __unused, int arg2, struct sysctl_req *req) {
+	uint64_t value = VMHStats::bootDuration(static_cast<VMHBootPhase>(arg2));
+	return SYSCTL_OUT(req, &value, sizeof(value));
+}
+
+// kern.vmh.stats.dropped_repeats handler, kept by the process set itself rather than per CPU
+static int VMH_sysctl_dropped_repeats(struct sysctl_oid *oidp __unused, void *arg1 __unused, int arg2 __unused, struct sysctl_req *req) {
+	uint64_t value = VMH::uniqueProcesses.droppedRepeats();
+	return SYSCTL_OUT(req, &value, sizeof(value));
+}
+
+// kern.vmh.latency handler, a vmh_latency_header_t followed by the histograms summed over every CPU
+int VMH_sysctl_latency(struct sysctl_oid *oidp __unused, void *arg1 __unused, int arg2 __unused, struct sysctl_req *req) {
+	vmh_latency_header_t header {};
+	header.magic = VMH_LATENCY_MAGIC;
+	header.version = VMH_ABI_VERSION;
+	header.phases = VMH_LATENCY_PHASES;
+	header.buckets = VMH_LATENCY_BUCKETS;
+	header.subBits = VMH_LATENCY_SUB_BITS;
+	header.tscFrequency = VMHStats::tscFrequency;
+	int error = SYSCTL_OUT(req, &header, sizeof(header));
+
+	// Without histograms, every bucket reads as empty
+	VMHStats::LatencyBlock *blocks = __atomic_load_n(&VMHStats::latency, __ATOMIC_ACQUIRE);
+	uint32_t cpus = blocks ? VMHStats::latencyCount : 0;
+	uint64_t chunk[VMH_LATENCY_CHUNK];
+	for (uint32_t phase = 0; phase < VMH_LATENCY_PHASES && !error; phase++) {
+		for (uint32_t first = 0; first < VMH_LATENCY_BUCKETS && !error; first += VMH_LATENCY_CHUNK) {
+			for (uint32_t i = 0; i < VMH_LATENCY_CHUNK; i++) {
+				chunk[i] = 0;
+				for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+					chunk[i] += __atomic_load_n(&blocks[cpu].counts[phase][first + i], __ATOMIC_RELAXED);
+				}
+			}
+			error = SYSCTL_OUT(req, chunk, sizeof(chunk));
+		}
+	}
+	return error;
+}
+
+// kern.vmh.topk handler, a vmh_topk_header_t followed by the heaviest callers
+int VMH_sysctl_topk(struct sysctl_oid *oidp __unused, void *arg1 __unused, int arg2 __unused, struct sysctl_req *req) {
+	// Process names of other users' processes are not for everyone
+	if (!kauth_cred_issuser(kauth_cred_get())) {
+		return EPERM;
+	}
+
+	uint8_t order[VMH_TOPK_SLOTS];
+	vmh_topk_header_t header {};
+	header.magic = VMH_TOPK_MAGIC;
+	header.version = VMH_ABI_VERSION;
+	header.entrySize = sizeof(vmh_topk_entry_t);
+	header.depth = VMH_TOPK_DEPTH;
+	header.width = VMH_TOPK_WIDTH;
+	header.count = static_cast<uint32_t>(VMHStats::callers.rank(order));
+	header.calls = VMHStats::callers.calls();
+	int error = SYSCTL_OUT(req, &header, sizeof(header));
+
+	vmh_topk_entry_t chunk[VMH_TOPK_CHUNK];
+	for (uint32_t first = 0; first < header.count && !error; first += VMH_TOPK_CHUNK) {
+		uint32_t count = header.count - first < VMH_TOPK_CHUNK ? header.count - first : VMH_TOPK_CHUNK;
+		VMHStats::callers.read(&order[first], count, chunk);
+		error = SYSCTL_OUT(req, chunk, count * sizeof(vmh_topk_entry_t));
+	}
+	return error;
+}
+
+#define VMH_STATS_ENTRY(parent, name, counter, descr) \
+	SYSCTL_PROC(parent, OID_AUTO, name, CTLTYPE_QUAD | CTLFLAG_RD | CTLFLAG_LOCKED, nullptr, counter, VMH_sysctl_stats_counter, "QU", descr)
+
+// kern.vmh.stats
+SYSCTL_NODE(_kern_vmh, OID_AUTO, stats, CTLFLAG_RD | CTLFLAG_LOCKED, nullptr, "VMHide hv_vmm_present statistics");
+VMH_STATS_ENTRY(_kern_vmh_stats, calls, VMHStatCalls, "Calls to kern.hv_vmm_present");
+VMH_STATS_ENTRY(_kern_vmh_stats, filtered, VMHStatFiltered, "Calls from filtered processes");
+VMH_STATS_ENTRY(_kern_vmh_stats, unfiltered, VMHStatUnfiltered, "Calls from processes not on the filter list");
+VMH_STATS_ENTRY(_kern_vmh_stats, cache_hits, VMHStatCacheHits, "Calls answered from the verdict cache");
+VMH_STATS_ENTRY(_kern_vmh_stats, cache_misses, VMHStatCacheMisses, "Calls that looked up the process name");
+VMH_STATS_ENTRY(_kern_vmh_stats, executable_cache_hits, VMHStatExecutableCacheHits, "Path and bundle verdicts answered from the executable cache");
+VMH_STATS_ENTRY(_kern_vmh_stats, executable_cache_misses, VMHStatExecutableCacheMisses, "Path and bundle verdicts that resolved the executable");
+VMH_STATS_ENTRY(_kern_vmh_stats, reroutes, VMHStatReroutes, "Successful handler reroutes");
+VMH_STATS_ENTRY(_kern_vmh_stats, reroute_failures, VMHStatRerouteFailures, "Failed handler reroutes");
+VMH_STATS_ENTRY(_kern_vmh_stats, write_windows, VMHStatWriteWindows, "Kernel write windows opened");
+VMH_STATS_ENTRY(_kern_vmh_stats, tree_marks, VMHStatTreeMarks, "Processes marked as members of a filtered process tree");
+SYSCTL_PROC(_kern_vmh_stats, OID_AUTO, dropped_repeats, CTLTYPE_QUAD | CTLFLAG_RD | CTLFLAG_LOCKED, nullptr, 0, VMH_sysctl_dropped_repeats, "QU", "Repeat calls lost to process set evictions before they were summarized");
+
+// kern.vmh.stats.state, calls per VMH::VmhState
+SYSCTL_NODE(_kern_vmh_stats, OID_AUTO, state, CTLFLAG_RD | CTLFLAG_LOCKED, nullptr, "Calls per VMHide state");
+VMH_STATS_ENTRY(_kern_vmh_stats_state, inverted, VMHStatStateBase + VMH::VMH_INVERTED, "Calls while inverted");
+VMH_STATS_ENTRY(_kern_vmh_stats_state, undercover, VMHStatStateBase + VMH::VMH_UNDERCOVER, "Calls while undercover");
+VMH_STATS_ENTRY(_kern_vmh_stats_state, internal, VMHStatStateBase + VMH::VMH_INTERNAL, "Calls while internal");
+VMH_STATS_ENTRY(_kern_vmh_stats_state, disabled, VMHStatStateBase + VMH::VMH_DISABLED, "Calls while disabled");
+VMH_STATS_ENTRY(_kern_vmh_stats_state, enabled, VMHStatStateBase + VMH::VMH_ENABLED, "Calls while enabled");
+VMH_STATS_ENTRY(_kern_vmh_stats_state, default, VMHStatStateBase + VMH::VMH_DEFAULT, "Calls in the default state");
+VMH_STATS_ENTRY(_kern_vmh_stats_state, strict, VMHStatStateBase + VMH::VMH_STRICT, "Calls while strict");
+
+#define VMH_BOOT_ENTRY(name, phase, descr) \
+	SYSCTL_PROC(_kern_vmh_boot, OID_AUTO, name, CTLTYPE_QUAD | CTLFLAG_RD | CTLFLAG_LOCKED, nullptr, phase, VMH_sysctl_boot_phase, "QU", descr)
+
+// kern.vmh.boot, nanoseconds spent in every boot phase
+SYSCTL_NODE(_kern_vmh, OID_AUTO, boot, CTLFLAG_RD | CTLFLAG_LOCKED, nullptr, "VMHide boot phase durations in nanoseconds");
+VMH_BOOT_ENTRY(init, VMHBootInit, "VMH::init");
+VMH_BOOT_ENTRY(patcher_wait, VMHBootPatcherWait, "Wait for the Lilu patcher");
+VMH_BOOT_ENTRY(patcher_load, VMHBootPatcherLoad, "Patcher load callback");
+VMH_BOOT_ENTRY(sysctl_children, VMHBootSysctlChildren, "Kernel symbol resolution and sysctl indexing");
+VMH_BOOT_ENTRY(sysctl_index, VMHBootSysctlIndex, "Sysctl tree indexing");
+VMH_BOOT_ENTRY(vmm_init, VMHBootVmmInit, "VMM::init");
+VMH_BOOT_ENTRY(symbols, VMHBootSymbols, "Kernel symbol resolution");
+VMH_BOOT_ENTRY(filter, VMHBootFilter, "Boot filter list publication");
+VMH_BOOT_ENTRY(reroute, VMHBootReroute, "Sysctl handler reroute");
+VMH_BOOT_ENTRY(write_window, VMHBootWriteWindow, "Kernel write protection disabled");
+
+// kern.vmh.latency
+SYSCTL_PROC(_kern_vmh, OID_AUTO, latency, CTLTYPE_OPAQUE | CTLFLAG_RD | CTLFLAG_LOCKED, nullptr, 0, VMH_sysctl_latency, "S,vmh_latency_header_t", "hv_vmm_present latency histograms");
+
+// kern.vmh.topk
+SYSCTL_PROC(_kern_vmh, OID_AUTO, topk, CTLTYPE_OPAQUE | CTLFLAG_RD | CTLFLAG_LOCKED, nullptr, 0, VMH_sysctl_topk, "S,vmh_topk_header_t", "Heaviest hv_vmm_present callers");
+
+// Registration order matters, a parent must be registered before its children
+static struct sysctl_oid *statsOids[] = {
+	&sysctl__kern_vmh_stats,
+	&sysctl__kern_vmh_stats_calls,
+	&sysctl__kern_vmh_stats_filtered,
+	&sysctl__kern_vmh_stats_unfiltered,
+	&sysctl__kern_vmh_stats_cache_hits,
+	&sysctl__kern_vmh_stats_cache_misses,
+	&sysctl__kern_vmh_stats_executable_cache_hits,
+	&sysctl__kern_vmh_stats_executable_cache_misses,
+	&sysctl__kern_vmh_stats_reroutes,
+	&sysctl__kern_vmh_stats_reroute_failures,
+	&sysctl__kern_vmh_stats_write_windows,
+	&sysctl__kern_vmh_stats_tree_marks,
+	&sysctl__kern_vmh_stats_dropped_repeats,
+	&sysctl__kern_vmh_stats_state,
+	&sysctl__kern_vmh_stats_state_inverted,
+	&sysctl__kern_vmh_stats_state_undercover,
+	&sysctl__kern_vmh_stats_state_internal,
+	&sysctl__kern_vmh_stats_state_disabled,
+	&sysctl__kern_vmh_stats_state_enabled,
+	&sysctl__kern_vmh_stats_state_default,
+	&sysctl__kern_vmh_stats_state_strict,
+	&sysctl__kern_vmh_latency,
+	&sysctl__kern_vmh_topk,
+	&sysctl__kern_vmh_boot,
+	&sysctl__kern_vmh_boot_init,
+	&sysctl__kern_vmh_boot_patcher_wait,
+	&sysctl__kern_vmh_boot_patcher_load,
+	&sysctl__kern_vmh_boot_sysctl_children,
+	&sysctl__kern_vmh_boot_sysctl_index,
+	&sysctl__kern_vmh_boot_vmm_init,
+	&sysctl__kern_vmh_boot_symbols,
+	&sysctl__kern_vmh_boot_filter,
+	&sysctl__kern_vmh_boot_reroute,
+	&sysctl__kern_vmh_boot_write_window,
+};
+
+// Function for the stats init routine
+void VMHStats::init() {
+	// The histograms are kept in TSC ticks, let the tools convert them to time
+	size_t size = sizeof(tscFrequency);
+	if (sysctlbyname("machdep.tsc.frequency", &tscFrequency, &size, nullptr, 0) != 0) {
+		DBGLOG(MODULE_STATS, "Failed to read machdep.tsc.frequency, latencies will be reported in ticks.");
+		tscFrequency = 0;
+	}
+	
+	// One histogram block per CPU that may come online, an all zero block is an empty histogram
+	uint32_t count = possibleCpus();
+	void *memory = IOMallocAligned(count * sizeof(LatencyBlock), alignof(LatencyBlock));
+	if (memory) {
+		bzero(memory, count * sizeof(LatencyBlock));
+		latencyCount = count;
+		__atomic_store_n(&latency, static_cast<LatencyBlock *>(memory), __ATOMIC_RELEASE);
+	} else {
+		DBGLOG(MODULE_ERROR, "Failed to allocate the latency histograms, kern.vmh.latency will stay empty.");
+	}
+
+	// Likewise one caller sketch per CPU, all zero counters
+	memory = IOMallocAligned(count * sizeof(VMHTopK::Block), alignof(VMHTopK::Block));
+	if (memory) {
+		bzero(memory, count * sizeof(VMHTopK::Block));
+		callers.attach(static_cast<VMHTopK::Block *>(memory), count);
+	} else {
+		DBGLOG(MODULE_ERROR, "Failed to allocate the caller sketches, kern.vmh.topk will stay empty.");
+	}
+	
+	for (size_t i = 0; i < arrsize(statsOids); i++) {
+		sysctl_register_oid(statsOids[i]);
+	}
+	DBGLOG(MODULE_STATS, "Registered kern.vmh.stats, kern.vmh.latency, kern.vmh.topk and kern.vmh.boot for %u CPUs.", count);
+}
+
+// CPUs beyond VMH_STATS_MAX_CPUS share blocks
+uint32_t VMHStats::possibleCpus() {
+	int cpus = 0;
+	size_t size = sizeof(cpus);
+	if (sysctlbyname("hw.logicalcpu_max", &cpus, &size, nullptr, 0) != 0 || cpus <= 0) {
+		DBGLOG(MODULE_STATS, "Failed to read hw.logicalcpu_max, assuming %d CPUs.", VMH_STATS_MAX_CPUS);
+		cpus = VMH_STATS_MAX_CPUS;
+	}
+	return cpus < VMH_STATS_MAX_CPUS ? static_cast<uint32_t>(cpus) : VMH_STATS_MAX_CPUS;
+}
+
+// Sums a counter over every CPU block, only ever called from sysctl readers
+uint64_t VMHStats::read(VMHStatsCounter counter) {
+	if (counter < 0 || counter >= VMHStatCount) {
+		return 0;
+	}
+	uint64_t total = 0;
+	for (size_t cpu = 0; cpu < VMH_STATS_MAX_CPUS; cpu++) {
+		total += __atomic_load_n(&perCpu[cpu].counters[counter], __ATOMIC_RELAXED);
+	}
+	return total;
+}
+
+// Boot phases take microseconds to milliseconds, mach_absolute_time is precise enough and needs no TSC frequency
+uint64_t VMHStats::recordBoot(VMHBootPhase phase, uint64_t since) {
+	uint64_t now = mach_absolute_time();
+	uint64_t nanoseconds = 0;
+	absolutetime_to_nanoseconds(now - since, &nanoseconds);
+	__atomic_store_n(&bootNanoseconds[phase], nanoseconds, __ATOMIC_RELAXED);
+	return now;
+}
+
+uint64_t VMHStats::bootDuration(VMHBootPhase phase) {
+	if (phase < 0 || phase >= VMHBootPhaseCount) {
+		return 0;
+	}
+	return __atomic_load_n(&bootNanoseconds[phase], __ATOMIC_RELAXED);
+}
@@ -0,0 +1,181 @@
+//
+//  kern_stats.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_stats_hpp
+#define kern_stats_hpp
+
+// Include Parent Module
+#include "kern_start.hpp"
+#include "kern_topk.hpp"
+#include "vmh_abi.h"
+
+// Logging Defs
+#define MODULE_STATS "STATS"
+
+// Number of per-CPU counter blocks, CPUs beyond this share a block (still correct, just not contention free)
+#define VMH_STATS_MAX_CPUS 64
+
+// Number of VMH::VmhState values, calls are additionally counted per state
+#define VMH_STATS_STATE_COUNT (VMH::VMH_STRICT + 1)
+
+/**
+ * @brief Counters kept by VMHStats, the values double as the arg2 of their sysctl entries.
+ */
+enum VMHStatsCounter {
+	VMHStatCalls,           // hv_vmm_present handler invocations
+	VMHStatFiltered,        // Calls answered with 1, the caller is on the filter list
+	VMHStatUnfiltered,      // Calls answered with 0, the caller is not on the filter list
+	VMHStatCacheHits,       // Calls answered from the verdict cache
+	VMHStatCacheMisses,     // Calls that had to look up the process name
+	VMHStatExecutableCacheHits,   // Path and bundle verdicts answered from the executable cache
+	VMHStatExecutableCacheMisses, // Path and bundle verdicts that had to resolve the executable
+	VMHStatReroutes,        // Successful handler reroutes
+	VMHStatRerouteFailures, // Failed handler reroutes
+	VMHStatWriteWindows,    // Kernel write windows opened by VMHPatchTransaction
+	VMHStatTreeMarks,       // Processes marked as members of a filtered process tree
+	VMHStatStateBase,       // First of VMH_STATS_STATE_COUNT per-state call counters
+	VMHStatCount = VMHStatStateBase + VMH_STATS_STATE_COUNT,
+};
+
+/**
+ * @brief Boot phases timed by VMHStats::recordBoot, the values double as the arg2 of their kern.vmh.boot entries.
+ */
+enum VMHBootPhase {
+	VMHBootInit,           // VMH::init, from the CPUID guard to the patcher callback registration
+	VMHBootPatcherWait,    // From the end of VMH::init until Lilu loads the patcher
+	VMHBootPatcherLoad,    // VMH::solveSysCtlChildrenAddr, everything VMHide does once the patcher is loaded
+	VMHBootSysctlChildren, // VMH::sysctlChildrenAddr, the kernel symbols and the index
+	VMHBootSysctlIndex,    // VMHSysctl::buildIndex, the single traversal of the sysctl tree
+	VMHBootVmmInit,        // VMM::init
+	VMHBootSymbols,        // Every kernel symbol, solved in one batch by VMH::sysctlChildrenAddr
+	VMHBootFilter,         // Publishing the boot filter list
+	VMHBootReroute,        // reRouteHvVmm, lookups and the handler swap
+	VMHBootWriteWindow,    // Time the latest VMHPatchTransaction kept kernel write protection disabled
+	VMHBootPhaseCount,
+};
+
+/**
+ * @brief Per-CPU counters and latency histograms of the hv_vmm_present hook.
+ *
+ * Every CPU increments its own cache-line aligned block, so the hot path never writes to a
+ * line shared with another CPU. The increments are still atomic, as a thread may migrate
+ * between reading cpu_number() and updating the block. The blocks are only summed up when
+ * someone reads kern.vmh.stats or kern.vmh.latency. Callers are counted by name the same way,
+ * in the per-CPU sketches of a VMHTopK read through kern.vmh.topk.
+ */
+class VMHStats {
+public:
+
+	// Allocates the histograms and caller sketches, and registers the kern.vmh.stats sysctl subtree, kern.vmh must already be registered
+	static void init();
+
+	/**
+	 * @brief Number of per-CPU blocks to allocate, one per CPU that may ever come online, at most VMH_STATS_MAX_CPUS.
+	 */
+	static uint32_t possibleCpus();
+
+	/**
+	 * @brief Increments a counter of the current CPU.
+	 */
+	static inline void count(VMHStatsCounter counter) {
+		__atomic_fetch_add(&perCpu[static_cast<uint32_t>(cpu_number()) % VMH_STATS_MAX_CPUS].counters[counter], 1, __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * @brief Increments the per-state call counter of state.
+	 */
+	static inline void countState(VMH::VmhState state) {
+		count(static_cast<VMHStatsCounter>(VMHStatStateBase + state));
+	}
+
+	/**
+	 * @brief Sums a counter over every CPU.
+	 */
+	static uint64_t read(VMHStatsCounter counter);
+
+	/**
+	 * @brief Hash of a caller name that countCaller takes, callers may remember it per process.
+	 */
+	static inline uint32_t callerHash(const char *name) {
+		return VMHTopK::hash(name);
+	}
+
+	/**
+	 * @brief Counts a call towards kern.vmh.topk, in the sketch of the current CPU.
+	 * @param hash callerHash of the caller name.
+	 * @param name Returns the caller name, only called when it is offered to the top callers.
+	 */
+	template <typename NameFn>
+	static inline void countCaller(uint32_t hash, int verdict, NameFn name) {
+		callers.count(static_cast<uint32_t>(cpu_number()), hash, static_cast<uint8_t>(verdict), name);
+	}
+
+	/**
+	 * @brief Reads the TSC, after every earlier instruction has completed.
+	 */
+	static inline uint64_t timestamp() {
+		uint32_t low, high;
+		asm volatile("lfence; rdtsc" : "=a"(low), "=d"(high) :: "memory");
+		return (static_cast<uint64_t>(high) << 32) | low;
+	}
+
+	/**
+	 * @brief Records the duration of phase, from since until now, in the histogram of the current CPU.
+	 * @return The current timestamp, to be used as the start of the next phase.
+	 */
+	static inline uint64_t recordLatency(uint32_t phase, uint64_t since) {
+		uint64_t now = timestamp();
+		LatencyBlock *blocks = __atomic_load_n(&latency, __ATOMIC_ACQUIRE);
+		if (blocks) {
+			uint64_t *counts = blocks[static_cast<uint32_t>(cpu_number()) % latencyCount].counts[phase];
+			__atomic_fetch_add(&counts[vmh_latency_bucket(now - since)], 1, __ATOMIC_RELAXED);
+		}
+		return now;
+	}
+
+	/**
+	 * @brief Records the duration of a boot phase, from since (a mach_absolute_time) until now.
+	 * Safe to call before init, a phase run more than once keeps its latest duration.
+	 * @return The current mach_absolute_time, to be used as the start of the next phase.
+	 */
+	static uint64_t recordBoot(VMHBootPhase phase, uint64_t since);
+
+	/**
+	 * @brief Latest duration of a boot phase in nanoseconds, 0 if it never ran.
+	 */
+	static uint64_t bootDuration(VMHBootPhase phase);
+
+	/**
+	 * @brief TSC frequency in Hz reported along with the histograms, 0 if unknown.
+	 */
+	static uint64_t tscFrequency;
+
+private:
+
+	struct alignas(64) CPUBlock {
+		uint64_t counters[VMHStatCount];
+	};
+
+	struct alignas(64) LatencyBlock {
+		uint64_t counts[VMH_LATENCY_PHASES][VMH_LATENCY_BUCKETS];
+	};
+
+	static CPUBlock perCpu[VMH_STATS_MAX_CPUS];
+	static LatencyBlock *latency;
+	static uint32_t latencyCount;
+	static uint64_t bootNanoseconds[VMHBootPhaseCount];
+	static VMHTopK callers;
+
+	// kern.vmh.latency handler, sums and copies out the histograms of every CPU
+	friend int VMH_sysctl_latency(struct sysctl_oid *oidp, void *arg1, int arg2, struct sysctl_req *req);
+
+	// kern.vmh.topk handler, copies out the heaviest callers
+	friend int VMH_sysctl_topk(struct sysctl_oid *oidp, void *arg1, int arg2, struct sysctl_req *req);
+
+};
+
+#endif /* kern_stats_hpp */
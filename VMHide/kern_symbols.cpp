@@ -0,0 +1,47 @@
+//
+//  kern_symbols.cpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#include "kern_symbols.hpp"
+
+// Resolves every distinct name once, then reports every request that is still unresolved
+bool VMHSymbols::solve(KernelPatcher &patcher, VMHSymbolRequest *requests, size_t count) {
+	if (count > VMH_SYMBOLS_MAX_REQUESTS) {
+		DBGLOG(MODULE_ERROR, "VMHSymbols::solve supports up to %d requests, got %lu.", VMH_SYMBOLS_MAX_REQUESTS, count);
+		return false;
+	}
+	
+	bool complete = true;
+	size_t lookups = 0;
+	for (size_t i = 0; i < count; i++) {
+		// A name requested earlier in the table shares its lookup
+		size_t first = 0;
+		while (first < i && strcmp(requests[first].name, requests[i].name) != 0) {
+			first++;
+		}
+		if (first < i) {
+			*requests[i].address = *requests[first].address;
+		} else {
+			*requests[i].address = patcher.solveSymbol(KernelPatcher::KernelID, requests[i].name);
+			lookups++;
+		}
+		if (*requests[i].address) {
+			continue;
+		}
+		
+		KernelPatcher::Error error = patcher.getError();
+		if (requests[i].required) {
+			DBGLOG(MODULE_ERROR, "Failed to resolve required symbol %s. (Lilu returned: %d)", requests[i].name, error);
+			complete = false;
+		} else {
+			DBGLOG(MODULE_WARN, "Failed to resolve optional symbol %s. (Lilu returned: %d)", requests[i].name, error);
+		}
+		patcher.clearError();
+	}
+	
+	DBGLOG(MODULE_SYMS, "Resolved %lu symbol requests with %lu lookups.", count, lookups);
+	return complete;
+}
@@ -0,0 +1,54 @@
+//
+//  kern_symbols.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_symbols_hpp
+#define kern_symbols_hpp
+
+// Include Parent Module
+#include "kern_start.hpp"
+
+// Logging Defs
+#define MODULE_SYMS "SYMS"
+
+// Upper bound on requests handled by a single VMHSymbols::solve call
+#define VMH_SYMBOLS_MAX_REQUESTS 32
+
+/**
+ * @brief Declarative description of one kernel symbol VMHide needs.
+ */
+struct VMHSymbolRequest {
+	// Symbol name, for example "_sysctl__children"
+	const char *name;
+	
+	// Slot receiving the address, left at 0 when the symbol is missing. Function pointers are
+	// stored through a cast, like Lilu's own SolveRequest does.
+	mach_vm_address_t *address;
+	
+	// Whether a missing symbol fails the whole batch, optional ones only disable their feature
+	bool required;
+};
+
+/**
+ * @brief Batched kernel symbol resolution.
+ *
+ * Every symbol of a table is resolved during a single call when the patcher loads, each
+ * distinct name is looked up exactly once however many requests share it, and every miss is
+ * reported on its own. Lilu scans the kernel symbol table on every solveSymbol and does not
+ * expose it, so this is the single place where a one-pass scan can replace the lookups.
+ */
+class VMHSymbols {
+public:
+	
+	/**
+	 * @brief Resolves every request, and clears the patcher error left by missing optional symbols.
+	 * @return false if a required symbol is missing, all other requests are still resolved.
+	 */
+	static bool solve(KernelPatcher &patcher, VMHSymbolRequest *requests, size_t count);
+	
+};
+
+#endif /* kern_symbols_hpp */
@@ -0,0 +1,183 @@
+//
+//  kern_sysctl.cpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#include "kern_sysctl.hpp"
+#include "kern_patch.hpp"
+
+// Every handler of a reroute is swapped by one transaction
+static_assert(VMH_SYSCTL_MAX_HOOKS <= VMH_PATCH_MAX_STORES, "VMHPatchTransaction cannot hold every hook of a reroute.");
+
+// Built at patcher load, and only kept until the boot reroute resolved its hooks
+VMHSysctlIndex *VMHSysctl::index = nullptr;
+
+// Checks whether component number depth of a dotted path is name, and whether it is the last one
+static bool VMH_pathComponentIs(const char *path, size_t depth, const char *name, bool &last) {
+	for (size_t i = 0; i < depth; i++) {
+		path = strchr(path, '.');
+		if (!path) {
+			return false;
+		}
+		path++;
+	}
+	size_t length = 0;
+	while (path[length] != '\0' && path[length] != '.') {
+		length++;
+	}
+	last = path[length] == '\0';
+	return strncmp(path, name, length) == 0 && name[length] == '\0';
+}
+
+// Walks one oid list, every list is visited at most once no matter how many hooks go through it
+void VMHSysctl::resolve(sysctl_oid_list *list, size_t depth, uint32_t mask, VMHSysctlHook *hooks, size_t hookCount) {
+	sysctl_oid *oid = nullptr;
+	SLIST_FOREACH(oid, list, oid_link) {
+		if (!oid->oid_name) {
+			continue;
+		}
+		
+		uint32_t matched = 0;
+		uint32_t descend = 0;
+		for (size_t i = 0; i < hookCount; i++) {
+			bool last = false;
+			if (!(mask & (1U << i)) || !VMH_pathComponentIs(hooks[i].path, depth, oid->oid_name, last)) {
+				continue;
+			}
+			matched |= 1U << i;
+			if (last) {
+				hooks[i].oid = oid;
+				DBGLOG(MODULE_SCTL, "Found '%s'.", hooks[i].path);
+			} else {
+				descend |= 1U << i;
+			}
+		}
+		
+		if (descend) {
+			// Only descend into genuine nodes, a string or opaque OID also has the low type bit set
+			sysctl_oid_list *children = VMHKernelOidTraits::children(oid);
+			if (children && depth + 1 < VMH_SYSCTL_MAX_DEPTH) {
+				resolve(children, depth + 1, descend, hooks, hookCount);
+			} else {
+				DBGLOG(MODULE_ERROR, "'%s' sysctl OID is not a valid node or has no children. Cannot traverse.", oid->oid_name);
+			}
+		}
+		
+		// Names are unique within a list, nothing further down this list can match these hooks
+		mask &= ~matched;
+		if (!mask) {
+			break;
+		}
+	}
+}
+
+// Resolves every hook in one walk, then swaps all handlers within one kernel write window
+bool VMHSysctl::reroute(KernelPatcher &patcher, VMHSysctlHook *hooks, size_t hookCount) {
+	
+	// Ensure that sysctlChildrenAddress exists before continuing
+	if (!VMH::gSysctlChildrenAddr) {
+		DBGLOG(MODULE_ERROR, "Failed to resolve _sysctl__children passed to function VMHSysctl::reroute.");
+		return false;
+	}
+	if (hookCount > VMH_SYSCTL_MAX_HOOKS) {
+		DBGLOG(MODULE_ERROR, "VMHSysctl::reroute supports up to %d hooks, got %lu.", VMH_SYSCTL_MAX_HOOKS, hookCount);
+		return false;
+	}
+	
+	// Look every hook up in the index, only walk the tree for the ones an incomplete index may have missed
+	uint32_t mask = 0;
+	for (size_t i = 0; i < hookCount; i++) {
+		hooks[i].oid = index ? index->find(hooks[i].path) : nullptr;
+		if (!hooks[i].oid) {
+			mask |= 1U << i;
+		}
+	}
+	if (mask && (!index || !index->isComplete())) {
+		DBGLOG(MODULE_SCTL, "Sysctl index is unavailable or incomplete, walking the tree.");
+		resolve(reinterpret_cast<sysctl_oid_list *>(VMH::gSysctlChildrenAddr), 0, mask, hooks, hookCount);
+	}
+	
+	// Check every hook before touching anything, a missing required OID leaves the tree untouched
+	bool complete = true;
+	size_t ready = 0;
+	for (size_t i = 0; i < hookCount; i++) {
+		if (hooks[i].oid && !hooks[i].oid->oid_handler) {
+			DBGLOG(MODULE_SCTL, "Failed to save original '%s' sysctl handler: The existing handler was NULL.", hooks[i].path);
+			hooks[i].oid = nullptr;
+		}
+		if (hooks[i].oid) {
+			ready++;
+		} else if (hooks[i].required) {
+			DBGLOG(MODULE_ERROR, "Failed to locate required '%s' sysctl entry.", hooks[i].path);
+			complete = false;
+		} else {
+			DBGLOG(MODULE_SCTL, "Optional '%s' sysctl entry is not present, skipping it.", hooks[i].path);
+		}
+	}
+	if (!complete) {
+		return false;
+	}
+	if (!ready) {
+		return true;
+	}
+	
+	// Save every original before its replacement becomes visible, replacements chain to them.
+	// The release stores of the transaction publish the originals along with the handlers.
+	VMHPatchTransaction transaction;
+	for (size_t i = 0; i < hookCount; i++) {
+		if (hooks[i].oid) {
+			*hooks[i].original = hooks[i].oid->oid_handler;
+			transaction.add(&hooks[i].oid->oid_handler, hooks[i].handler);
+		}
+	}
+	transaction.commit(patcher);
+	
+	DBGLOG(MODULE_SCTL, "Successfully rerouted %lu of %lu sysctl handlers.", ready, hookCount);
+	return true;
+	
+}
+
+// Indexes the whole sysctl tree in one traversal
+bool VMHSysctl::buildIndex(mach_vm_address_t root) {
+	if (!root) {
+		return false;
+	}
+	if (!index) {
+		void *memory = IOMalloc(sizeof(VMHSysctlIndex));
+		if (!memory) {
+			DBGLOG(MODULE_ERROR, "Failed to allocate the sysctl index, lookups will walk the tree.");
+			return false;
+		}
+		index = static_cast<VMHSysctlIndex *>(memory);
+	}
+	bool complete = index->build(reinterpret_cast<sysctl_oid_list *>(root));
+	if (complete) {
+		DBGLOG(MODULE_SCTL, "Indexed %lu sysctl OIDs.", index->size());
+	} else {
+		DBGLOG(MODULE_WARN, "Sysctl index holds only the first %lu OIDs, other lookups will walk the tree.", index->size());
+	}
+	return complete;
+}
+
+// Nothing in the kext looks OIDs up past the boot reroute, the index would only hold on to its memory
+void VMHSysctl::releaseIndex() {
+	if (index) {
+		IOFree(index, sizeof(VMHSysctlIndex));
+		index = nullptr;
+		DBGLOG(MODULE_SCTL, "Released the sysctl index.");
+	}
+}
+
+// Finds one OID, through the index when possible
+sysctl_oid *VMHSysctl::find(const char *path) {
+	VMHSysctlHook hook {path, nullptr, nullptr, false, nullptr};
+	if (index) {
+		hook.oid = index->find(path);
+	}
+	if (!hook.oid && (!index || !index->isComplete()) && VMH::gSysctlChildrenAddr) {
+		resolve(reinterpret_cast<sysctl_oid_list *>(VMH::gSysctlChildrenAddr), 0, 1, &hook, 1);
+	}
+	return hook.oid;
+}
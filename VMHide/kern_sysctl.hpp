@@ -0,0 +1,117 @@
+//
+//  kern_sysctl.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_sysctl_hpp
+#define kern_sysctl_hpp
+
+// Include Parent Module
+#include "kern_start.hpp"
+#include "kern_oidindex.hpp"
+
+// Logging Defs
+#define MODULE_SCTL "SCTL"
+
+// Upper bound on hooks handled by a single VMHSysctl::reroute call, and on their path depth
+#define VMH_SYSCTL_MAX_HOOKS 32
+#define VMH_SYSCTL_MAX_DEPTH 8
+
+// OIDs held by the sysctl index, the kernel tree has about 2000. Larger trees fall back to walking.
+#define VMH_SYSCTL_INDEX_CAPACITY 4096
+
+/**
+ * @brief Declarative description of one intercepted sysctl OID.
+ */
+struct VMHSysctlHook {
+	// Dotted path of the OID, for example "kern.hv_vmm_present"
+	const char *path;
+	
+	// Handler installed in place of the original one
+	sysctl_handler_t handler;
+	
+	// Slot receiving the original handler, so the replacement can chain to it
+	sysctl_handler_t *original;
+	
+	// Whether failing to intercept this OID fails the whole reroute
+	bool required;
+	
+	// Resolved OID, filled in by VMHSysctl::reroute
+	sysctl_oid *oid;
+};
+
+/**
+ * @brief Describes the kernel's sysctl_oid tree to VMHOidIndex.
+ */
+struct VMHKernelOidTraits {
+	typedef sysctl_oid Oid;
+	typedef sysctl_oid_list List;
+	
+	static Oid *first(List *list) { return SLIST_FIRST(list); }
+	static Oid *next(Oid *oid) { return SLIST_NEXT(oid, oid_link); }
+	static const char *name(const Oid *oid) { return oid->oid_name; }
+	static int number(const Oid *oid) { return oid->oid_number; }
+	
+	// Like sysctl itself, never descend into nodes implemented by a handler, their arg1 is not a list
+	static List *children(Oid *oid) {
+		if ((oid->oid_kind & CTLTYPE) != CTLTYPE_NODE || oid->oid_handler) {
+			return nullptr;
+		}
+		return reinterpret_cast<List *>(oid->oid_arg1);
+	}
+};
+
+typedef VMHOidIndex<VMHKernelOidTraits, VMH_SYSCTL_INDEX_CAPACITY> VMHSysctlIndex;
+
+/**
+ * @brief Table-driven sysctl handler interception.
+ *
+ * Hooks are resolved through a hashed index of the whole sysctl tree, built in a single
+ * traversal when the patcher loads. Should the index be missing or incomplete, the remaining
+ * hooks are resolved during a single walk of the tree instead: each oid list on the way to any
+ * of the targets is traversed once, matching all hooks sharing that prefix at the same time.
+ * The handlers are then swapped by a single VMHPatchTransaction.
+ */
+class VMHSysctl {
+public:
+	
+	/**
+	 * @brief Indexes the sysctl tree below root (_sysctl__children). Called once at patcher load.
+	 * @return false if the index could not be allocated or does not hold the whole tree.
+	 */
+	static bool buildIndex(mach_vm_address_t root);
+	
+	/**
+	 * @brief Frees the index, once the boot reroute resolved every hook. Later lookups walk the tree.
+	 */
+	static void releaseIndex();
+	
+	/**
+	 * @brief Finds an OID by dotted path, through the index when possible.
+	 */
+	static sysctl_oid *find(const char *path);
+	
+	/**
+	 * @brief Index built by buildIndex, or null once released. It is a snapshot of the tree at
+	 * patcher load, rebuild it before relying on it once other kexts may have unregistered their OIDs.
+	 */
+	static VMHSysctlIndex *index;
+	
+	/**
+	 * @brief Resolves and installs every hook of a table.
+	 * @param patcher KernelPatcher, whose write lock guards the handler swaps.
+	 * @param hooks Hook table, oid and original slots are filled in.
+	 * @return true if every required hook was installed. Optional hooks that are missing are skipped.
+	 */
+	static bool reroute(KernelPatcher &patcher, VMHSysctlHook *hooks, size_t hookCount);
+	
+private:
+	
+	// Walks one oid list, resolving the hooks selected by mask whose paths match up to depth
+	static void resolve(sysctl_oid_list *list, size_t depth, uint32_t mask, VMHSysctlHook *hooks, size_t hookCount);
+	
+};
+
+#endif /* kern_sysctl_hpp */
@@ -0,0 +1,239 @@
+//
+//  kern_topk.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_topk_hpp
+#define kern_topk_hpp
+
+// Like kern_filter.hpp, this header stays free of kernel includes so the tools can share it.
+#include <stddef.h>
+#include <stdint.h>
+#include "kern_filter.hpp"
+#include "vmh_abi.h"
+
+// A caller is offered to the candidates every time its count on one CPU reaches a multiple of this
+#define VMH_TOPK_ADMIT_INTERVAL 64
+
+/**
+ * @brief Heaviest callers of hv_vmm_present in fixed memory, however many distinct names call it.
+ *
+ * Every call is counted by process name in a count-min sketch, VMH_TOPK_DEPTH rows of
+ * VMH_TOPK_WIDTH counters indexed by independent hashes derived from one hash of the name.
+ * Callers pass that hash in, so one that remembers it per process never touches the name
+ * until it is offered to the candidates. Each CPU counts into its own cache-line aligned
+ * copy of the sketch, like the VMHStats histograms, allocated by the owner and handed over
+ * with attach(). Calls before that are not counted. As the sketch is linear the copies are
+ * only summed up by readers. The estimate of a name is the smallest of its counters, never
+ * below its true count.
+ *
+ * The names themselves are kept in VMH_TOPK_SLOTS candidates. Whenever the estimate of a name
+ * on the current CPU reaches a multiple of VMH_TOPK_ADMIT_INTERVAL, it replaces the candidate
+ * with the lowest such estimate if its own is higher. A single CPU updates the candidates at a
+ * time, the others skip the update rather than wait, and will offer the name again later.
+ */
+class VMHTopK {
+	static_assert(!(VMH_TOPK_WIDTH & (VMH_TOPK_WIDTH - 1)), "VMH_TOPK_WIDTH must be a power of two");
+	static_assert(!(VMH_TOPK_ADMIT_INTERVAL & (VMH_TOPK_ADMIT_INTERVAL - 1)), "VMH_TOPK_ADMIT_INTERVAL must be a power of two");
+
+public:
+	/**
+	 * @brief Copy of the sketch counted into by one CPU.
+	 */
+	struct alignas(64) Block {
+		uint64_t counters[VMH_TOPK_DEPTH][VMH_TOPK_WIDTH];
+	};
+
+	/**
+	 * @brief Starts counting into count zeroed blocks, which must outlive the sketch. CPUs beyond count share blocks.
+	 */
+	void attach(Block *zeroed, uint32_t count) {
+		blockCount = count;
+		__atomic_store_n(&blocks, zeroed, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * @brief Hash of the first VMH_TOPK_NAME_LEN bytes of name, which its calls are counted by.
+	 */
+	static uint32_t hash(const char *name) {
+		VMHNameKey key;
+		vmhNameKeyPack(name, key, VMH_TOPK_NAME_LEN);
+		return hash(key);
+	}
+
+	/**
+	 * @brief Counts one call on cpu of the name with the given hash.
+	 * @param verdict Value returned to the caller, reported along with its name.
+	 * @param name Returns the name, only called when it is offered to the candidates.
+	 */
+	template <typename NameFn>
+	void count(uint32_t cpu, uint32_t hash, uint8_t verdict, NameFn name) {
+		Block *copies = __atomic_load_n(&blocks, __ATOMIC_ACQUIRE);
+		if (!copies) {
+			return;
+		}
+		uint64_t (&counters)[VMH_TOPK_DEPTH][VMH_TOPK_WIDTH] = copies[cpu % blockCount].counters;
+		uint64_t estimate = UINT64_MAX;
+		for (size_t row = 0; row < VMH_TOPK_DEPTH; row++) {
+			uint64_t value = __atomic_add_fetch(&counters[row][column(hash, row)], 1, __ATOMIC_RELAXED);
+			estimate = value < estimate ? value : estimate;
+		}
+		if (!(estimate & (VMH_TOPK_ADMIT_INTERVAL - 1))) {
+			VMHNameKey key;
+			vmhNameKeyPack(name(), key, VMH_TOPK_NAME_LEN);
+			admit(key, estimate, verdict);
+		}
+	}
+
+	/**
+	 * @brief Estimated calls of name over every CPU.
+	 */
+	uint64_t estimate(const char *name) const {
+		VMHNameKey key;
+		vmhNameKeyPack(name, key, VMH_TOPK_NAME_LEN);
+		return estimate(key);
+	}
+
+	/**
+	 * @brief Ranks the candidates, heaviest first.
+	 * @param order Receives the slots of the candidates to pass to read, room for VMH_TOPK_SLOTS.
+	 * @return Number of slots filled in.
+	 */
+	size_t rank(uint8_t *order) {
+		uint64_t counts[VMH_TOPK_SLOTS];
+		size_t filled = 0;
+		lock();
+		for (size_t i = 0; i < VMH_TOPK_SLOTS; i++) {
+			if (!candidates[i].used) {
+				continue;
+			}
+			// Insertion sort, there are only VMH_TOPK_SLOTS of them
+			uint64_t count = estimate(candidates[i].key);
+			size_t at = filled++;
+			for (; at > 0 && counts[at - 1] < count; at--) {
+				counts[at] = counts[at - 1];
+				order[at] = order[at - 1];
+			}
+			counts[at] = count;
+			order[at] = static_cast<uint8_t>(i);
+		}
+		__atomic_store_n(&admitting, 0, __ATOMIC_RELEASE);
+		return filled;
+	}
+
+	/**
+	 * @brief Copies the candidates of slots returned by rank into entries, with their current estimates.
+	 * A candidate replaced since rank is reported in place of the one it replaced.
+	 */
+	void read(const uint8_t *slots, size_t count, vmh_topk_entry_t *entries) {
+		lock();
+		for (size_t i = 0; i < count; i++) {
+			const Candidate &candidate = candidates[slots[i] % VMH_TOPK_SLOTS];
+			vmh_topk_entry_t entry {};
+			entry.count = estimate(candidate.key);
+			entry.verdict = candidate.verdict;
+			for (size_t j = 0; j < VMH_TOPK_NAME_LEN; j++) {
+				entry.name[j] = static_cast<char>(candidate.key.words[j / 8] >> ((j % 8) * 8));
+			}
+			entries[i] = entry;
+		}
+		__atomic_store_n(&admitting, 0, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * @brief Number of calls counted so far.
+	 */
+	uint64_t calls() const {
+		// Every call added exactly one to every row, any row sums up to the calls
+		const Block *copies = __atomic_load_n(&blocks, __ATOMIC_ACQUIRE);
+		uint64_t calls = 0;
+		for (size_t cpu = 0; copies && cpu < blockCount; cpu++) {
+			for (size_t i = 0; i < VMH_TOPK_WIDTH; i++) {
+				calls += __atomic_load_n(&copies[cpu].counters[0][i], __ATOMIC_RELAXED);
+			}
+		}
+		return calls;
+	}
+
+private:
+	struct Candidate {
+		VMHNameKey key;
+		uint64_t score;    // Highest estimate of the name on a single CPU, when it was offered
+		uint8_t verdict;
+		bool used;
+	};
+
+	Block *blocks {nullptr};
+	uint32_t blockCount {0};
+	Candidate candidates[VMH_TOPK_SLOTS] {};
+	uint32_t admitting {0};
+
+	// Candidates are only ever held for a few dozen compares and estimates, readers wait for them
+	void lock() {
+		while (__atomic_exchange_n(&admitting, 1, __ATOMIC_ACQUIRE)) {
+			__builtin_ia32_pause();
+		}
+	}
+
+	static uint32_t hash(const VMHNameKey &key) {
+		uint64_t hash = vmhNameKeyHash(key);
+		return static_cast<uint32_t>(hash ^ (hash >> 32));
+	}
+
+	// Row hashes derived from the two halves of the spread name hash, the odd step keeps them distinct
+	static size_t column(uint32_t hash, size_t row) {
+		uint64_t spread = hash * 0x9e3779b97f4a7c15ULL;
+		uint32_t step = static_cast<uint32_t>(spread >> 32) | 1;
+		return (static_cast<uint32_t>(spread) + static_cast<uint32_t>(row) * step) & (VMH_TOPK_WIDTH - 1);
+	}
+
+	uint64_t estimate(const VMHNameKey &key) const {
+		const Block *copies = __atomic_load_n(&blocks, __ATOMIC_ACQUIRE);
+		if (!copies) {
+			return 0;
+		}
+		uint32_t hash = VMHTopK::hash(key);
+		uint64_t estimate = UINT64_MAX;
+		for (size_t row = 0; row < VMH_TOPK_DEPTH; row++) {
+			uint64_t sum = 0;
+			for (size_t cpu = 0; cpu < blockCount; cpu++) {
+				sum += __atomic_load_n(&copies[cpu].counters[row][column(hash, row)], __ATOMIC_RELAXED);
+			}
+			estimate = sum < estimate ? sum : estimate;
+		}
+		return estimate;
+	}
+
+	// Refreshes the candidate of key, or lets it replace the lightest candidate
+	void admit(const VMHNameKey &key, uint64_t score, uint8_t verdict) {
+		if (__atomic_exchange_n(&admitting, 1, __ATOMIC_ACQUIRE)) {
+			return;
+		}
+		size_t slot = VMH_TOPK_SLOTS;
+		size_t lightest = 0;
+		for (size_t i = 0; i < VMH_TOPK_SLOTS; i++) {
+			if (candidates[i].used && vmhNameKeyEqual(candidates[i].key, key)) {
+				slot = i;
+				break;
+			}
+			if (candidates[i].score < candidates[lightest].score) {
+				lightest = i;
+			}
+		}
+		if (slot == VMH_TOPK_SLOTS && (!candidates[lightest].used || candidates[lightest].score < score)) {
+			slot = lightest;
+			candidates[slot].key = key;
+			candidates[slot].score = 0;
+			candidates[slot].used = true;
+		}
+		if (slot != VMH_TOPK_SLOTS) {
+			candidates[slot].score = score > candidates[slot].score ? score : candidates[slot].score;
+			candidates[slot].verdict = verdict;
+		}
+		__atomic_store_n(&admitting, 0, __ATOMIC_RELEASE);
+	}
+};
+
+#endif /* kern_topk_hpp */
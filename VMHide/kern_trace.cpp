@@ -0,0 +1,143 @@
+//
+//  kern_trace.cpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#include "kern_trace.hpp"
+#include "kern_stats.hpp"
+
+// The ring is allocated the first time recording is turned on, and never freed as VMHide cannot be unloaded
+VMHTrace::Ring *VMHTrace::ring = nullptr;
+int VMHTrace::recording = 0;
+IOLock *VMHTrace::lock = nullptr;
+uint64_t VMHTrace::carriedLost = 0;
+
+// Appends one call to the ring
+void VMHTrace::record(pid_t pid, uint32_t generation, const char *name, int verdict, bool cached, uint64_t ticks) {
+	Ring *published = __atomic_load_n(&ring, __ATOMIC_ACQUIRE);
+	if (!published) {
+		return;
+	}
+
+	vmh_trace_record_t entry {};
+	entry.timestamp = mach_absolute_time();
+	entry.pid = pid;
+	entry.generation = generation;
+	entry.ticks = ticks > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(ticks);
+	entry.verdict = static_cast<uint8_t>(verdict);
+	entry.flags = cached ? VMH_TRACE_CACHED : 0;
+	char lookedUp[VMH_TRACE_NAME_LEN + 1];
+	if (!name) {
+		lookedUp[0] = '\0';
+		proc_name(pid, lookedUp, sizeof(lookedUp));
+		name = lookedUp;
+	}
+	for (size_t i = 0; i < VMH_TRACE_NAME_LEN && name[i] != '\0'; i++) {
+		entry.name[i] = name[i];
+	}
+	published->push(entry);
+}
+
+// kern.vmh.trace handler, a vmh_trace_header_t followed by as many drained records as fit the caller's buffer
+int VMH_sysctl_trace(struct sysctl_oid *oidp __unused, void *arg1 __unused, int arg2 __unused, struct sysctl_req *req) {
+	// Process names of other users' processes are not for everyone, and draining consumes the records
+	if (!kauth_cred_issuser(kauth_cred_get())) {
+		return EPERM;
+	}
+
+	// Size query, report the worst case of a full ring
+	if (!req->oldptr) {
+		return SYSCTL_OUT(req, nullptr, sizeof(vmh_trace_header_t) + VMH_TRACE_SLOTS * sizeof(vmh_trace_record_t));
+	}
+	if (req->oldlen < sizeof(vmh_trace_header_t)) {
+		return ENOMEM;
+	}
+	size_t room = (req->oldlen - sizeof(vmh_trace_header_t)) / sizeof(vmh_trace_record_t);
+	if (room > VMH_TRACE_SLOTS) {
+		room = VMH_TRACE_SLOTS;
+	}
+
+	IOLockLock(VMHTrace::lock);
+
+	// The header counts the records, so they are drained before anything is copied out
+	vmh_trace_record_t *records = nullptr;
+	size_t copied = 0;
+	if (VMHTrace::ring && room) {
+		records = static_cast<vmh_trace_record_t *>(IOMalloc(room * sizeof(vmh_trace_record_t)));
+		if (!records) {
+			IOLockUnlock(VMHTrace::lock);
+			return ENOMEM;
+		}
+		copied = VMHTrace::ring->drain(records, room, VMHTrace::carriedLost);
+	}
+
+	mach_timebase_info_data_t timebase {};
+	clock_timebase_info(&timebase);
+	vmh_trace_header_t header {};
+	header.magic = VMH_TRACE_MAGIC;
+	header.version = VMH_ABI_VERSION;
+	header.recordSize = sizeof(vmh_trace_record_t);
+	header.timebaseNumer = timebase.numer;
+	header.timebaseDenom = timebase.denom;
+	header.tscFrequency = VMHStats::tscFrequency;
+	header.lost = VMHTrace::carriedLost;
+	header.count = static_cast<uint32_t>(copied);
+	VMHTrace::carriedLost = 0;
+	int error = SYSCTL_OUT(req, &header, sizeof(header));
+	if (!error && copied) {
+		error = SYSCTL_OUT(req, records, copied * sizeof(vmh_trace_record_t));
+	}
+	if (records) {
+		IOFree(records, room * sizeof(vmh_trace_record_t));
+	}
+
+	IOLockUnlock(VMHTrace::lock);
+	return error;
+}
+
+// kern.vmh.trace_enabled handler, writes are restricted to root by sysctl itself
+int VMH_sysctl_trace_enabled(struct sysctl_oid *oidp __unused, void *arg1 __unused, int arg2 __unused, struct sysctl_req *req) {
+	int value = VMHTrace::recording;
+	int error = SYSCTL_OUT(req, &value, sizeof(value));
+	if (error || !req->newptr) {
+		return error;
+	}
+	error = SYSCTL_IN(req, &value, sizeof(value));
+	if (error) {
+		return error;
+	}
+
+	IOLockLock(VMHTrace::lock);
+	if (value && !VMHTrace::ring) {
+		void *memory = IOMallocAligned(sizeof(VMHTrace::Ring), alignof(VMHTrace::Ring));
+		if (!memory) {
+			IOLockUnlock(VMHTrace::lock);
+			return ENOMEM;
+		}
+		// An all zero ring is an empty ring
+		bzero(memory, sizeof(VMHTrace::Ring));
+		__atomic_store_n(&VMHTrace::ring, static_cast<VMHTrace::Ring *>(memory), __ATOMIC_RELEASE);
+		DBGLOG(MODULE_TRACE, "Allocated the trace ring of %d records.", VMH_TRACE_SLOTS);
+	}
+	__atomic_store_n(&VMHTrace::recording, value ? 1 : 0, __ATOMIC_RELAXED);
+	IOLockUnlock(VMHTrace::lock);
+	DBGLOG(MODULE_TRACE, "Tracing of hv_vmm_present calls turned %s.", value ? "on" : "off");
+	return 0;
+}
+
+// kern.vmh.trace and kern.vmh.trace_enabled
+SYSCTL_PROC(_kern_vmh, OID_AUTO, trace, CTLTYPE_OPAQUE | CTLFLAG_RD | CTLFLAG_LOCKED, nullptr, 0, VMH_sysctl_trace, "S,vmh_trace_header_t", "Drains the hv_vmm_present call trace");
+SYSCTL_PROC(_kern_vmh, OID_AUTO, trace_enabled, CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_LOCKED, nullptr, 0, VMH_sysctl_trace_enabled, "I", "Records every hv_vmm_present call into kern.vmh.trace");
+
+// Function for the trace init routine
+void VMHTrace::init() {
+	lock = IOLockAlloc();
+	if (!lock) {
+		DBGLOG(MODULE_ERROR, "Failed to allocate the trace lock, kern.vmh.trace is unavailable.");
+		return;
+	}
+	sysctl_register_oid(&sysctl__kern_vmh_trace);
+	sysctl_register_oid(&sysctl__kern_vmh_trace_enabled);
+}
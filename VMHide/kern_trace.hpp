@@ -0,0 +1,65 @@
+//
+//  kern_trace.hpp
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+
+#ifndef kern_trace_hpp
+#define kern_trace_hpp
+
+// Include Parent Module
+#include "kern_start.hpp"
+#include "kern_ring.hpp"
+#include "vmh_abi.h"
+
+// Logging Defs
+#define MODULE_TRACE "TRACE"
+
+// Calls kept before the oldest ones are overwritten, about a second of a busy boot
+#define VMH_TRACE_SLOTS 4096
+
+/**
+ * @brief Optional recorder of every hv_vmm_present call, for replay with Tools/vmh-replay.
+ *
+ * Off unless kern.vmh.trace_enabled is set to 1, which allocates a single lock-free ring shared
+ * by every CPU, so that records stay in call order. kern.vmh.trace drains it. While off, the
+ * handler pays one relaxed load for it.
+ */
+class VMHTrace {
+public:
+
+	// Registers kern.vmh.trace and kern.vmh.trace_enabled, kern.vmh must already be registered
+	static void init();
+
+	/**
+	 * @brief Whether calls should be recorded.
+	 */
+	static inline bool enabled() {
+		return __atomic_load_n(&recording, __ATOMIC_RELAXED) != 0;
+	}
+
+	/**
+	 * @brief Appends one call to the ring.
+	 * @param name Process name, or null to look it up from pid, as cached calls never did.
+	 */
+	static void record(pid_t pid, uint32_t generation, const char *name, int verdict, bool cached, uint64_t ticks);
+
+private:
+
+	typedef VMHRing<vmh_trace_record_t, VMH_TRACE_SLOTS> Ring;
+
+	static Ring *ring;
+	static int recording;
+	static IOLock *lock;
+	static uint64_t carriedLost;
+
+	// kern.vmh.trace handler, drains the ring into the caller's buffer
+	friend int VMH_sysctl_trace(struct sysctl_oid *oidp, void *arg1, int arg2, struct sysctl_req *req);
+
+	// kern.vmh.trace_enabled handler, allocates the ring the first time recording is turned on
+	friend int VMH_sysctl_trace_enabled(struct sysctl_oid *oidp, void *arg1, int arg2, struct sysctl_req *req);
+
+};
+
+#endif /* kern_trace_hpp */
@@ -10,144 +10,486 @@
 int VMM::hvVmmPresent = 0;
 size_t hvVmmIntSize = sizeof(VMM::hvVmmPresent);
 sysctl_handler_t VMM::originalHvVmmHandler = nullptr;
+sysctl_handler_t VMM::originalCpuFeaturesHandler = nullptr;
+VMHVerdictCache<VMM_VERDICT_CACHE_SLOTS> VMM::verdictCache;
+VMHNameHashCache<VMM_VERDICT_CACHE_SLOTS> VMM::callerHashes;
+VMHVnodeVerdictCache<VMM_EXECUTABLE_CACHE_SLOTS> VMM::executableCache;
+VMHVerdictCache<VMM_TREE_CACHE_SLOTS> VMM::treeCache;
+kauth_listener_t VMM::execListener = nullptr;
+vnode_t (*VMM::procExecutableVnode)(proc_t proc) = nullptr;
+const char *(*VMM::csIdentityGet)(proc_t proc) = nullptr;
 
 /**
- * @brief Defines the list of processes to filter for the VMM module.
+ * @brief Defines the initial list of processes to filter for the VMM module.
  * If a process calling kern.hv_vmm_present is in this list, the call will return 1.
  * For all other processes, the call will return 0.
  * The pid is not used in this check, so it can be left as 0.
+ * By default names are matched against proc_name, set match to VMH::VMH_MATCH_PATH or
+ * VMH::VMH_MATCH_BUNDLE to match the executable path or bundle identifier instead.
+ * Names containing '*' or '?' are glob rules, which cover whole families of processes and
+ * names longer than MAXCOMLEN, such as com.apple.MobileSoftwareUpdate.UpdateBrainService.
+ * Set tree to also filter every process a matching one spawns, and their own descendants.
+ * The list can be replaced at runtime through kern.vmh.filter, see VMHLiveFilter.
  */
-const VMH::DetectedProcess VMM::filteredProcs[] = {
-	{"SoftwareUpdateNo", -1},
+constexpr VMH::DetectedProcess VMM::filteredProcs[] = {
+	{"SoftwareUpdateNo*", -1},
 	{"softwareupdated", -1},
-	{"com.apple.Mobile", -1},
+	{"com.apple.Mobile*", -1},
 	{"osinstallersetup", -1}
 };
 
-// VMHide's custom sysctl VMM present function
-int VMH_sysctl_vmm_present(struct sysctl_oid *oidp, void *arg1, int arg2, struct sysctl_req *req) {
+// Runs the construction VMHLiveFilter::build runs at boot: per kind, a table over the exact names
+// of that kind only, with vmhFilterBuckets of their count. Glob rules go to the DFA instead.
+template <size_t N>
+constexpr bool VMM_bootTablesValid(const VMH::DetectedProcess (&procs)[N]) {
+	for (size_t kind = 0; kind < VMH::VMH_MATCH_KINDS; kind++) {
+		VMH::DetectedProcess exact[N] {};
+		size_t exactCount = 0;
+		for (size_t i = 0; i < N; i++) {
+			if (static_cast<size_t>(procs[i].match) == kind && !vmhIsGlob(procs[i].name)) {
+				exact[exactCount++] = procs[i];
+			}
+		}
+		uint32_t seeds[vmhPow2(N)] {};
+		VMHFilterSlot slots[vmhPow2(N) * 2] {};
+		uint64_t hashes[N] {};
+		uint32_t order[N] {};
+		uint32_t offsets[vmhPow2(N) + 1] {};
+		VMHFilterTableView table(seeds, slots, vmhFilterBuckets(exactCount));
+		if (!table.build(exact, exactCount, hashes, order, offsets)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// The live filter builds those tables over the exact names at boot, make sure they can be built
+static_assert(VMM_bootTablesValid(VMM::filteredProcs), "Failed to generate the perfect hash tables of VMM::filteredProcs.");
+static_assert(arrsize(VMM::filteredProcs) <= VMH_LIVE_FILTER_MAX, "VMM::filteredProcs exceeds VMH_LIVE_FILTER_MAX.");
+
+// Cached verdicts note the unique process set slot of their process, plus one so that 0 means untracked
+static_assert(VMH_PROCESS_UNTRACKED < (1 << VMH_VERDICT_NOTE_BITS), "VMH_VERDICT_NOTE_BITS cannot hold every unique process set slot.");
+
+// Matches the executable of a process against the path and bundle rules. Resolving the path is
+// expensive, so the verdict is cached per executable vnode and computed once per binary.
+// Must be called within a live filter read-side section.
+static bool VMM_executableFiltered(proc_t process) {
+	if (!VMM::procExecutableVnode) {
+		return false;
+	}
+	vnode_t executable = VMM::procExecutableVnode(process);
+	if (executable == NULLVP) {
+		return false;
+	}
 	
-	// Retrieve the current process information
+	uint32_t vid = vnode_vid(executable);
+	bool isFiltered = false;
+	if (VMM::executableCache.lookup(executable, vid, isFiltered)) {
+		VMHStats::count(VMHStatExecutableCacheHits);
+	} else {
+		VMHStats::count(VMHStatExecutableCacheMisses);
+		if (VMHLiveFilter::hasRules(VMH::VMH_MATCH_PATH)) {
+			char *path = static_cast<char *>(IOMalloc(MAXPATHLEN));
+			int length = MAXPATHLEN;
+			if (path && vn_getpath(executable, path, &length) == 0) {
+				isFiltered = VMHLiveFilter::contains(VMH::VMH_MATCH_PATH, path);
+			}
+			if (path) {
+				IOFree(path, MAXPATHLEN);
+			}
+		}
+		// The signing identifier belongs to the executable's code signature, caching it per vnode holds as well
+		if (!isFiltered && VMM::csIdentityGet && VMHLiveFilter::hasRules(VMH::VMH_MATCH_BUNDLE)) {
+			const char *identity = VMM::csIdentityGet(process);
+			isFiltered = identity && VMHLiveFilter::contains(VMH::VMH_MATCH_BUNDLE, identity);
+		}
+		VMM::executableCache.store(executable, vid, isFiltered);
+	}
+	vnode_put(executable);
+	return isFiltered;
+}
+
+// Looks for a process matching a tree rule, or marked as part of a filtered tree, from pid up
+// through at most depth ancestors. Returns the pid found, 0 if there is none. Must be called
+// within a live filter read-side section.
+static pid_t VMM_treeAncestor(pid_t pid, size_t depth) {
+	for (; depth > 0 && pid > 1; depth--) {
+		proc_t ancestor = proc_find(pid);
+		if (!ancestor) {
+			return 0;
+		}
+		bool marked = false;
+		bool hit = VMM::treeCache.lookup(pid, static_cast<uint32_t>(proc_pidversion(ancestor)), marked);
+		pid_t parent = proc_ppid(ancestor);
+		proc_rele(ancestor);
+		
+		// Processes started before their tree rule, or before VMHide, are only recognized by name
+		char name[MAX_PROC_NAME_LEN];
+		name[0] = '\0';
+		if (!hit) {
+			proc_name(pid, name, sizeof(name));
+		}
+		if (hit || VMHLiveFilter::matchesTree(VMH::VMH_MATCH_NAME, name)) {
+			return pid;
+		}
+		pid = parent;
+	}
+	return 0;
+}
+
+// Marks a process that just called exec if it matches a tree rule itself, or descends from a
+// process that does. The ancestry is resolved here, once per exec, so that the handler only
+// ever has to look up the mark of a caller or of its parent. path may be null.
+static void VMM_markTree(proc_t process, vnode_t executable, const char *path) {
+	uint32_t section = VMHLiveFilter::enter();
+	if (!VMHLiveFilter::hasTreeRules()) {
+		VMHLiveFilter::exit(section);
+		return;
+	}
+	pid_t procPid = proc_pid(process);
+	char procName[MAX_PROC_NAME_LEN];
+	procName[0] = '\0';
+	proc_name(procPid, procName, sizeof(procName));
+	
+	pid_t head = VMHLiveFilter::matchesTree(VMH::VMH_MATCH_NAME, procName) ? procPid : 0;
+	if (!head && VMHLiveFilter::hasTreeRules(VMH::VMH_MATCH_PATH)) {
+		char *resolved = path ? nullptr : static_cast<char *>(IOMalloc(MAXPATHLEN));
+		int length = MAXPATHLEN;
+		if (resolved && executable != NULLVP && vn_getpath(executable, resolved, &length) == 0) {
+			path = resolved;
+		}
+		if (path && VMHLiveFilter::matchesTree(VMH::VMH_MATCH_PATH, path)) {
+			head = procPid;
+		}
+		if (resolved) {
+			IOFree(resolved, MAXPATHLEN);
+		}
+	}
+	if (!head && VMM::csIdentityGet && VMHLiveFilter::hasTreeRules(VMH::VMH_MATCH_BUNDLE)) {
+		const char *identity = VMM::csIdentityGet(process);
+		head = identity && VMHLiveFilter::matchesTree(VMH::VMH_MATCH_BUNDLE, identity) ? procPid : 0;
+	}
+	if (!head) {
+		head = VMM_treeAncestor(proc_ppid(process), VMM_TREE_MAX_DEPTH);
+	}
+	if (head) {
+		VMM::treeCache.store(procPid, static_cast<uint32_t>(proc_pidversion(process)), true);
+		VMHStats::count(VMHStatTreeMarks);
+		VMHLOG(VMH_MSG_CVMM_TREE, procName, procPid, 1, static_cast<uint64_t>(head));
+	}
+	VMHLiveFilter::exit(section);
+}
+
+// Whether a caller belongs to a filtered process tree: marked at its last exec, or forked since
+// from a process that is marked or matches a tree rule by name. Constant time, a forked caller
+// is marked in turn so that its own children find it. Must be called within a read-side section.
+static bool VMM_inTree(proc_t process, pid_t procPid, uint32_t procGeneration) {
+	bool marked = false;
+	if (VMM::treeCache.lookup(procPid, procGeneration, marked)) {
+		return true;
+	}
+	if (!VMM_treeAncestor(proc_ppid(process), 1)) {
+		return false;
+	}
+	VMM::treeCache.store(procPid, procGeneration, true);
+	VMHStats::count(VMHStatTreeMarks);
+	return true;
+}
+
+// Matches a process against the live filter and caches the verdict. The verdict is stored before
+// leaving the read-side section, so a replaced list is only retired, and the caches cleared, once
+// no verdict derived from it can still be stored.
+static bool VMM_matchAndRemember(proc_t process, const char *procName, pid_t procPid, uint32_t procGeneration) {
+	uint32_t section = VMHLiveFilter::enter();
+	bool isFiltered = VMHLiveFilter::contains(VMH::VMH_MATCH_NAME, procName);
+	if (!isFiltered && (VMHLiveFilter::hasRules(VMH::VMH_MATCH_PATH) || VMHLiveFilter::hasRules(VMH::VMH_MATCH_BUNDLE))) {
+		isFiltered = VMM_executableFiltered(process);
+	}
+	if (!isFiltered && VMHLiveFilter::hasTreeRules()) {
+		isFiltered = VMM_inTree(process, procPid, procGeneration);
+	}
+	VMM::callerHashes.store(procPid, VMHStats::callerHash(procName));
+	VMM::verdictCache.store(procPid, procGeneration, isFiltered);
+	VMHLiveFilter::exit(section);
+	return isFiltered;
+}
+
+// Logs a call in detail the first time its process name is seen. Repeat calls, cached ones
+// included, are only counted per name and reported by VMH::summarizeProcesses.
+static void VMM_logCall(const char *procName, pid_t procPid, uint32_t procGeneration, bool cacheHit, uint32_t note, bool isFiltered, int value_to_return) {
+	if (cacheHit) {
+		if (note) {
+			VMH::uniqueProcesses.repeat(note - 1);
+		}
+	} else {
+		size_t slot = VMH_PROCESS_UNTRACKED;
+		if (VMH::processCurrentProcessUnique(procName, procPid, isFiltered, &slot)) {
+			VMHLOG(isFiltered ? VMH_MSG_CVMM_FILTERED : VMH_MSG_CVMM_ALLOWED, procName, procPid, value_to_return, 0);
+		}
+		if (slot != VMH_PROCESS_UNTRACKED) {
+			VMM::verdictCache.annotate(procPid, procGeneration, static_cast<uint32_t>(slot) + 1);
+		}
+	}
+	VMH::summarizeProcesses();
+}
+
+// Drops every cached verdict once a replaced filter list has been retired. Tree marks go as well,
+// running descendants of a tree are then only recognized again through a parent matching by name.
+static void VMM_filterRetired() {
+	VMM::verdictCache.clear();
+	VMM::executableCache.clear();
+	VMM::treeCache.clear();
+}
+
+// Filter verdict of the calling process, answered from the verdict cache when possible
+bool VMM::isCurrentProcFiltered() {
 	proc_t currentProcess = current_proc();
 	pid_t procPid = proc_pid(currentProcess);
-	char procName[MAX_PROC_NAME_LEN] = {0};
-	proc_name(procPid, procName, sizeof(procName));
+	uint32_t procGeneration = static_cast<uint32_t>(proc_pidversion(currentProcess));
+	bool isFiltered = false;
+	if (!verdictCache.lookup(procPid, procGeneration, isFiltered)) {
+		char procName[MAX_PROC_NAME_LEN];
+		procName[0] = '\0';
+		proc_name(procPid, procName, sizeof(procName));
+		isFiltered = VMM_matchAndRemember(currentProcess, procName, procPid, procGeneration);
+	}
+	return isFiltered;
+}
+
+// VMHide's custom sysctl VMM present function, one specialization per VMH::VmhState.
+// VMM_vmmPresentHandler picks the one matching vmhStateEnum at reroute time, so calls never branch on the state.
+template <VMH::VmhState State>
+static int VMH_sysctl_vmm_present(struct sysctl_oid *oidp, void *arg1, int arg2, struct sysctl_req *req) {
+	
+	// Every phase below is timed into the per-CPU latency histograms of kern.vmh.latency
+	uint64_t handlerStart = VMHStats::timestamp();
+	uint64_t phaseStart = handlerStart;
+	VMHStats::count(VMHStatCalls);
+	VMHStats::countState(State);
+	
+	// Strict answers 0 to everyone, without looking at the caller
+	if (State == VMH::VMH_STRICT) {
+		int value_to_return = 0;
+		VMHStats::count(VMHStatUnfiltered);
+		int error = SYSCTL_OUT(req, &value_to_return, sizeof(value_to_return));
+		uint64_t handlerEnd = VMHStats::recordLatency(VMH_LATENCY_TOTAL, handlerStart);
+		if (VMHTrace::enabled()) {
+			proc_t currentProcess = current_proc();
+			VMHTrace::record(proc_pid(currentProcess), static_cast<uint32_t>(proc_pidversion(currentProcess)), nullptr, value_to_return, false, handlerEnd - handlerStart);
+		}
+		return error;
+	}
+	
+	// Disabled leaves the answer to the kernel
+	if (State == VMH::VMH_DISABLED) {
+		sysctl_handler_t original = VMM::originalHvVmmHandler;
+		return original ? original(oidp, arg1, arg2, req) : ENOENT;
+	}
+	
+	// Retrieve the current process information, the generation changes on every fork and exec
+	proc_t currentProcess = current_proc();
+	pid_t procPid = proc_pid(currentProcess);
+	uint32_t procGeneration = static_cast<uint32_t>(proc_pidversion(currentProcess));
+	char procName[MAX_PROC_NAME_LEN];
+	procName[0] = '\0';
 	
 	// Default to 0 (VMM not present). This will be the value for any process NOT in our list.
 	int value_to_return = 0;
 	bool isFiltered = false;
+	uint32_t note = 0;
 
-	// Determine the number of processes in our filter list
-	const size_t num_filtered = sizeof(VMM::filteredProcs) / sizeof(VMM::filteredProcs[0]);
+	// Repeat callers are answered from the verdict cache, without looking up their name
+	bool cacheHit = VMM::verdictCache.lookup(procPid, procGeneration, isFiltered, &note);
+	if (cacheHit) {
+		VMHStats::count(VMHStatCacheHits);
+	} else {
+		VMHStats::count(VMHStatCacheMisses);
+		proc_name(procPid, procName, sizeof(procName));
+	}
+	phaseStart = VMHStats::recordLatency(VMH_LATENCY_LOOKUP, phaseStart);
 
-	// Loop through the filteredProcs list to check for a match
-	for (size_t i = 0; i < num_filtered; ++i) {
-		// Use strcmp to compare the current process name with the name in our list
-		if (strcmp(procName, VMM::filteredProcs[i].name) == 0) {
-			// Match found! Set the return value to 1 (VMM is present).
-			value_to_return = 1;
-			isFiltered = true;
-			break; // Exit the loop since we found our match
-		}
+	if (!cacheHit) {
+		// Check the live filter list for a match, and remember the verdict for this process
+		isFiltered = VMM_matchAndRemember(currentProcess, procName, procPid, procGeneration);
+		VMHStats::recordLatency(VMH_LATENCY_MATCH, phaseStart);
 	}
 
-	// Log the action for debugging purposes
 	if (isFiltered) {
-		DBGLOG(MODULE_CVMM, "Process '%s' (PID: %d) is on the filter list. Reporting hv_vmm_present as %d.", procName, procPid, value_to_return);
+		// Match found! Set the return value to 1 (VMM is present).
+		value_to_return = 1;
+		VMHStats::count(VMHStatFiltered);
 	} else {
-		DBGLOG(MODULE_CVMM, "Process '%s' (PID: %d) is NOT on the filter list. Reporting hv_vmm_present as %d.", procName, procPid, value_to_return);
+		VMHStats::count(VMHStatUnfiltered);
 	}
 	
-	// Use the kernel macro to properly return the value to the calling process, depending on our context
-	return SYSCTL_OUT(req, &value_to_return, sizeof(value_to_return));
-}
-
-// Function to reroute kern.hv_vmm_present function to our own custom one
-bool reRouteHvVmm(KernelPatcher &patcher) {
-
-	// Ensure that sysctlChildrenAddress exists before continuing
-	if (!VMH::gSysctlChildrenAddr) {
-		DBGLOG(MODULE_ERROR, "Failed to resolve _sysctl__children passed to function reRouteHvVmm.");
-		panic(MODULE_RRHVM, "Failed to resolve _sysctl__children passed to function reRouteHvVmm");
-		return false;
-	} else {
-		DBGLOG(MODULE_RRHVM, "Got address 0x%llx for _sysctl__children passed to function reRouteHvVmm.", VMH::gSysctlChildrenAddr);
+	// Inverted hides the VMM from the filtered processes only, and shows it to everyone else
+	if (State == VMH::VMH_INVERTED) {
+		value_to_return = !value_to_return;
 	}
 
-	// Case the address to sysctl_oid_list*
-	sysctl_oid_list *sysctlChildren = reinterpret_cast<sysctl_oid_list *>(VMH::gSysctlChildrenAddr);
-
-	// traverse the sysctl tree to locate 'kern'
-	sysctl_oid *kernNode = nullptr;
-	SLIST_FOREACH(kernNode, sysctlChildren, oid_link) {
-		// Add a null-check for oid_name as a good safety practice within the loop
-		if (kernNode && kernNode->oid_name && strcmp(kernNode->oid_name, "kern") == 0) {
-			DBGLOG(MODULE_RRHVM, "Found 'kern' node.");
-			break;
+	// Every caller is counted by name for kern.vmh.topk, cached ones by the name hash stored with their verdict.
+	// Their short name is only copied when it is offered to the top callers, or another pid took the hash slot.
+	uint32_t nameHash = 0;
+	if (!VMM::callerHashes.lookup(procPid, nameHash)) {
+		if (cacheHit) {
+			proc_selfname(procName, VMH_TOPK_NAME_LEN + 1);
 		}
+		nameHash = VMHStats::callerHash(procName);
+		VMM::callerHashes.store(procPid, nameHash);
 	}
+	VMHStats::countCaller(nameHash, value_to_return, [&procName]() -> const char * {
+		if (procName[0] == '\0') {
+			proc_selfname(procName, VMH_TOPK_NAME_LEN + 1);
+		}
+		return procName;
+	});
 
-	// check if kern node was found
-	if (!kernNode) {
-		DBGLOG(MODULE_RRHVM, "Failed to locate 'kern' node in sysctl tree.");
-		return false;
+	// Log the action for debugging purposes, once per process name, formatting is deferred to whoever drains kern.vmh.log
+	if (ADDPR(debugEnabled)) {
+		VMM_logCall(procName, procPid, procGeneration, cacheHit, note, isFiltered, value_to_return);
 	}
+	
+	// Use the kernel macro to properly return the value to the calling process, depending on our context
+	phaseStart = VMHStats::timestamp();
+	int error = SYSCTL_OUT(req, &value_to_return, sizeof(value_to_return));
+	VMHStats::recordLatency(VMH_LATENCY_OUT, phaseStart);
+	uint64_t handlerEnd = VMHStats::recordLatency(VMH_LATENCY_TOTAL, handlerStart);
+	
+	// Optional call trace for Tools/vmh-replay, cached callers only have their name looked up while tracing
+	if (VMHTrace::enabled()) {
+		VMHTrace::record(procPid, procGeneration, cacheHit ? nullptr : procName, value_to_return, cacheHit, handlerEnd - handlerStart);
+	}
+	return error;
+}
 
-	// --- SAFETY CHECKS ADDED ---
-	// Before traversing children, validate that the kern node is structured as we expect.
-	// 1. It must be a NODE type, indicating it's a parent in the tree.
-	// 2. The pointer to its children (oid_arg1) must not be null.
-	if (!(kernNode->oid_kind & CTLTYPE_NODE) || !kernNode->oid_arg1) {
-		DBGLOG(MODULE_ERROR, "'kern' sysctl OID is not a valid node or has no children. Cannot traverse.");
-		return false;
+// kauth file operation listener, a process calling exec must have its cached verdict recomputed,
+// and is marked when it joins a filtered process tree. arg0 is the executable vnode, arg1 its path.
+static int VMM_fileop_listener(kauth_cred_t credential __unused, void *idata __unused, kauth_action_t action,
+							   uintptr_t arg0, uintptr_t arg1, uintptr_t arg2 __unused, uintptr_t arg3 __unused) {
+	if (action == KAUTH_FILEOP_EXEC) {
+		proc_t process = current_proc();
+		pid_t procPid = proc_pid(process);
+		VMM::verdictCache.invalidate(procPid);
+		VMHLOG(VMH_MSG_CVMM_EXEC, nullptr, procPid, 0, 0);
+		VMM_markTree(process, reinterpret_cast<vnode_t>(arg0), reinterpret_cast<const char *>(arg1));
 	}
-	// --- END SAFETY CHECKS ---
+	return KAUTH_RESULT_DEFER;
+}
+
+// SYSCTL_OUT replacement collecting the output of an original handler into a kernel buffer
+static int VMM_captureOut(struct sysctl_req *req, const void *data, size_t length) {
+	if (req->oldidx < req->oldlen) {
+		size_t room = req->oldlen - req->oldidx;
+		memcpy(reinterpret_cast<char *>(req->oldptr) + req->oldidx, data, length < room ? length : room);
+	}
+	req->oldidx += length;
+	return req->oldidx > req->oldlen ? ENOMEM : 0;
+}
 
-	// Now it's safe to traverse the children of 'kern'
-	sysctl_oid_list *kernChildren = reinterpret_cast<sysctl_oid_list *>(kernNode->oid_arg1);
-	sysctl_oid *vmmNode = nullptr;
-	SLIST_FOREACH(vmmNode, kernChildren, oid_link) {
-		if (vmmNode && vmmNode->oid_name && strcmp(vmmNode->oid_name, "hv_vmm_present") == 0) {
-			DBGLOG(MODULE_RRHVM, "Found 'hv_vmm_present' node.");
-			break;
+// Removes every standalone occurrence of word, along with one separating space
+static void VMM_stripWord(char *string, const char *word) {
+	size_t wordLength = strlen(word);
+	char *match = string;
+	while ((match = strstr(match, word)) != nullptr) {
+		bool startsWord = match == string || match[-1] == ' ';
+		bool endsWord = match[wordLength] == '\0' || match[wordLength] == ' ';
+		if (!startsWord || !endsWord) {
+			match += wordLength;
+			continue;
 		}
+		char *from = match + wordLength;
+		char *to = match;
+		if (*from == ' ') {
+			from++;
+		} else if (to != string) {
+			to--; // Last word, drop the space before it instead
+		}
+		memmove(to, from, strlen(from) + 1);
+		match = to;
 	}
+}
 
-	// check if the vmm present entry was found
-	if (!vmmNode) {
-		DBGLOG(MODULE_RRHVM, "Failed to locate 'hv_vmm_present' sysctl entry.");
-		return false;
+// Whether the calling process is told hv_vmm_present is 1 under State
+template <VMH::VmhState State>
+static inline bool VMM_showsVmm() {
+	switch (State) {
+		case VMH::VMH_STRICT:
+			return false;
+		case VMH::VMH_DISABLED:
+			return true;
+		case VMH::VMH_INVERTED:
+			return !VMM::isCurrentProcFiltered();
+		default:
+			return VMM::isCurrentProcFiltered();
 	}
+}
 
-	// Check if the found vmmNode's handler is NULL, which might be unexpected.
-	if (vmmNode->oid_handler == nullptr) {
-		DBGLOG(MODULE_RRHVM, "Failed to save original 'hv_vmm_present' sysctl handler: The existing handler was NULL.");
-		return false; // Return false as this is considered a failure condition.
+// machdep.cpu.features handler, hides the VMM feature flag from every process that is also told hv_vmm_present is 0
+template <VMH::VmhState State>
+static int VMH_sysctl_cpu_features(struct sysctl_oid *oidp, void *arg1, int arg2, struct sysctl_req *req) {
+	sysctl_handler_t original = VMM::originalCpuFeaturesHandler;
+	if (!original) {
+		return ENOENT;
 	}
 	
-	// Save the original handler
-	VMM::originalHvVmmHandler = vmmNode->oid_handler;
-	DBGLOG(MODULE_RRHVM, "Successfully saved original 'hv_vmm_present' sysctl handler.");
-	 
-	// On macOS Ventura (Darwin 22) and newer (?), we must disable kernel write protection.
-	// Not too sure when this began to be a requirement, but let's do it for Vent+ for now.
-	if (getKernelVersion() >= KernelVersion::Ventura) {
-		DBGLOG(MODULE_RRHVM, "Ventura or newer detected. Disabling kernel write protection...");
-		PANIC_COND(MachInfo::setKernelWriting(true, patcher.kernelWriteLock) != KERN_SUCCESS, MODULE_SHORT, "Failed to disable kernel write protection.");
+	// Size queries and processes shown the VMM get the genuine answer
+	if (!req->oldptr || req->newptr || VMM_showsVmm<State>()) {
+		return original(oidp, arg1, arg2, req);
 	}
 	
-	// Reroute the handler to our custom function.
-	vmmNode->oid_handler = VMH_sysctl_vmm_present;
-	
-	// Re-enable kernel write protection if we disabled it.
-	if (getKernelVersion() >= KernelVersion::Ventura) {
-		DBGLOG(MODULE_RRHVM, "Re-enabling kernel write protection.");
-		MachInfo::setKernelWriting(false, patcher.kernelWriteLock);
+	char *features = static_cast<char *>(IOMalloc(VMM_FEATURES_MAX));
+	if (!features) {
+		return ENOMEM;
 	}
-	
-	DBGLOG(MODULE_RRHVM, "Successfully rerouted 'hv_vmm_present' sysctl handler.");
-	return true;
-	
+	sysctl_req capture = *req;
+	capture.oldptr = reinterpret_cast<user_addr_t>(features);
+	capture.oldlen = VMM_FEATURES_MAX - 1;
+	capture.oldidx = 0;
+	capture.oldfunc = VMM_captureOut;
+	int error = original(oidp, arg1, arg2, &capture);
+	if (!error) {
+		features[capture.oldidx < VMM_FEATURES_MAX - 1 ? capture.oldidx : VMM_FEATURES_MAX - 1] = '\0';
+		VMM_stripWord(features, "VMM");
+		error = SYSCTL_OUT(req, features, strlen(features) + 1);
+	}
+	IOFree(features, VMM_FEATURES_MAX);
+	return error;
+}
+
+/**
+ * @brief Every sysctl OID VMHide intercepts, resolved in a single walk of the sysctl tree.
+ * Only OIDs whose answer VMHide changes belong here, every hook is a kernel patch.
+ * VMM_selectHandlers relies on this order.
+ */
+VMHSysctlHook VMM::sysctlHooks[] = {
+	{"kern.hv_vmm_present", VMH_sysctl_vmm_present<VMH::VMH_DEFAULT>, &VMM::originalHvVmmHandler, true, nullptr},
+	{"machdep.cpu.features", VMH_sysctl_cpu_features<VMH::VMH_DEFAULT>, &VMM::originalCpuFeaturesHandler, false, nullptr},
+};
+
+// Points the kern.hv_vmm_present and machdep.cpu.features hooks at their specializations for State
+template <VMH::VmhState State>
+static void VMM_selectHandlers() {
+	VMM::sysctlHooks[0].handler = VMH_sysctl_vmm_present<State>;
+	VMM::sysctlHooks[1].handler = VMH_sysctl_cpu_features<State>;
+}
+
+// Function to reroute kern.hv_vmm_present, and the related OIDs, to our own custom ones
+bool reRouteHvVmm(KernelPatcher &patcher) {
+	// The state is fixed at boot, install the handlers specialized for it
+	switch (VMH::vmhStateEnum) {
+		case VMH::VMH_STRICT:     VMM_selectHandlers<VMH::VMH_STRICT>(); break;
+		case VMH::VMH_INVERTED:   VMM_selectHandlers<VMH::VMH_INVERTED>(); break;
+		case VMH::VMH_DISABLED:   VMM_selectHandlers<VMH::VMH_DISABLED>(); break;
+		case VMH::VMH_UNDERCOVER: VMM_selectHandlers<VMH::VMH_UNDERCOVER>(); break;
+		case VMH::VMH_INTERNAL:   VMM_selectHandlers<VMH::VMH_INTERNAL>(); break;
+		case VMH::VMH_ENABLED:    VMM_selectHandlers<VMH::VMH_ENABLED>(); break;
+		default:                  VMM_selectHandlers<VMH::VMH_DEFAULT>(); break;
+	}
+	DBGLOG(MODULE_RRHVM, "Rerouting %lu sysctl handlers for state %d.", arrsize(VMM::sysctlHooks), VMH::vmhStateEnum);
+	uint64_t phaseStart = mach_absolute_time();
+	bool rerouted = VMHSysctl::reroute(patcher, VMM::sysctlHooks, arrsize(VMM::sysctlHooks));
+	VMHStats::recordBoot(VMHBootReroute, phaseStart);
+	return rerouted;
 }
 
 // Function for the VMM init routine
@@ -155,6 +497,7 @@ void VMM::init(KernelPatcher &Patcher) {
 
 	// Register a request to reroute to our custom function
 	DBGLOG(MODULE_VMM, "VMM::init() called. VMM module is starting.");
+	uint64_t initStart = mach_absolute_time();
 	
 	if (!VMH::gSysctlChildrenAddr) {
 		DBGLOG(MODULE_ERROR, "VMH::gSysctlChildrenAddr is not set. Cannot perform VMM rerouting.");
@@ -162,12 +505,42 @@ void VMM::init(KernelPatcher &Patcher) {
 		return;
 	}
 	
+	// Path and bundle rules need the executable of a process, neither helper is a public KPI.
+	// Both were resolved along with _sysctl__children, and are optional.
+	if (!VMM::procExecutableVnode || !VMM::csIdentityGet) {
+		DBGLOG(MODULE_WARN, "Failed to resolve %s, such rules will never match.",
+			   !VMM::procExecutableVnode ? "_proc_getexecutablevnode, path and bundle" : "_cs_identity_get, bundle");
+	}
+	uint64_t phaseStart = mach_absolute_time();
+	
+	// Publish the compiled filter in NVRAM, or filteredProcs, as the initial live filter list, the handlers below read nothing else
+	if (!VMHLiveFilter::init(VMM::filteredProcs, arrsize(VMM::filteredProcs), VMM_filterRetired)) {
+		DBGLOG(MODULE_ERROR, "Failed to publish the filter list. Cannot perform VMM rerouting.");
+		panic(MODULE_LONG, "Failed to publish the filter list.");
+		return;
+	}
+	VMHStats::recordBoot(VMHBootFilter, phaseStart);
+	
+	// Exec replaces the process image and name, so drop its cached verdict when it happens.
+	// It is also where processes are marked as members of a filtered process tree, see VMM_markTree.
+	// Exits need no listener, a recycled pid comes with a new generation and never hits a stale verdict.
+	VMM::execListener = kauth_listen_scope(KAUTH_SCOPE_FILEOP, VMM_fileop_listener, nullptr);
+	if (!VMM::execListener) {
+		DBGLOG(MODULE_WARN, "Failed to register the exec listener, cached verdicts will only be refreshed by process generation.");
+	}
+	
 	// Perform rerouting, as Patcher is available and gSysctlChildrenAddr is known (hopefully by now, yes it is)
 	if (!reRouteHvVmm(Patcher)) {
+		VMHStats::count(VMHStatRerouteFailures);
+		VMHLOG(VMH_MSG_RRHVM_FAILED, nullptr, 0, 0, 0);
 		DBGLOG(MODULE_ERROR, "Failed to reroute kern.hv_vmm_present.");
 		panic(MODULE_LONG, "Failed to reroute kern.hv_vmm_present.");
 	} else {
+		VMHStats::count(VMHStatReroutes);
+		VMHLOG(VMH_MSG_RRHVM_DONE, nullptr, 0, 0, reinterpret_cast<uint64_t>(VMM::originalHvVmmHandler));
 		DBGLOG(MODULE_INFO, "kern.hv_vmm_present rerouted successfully.");
 	}
+	VMHSysctl::releaseIndex();
+	VMHStats::recordBoot(VMHBootVmmInit, initStart);
 
 }
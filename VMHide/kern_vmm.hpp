@@ -10,12 +10,34 @@
 
 // Include Parent Module
 #include "kern_start.hpp"
+#include "kern_filter.hpp"
+#include "kern_cache.hpp"
+#include "kern_stats.hpp"
+#include "kern_log.hpp"
+#include "kern_trace.hpp"
+#include "kern_sysctl.hpp"
+#include "kern_livefilter.hpp"
 
 // Logging Defs
 #define MODULE_VMM "VMM"
 #define MODULE_RRHVM "RRHVM"
 #define MODULE_CVMM "CVMM"
 
+// Number of per-process verdicts remembered by the hv_vmm_present handler
+#define VMM_VERDICT_CACHE_SLOTS 1024
+
+// Number of executables whose path and bundle identifier verdicts are remembered
+#define VMM_EXECUTABLE_CACHE_SLOTS 1024
+
+// Number of processes remembered as members of a filtered process tree
+#define VMM_TREE_CACHE_SLOTS 4096
+
+// Most ancestors an exec looks through for the head of a filtered process tree
+#define VMM_TREE_MAX_DEPTH 32
+
+// Largest machdep.cpu.features string rewritten by VMHide
+#define VMM_FEATURES_MAX 1024
+
 // VMM Patcher Class
 class VMM {
 public:
@@ -26,14 +48,37 @@ public:
 	// Presence Tracker
 	static int hvVmmPresent;
 	
-	// Store the original handler
+	// Store the original handlers
 	static sysctl_handler_t originalHvVmmHandler;
+	static sysctl_handler_t originalCpuFeaturesHandler;
+	
+	// Every intercepted sysctl OID
+	static VMHSysctlHook sysctlHooks[2];
 
-	// Declaration for the array of processes to filter
+	// Declaration for the array of processes filtered at boot
     static const VMH::DetectedProcess filteredProcs[];
 	
-	// is Process in Filter Tracker
-	static bool isProcFiltered;
+	// Filter verdict of the calling process
+	static bool isCurrentProcFiltered();
+	
+	// Verdicts of recent callers, keyed by pid and process generation
+	static VMHVerdictCache<VMM_VERDICT_CACHE_SLOTS> verdictCache;
+	
+	// Hashes of the names recent callers are counted by in kern.vmh.topk, stored along with their verdicts
+	static VMHNameHashCache<VMM_VERDICT_CACHE_SLOTS> callerHashes;
+	
+	// Path and bundle identifier verdicts of recent executables, keyed by vnode and vid
+	static VMHVnodeVerdictCache<VMM_EXECUTABLE_CACHE_SLOTS> executableCache;
+	
+	// Processes that head or descend from a process matching a tree rule, marked when they call exec
+	static VMHVerdictCache<VMM_TREE_CACHE_SLOTS> treeCache;
+	
+	// Listener dropping cached verdicts of processes calling exec, and marking filtered process trees
+	static kauth_listener_t execListener;
+	
+	// Resolved during init, path and bundle rules never match on kernels lacking them
+	static vnode_t (*procExecutableVnode)(proc_t proc);
+	static const char *(*csIdentityGet)(proc_t proc);
 
 private:
 	
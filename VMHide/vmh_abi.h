@@ -0,0 +1,305 @@
+//
+//  vmh_abi.h
+//  VMHide
+//
+//  Created by Carnations Botanica on 10/16/26.
+//
+//  Layouts of the binary blobs VMHide exports through kern.vmh sysctls.
+//  This header is plain C and free of kernel includes, so the kext and the tools in Tools/
+//  (including their Linux builds) agree on a single definition.
+//
+
+#ifndef vmh_abi_h
+#define vmh_abi_h
+
+#include <stdint.h>
+
+// Bumped whenever a layout below changes incompatibly
+#define VMH_ABI_VERSION 1
+
+// ---------------------------------------------------------------------------------------------
+// kern.vmh.latency
+// ---------------------------------------------------------------------------------------------
+
+#define VMH_LATENCY_MAGIC 0x544c4d56 // 'VMLT'
+
+// Log-bucketed (HDR-style) histograms. Values below 2^SUB_BITS ticks get a bucket each, every
+// larger power of two is split into 2^SUB_BITS linear sub-buckets, so a bucket is never wider
+// than 1/4th of its lower bound. 64 buckets reach 2^17 ticks, tens of microseconds, and the
+// last bucket also collects everything above it.
+#define VMH_LATENCY_SUB_BITS 2
+#define VMH_LATENCY_SUB_COUNT (1 << VMH_LATENCY_SUB_BITS)
+#define VMH_LATENCY_BUCKETS 64
+
+// Timed phases of VMH_sysctl_vmm_present
+enum {
+	VMH_LATENCY_LOOKUP, // Verdict cache lookup, and proc_name on a miss
+	VMH_LATENCY_MATCH,  // Filter table match, only recorded on verdict cache misses
+	VMH_LATENCY_OUT,    // SYSCTL_OUT, the only work the original handler does
+	VMH_LATENCY_TOTAL,  // Whole handler
+	VMH_LATENCY_PHASES
+};
+
+// kern.vmh.latency starts with this header, followed by
+// uint64_t counts[phases][buckets], the sum of every CPU.
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t phases;
+	uint16_t buckets;
+	uint16_t subBits;
+	uint32_t reserved;
+	uint64_t tscFrequency; // Hz, 0 if unknown
+} vmh_latency_header_t;
+
+/**
+ * @brief Bucket of a duration in TSC ticks.
+ */
+static inline uint32_t vmh_latency_bucket(uint64_t ticks) {
+	if (ticks < VMH_LATENCY_SUB_COUNT) {
+		return (uint32_t)ticks;
+	}
+	uint32_t exponent = 63 - (uint32_t)__builtin_clzll(ticks);
+	uint32_t bucket = (exponent - VMH_LATENCY_SUB_BITS + 1) * VMH_LATENCY_SUB_COUNT +
+					  (uint32_t)((ticks >> (exponent - VMH_LATENCY_SUB_BITS)) & (VMH_LATENCY_SUB_COUNT - 1));
+	return bucket < VMH_LATENCY_BUCKETS ? bucket : VMH_LATENCY_BUCKETS - 1;
+}
+
+/**
+ * @brief Smallest duration in TSC ticks that falls into bucket.
+ */
+static inline uint64_t vmh_latency_bucket_low(uint32_t bucket) {
+	if (bucket < VMH_LATENCY_SUB_COUNT) {
+		return bucket;
+	}
+	uint32_t exponent = bucket / VMH_LATENCY_SUB_COUNT + VMH_LATENCY_SUB_BITS - 1;
+	uint64_t sub = bucket & (VMH_LATENCY_SUB_COUNT - 1);
+	return (1ULL << exponent) | (sub << (exponent - VMH_LATENCY_SUB_BITS));
+}
+
+// ---------------------------------------------------------------------------------------------
+// kern.vmh.log
+// ---------------------------------------------------------------------------------------------
+
+#define VMH_LOG_MAGIC 0x474c4d56 // 'VMLG'
+
+// Bytes of the process name kept per record, matches MAXCOMLEN. Not NUL terminated when full.
+#define VMH_LOG_NAME_LEN 16
+
+/**
+ * Every hot path message, as X(id, module, format). The format is only ever expanded by a
+ * reader, with {name}, {pid}, {verdict}, {arg} and {hex} replaced by the fields of the record.
+ * New messages must be appended, so that older decoders keep working.
+ */
+#define VMH_LOG_MESSAGES(X) \
+	X(VMH_MSG_NONE,          "VMH",  "Unknown message.") \
+	X(VMH_MSG_CVMM_CACHED,   "CVMM", "Process PID {pid} has a cached verdict. Reporting hv_vmm_present as {verdict}.") \
+	X(VMH_MSG_CVMM_FILTERED, "CVMM", "Process '{name}' (PID: {pid}) is on the filter list. Reporting hv_vmm_present as {verdict}.") \
+	X(VMH_MSG_CVMM_ALLOWED,  "CVMM", "Process '{name}' (PID: {pid}) is NOT on the filter list. Reporting hv_vmm_present as {verdict}.") \
+	X(VMH_MSG_CVMM_EXEC,     "CVMM", "Process PID {pid} called exec, dropped its cached verdict.") \
+	X(VMH_MSG_PPU_PRESENT,   "PPU",  "Process '{name}' (PID: {pid}) already exists in the unique process set.") \
+	X(VMH_MSG_PPU_INSERTED,  "PPU",  "Process '{name}' (PID: {pid}) added to the unique process set ({arg} tracked).") \
+	X(VMH_MSG_PPU_EVICTED,   "PPU",  "Process '{name}' (PID: {pid}) added to the unique process set, replacing a process not seen recently.") \
+	X(VMH_MSG_PPU_CONTENDED, "PPU",  "Unique process set is contended. Cannot add process '{name}' (PID: {pid}) right now.") \
+	X(VMH_MSG_RRHVM_DONE,    "RRHVM", "Rerouted 'hv_vmm_present', original handler at {hex}.") \
+	X(VMH_MSG_RRHVM_FAILED,  "RRHVM", "Failed to reroute 'hv_vmm_present'.") \
+	X(VMH_MSG_PPU_SUMMARY,   "PPU",  "Process '{name}' called hv_vmm_present {arg} more times since its last summary.") \
+	X(VMH_MSG_CVMM_TREE,     "CVMM", "Process '{name}' (PID: {pid}) called exec within the filtered process tree of PID {arg}.")
+
+#define VMH_LOG_MESSAGE_ID(id, module, format) id,
+enum {
+	VMH_LOG_MESSAGES(VMH_LOG_MESSAGE_ID)
+	VMH_MSG_COUNT
+};
+#undef VMH_LOG_MESSAGE_ID
+
+// Fixed-size binary log record, 40 bytes
+typedef struct {
+	uint64_t timestamp;             // mach_absolute_time
+	uint64_t arg;                   // Message specific value, {arg} or {hex}
+	int32_t pid;
+	uint16_t message;               // VMH_MSG_*
+	uint8_t cpu;
+	uint8_t verdict;
+	char name[VMH_LOG_NAME_LEN];
+} vmh_log_record_t;
+
+// kern.vmh.log starts with this header, followed by the drained records of every CPU.
+// Records of a single CPU are in order, records of different CPUs are not, sort by timestamp.
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t recordSize;
+	uint32_t timebaseNumer;         // mach_timebase_info, to convert timestamps to nanoseconds
+	uint32_t timebaseDenom;
+	uint64_t lost;                  // Records overwritten before they could be drained. Overwrites
+	                                // racing with a drain are reported by the next one.
+} vmh_log_header_t;
+
+// ---------------------------------------------------------------------------------------------
+// kern.vmh.trace
+// ---------------------------------------------------------------------------------------------
+
+#define VMH_TRACE_MAGIC 0x52544d56 // 'VMTR'
+
+// Bytes of the process name kept per record, proc_name is at most 2 * MAXCOMLEN. Not NUL terminated when full.
+#define VMH_TRACE_NAME_LEN 32
+
+// vmh_trace_record_t flags
+#define VMH_TRACE_CACHED 0x01 // Answered from the verdict cache
+
+// One kern.hv_vmm_present call, 56 bytes
+typedef struct {
+	uint64_t timestamp;             // mach_absolute_time at the end of the call
+	int32_t pid;
+	uint32_t generation;            // proc_pidversion, changes on every fork and exec
+	uint32_t ticks;                 // TSC ticks spent in the handler
+	uint8_t verdict;                // Value returned to the caller
+	uint8_t flags;                  // VMH_TRACE_*
+	uint16_t reserved;
+	char name[VMH_TRACE_NAME_LEN];
+} vmh_trace_record_t;
+
+// Every read of kern.vmh.trace is this header followed by count records, oldest first. A trace
+// file is any number of such reads appended to each other.
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t recordSize;
+	uint32_t timebaseNumer;         // mach_timebase_info, to convert timestamps to nanoseconds
+	uint32_t timebaseDenom;
+	uint64_t tscFrequency;          // Hz, to convert ticks to nanoseconds, 0 if unknown
+	uint64_t lost;                  // Records overwritten before they could be drained
+	uint32_t count;                 // Records following this header
+	uint32_t reserved;
+} vmh_trace_header_t;
+
+// ---------------------------------------------------------------------------------------------
+// kern.vmh.topk
+// ---------------------------------------------------------------------------------------------
+
+#define VMH_TOPK_MAGIC 0x4b544d56 // 'VMTK'
+
+// Bytes of the process name callers are counted by, matches MAXCOMLEN. Not NUL terminated when full.
+#define VMH_TOPK_NAME_LEN 16
+
+// Count-min sketch every call is counted in, VMH_TOPK_DEPTH rows of VMH_TOPK_WIDTH counters.
+// A count is never below the true one, and with probability 1 - e^-depth at most
+// e / width of every counted call above it.
+#define VMH_TOPK_DEPTH 4
+#define VMH_TOPK_WIDTH 128
+
+// Most callers reported, the heaviest ones seen so far
+#define VMH_TOPK_SLOTS 32
+
+// One caller, 32 bytes
+typedef struct {
+	uint64_t count;                 // Calls estimated by the sketch, never below the true count
+	uint8_t verdict;                // Value returned on its latest recorded call
+	uint8_t reserved[7];
+	char name[VMH_TOPK_NAME_LEN];
+} vmh_topk_entry_t;
+
+// kern.vmh.topk is this header followed by count entries, heaviest first
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t entrySize;
+	uint16_t depth;                 // VMH_TOPK_DEPTH the counts were estimated with
+	uint16_t width;                 // VMH_TOPK_WIDTH
+	uint32_t count;                 // Entries following this header
+	uint64_t calls;                 // Every call counted in the sketch
+} vmh_topk_header_t;
+
+// ---------------------------------------------------------------------------------------------
+// Compiled filter blob, written by Tools/vmh-filterc and read by the kext from NVRAM
+// ---------------------------------------------------------------------------------------------
+
+#define VMH_FILTER_MAGIC 0x464d4d56 // 'VMMF'
+
+// Bumped whenever the blob layout changes, independently of VMH_ABI_VERSION
+#define VMH_FILTER_VERSION 1
+
+// NVRAM variable holding the blob, under Lilu's vendor GUID
+#define VMH_FILTER_NVRAM_NAME "vmh-filter"
+
+// What a rule is matched against, same values as VMH::MatchKind
+enum {
+	VMH_FILTER_KIND_NAME,   // proc_name
+	VMH_FILTER_KIND_PATH,   // Full path of the executable
+	VMH_FILTER_KIND_BUNDLE, // Code signing identifier
+	VMH_FILTER_KINDS
+};
+
+// vmh_filter_rule_t flags
+#define VMH_FILTER_RULE_GLOB 0x01 // Contains '*' or '?', compiled into a DFA when the blob is loaded
+#define VMH_FILTER_RULE_TREE 0x02 // "tree:" rule, every descendant of a matching process is filtered too
+
+// Most glob rules a blob may hold, every other rule is an exact name with a slot in its table.
+// The glob rules of each kind must also compile to at most as many DFA states and transitions.
+#define VMH_FILTER_MAX_GLOBS 128
+#define VMH_FILTER_GLOB_STATES 1024
+#define VMH_FILTER_GLOB_TRANSITIONS 16384
+
+// Most tree rules a blob may hold, they are matched one by one, and only when a process calls exec
+#define VMH_FILTER_MAX_TREES 64
+
+// Most bytes of a rule, and of a whole blob
+#define VMH_FILTER_RULE_MAX 255
+#define VMH_FILTER_BLOB_MAX (1U << 20)
+
+// Perfect hash table of the exact rules of one kind, see VMHFilterTable for the construction.
+// A name hashes to bucket hash & (buckets - 1), whose seed picks its slot among 2 * buckets.
+typedef struct {
+	uint32_t buckets;               // Power of two, 0 when the kind has no exact rules
+	uint32_t seeds;                 // Offset of uint32_t seeds[buckets]
+	uint32_t slots;                 // Offset of vmh_filter_slot_t slots[2 * buckets], 16 byte aligned
+	uint32_t exact;                 // Exact rules in the table
+	uint32_t rules;                 // Rules of this kind, exact and glob
+	uint32_t reserved;
+} vmh_filter_table_t;
+
+// One slot of a table, 32 bytes. Empty slots have a length of 0.
+typedef struct {
+	uint64_t key[2];                // VMHNameKey of the name, the first 16 bytes zero padded
+	uint32_t name;                  // Offset of the NUL terminated name in the pool
+	uint32_t length;
+	uint64_t reserved;
+} vmh_filter_slot_t;
+
+// One rule in source order, 8 bytes
+typedef struct {
+	uint32_t name;                  // Offset of the NUL terminated name in the pool
+	uint16_t length;
+	uint8_t kind;                   // VMH_FILTER_KIND_*
+	uint8_t flags;                  // VMH_FILTER_RULE_*
+} vmh_filter_rule_t;
+
+// A blob is this header followed by the seeds and slots of every table, the rules and the pool.
+// Offsets are from the start of the blob. The checksum covers every byte after its own field.
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t headerSize;
+	uint32_t size;                  // Bytes of the whole blob
+	uint32_t checksum;              // vmh_filter_checksum
+	uint32_t ruleCount;
+	uint32_t rules;                 // Offset of vmh_filter_rule_t rules[ruleCount]
+	uint32_t pool;                  // Offset of the name pool, ends with a NUL byte
+	uint32_t poolSize;
+	vmh_filter_table_t tables[VMH_FILTER_KINDS];
+} vmh_filter_header_t;
+
+/**
+ * @brief 32-bit FNV-1a of size bytes.
+ */
+static inline uint32_t vmh_filter_checksum(const uint8_t *data, uint32_t size) {
+	uint32_t hash = 0x811c9dc5U;
+	for (uint32_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 0x01000193U;
+	}
+	return hash;
+}
+
+#endif /* vmh_abi_h */